@@ -0,0 +1,122 @@
+#include "adr.h"
+#include "radio.h"
+
+static uint8_t holdFrames;     // frames with an uplink in the window
+static int8_t windowRssi;      // worst sample in the window
+static int8_t windowSnr;
+
+void adrReset() {
+  holdFrames = 0;
+  windowRssi = INT8_MAX;
+  windowSnr = INT8_MAX;
+}
+
+static int8_t worseOf(int8_t a, int8_t b) {
+  if (a == ADR_NO_SAMPLE) {
+    return b;
+  }
+  if (b == ADR_NO_SAMPLE) {
+    return a;
+  }
+  return a < b ? a : b;
+}
+
+// Margin [dB] profile would have with rssi/snr measured while using measuredOn
+static int16_t adrMargin(uint8_t profile, uint8_t measuredOn, int8_t rssi, int8_t snr) {
+  const RadioProfile &p = kRadioProfiles[profile];
+  int16_t margin = rssi - p.sensitivityDbm;
+  if (!p.flrc && !kRadioProfiles[measuredOn].flrc) {
+    int16_t snrMargin = (snr - p.snrMin) / 4;
+    if (snrMargin < margin) {
+      margin = snrMargin;
+    }
+  }
+  return margin;
+}
+
+// Fastest profile below limit with ADR_MARGIN_UP_DB, the most robust if none
+static uint8_t adrFastest(uint8_t limit, uint8_t measuredOn, int8_t rssi, int8_t snr) {
+  for (uint8_t p = limit; p-- > 0;) {
+    if (adrMargin(p, measuredOn, rssi, snr) >= ADR_MARGIN_UP_DB) {
+      return p;
+    }
+  }
+  return 0;
+}
+
+uint8_t adrUpdate(uint8_t profile, bool uplinkSeen, const adrLink &up, const adrLink &down) {
+  // The follower's report is only current if its uplink arrived
+  uint8_t loss = up.loss;
+  int8_t rssi = up.rssi;
+  int8_t snr = up.snr;
+  if (uplinkSeen) {
+    loss = (down.loss > loss) ? down.loss : loss;
+    rssi = worseOf(rssi, down.rssi);
+    snr = worseOf(snr, down.snr);
+  }
+  bool sample = uplinkSeen && rssi != ADR_NO_SAMPLE;
+
+  if (profile > 0 && loss >= ADR_LOSS_DOWN) {
+    adrReset();
+    uint8_t next = profile - 1;
+    if (sample) {
+      uint8_t byMargin = adrFastest(profile, profile, rssi, snr);
+      next = (byMargin < next) ? byMargin : next;
+    }
+    return next;
+  }
+  if (!sample) {
+    return profile;
+  }
+  if (profile > 0 && adrMargin(profile, profile, rssi, snr) < ADR_MARGIN_DOWN_DB) {
+    adrReset();
+    return adrFastest(profile, profile, rssi, snr);
+  }
+
+  windowRssi = (rssi < windowRssi) ? rssi : windowRssi;
+  windowSnr = (snr < windowSnr) ? snr : windowSnr;
+  if (++holdFrames < ADR_HOLD_FRAMES) {
+    return profile;
+  }
+  uint8_t next = (loss <= ADR_LOSS_UP) ? adrFastest(RADIO_PROFILE_COUNT, profile, windowRssi, windowSnr) : 0;
+  adrReset();
+  return (next > profile) ? next : profile;
+}
+
+static int8_t saturate(float v) {
+  if (v <= -127.0f) {
+    return -127;  // INT8_MIN is ADR_NO_SAMPLE
+  }
+  if (v >= 127.0f) {
+    return 127;
+  }
+  return (int8_t)(v < 0 ? v - 0.5f : v + 0.5f);
+}
+
+int8_t adrQuantizeRssi(float rssi) {
+  return saturate(rssi);
+}
+
+int8_t adrQuantizeSnr(float snr) {
+  return saturate(snr * 4.0f);
+}
+
+void adrWorst(adrLink &link, float rssi, float snr) {
+  int8_t r = adrQuantizeRssi(rssi);
+  int8_t s = adrQuantizeSnr(snr);
+  if (link.rssi == ADR_NO_SAMPLE || r < link.rssi) {
+    link.rssi = r;
+  }
+  if (link.snr == ADR_NO_SAMPLE || s < link.snr) {
+    link.snr = s;
+  }
+}
+
+uint8_t adrLossCount(uint16_t history) {
+  static_assert(ADR_WINDOW_FRAMES == 16, "one history bit per frame");
+  uint8_t lost = 0;
+  for (uint16_t missing = (uint16_t)~history; missing != 0; missing &= (uint16_t)(missing - 1)) {
+    lost++;
+  }
+  return lost;
+}
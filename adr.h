@@ -0,0 +1,56 @@
+/*
+Adaptive data rate
+
+Master-side policy that picks the radio profile from the link quality both
+ends measure; tdma.cpp feeds it once per frame and announces its choice like
+any other profile switch
+
+Inputs per frame:
+- Uplink: worst RSSI/SNR of the packets the master received, frames without
+  an uplink among the last ADR_WINDOW_FRAMES
+- Downlink: the same as seen by the follower, reported in tdmaUplinkHeader
+- The worse direction counts
+
+Margin of a profile: RSSI above its sensitivity (RadioProfile.sensitivityDbm);
+on LoRa also SNR above the demodulation limit of its spreading factor. SNR
+measured on FLRC is not used
+
+Policy:
+- Down: as soon as a frame's margin drops below ADR_MARGIN_DOWN_DB, or
+  ADR_LOSS_DOWN of the last ADR_WINDOW_FRAMES frames were lost, to the fastest
+  slower profile that has ADR_MARGIN_UP_DB (the most robust one if none does)
+- Up: after ADR_HOLD_FRAMES frames with an uplink and at most ADR_LOSS_UP
+  losses, to the fastest profile that has ADR_MARGIN_UP_DB with the worst
+  sample of that window; the gap to ADR_MARGIN_DOWN_DB is the hysteresis
+- Every decision and every applied switch restarts the window
+- Missed frames beyond that are handled by the TDMA fallback
+  (TDMA_PROFILE_FALLBACK_FRAMES), which lands on the most robust profile
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define ADR_WINDOW_FRAMES 16      // loss history, one bit per frame
+#define ADR_HOLD_FRAMES 10        // good frames before stepping up
+#define ADR_MARGIN_UP_DB 10
+#define ADR_MARGIN_DOWN_DB 4
+#define ADR_LOSS_UP 4             // of ADR_WINDOW_FRAMES
+#define ADR_LOSS_DOWN 8
+#define ADR_NO_SAMPLE INT8_MIN    // rssi/snr: nothing received
+
+// Link quality of one direction
+struct adrLink {
+  int8_t rssi;   // worst packet [dBm], ADR_NO_SAMPLE if none
+  int8_t snr;    // worst packet [0.25 dB]
+  uint8_t loss;  // frames without a packet of the last ADR_WINDOW_FRAMES
+};
+
+void adrReset();  // restart the window, after a profile change
+// Profile to use from the next switch on; returns profile to stay
+uint8_t adrUpdate(uint8_t profile, bool uplinkSeen, const adrLink &up, const adrLink &down);
+
+void adrWorst(adrLink &link, float rssi, float snr);  // fold one packet into link
+int8_t adrQuantizeRssi(float rssi);  // [dBm], saturated
+int8_t adrQuantizeSnr(float snr);    // [0.25 dB], saturated
+uint8_t adrLossCount(uint16_t history);  // zero bits of a one-bit-per-frame history
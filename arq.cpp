@@ -0,0 +1,196 @@
+#include "arq.h"
+#include "stats.h"
+
+#define ARQ_MASK (ARQ_WINDOW - 1)
+
+enum ArqState : uint8_t {
+  ARQ_FREE,
+  ARQ_DUE,    // waiting for its next send
+  ARQ_SENT,   // sent this frame, waiting for the ack
+  ARQ_DONE    // acknowledged or expired, slot freed once it reaches the base
+};
+
+struct arqEntry {
+  canRec rec;
+  ArqState state;
+  uint8_t tries;
+  uint8_t acked;  // bit node - 1 per follower that acknowledged it
+};
+
+// Sender: entries for seq are at [seq % ARQ_WINDOW]; txBase..txNext-1 in use
+static arqEntry txWin[ARQ_WINDOW];
+static uint8_t txBase;
+static uint8_t txNext;
+static uint8_t txPeers = 1;  // followers whose acks an entry needs
+
+// Receiver: bit i of rxMask set when rxBase + i waits in rxWin
+static canRec rxWin[ARQ_WINDOW];
+static uint8_t rxBase;
+static uint32_t rxMask;
+static bool rxStarted;
+
+void arqTxReset() {
+  for (arqEntry &e : txWin) {
+    e.state = ARQ_FREE;
+  }
+  txBase = txNext = 0;
+}
+
+static void arqTxAdvance() {
+  while (txBase != txNext && txWin[txBase & ARQ_MASK].state == ARQ_DONE) {
+    txWin[txBase & ARQ_MASK].state = ARQ_FREE;
+    txBase++;
+  }
+}
+
+void arqTxFill() {
+  while (!txBuf.isEmpty() && (uint8_t)(txNext - txBase) < ARQ_WINDOW) {
+    arqEntry &e = txWin[txNext & ARQ_MASK];
+    e.rec = txBuf.shift();
+    e.state = ARQ_DUE;
+    e.tries = 0;
+    e.acked = 0;
+    txNext++;
+  }
+}
+
+void arqTxNewFrame(uint8_t peers) {
+  txPeers = peers;
+  for (uint8_t seq = txBase; seq != txNext; seq++) {
+    arqEntry &e = txWin[seq & ARQ_MASK];
+    if ((e.state == ARQ_DUE || e.state == ARQ_SENT) && (e.acked & peers) == peers) {
+      e.state = ARQ_DONE;  // the followers still missing it went silent
+      continue;
+    }
+    if (e.state != ARQ_SENT) {
+      continue;
+    }
+    if (e.tries >= ARQ_MAX_TRIES) {
+      e.state = ARQ_DONE;
+      stats.arqExpired++;
+    } else {
+      e.state = ARQ_DUE;
+    }
+  }
+  arqTxAdvance();
+}
+
+int8_t arqTxDue(int8_t after) {
+  uint8_t seq = (after < 0) ? txBase : (uint8_t)(arqTxSeq(after) + 1);
+  for (; seq != txNext; seq++) {
+    if (txWin[seq & ARQ_MASK].state == ARQ_DUE) {
+      return (int8_t)(seq & ARQ_MASK);
+    }
+  }
+  return -1;
+}
+
+const canRec &arqTxRec(int8_t i) {
+  return txWin[i].rec;
+}
+
+uint8_t arqTxSeq(int8_t i) {
+  // The one seq in the window that maps to slot i
+  return (uint8_t)(txBase + ((i - txBase) & ARQ_MASK));
+}
+
+void arqTxSent(int8_t i) {
+  arqEntry &e = txWin[i];
+  if (e.tries > 0) {
+    stats.arqRetransmits++;
+  }
+  e.tries++;
+  e.state = ARQ_SENT;
+}
+
+uint8_t arqTxDueCount() {
+  uint8_t n = 0;
+  for (uint8_t seq = txBase; seq != txNext; seq++) {
+    n += (txWin[seq & ARQ_MASK].state == ARQ_DUE);
+  }
+  return n;
+}
+
+bool arqTxIdle() {
+  return txBase == txNext;
+}
+
+uint8_t arqTxBase() {
+  return txBase;
+}
+
+void arqTxAck(uint8_t node, uint8_t base, uint32_t mask) {
+  uint8_t ahead = (uint8_t)(base - txBase);
+  if (ahead > (uint8_t)(txNext - txBase) && ahead <= 128) {
+    return;  // beyond anything sent: an ack for another sequence
+  }
+  for (uint8_t seq = txBase; seq != txNext; seq++) {
+    uint8_t d = (uint8_t)(seq - base);
+    bool acked = (d >= 128) || (d < ARQ_WINDOW && (mask >> d) & 1);
+    arqEntry &e = txWin[seq & ARQ_MASK];
+    if (acked && e.state != ARQ_FREE && e.state != ARQ_DONE) {
+      e.acked |= (uint8_t)(1u << (node - 1));
+      if ((e.acked & txPeers) == txPeers) {
+        e.state = ARQ_DONE;
+      }
+    }
+  }
+  arqTxAdvance();
+}
+
+void arqRxReset() {
+  rxMask = 0;
+  rxStarted = false;
+}
+
+// Hands the records waiting at the base to rxBuf
+static void arqRxDeliver() {
+  while (rxMask & 1) {
+    rxBuf.push(rxWin[rxBase & ARQ_MASK]);
+    rxMask >>= 1;
+    rxBase++;
+  }
+}
+
+void arqRxBase(uint8_t base) {
+  uint8_t ahead = (uint8_t)(base - rxBase);
+  uint8_t behind = (uint8_t)(rxBase - base);
+  if (!rxStarted || (ahead > 128 && behind > ARQ_WINDOW)) {
+    // First header, or a sequence this window cannot belong to
+    rxBase = base;
+    rxMask = 0;
+    rxStarted = true;
+    return;
+  }
+  if (ahead > 128) {
+    return;  // our acks have not reached the master yet
+  }
+  // The master gave up on everything before base: skip the gaps
+  while (rxBase != base) {
+    if (rxMask & 1) {
+      rxBuf.push(rxWin[rxBase & ARQ_MASK]);
+    }
+    rxMask >>= 1;
+    rxBase++;
+  }
+  arqRxDeliver();
+}
+
+void arqRxRecord(uint8_t seq, const canRec &rec) {
+  uint8_t d = (uint8_t)(seq - rxBase);
+  if (d >= ARQ_WINDOW || (rxMask >> d) & 1) {
+    stats.arqDuplicates++;  // delivered before (or outside the window)
+    return;
+  }
+  rxWin[seq & ARQ_MASK] = rec;
+  rxMask |= 1ul << d;
+  arqRxDeliver();
+}
+
+uint8_t arqRxAckBase() {
+  return rxBase;
+}
+
+uint32_t arqRxAckMask() {
+  return rxMask;
+}
@@ -0,0 +1,59 @@
+/*
+Downlink ARQ
+
+Selective-repeat retransmission of GCS -> rocket records (TDMA_ENABLE_ARQ)
+
+Sender (master):
+- Records move from txBuf into a window of ARQ_WINDOW entries and get an
+  8-bit sequence number; DOWNLINK packets carry them as [seq][record]
+  (TDMA_FORMAT_ARQ) and tdmaHeader.arq_base holds the oldest unresolved one
+- Each record is sent once per frame until acknowledged: at the rollover
+  every sent but unacknowledged entry is due again, so the next DOWNLINK
+  resends only those
+- After ARQ_MAX_TRIES sends an entry expires; moving arq_base past it tells
+  the follower to stop waiting for it
+- With several followers each one's acks are kept per entry; an entry is
+  done once every follower the TDMA layer names at the rollover has
+  acknowledged it, so one that went silent does not hold the window
+
+Receiver (follower):
+- Window of ARQ_WINDOW sequence numbers from rxBase, the oldest missing one;
+  records ahead of a gap wait there, so rxBuf gets them in sequence order and
+  each exactly once
+- Every uplink carries rxBase and a bitmap of the window (bit i: rxBase + i
+  received)
+- rxBase follows arq_base forward; the window restarts at arq_base on the
+  first header after sync and when the TDMA layer sees the master restart
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "can.h"
+
+#ifndef ARQ_WINDOW
+#define ARQ_WINDOW 32  // entries in flight, power of two <= 32 (ack bitmap)
+#endif
+#define ARQ_MAX_TRIES 10  // sends (one per frame) before a record expires
+
+static_assert(ARQ_WINDOW <= 32 && (ARQ_WINDOW & (ARQ_WINDOW - 1)) == 0, "ARQ_WINDOW");
+
+// Sender
+void arqTxReset();
+void arqTxFill();        // admit records from txBuf while the window has room
+void arqTxNewFrame(uint8_t peers);  // rollover: unacknowledged entries are due again; peers: bit node - 1 per follower that must ack
+int8_t arqTxDue(int8_t after);  // next entry to send after index after (-1: from the start), -1 if none
+const canRec &arqTxRec(int8_t i);
+uint8_t arqTxSeq(int8_t i);
+void arqTxSent(int8_t i);
+uint8_t arqTxDueCount();
+bool arqTxIdle();        // no entry waiting for a send or an ack
+uint8_t arqTxBase();
+void arqTxAck(uint8_t node, uint8_t base, uint32_t mask);  // node: TDMA_NODE_ID of the follower
+
+// Receiver
+void arqRxReset();
+void arqRxBase(uint8_t base);  // from tdmaHeader.arq_base
+void arqRxRecord(uint8_t seq, const canRec &rec);  // delivers to rxBuf in order
+uint8_t arqRxAckBase();
+uint32_t arqRxAckMask();
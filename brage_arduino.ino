@@ -2,30 +2,41 @@
 #include "can.h"
 #include "radio.h"
 #include "tdma.h"
+#include "stats.h"
+#include "profile.h"
+#include "gcsstream.h"
+#include "flightlog.h"
 
+#ifndef ROLE
 #define ROLE TDMA_MASTER
 // #define ROLE TDMA_FOLLOWER
+#endif
 
 // canRec testUplinkData = {.id = 0x720, .dlc = 8, .data = {0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA}};
 
 int lastTransmit = 0;
 
 void setup() {
-  Serial.begin(230400);
+  Serial.begin((GCS_STREAM_ENABLE && ROLE == TDMA_MASTER) ? GCS_STREAM_BAUD : 230400);
 
   pinMode(LED_RX, OUTPUT);
   pinMode(LED_TX, OUTPUT);
 
+  statsInit(ROLE);
+  flogInit(ROLE);  // its page erase halts the core: before FDCAN takes frames
   initCan();
   initRadio();
   configRadio();
   tdmaInit(ROLE);
+  PROFILE_INIT();
 
   delay(500);
 }
 
 
 void loop() {
+  PROFILE_POLL();
+  PROFILE_SCOPE(PROF_LOOP);
 
   // if (millis() - lastTransmit >= 1000) {
   //   txBuf.push(testUplinkData);
@@ -39,5 +50,10 @@ void loop() {
     tdmaUpdate();
   }
 
+  statsUpdate();
   processCanTx();
+  flogPoll();
+  if (ROLE == TDMA_MASTER) {
+    gcsStreamPoll();
+  }
 }
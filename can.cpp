@@ -1,40 +1,81 @@
 #include "can.h"
+#include "canfilter.h"
+#include "spsc_ring.h"
+#include "stats.h"
+#include "tdma.h"
+#include "profile.h"
+#include "flightlog.h"
 
 #include <Arduino.h>
 
-// static uint32_t txBufOverwrites = 0; // track overwritten CAN records
 
 FDCAN_HandleTypeDef hfdcan1;
 
-CircularBuffer<canRec, MAX_LENGTH> rxBuf;   // radio -> CAN
-CircularBuffer<canRec, MAX_LENGTH> txBuf;   // CAN  -> radio
+struct canPrioRange {
+  uint32_t first;
+  uint32_t last;
+  uint8_t prio;
+};
+
+// First matching range wins; IDs not listed are NORMAL. 29-bit IDs match
+// ranges with CAN_EXT_FLAG set. Both ends classify with their own table, so
+// the GCS and rocket builds should agree.
+static const canPrioRange kCanPrioTable[] = {
+  {0x000, 0x0FF, CAN_PRIO_CRITICAL},
+  {0x700, 0x7FF, CAN_PRIO_BULK},
+};
+
+static const uint8_t kCanPrioWeights[CAN_PRIO_COUNT] = {
+  0,  // strict priority
+  CAN_PRIO_WEIGHT_NORMAL,
+  CAN_PRIO_WEIGHT_BULK,
+};
+
+uint8_t canPriority(uint32_t id) {
+  for (const canPrioRange &r : kCanPrioTable) {
+    if (id >= r.first && id <= r.last) {
+      return r.prio;
+    }
+  }
+  return CAN_PRIO_NORMAL;
+}
 
-static uint8_t dlcToBytes(uint32_t dlc) {
-  switch (dlc) {
-    case FDCAN_DLC_BYTES_0: return 0;
-    case FDCAN_DLC_BYTES_1: return 1;
-    case FDCAN_DLC_BYTES_2: return 2;
-    case FDCAN_DLC_BYTES_3: return 3;
-    case FDCAN_DLC_BYTES_4: return 4;
-    case FDCAN_DLC_BYTES_5: return 5;
-    case FDCAN_DLC_BYTES_6: return 6;
-    case FDCAN_DLC_BYTES_7: return 7;
-    default: return 8;
+CanRxQueue rxBuf(kCanPrioWeights);   // radio -> CAN
+CanTxQueue txBuf(kCanPrioWeights);   // CAN  -> radio
+
+static SpscRing<canRec, CAN_RX_RING_LEN> rxRing;   // FDCAN ISR -> loop
+
+volatile uint32_t canRxFifoLost = 0;
+volatile uint32_t canRxRingFull = 0;
+
+static uint32_t rxTimes[CAN_RX_FIFO_LEN];  // pollCanRx() time of the last frames, oldest next
+static uint8_t rxTimesNext;
+static uint8_t rxTimesCount;
+
+static const uint8_t kCanDlcLen[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64};
+
+// The G0/C0/U5 HAL's FDCAN_DLC_BYTES_* are the DLC codes themselves
+static_assert(FDCAN_DLC_BYTES_8 == 8 && FDCAN_DLC_BYTES_12 == 9 && FDCAN_DLC_BYTES_64 == 15, "FDCAN DLC encoding");
+
+uint8_t canDlcLen(uint8_t code) {
+  return kCanDlcLen[code & 0x0F];
+}
+
+uint8_t canLenDlc(uint8_t len) {
+  uint8_t code = 0;
+  while (code < 15 && kCanDlcLen[code] < len) {
+    code++;
   }
+  return code;
+}
+
+static uint8_t dlcToBytes(uint32_t dlc) {
+  uint8_t len = canDlcLen((uint8_t)dlc);
+  return len < CAN_MAX_DLEN ? len : CAN_MAX_DLEN;
 }
 
 static uint32_t bytesToDlc(uint8_t len) {
-  switch (len) {
-    case 0: return FDCAN_DLC_BYTES_0;
-    case 1: return FDCAN_DLC_BYTES_1;
-    case 2: return FDCAN_DLC_BYTES_2;
-    case 3: return FDCAN_DLC_BYTES_3;
-    case 4: return FDCAN_DLC_BYTES_4;
-    case 5: return FDCAN_DLC_BYTES_5;
-    case 6: return FDCAN_DLC_BYTES_6;
-    case 7: return FDCAN_DLC_BYTES_7;
-    default: return FDCAN_DLC_BYTES_8;
-  }
+  return canLenDlc(len);
 }
 
 static void EnableFdcanGpioClock() {
@@ -51,7 +92,7 @@ extern "C" void HAL_FDCAN_MspInit(FDCAN_HandleTypeDef* hfdcan) {
     __HAL_RCC_FDCAN1_CLK_ENABLE();
     EnableFdcanGpioClock();
 
-    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    GPIO_InitTypeDef GPIO_InitStruct = {};
 
     GPIO_InitStruct.Pin       = FDCAN_TX_GPIO;
     GPIO_InitStruct.Mode      = GPIO_MODE_AF_PP;
@@ -71,7 +112,7 @@ void initCan() {
 
   // Basic config
   hfdcan1.Init.ClockDivider       = FDCAN_CLOCK_DIV1;
-  hfdcan1.Init.FrameFormat        = FDCAN_FRAME_CLASSIC;
+  hfdcan1.Init.FrameFormat        = CAN_ENABLE_FD ? FDCAN_FRAME_FD_BRS : FDCAN_FRAME_CLASSIC;
   hfdcan1.Init.Mode               = FDCAN_MODE_NORMAL;
   hfdcan1.Init.AutoRetransmission = ENABLE;
   hfdcan1.Init.TransmitPause      = DISABLE;
@@ -83,15 +124,23 @@ void initCan() {
   hfdcan1.Init.NominalTimeSeg1      = 13;
   hfdcan1.Init.NominalTimeSeg2      = 2;
 
+#if CAN_ENABLE_FD
+  // Data bit timing for 2 Mbps after BRS at 48 MHz CAN clock, 75% sample point
+  hfdcan1.Init.DataPrescaler        = 1;
+  hfdcan1.Init.DataSyncJumpWidth    = 6;
+  hfdcan1.Init.DataTimeSeg1         = 17;
+  hfdcan1.Init.DataTimeSeg2         = 6;
+#else
   // Data bit timing (same as nominal)
   hfdcan1.Init.DataPrescaler        = 6;
   hfdcan1.Init.DataSyncJumpWidth    = 1;
   hfdcan1.Init.DataTimeSeg1         = 13;
   hfdcan1.Init.DataTimeSeg2         = 2;
+#endif
 
-  // Filters and Tx FIFO/queue
-  hfdcan1.Init.StdFiltersNbr        = 1;
-  hfdcan1.Init.ExtFiltersNbr        = 0;
+  // Filters (canfilter.h) and Tx FIFO/queue
+  hfdcan1.Init.StdFiltersNbr        = canFilterCount(false);
+  hfdcan1.Init.ExtFiltersNbr        = canFilterCount(true);
   hfdcan1.Init.TxFifoQueueMode      = FDCAN_TX_FIFO_OPERATION;
 
   int ret = HAL_FDCAN_Init(&hfdcan1);
@@ -101,74 +150,153 @@ void initCan() {
     return;
   }
 
-  // configure filter
-  FDCAN_FilterTypeDef sFilterConfig;
-  sFilterConfig.IdType       = FDCAN_STANDARD_ID;
-  sFilterConfig.FilterIndex  = 0;
-  sFilterConfig.FilterType   = FDCAN_FILTER_MASK;
-  sFilterConfig.FilterConfig = FDCAN_FILTER_TO_RXFIFO0;
-  sFilterConfig.FilterID1    = 0x0;
-  sFilterConfig.FilterID2    = 0x0; // match all
+#if CAN_ENABLE_FD
+  // The transceiver loop delay is a large part of a 500 ns data bit: check
+  // the own bits at the delay measured per frame plus seg1
+  ret = HAL_FDCAN_ConfigTxDelayCompensation(&hfdcan1, hfdcan1.Init.DataPrescaler * hfdcan1.Init.DataTimeSeg1, 0);
+  if (ret == HAL_OK) {
+    ret = HAL_FDCAN_EnableTxDelayCompensation(&hfdcan1);
+  }
+  if (ret != HAL_OK) {
+    Serial.println("[CAN] Delay compensation config FAILED");
+    return;
+  }
+#endif
 
-  ret = HAL_FDCAN_ConfigFilter(&hfdcan1, &sFilterConfig);
+  // configure filter bank
+  ret = canFilterConfig(&hfdcan1) ? HAL_OK : HAL_ERROR;
   Serial.printf("[CAN] Filter config returned (%d), ErrorCode=0x%x\n", ret, hfdcan1.ErrorCode);
   if (ret != HAL_OK) {
     Serial.println("[CAN] Filter config FAILED");
     return;
   }
+  canRateReset();
+
+#if CAN_ENABLE_RX_IRQ
+  ret = HAL_FDCAN_ActivateNotification(&hfdcan1,
+                                       FDCAN_IT_RX_FIFO0_NEW_MESSAGE | FDCAN_IT_RX_FIFO0_MESSAGE_LOST |
+                                       FDCAN_IT_RX_FIFO1_NEW_MESSAGE | FDCAN_IT_RX_FIFO1_MESSAGE_LOST, 0);
+  if (ret != HAL_OK) {
+    Serial.println("[CAN] Notification config FAILED");
+    return;
+  }
+  HAL_NVIC_SetPriority(FDCAN_IT0_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(FDCAN_IT0_IRQn);
+#endif
 
   ret = HAL_FDCAN_Start(&hfdcan1);
   Serial.printf("[CAN] Start returned (%d), ErrorCode=0x%x\n", ret, hfdcan1.ErrorCode);
 }
 
-// Check for received CAN messages and push them to txBuf
-void pollCanRx() {
-
-  if (HAL_FDCAN_GetRxFifoFillLevel(&hfdcan1, FDCAN_RX_FIFO0) == 0) {
-    return; // no frames received
-  }
-
-  uint8_t data[8];
+// Move every frame waiting in a FIFO into rxRing, read straight into the ring
+// slot; the only producer of rxRing
+static void drainRxFifo(uint32_t fifo) {
   FDCAN_RxHeaderTypeDef rxHeader;
 
-  if (HAL_FDCAN_GetRxMessage(&hfdcan1, FDCAN_RX_FIFO0, &rxHeader, data) == HAL_OK) {
+  while (HAL_FDCAN_GetRxFifoFillLevel(&hfdcan1, fifo) > 0) {
+    canRec *rec = rxRing.claim();
+    if (rec == nullptr) {
+      // Ring full: the frame still has to leave the FIFO
+      uint8_t data[CAN_MAX_DLEN];
+      HAL_FDCAN_GetRxMessage(&hfdcan1, fifo, &rxHeader, data);
+      canRxRingFull++;
+      continue;
+    }
+    if (HAL_FDCAN_GetRxMessage(&hfdcan1, fifo, &rxHeader, rec->data) != HAL_OK) {
+      break;
+    }
     uint8_t len = dlcToBytes(rxHeader.DataLength);
-    // Serial.printf("[CAN] Frame received (ID=0x%x DLC=%d)\n",
-    //               rxHeader.Identifier,
-    //               rxHeader.DataLength);
+    rec->id  = rxHeader.Identifier | (rxHeader.IdType == FDCAN_EXTENDED_ID ? CAN_EXT_FLAG : 0);
+    rec->dlc = len;
+    rec->flags = (rxHeader.FDFormat == FDCAN_FD_CAN ? CAN_REC_FD : 0) |
+                 (rxHeader.BitRateSwitch == FDCAN_BRS_ON ? CAN_REC_BRS : 0);
+    memset(&rec->data[len], 0, sizeof(rec->data) - len);
+    rxRing.publish();
+  }
+}
 
-    canRec rec;
-    rec.id  = rxHeader.Identifier;
-    rec.dlc = len;
+extern "C" void HAL_FDCAN_RxFifo0Callback(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo0ITs) {
+  (void)hfdcan;  // the only FDCAN instance
+  PROFILE_SCOPE(PROF_CAN_ISR);
+  if (RxFifo0ITs & FDCAN_IT_RX_FIFO0_MESSAGE_LOST) {
+    canRxFifoLost++;
+  }
+  if (RxFifo0ITs & FDCAN_IT_RX_FIFO0_NEW_MESSAGE) {
+    drainRxFifo(FDCAN_RX_FIFO0);
+  }
+}
 
-    memset(rec.data, 0, sizeof(rec.data));
-    memcpy(rec.data, data, len);
+extern "C" void HAL_FDCAN_RxFifo1Callback(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo1ITs) {
+  (void)hfdcan;
+  PROFILE_SCOPE(PROF_CAN_ISR);
+  if (RxFifo1ITs & FDCAN_IT_RX_FIFO1_MESSAGE_LOST) {
+    canRxFifoLost++;
+  }
+  if (RxFifo1ITs & FDCAN_IT_RX_FIFO1_NEW_MESSAGE) {
+    drainRxFifo(FDCAN_RX_FIFO1);
+  }
+}
 
-    txBuf.push(rec);
-    // if(!txBuf.push(rec)) {
-    //   txBufOverwrites += 1; // push returns 0 on overwrite
-    // }
+#if CAN_ENABLE_RX_IRQ
+extern "C" void FDCAN_IT0_IRQHandler(void) {
+  HAL_FDCAN_IRQHandler(&hfdcan1);
+}
+#endif
 
-  } else {
-    Serial.printf("[CAN] GetRxMessage failed, ErrorCode=0x%08lx\n", hfdcan1.ErrorCode);
+// Move frames received since the last call from rxRing to txBuf
+void pollCanRx() {
+  PROFILE_SCOPE(PROF_CAN_RX);
+#if !CAN_ENABLE_RX_IRQ
+  drainRxFifo(FDCAN_RX_FIFO0);
+  drainRxFifo(FDCAN_RX_FIFO1);
+#endif
+
+  uint32_t now = micros();
+  while (const canRec *rec = rxRing.peek()) {
+    rxTimes[rxTimesNext] = now;
+    rxTimesNext = (rxTimesNext + 1) % CAN_RX_FIFO_LEN;
+    if (rxTimesCount < CAN_RX_FIFO_LEN) {
+      rxTimesCount++;
+    }
+    // Link commands are not bridged; drops are counted per class in txBuf
+    if (!tdmaHandleCommand(rec->id, rec->data, rec->dlc) && canRateAdmit(rec->id, now)) {
+      if (FLOG_ENABLE) {
+        canRec logged = *rec;
+        flogAppend(logged);
+        txBuf.push(logged);
+      } else {
+        txBuf.push(*rec);
+      }
+    }
+    rxRing.drop();
   }
+  statsHighWater(stats.txBufHigh, txBuf.size());
+}
+
+bool canRxQuiet(uint32_t us) {
+  return rxTimesCount < CAN_RX_FIFO_LEN || micros() - rxTimes[rxTimesNext] >= us;
 }
 
 // empty rxBuf and transmit via CAN
 void processCanTx() {
+  PROFILE_SCOPE(PROF_CAN_TX);
 
   while (!rxBuf.isEmpty() && HAL_FDCAN_GetTxFifoFreeLevel(&hfdcan1) > 0) {
 
     canRec rec = rxBuf.shift();
+    if (flogHandleRequest(rec)) {
+      continue;  // backfill request from the master, not for the bus
+    }
+    bool fd = CAN_ENABLE_FD && (rec.flags & CAN_REC_FD);
 
     FDCAN_TxHeaderTypeDef txHeader;
-    txHeader.Identifier          = rec.id;
-    txHeader.IdType              = FDCAN_STANDARD_ID;
+    txHeader.Identifier          = rec.id & ~CAN_EXT_FLAG;
+    txHeader.IdType              = (rec.id & CAN_EXT_FLAG) ? FDCAN_EXTENDED_ID : FDCAN_STANDARD_ID;
     txHeader.TxFrameType         = FDCAN_DATA_FRAME;
     txHeader.DataLength          = bytesToDlc(rec.dlc);
     txHeader.ErrorStateIndicator = FDCAN_ESI_ACTIVE;
-    txHeader.BitRateSwitch       = FDCAN_BRS_OFF;
-    txHeader.FDFormat            = FDCAN_CLASSIC_CAN;
+    txHeader.BitRateSwitch       = (fd && (rec.flags & CAN_REC_BRS)) ? FDCAN_BRS_ON : FDCAN_BRS_OFF;
+    txHeader.FDFormat            = fd ? FDCAN_FD_CAN : FDCAN_CLASSIC_CAN;
     txHeader.TxEventFifoControl  = FDCAN_NO_TX_EVENTS;
     txHeader.MessageMarker       = 0;
 
@@ -180,4 +308,12 @@ void processCanTx() {
       break;
     }
   }
+
+  // Count each time the TX FIFO starts holding records back
+  static bool txFifoFull = false;
+  bool full = !rxBuf.isEmpty();
+  if (full && !txFifoFull) {
+    stats.canTxFifoFull++;
+  }
+  txFifoFull = full;
 }
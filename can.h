@@ -6,9 +6,29 @@ Used for low level control of the CAN bus and handles link buffers
 Buffers:
 - rxBuf: stores data received by the radio -> to be transmitted with CAN
 - txBuf: stores data received by CAN -> to be transmitted with radio
+  (coalesces per ID on the follower, see can_queue.h)
+- Both are split into priority classes (kCanPrioTable): CRITICAL is always
+  served first, NORMAL and BULK share the rest by weight
 
-Filter:
-- Accept all id's
+Filter (canfilter.h):
+- Hardware filter bank from a routing table: CRITICAL and NORMAL IDs to
+  FIFO0, BULK to FIFO1, everything else rejected
+- Per-ID rate limits before txBuf
+
+RX path:
+- FIFO0/FIFO1 new-message interrupts drain the hardware FIFOs into an SPSC
+  ring (CAN_RX_RING_LEN); pollCanRx() moves the ring into txBuf in one batch
+- CAN_ENABLE_RX_IRQ=0 drains the FIFOs from pollCanRx() instead
+
+Frames:
+- 11-bit and 29-bit IDs; canRec.id carries CAN_EXT_FLAG for the latter, so
+  queues, filters and priorities key on the ID and its type together
+- CAN_ENABLE_FD: the controller runs CAN FD with bit-rate switching
+  (500 kbps arbitration, 2 Mbps data phase) and records hold up to 64
+  bytes; classic frames still pass unchanged. On by default on the U5 only:
+  64-byte records at these queue depths do not fit the C0's RAM. Both ends
+  must be built alike, a record longer than the peer's CAN_MAX_DLEN is
+  malformed there
 */
 
 #pragma once
@@ -24,17 +44,92 @@ Filter:
   #include "stm32u5xx_hal_fdcan.h"
 #endif
 
-#define MAX_LENGTH 32 // # of can records
+// Records per priority class in each of rxBuf and txBuf. NORMAL carries most
+// traffic and keeps the old single-buffer depth; CRITICAL and BULK add 8
+// records each (txBuf 2016 B, rxBuf 864 B with classic records)
+#ifndef CAN_QUEUE_LEN_CRITICAL
+#define CAN_QUEUE_LEN_CRITICAL 8
+#endif
+#ifndef CAN_QUEUE_LEN_NORMAL
+#define CAN_QUEUE_LEN_NORMAL 32
+#endif
+#ifndef CAN_QUEUE_LEN_BULK
+#define CAN_QUEUE_LEN_BULK 8
+#endif
+#define CAN_RX_RING_LEN 32 // ISR -> loop, power of two
+#define CAN_RX_FIFO_LEN 3  // elements per FDCAN RX FIFO
+
+#ifndef CAN_ENABLE_RX_IRQ
+#define CAN_ENABLE_RX_IRQ 1
+#endif
+
+#ifndef CAN_ENABLE_FD
+#if defined (STM32U5xx)
+#define CAN_ENABLE_FD 1
+#else
+#define CAN_ENABLE_FD 0
+#endif
+#endif
+
+#define CAN_MAX_DLEN (CAN_ENABLE_FD ? 64 : 8)
+
+#define CAN_EXT_FLAG 0x80000000u  // canRec.id: 29-bit identifier
+#define CAN_STD_ID_MAX 0x7FF
+#define CAN_EXT_ID_MAX 0x1FFFFFFF
+
+// canRec.flags
+#define CAN_REC_FD 0x01   // CAN FD frame
+#define CAN_REC_BRS 0x02  // data phase at the data bit rate (FD only)
+#define CAN_REC_LOGGED 0x04  // logSeq is valid (flightlog.h), not sent on the bus
 
 typedef struct __attribute__((packed)){
-  uint32_t id;
-  uint8_t dlc;
-  uint8_t data[8];
+  uint32_t id;     // 11-bit ID, or 29-bit ID | CAN_EXT_FLAG
+  uint8_t dlc;     // data bytes: 0-8, FD also 12, 16, 20, 24, 32, 48, 64
+  uint8_t flags;   // CAN_REC_*
+  uint16_t logSeq; // flight log sequence number, with CAN_REC_LOGGED
+  uint8_t data[CAN_MAX_DLEN];
 } canRec;
 
+uint8_t canDlcLen(uint8_t code);  // DLC code 0-15 to data bytes
+uint8_t canLenDlc(uint8_t len);   // data bytes to the smallest DLC code holding them
+
+enum CanPrio : uint8_t {
+  CAN_PRIO_CRITICAL = 0,  // flight state, arm/abort
+  CAN_PRIO_NORMAL,
+  CAN_PRIO_BULK,          // housekeeping
+  CAN_PRIO_COUNT
+};
+
+// Records served in a row per weighted class
+#define CAN_PRIO_WEIGHT_NORMAL 4
+#define CAN_PRIO_WEIGHT_BULK 1
+
+uint8_t canPriority(uint32_t id);
+
+#include "can_queue.h"
+
+static_assert(CAN_PRIO_COUNT == 3, "one queue depth per CanPrio class");
+
+typedef PrioQueue<canRec, canPriority,
+                  CanQueue<canRec, CAN_QUEUE_LEN_CRITICAL>,
+                  CanQueue<canRec, CAN_QUEUE_LEN_NORMAL>,
+                  CanQueue<canRec, CAN_QUEUE_LEN_BULK>> CanTxQueue;
+typedef PrioQueue<canRec, canPriority,
+                  CircularBuffer<canRec, CAN_QUEUE_LEN_CRITICAL>,
+                  CircularBuffer<canRec, CAN_QUEUE_LEN_NORMAL>,
+                  CircularBuffer<canRec, CAN_QUEUE_LEN_BULK>> CanRxQueue;
+
 extern FDCAN_HandleTypeDef hfdcan1;
-extern CircularBuffer<canRec, MAX_LENGTH> rxBuf;   // radio -> CAN
-extern CircularBuffer<canRec, MAX_LENGTH> txBuf;   // CAN  -> radio
+extern CanRxQueue rxBuf;   // radio -> CAN
+extern CanTxQueue txBuf;   // CAN  -> radio
+
+extern volatile uint32_t canRxFifoLost;  // FIFO0/FIFO1 message-lost events (IRQ mode)
+extern volatile uint32_t canRxRingFull;  // frames dropped because the ring was full
+
+// Fewer than CAN_RX_FIFO_LEN frames taken in the last us, so a CPU stall
+// with interrupts held (C0 flash erase) likely leaves the RX FIFOs room; a
+// burst during one still overflows them, counted in canRxFifoLost
+bool canRxQuiet(uint32_t us);
 
 void initCan();
 void pollCanRx();
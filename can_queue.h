@@ -0,0 +1,354 @@
+/*
+CAN record queues
+
+Fixed-memory queues for CAN records used in place of CircularBuffer where the
+drop policy matters.
+
+IdMap:
+- Open-addressed (linear probing) map from CAN ID to a small slot index
+- Backward-shift deletion, so no tombstones build up
+
+CanQueue:
+- Records live in a static pool; service order is a ring of slot indices
+- FIFO mode: every push takes a new slot
+- Coalescing mode: a push for an ID that is already pending replaces that
+  record in place and keeps its position, so each pending ID is served
+  round-robin with its freshest value
+- When all slots are taken the new record is dropped (push returns false);
+  pending records are never overwritten
+- Transactional dequeue: take() removes a record from service but keeps its
+  slot; commit() frees what was taken, rollback() puts it back at the head
+  in its old order. In coalescing mode a record superseded while taken is
+  dropped at rollback in favour of the newer value
+
+PrioQueue:
+- One queue per priority class, strict priority for class 0 and weighted
+  round-robin for the rest, with per-class drop counters
+- take() / commit() / rollback() over all classes (CanQueue classes only)
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <tuple>
+#include <CircularBuffer.hpp>
+
+template <uint16_t CAP>
+class IdMap {
+  static_assert(CAP > 0 && (CAP & (CAP - 1)) == 0, "IdMap capacity must be a power of two");
+
+public:
+  static const uint8_t EMPTY = 0xFF;
+
+  IdMap() { clear(); }
+
+  void clear() {
+    memset(values, EMPTY, sizeof(values));
+  }
+
+  // Returns the slot stored for id, or EMPTY
+  uint8_t find(uint32_t id) const {
+    for (uint16_t i = home(id);; i = (i + 1) & (CAP - 1)) {
+      if (values[i] == EMPTY) {
+        return EMPTY;
+      }
+      if (ids[i] == id) {
+        return values[i];
+      }
+    }
+  }
+
+  // id must not be present; the caller keeps the load factor below 1
+  void insert(uint32_t id, uint8_t value) {
+    uint16_t i = home(id);
+    while (values[i] != EMPTY) {
+      i = (i + 1) & (CAP - 1);
+    }
+    ids[i] = id;
+    values[i] = value;
+  }
+
+  void erase(uint32_t id) {
+    uint16_t i = home(id);
+    while (values[i] == EMPTY || ids[i] != id) {
+      if (values[i] == EMPTY) {
+        return;
+      }
+      i = (i + 1) & (CAP - 1);
+    }
+
+    // Shift back later entries of the probe run that may not skip the hole
+    uint16_t hole = i;
+    for (uint16_t j = (i + 1) & (CAP - 1); values[j] != EMPTY; j = (j + 1) & (CAP - 1)) {
+      uint16_t h = home(ids[j]);
+      bool movable = (hole <= j) ? (h <= hole || h > j) : (h <= hole && h > j);
+      if (movable) {
+        ids[hole] = ids[j];
+        values[hole] = values[j];
+        hole = j;
+      }
+    }
+    values[hole] = EMPTY;
+  }
+
+private:
+  static uint16_t home(uint32_t id) {
+    return (uint16_t)((id * 2654435761u) >> 16) & (CAP - 1);
+  }
+
+  uint32_t ids[CAP];
+  uint8_t values[CAP];
+};
+
+// Rec needs a uint32_t id member (canRec)
+template <typename Rec, uint8_t N>
+class CanQueue {
+public:
+  CanQueue() { clear(); }
+
+  void setCoalescing(bool on) {
+    clear();
+    coalescing = on;
+  }
+
+  void clear() {
+    order.clear();
+    index.clear();
+    for (uint8_t i = 0; i < N; i++) {
+      freeSlots[i] = i;
+    }
+    freeCount = N;
+    takenCount = 0;
+  }
+
+  // Returns false if the record was dropped because the queue is full
+  bool push(const Rec &rec) {
+    if (coalescing) {
+      uint8_t slot = index.find(rec.id);
+      if (slot != index.EMPTY) {
+        pool[slot] = rec;
+        replaced++;
+        return true;
+      }
+    }
+    if (freeCount == 0) {
+      return false;
+    }
+    uint8_t slot = freeSlots[--freeCount];
+    pool[slot] = rec;
+    order.push(slot);
+    if (coalescing) {
+      index.insert(rec.id, slot);
+    }
+    return true;
+  }
+
+  const Rec &first() const {
+    return pool[order.first()];
+  }
+
+  Rec shift() {
+    uint8_t slot = order.shift();
+    if (coalescing) {
+      index.erase(pool[slot].id);
+    }
+    freeSlots[freeCount++] = slot;
+    return pool[slot];
+  }
+
+  // Like shift(), but the slot stays allocated and the reference valid until
+  // commit() or rollback()
+  const Rec &take() {
+    uint8_t slot = order.shift();
+    if (coalescing) {
+      index.erase(pool[slot].id);  // a newer value gets its own slot meanwhile
+    }
+    taken[takenCount++] = slot;
+    return pool[slot];
+  }
+
+  void commit() {
+    while (takenCount > 0) {
+      freeSlots[freeCount++] = taken[--takenCount];
+    }
+  }
+
+  // Returns the records requeued
+  uint8_t rollback() {
+    uint8_t requeued = 0;
+    while (takenCount > 0) {
+      uint8_t slot = taken[--takenCount];
+      if (coalescing && index.find(pool[slot].id) != index.EMPTY) {
+        freeSlots[freeCount++] = slot;
+        replaced++;
+        continue;
+      }
+      order.unshift(slot);
+      if (coalescing) {
+        index.insert(pool[slot].id, slot);
+      }
+      requeued++;
+    }
+    return requeued;
+  }
+
+  uint16_t size() const { return order.size(); }
+  bool isEmpty() const { return order.isEmpty(); }
+  bool isFull() const { return freeCount == 0; }
+  uint8_t takenSize() const { return takenCount; }
+  uint32_t replacedCount() const { return replaced; }  // records superseded by a newer value
+
+private:
+  bool coalescing = false;
+  Rec pool[N];
+  CircularBuffer<uint8_t, N> order;  // slots in service order
+  uint8_t freeSlots[N];
+  uint8_t freeCount;
+  uint8_t taken[N];  // slots taken since the last commit, in order
+  uint8_t takenCount;
+  IdMap<(N <= 32) ? 64 : (N <= 64) ? 128 : 256> index;  // load factor <= 1/2
+  uint32_t replaced = 0;
+};
+
+// Per-class queues over any of the above (or CircularBuffer), one queue type
+// per class so each class gets its own depth. Classify maps a CAN ID to a
+// class; class 0 is served with strict priority, the others by weighted
+// round-robin (weights[c] records in a row). Lost records are counted per
+// class: a CanQueue rejects the new one, a CircularBuffer overwrites the
+// oldest.
+template <typename Rec, uint8_t (*Classify)(uint32_t), typename... Qs>
+class PrioQueue {
+  static constexpr uint8_t CLASSES = sizeof...(Qs);
+  static_assert(CLASSES >= 2, "PrioQueue needs a strict class and at least one weighted class");
+
+public:
+  explicit PrioQueue(const uint8_t *classWeights) : weights(classWeights) {
+    for (uint8_t c = 0; c < CLASSES; c++) {
+      credit[c] = weights[c];
+    }
+  }
+
+  void setCoalescing(bool on) {
+    each([on](auto &q) { q.setCoalescing(on); });
+  }
+
+  void clear() {
+    each([](auto &q) { q.clear(); });
+  }
+
+  bool push(const Rec &rec) {
+    uint8_t c = Classify(rec.id);
+    if (c >= CLASSES) {
+      c = CLASSES - 1;
+    }
+    if (!at(c, [&rec](auto &q) { return q.push(rec); })) {
+      drops[c]++;
+      return false;
+    }
+    return true;
+  }
+
+  // Only valid if !isEmpty(); shift() or take() then removes this same record.
+  // A reference into the queue where the class queue allows it
+  decltype(auto) first() {
+    return at(select(), [](auto &q) -> decltype(auto) { return q.first(); });
+  }
+
+  Rec shift() {
+    uint8_t c = select();
+    if (c != 0) {
+      credit[c]--;
+    }
+    return at(c, [](auto &q) -> Rec { return q.shift(); });
+  }
+
+  const Rec &take() {
+    uint8_t c = select();
+    if (c != 0) {
+      credit[c]--;
+    }
+    return at(c, [](auto &q) -> const Rec & { return q.take(); });
+  }
+
+  void commit() {
+    each([](auto &q) { q.commit(); });
+  }
+
+  // Returns the records requeued; the rest were superseded
+  uint16_t rollback() {
+    uint16_t n = 0;
+    each([&n](auto &q) { n += q.rollback(); });
+    return n;
+  }
+
+  uint16_t takenSize() const {
+    uint16_t n = 0;
+    each([&n](const auto &q) { n += q.takenSize(); });
+    return n;
+  }
+
+  uint16_t size() const {
+    uint16_t n = 0;
+    each([&n](const auto &q) { n += q.size(); });
+    return n;
+  }
+
+  bool isEmpty() const { return size() == 0; }
+  uint16_t size(uint8_t c) const {
+    return at(c, [](const auto &q) -> uint16_t { return q.size(); });
+  }
+  uint32_t dropped(uint8_t c) const { return drops[c]; }
+
+private:
+  uint8_t select() {
+    if (!empty(0)) {
+      return 0;
+    }
+    // Serve the current class while it has credit, then refill it and move on
+    for (uint8_t n = 0; n < 2 * (CLASSES - 1); n++) {
+      if (!empty(current) && credit[current] > 0) {
+        return current;
+      }
+      credit[current] = weights[current];
+      current = (current == CLASSES - 1) ? 1 : current + 1;
+    }
+    return 0;  // all empty
+  }
+
+  bool empty(uint8_t c) const {
+    return at(c, [](const auto &q) { return q.isEmpty(); });
+  }
+
+  template <typename F>
+  void each(F &&fn) {
+    std::apply([&fn](auto &...q) { (fn(q), ...); }, queues);
+  }
+  template <typename F>
+  void each(F &&fn) const {
+    std::apply([&fn](const auto &...q) { (fn(q), ...); }, queues);
+  }
+
+  // fn(queue of class c); fn returns the same type for every class
+  template <typename F>
+  decltype(auto) at(uint8_t c, F &&fn) { return atFrom<0>(*this, c, fn); }
+  template <typename F>
+  decltype(auto) at(uint8_t c, F &&fn) const { return atFrom<0>(*this, c, fn); }
+
+  template <size_t I, typename Self, typename F>
+  static decltype(auto) atFrom(Self &self, uint8_t c, F &fn) {
+    if constexpr (I + 1 < CLASSES) {
+      if (c != I) {
+        return atFrom<I + 1>(self, c, fn);
+      }
+    }
+    return fn(std::get<I>(self.queues));
+  }
+
+  std::tuple<Qs...> queues;
+  const uint8_t *weights;
+  uint8_t credit[CLASSES];
+  uint8_t current = 1;
+  uint32_t drops[CLASSES] = {};
+};
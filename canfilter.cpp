@@ -0,0 +1,120 @@
+#include "canfilter.h"
+#include "can_queue.h"
+#include "stats.h"
+
+#include <Arduino.h>
+
+struct canFilterRange {
+  uint32_t first;
+  uint32_t last;
+  bool ext;
+  uint8_t route;
+};
+
+// First matching entry wins; everything else is rejected in hardware
+static const canFilterRange kCanFilterTable[] = {
+  {0x000, 0x0FF, false, CAN_ROUTE_FIFO0},  // CRITICAL
+  {0x100, 0x6FF, false, CAN_ROUTE_FIFO0},  // NORMAL
+  {0x700, 0x7FF, false, CAN_ROUTE_FIFO1},  // BULK, link commands, diagnostics
+  {0x00000000, CAN_EXT_ID_MAX, true, CAN_ROUTE_FIFO0},  // 29-bit, NORMAL
+};
+
+struct canRateRule {
+  uint32_t first;
+  uint32_t last;
+  uint16_t maxHz;     // 0: no limit
+  uint8_t everyNth;   // 0 or 1: every frame
+};
+
+// Per ID; the first matching rule applies. 29-bit IDs match with CAN_EXT_FLAG
+static const canRateRule kCanRateTable[] = {
+  {0x700, 0x7EF, 10, 1},  // housekeeping
+};
+
+static IdMap<CAN_RATE_IDS * 2> rateIndex;
+static uint32_t rateNextUs[CAN_RATE_IDS];  // earliest time the next frame is admitted
+static uint8_t rateSkipped[CAN_RATE_IDS];  // frames since the last admitted one
+static uint8_t rateUsed;
+
+uint32_t canFilterCount(bool ext) {
+  uint32_t n = 0;
+  for (const canFilterRange &f : kCanFilterTable) {
+    n += (f.ext == ext);
+  }
+  uint32_t max = ext ? CAN_EXT_FILTERS_MAX : CAN_STD_FILTERS_MAX;
+  return n < max ? n : max;
+}
+
+bool canFilterConfig(FDCAN_HandleTypeDef *hfdcan) {
+  uint32_t next[2] = {0, 0};  // standard, extended
+  for (const canFilterRange &f : kCanFilterTable) {
+    uint32_t &index = next[f.ext];
+    if (index >= canFilterCount(f.ext)) {
+      Serial.printf("[CAN] Filter 0x%x-0x%x left out: no free %s element\n", f.first, f.last,
+                    f.ext ? "extended" : "standard");
+      continue;
+    }
+
+    FDCAN_FilterTypeDef sFilterConfig;
+    sFilterConfig.IdType       = f.ext ? FDCAN_EXTENDED_ID : FDCAN_STANDARD_ID;
+    sFilterConfig.FilterIndex  = index++;
+    sFilterConfig.FilterType   = FDCAN_FILTER_RANGE;
+    sFilterConfig.FilterConfig = f.route == CAN_ROUTE_FIFO0 ? FDCAN_FILTER_TO_RXFIFO0 :
+                                 f.route == CAN_ROUTE_FIFO1 ? FDCAN_FILTER_TO_RXFIFO1 : FDCAN_FILTER_REJECT;
+    sFilterConfig.FilterID1    = f.first;
+    sFilterConfig.FilterID2    = f.last;
+    if (HAL_FDCAN_ConfigFilter(hfdcan, &sFilterConfig) != HAL_OK) {
+      return false;
+    }
+  }
+  return HAL_FDCAN_ConfigGlobalFilter(hfdcan, FDCAN_REJECT, FDCAN_REJECT, FDCAN_REJECT_REMOTE,
+                                      FDCAN_REJECT_REMOTE) == HAL_OK;
+}
+
+static const canRateRule *rateRule(uint32_t id) {
+  for (const canRateRule &r : kCanRateTable) {
+    if (id >= r.first && id <= r.last) {
+      return &r;
+    }
+  }
+  return nullptr;
+}
+
+bool canRateAdmit(uint32_t id, uint32_t nowUs) {
+  const canRateRule *rule = rateRule(id);
+  if (rule == nullptr) {
+    return true;
+  }
+  uint32_t periodUs = rule->maxHz ? 1000000 / rule->maxHz : 0;
+
+  uint8_t slot = rateIndex.find(id);
+  if (slot == rateIndex.EMPTY) {
+    if (rateUsed >= CAN_RATE_IDS) {
+      return true;  // untracked
+    }
+    slot = rateUsed++;
+    rateIndex.insert(id, slot);
+    rateSkipped[slot] = 0;
+    rateNextUs[slot] = nowUs + periodUs;
+    return true;  // the first frame of an ID always passes
+  }
+
+  if (rateSkipped[slot] < 0xFF) {
+    rateSkipped[slot]++;
+  }
+  if (rateSkipped[slot] < rule->everyNth || (int32_t)(nowUs - rateNextUs[slot]) < 0) {
+    stats.canRxDecimated++;
+    return false;
+  }
+  rateSkipped[slot] = 0;
+  // Keep the long-run rate at maxHz with jittered arrivals, but do not
+  // bank credit over a pause
+  uint32_t lateUs = nowUs - rateNextUs[slot];
+  rateNextUs[slot] = (lateUs < periodUs ? rateNextUs[slot] : nowUs) + periodUs;
+  return true;
+}
+
+void canRateReset() {
+  rateIndex.clear();
+  rateUsed = 0;
+}
@@ -0,0 +1,48 @@
+/*
+CAN filter bank and rate limits
+
+Decides which bus frames the bridge takes at all (in hardware) and how
+often each ID may enter txBuf (in software)
+
+Routing (kCanFilterTable in canfilter.cpp):
+- Each entry is an ID range of standard or extended IDs, programmed into
+  one FDCAN range filter element: FIFO0, FIFO1 or reject
+- Elements keep table order and the first match wins, as in hardware
+- IDs matching no entry are rejected by the global filter, so they never
+  cost an interrupt or a ring slot
+- At most CAN_STD_FILTERS_MAX standard and CAN_EXT_FILTERS_MAX extended
+  entries (the FDCAN message RAM of the C0 and U5); entries beyond that
+  are reported at init and left out
+- FIFO0 carries CRITICAL and NORMAL IDs (all 29-bit IDs by default), FIFO1
+  BULK ones, so a burst of housekeeping frames cannot fill the FIFO
+  critical frames arrive in.
+  Keep the table in line with kCanPrioTable (can.cpp)
+
+Rate limits (kCanRateTable in canfilter.cpp):
+- Per ID within a range: at most maxHz frames per second and only every
+  Nth frame (0 / 1 for no limit), checked by pollCanRx() before txBuf;
+  link commands are never limited
+- State for up to CAN_RATE_IDS limited IDs; more IDs than that pass
+  unlimited
+- Dropped frames are counted in stats.canRxDecimated
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "can.h"
+
+#define CAN_STD_FILTERS_MAX 28
+#define CAN_EXT_FILTERS_MAX 8
+#define CAN_RATE_IDS 32
+
+enum CanRoute : uint8_t {
+  CAN_ROUTE_FIFO0,
+  CAN_ROUTE_FIFO1,
+  CAN_ROUTE_REJECT
+};
+
+uint32_t canFilterCount(bool ext);  // elements used, for FDCAN_InitTypeDef
+bool canFilterConfig(FDCAN_HandleTypeDef *hfdcan);  // after HAL_FDCAN_Init()
+bool canRateAdmit(uint32_t id, uint32_t nowUs);  // false: drop this frame
+void canRateReset();
@@ -0,0 +1,65 @@
+#include "clocksync.h"
+#include "tdma.h"
+
+// Offset at refUs is baseUs + frac; frac stays below 1 us so float keeps
+// sub-microsecond resolution however far apart the clocks are
+static int32_t baseUs;
+static float frac;
+static float drift;
+static uint32_t refUs;
+static bool locked;
+
+void clockSyncReset() {
+  locked = false;
+}
+
+static void clockSyncSet(uint32_t localUs, int32_t offsetUs) {
+  baseUs = offsetUs;
+  frac = 0.0f;
+  drift = 0.0f;
+  refUs = localUs;
+  locked = true;
+}
+
+// Offset at localUs relative to baseUs
+static float clockSyncAdvance(uint32_t localUs) {
+  return frac + drift * (float)(int32_t)(localUs - refUs);
+}
+
+int32_t clockSyncSample(uint32_t localUs, int32_t offsetUs) {
+  if (!locked) {
+    clockSyncSet(localUs, offsetUs);
+    return 0;
+  }
+  float predicted = clockSyncAdvance(localUs);
+  float residual = (float)(int32_t)((uint32_t)offsetUs - (uint32_t)baseUs) - predicted;
+  if (residual > CLOCKSYNC_RELOCK_US || residual < -CLOCKSYNC_RELOCK_US) {
+    clockSyncSet(localUs, offsetUs);
+    return (int32_t)residual;
+  }
+
+  int32_t sinceUs = (int32_t)(localUs - refUs);
+  float spanUs = (float)(sinceUs > FRAME_LEN_US ? sinceUs : FRAME_LEN_US);
+  drift += CLOCKSYNC_KI * residual / spanUs;
+  if (drift > CLOCKSYNC_MAX_DRIFT) {
+    drift = CLOCKSYNC_MAX_DRIFT;
+  } else if (drift < -CLOCKSYNC_MAX_DRIFT) {
+    drift = -CLOCKSYNC_MAX_DRIFT;
+  }
+
+  float offset = predicted + CLOCKSYNC_KP * residual;
+  int32_t whole = (int32_t)(offset < 0 ? offset - 0.5f : offset + 0.5f);
+  baseUs += whole;
+  frac = offset - (float)whole;
+  refUs = localUs;
+  return (int32_t)(residual < 0 ? residual - 0.5f : residual + 0.5f);
+}
+
+int32_t clockSyncOffset(uint32_t localUs) {
+  float offset = clockSyncAdvance(localUs);
+  return baseUs + (int32_t)(offset < 0 ? offset - 0.5f : offset + 0.5f);
+}
+
+float clockSyncDrift() {
+  return drift;
+}
@@ -0,0 +1,42 @@
+/*
+Clock synchronization
+
+Follower-side estimate of the master's clock: offset and crystal drift,
+tracked with a PI loop over the timestamps of every DOWNLINK packet
+
+Samples:
+- The master writes its micros() at TX start into tdmaHeader.tx_us
+  (radioTxDelayUs() ahead of radioTransmit()); the follower takes the
+  packet start from the DIO1 RX_DONE edge, stamped in the ISR, less the
+  time-on-air. Their difference is one offset measurement
+- Every DOWNLINK packet is a sample, wherever it sits in the slot
+
+Loop:
+- Residual: measurement less the offset predicted from the last estimate
+  and drift
+- The offset takes CLOCKSYNC_KP of the residual, the drift CLOCKSYNC_KI of it
+  per frame of time since the last sample (at least one frame, so burst
+  packets do not jerk it)
+- Between samples, and through missed frames, the offset keeps following
+  the drift; tdma.cpp re-reads it at every rollover
+- The first sample, and one off by more than CLOCKSYNC_RELOCK_US (master
+  restart), set the offset directly and restart the drift
+
+Residuals go to stats (frame 2) and bound the sync error the guard times
+have to cover
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define CLOCKSYNC_KP 0.25f
+#define CLOCKSYNC_KI (1.0f / 32.0f)
+#define CLOCKSYNC_RELOCK_US 2000
+#define CLOCKSYNC_MAX_DRIFT 500e-6f  // crystal error bound, +-500 ppm
+
+void clockSyncReset();
+// One measured offset at local time localUs; returns the residual [us]
+int32_t clockSyncSample(uint32_t localUs, int32_t offsetUs);
+int32_t clockSyncOffset(uint32_t localUs);  // predicted master - local [us]
+float clockSyncDrift();  // estimated master / local rate - 1
@@ -0,0 +1,291 @@
+#include "codec.h"
+
+#include <string.h>
+
+struct recDictEntry {
+  uint16_t id;
+  uint8_t dlc;
+};
+
+// Frequent IDs sent with a 1-byte header. Keep sorted by id: the position is
+// the wire index, so both ends must be built from the same table. Frames with
+// a different length than the entry fall back to the standard form.
+static const recDictEntry kRecDict[] = {
+  {0x100, 4},
+  {0x101, 4},
+  {0x102, 4},
+  {0x103, 4},
+  {0x104, 2},
+  {0x105, 2},
+  {0x106, 2},
+  {0x107, 2},
+};
+
+static const size_t kRecDictLen = sizeof(kRecDict) / sizeof(kRecDict[0]);
+
+static_assert(kRecDictLen <= REC_DICT_MAX, "ID dictionary too large");
+
+// Returns the dictionary index for rec, or -1
+static int dictLookup(const canRec &rec) {
+  size_t lo = 0;
+  size_t hi = kRecDictLen;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (kRecDict[mid].id < rec.id) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < kRecDictLen && kRecDict[lo].id == rec.id && kRecDict[lo].dlc == rec.dlc) {
+    return (int)lo;
+  }
+  return -1;
+}
+
+// Classic 11-bit frames of up to 8 bytes take the standard or dictionary form
+static bool isLong(const canRec &rec) {
+  return (rec.id & CAN_EXT_FLAG) || (rec.flags & CAN_REC_FD);
+}
+
+static bool encodable(const canRec &rec) {
+  uint32_t id = rec.id & ~CAN_EXT_FLAG;
+  if (id > ((rec.id & CAN_EXT_FLAG) ? CAN_EXT_ID_MAX : CAN_STD_ID_MAX) || rec.dlc > CAN_MAX_DLEN) {
+    return false;
+  }
+  if (!(rec.flags & CAN_REC_FD)) {
+    return rec.dlc <= 8 && !(rec.flags & CAN_REC_BRS);
+  }
+  return canDlcLen(canLenDlc(rec.dlc)) == rec.dlc;
+}
+
+static size_t headerLen(const canRec &rec) {
+  if (isLong(rec)) {
+    return (rec.id & CAN_EXT_FLAG) ? 6 : 4;
+  }
+  return dictLookup(rec) >= 0 ? 1 : 2;
+}
+
+// Writes the record header; returns its length, 0 if it does not fit
+static size_t encodeHeader(const canRec &rec, uint8_t *out, size_t cap) {
+  if (isLong(rec)) {
+    size_t len = headerLen(rec);
+    if (cap < len) {
+      return 0;
+    }
+    bool ext = rec.id & CAN_EXT_FLAG;
+    uint32_t id = rec.id & ~CAN_EXT_FLAG;
+    out[0] = REC_LONG_ESCAPE;
+    out[1] = (ext ? REC_LONG_EXT : 0) | ((rec.flags & CAN_REC_FD) ? REC_LONG_FD : 0) |
+             ((rec.flags & CAN_REC_BRS) ? REC_LONG_BRS : 0) | canLenDlc(rec.dlc);
+    for (size_t i = 2; i < len; i++) {
+      out[i] = (uint8_t)(id >> (8 * (len - 1 - i)));
+    }
+    return len;
+  }
+
+  int index = dictLookup(rec);
+  if (index >= 0) {
+    if (cap < 1) {
+      return 0;
+    }
+    out[0] = REC_DICT_FLAG | (uint8_t)index;
+    return 1;
+  }
+  if (cap < 2) {
+    return 0;
+  }
+  out[0] = (uint8_t)(rec.id >> 4);
+  out[1] = (uint8_t)((rec.id & 0x0F) << 4) | rec.dlc;
+  return 2;
+}
+
+// Long form after the escape byte
+static size_t decodeLongHeader(const uint8_t *buf, size_t len, canRec &rec) {
+  if (len < 2 || (buf[1] & 0x10)) {
+    return 0;
+  }
+  uint8_t flags = buf[1];
+  size_t hlen = (flags & REC_LONG_EXT) ? 6 : 4;
+  if (len < hlen) {
+    return 0;
+  }
+  uint32_t id = 0;
+  for (size_t i = 2; i < hlen; i++) {
+    id = (id << 8) | buf[i];
+  }
+  rec.id = (flags & REC_LONG_EXT) ? (id | CAN_EXT_FLAG) : id;
+  rec.dlc = canDlcLen(flags & 0x0F);
+  rec.flags = ((flags & REC_LONG_FD) ? CAN_REC_FD : 0) | ((flags & REC_LONG_BRS) ? CAN_REC_BRS : 0);
+  return encodable(rec) ? hlen : 0;
+}
+
+// Parses the record header into rec.id/dlc/flags; returns its length, 0 if malformed
+static size_t decodeHeader(const uint8_t *buf, size_t len, canRec &rec) {
+  if (len < 1) {
+    return 0;
+  }
+  if (buf[0] == REC_LONG_ESCAPE) {
+    return decodeLongHeader(buf, len, rec);
+  }
+  rec.flags = 0;
+  if (buf[0] & REC_DICT_FLAG) {
+    uint8_t index = buf[0] & ~REC_DICT_FLAG;
+    if (index >= kRecDictLen) {
+      return 0;
+    }
+    rec.id = kRecDict[index].id;
+    rec.dlc = kRecDict[index].dlc;
+    return 1;
+  }
+  if (len < 2) {
+    return 0;
+  }
+  rec.id = ((uint32_t)buf[0] << 4) | (buf[1] >> 4);
+  rec.dlc = buf[1] & 0x0F;
+  if (rec.dlc > 8) {
+    return 0;
+  }
+  return 2;
+}
+
+// Delta groups: one byte each up to dlc 8, then dlc / 8 rounded up
+static uint8_t groupLen(uint8_t dlc) {
+  return (uint8_t)((dlc + 7) / 8);
+}
+
+static uint8_t fullMask(uint8_t dlc) {
+  uint8_t g = groupLen(dlc);
+  uint8_t groups = g ? (uint8_t)((dlc + g - 1) / g) : 0;
+  return (uint8_t)((1u << groups) - 1);
+}
+
+size_t recEncodedLen(const canRec &rec) {
+  return encodable(rec) ? headerLen(rec) + rec.dlc : 0;
+}
+
+size_t recEncode(const canRec &rec, uint8_t *out, size_t cap) {
+  if (!encodable(rec)) {
+    return 0;
+  }
+
+  size_t offset = encodeHeader(rec, out, cap);
+  if (offset == 0 || cap < offset + rec.dlc) {
+    return 0;
+  }
+  memcpy(&out[offset], rec.data, rec.dlc);
+  return offset + rec.dlc;
+}
+
+size_t recDecode(const uint8_t *buf, size_t len, canRec &rec) {
+  size_t offset = decodeHeader(buf, len, rec);
+  if (offset == 0 || offset + rec.dlc > len) {
+    return 0;
+  }
+  memset(rec.data, 0, sizeof(rec.data));
+  memcpy(rec.data, &buf[offset], rec.dlc);
+  return offset + rec.dlc;
+}
+
+size_t recEncodeDelta(const canRec &rec, const canRec *ref, uint8_t *out, size_t cap) {
+  if (!encodable(rec)) {
+    return 0;
+  }
+
+  size_t offset = encodeHeader(rec, out, cap);
+  if (offset == 0) {
+    return 0;
+  }
+  if (rec.dlc == 0) {
+    return offset;
+  }
+
+  uint8_t g = groupLen(rec.dlc);
+  uint8_t mask = fullMask(rec.dlc);
+  if (ref != nullptr && ref->dlc == rec.dlc) {
+    mask = 0;
+    for (uint8_t i = 0; i < rec.dlc; i++) {
+      if (rec.data[i] != ref->data[i]) {
+        mask |= (uint8_t)(1u << (i / g));
+      }
+    }
+  }
+
+  if (cap < offset + 1) {
+    return 0;
+  }
+  out[offset++] = mask;
+  for (uint8_t i = 0; i < rec.dlc; i++) {
+    if (mask & (1u << (i / g))) {
+      if (offset >= cap) {
+        return 0;
+      }
+      out[offset++] = rec.data[i];
+    }
+  }
+  return offset;
+}
+
+size_t recDecodeDelta(const uint8_t *buf, size_t len, const RecMirror &mirror, canRec &rec, bool &missingRef) {
+  missingRef = false;
+  size_t offset = decodeHeader(buf, len, rec);
+  if (offset == 0) {
+    return 0;
+  }
+  memset(rec.data, 0, sizeof(rec.data));
+  if (rec.dlc == 0) {
+    return offset;
+  }
+
+  if (offset >= len) {
+    return 0;
+  }
+  uint8_t mask = buf[offset++];
+  if (mask & ~fullMask(rec.dlc)) {
+    return 0;
+  }
+
+  const canRec *ref = nullptr;
+  if (mask != fullMask(rec.dlc)) {
+    ref = mirror.find(rec.id);
+    if (ref == nullptr || ref->dlc != rec.dlc) {
+      missingRef = true;
+      ref = nullptr;
+    }
+  }
+
+  uint8_t g = groupLen(rec.dlc);
+  for (uint8_t i = 0; i < rec.dlc; i++) {
+    if (mask & (1u << (i / g))) {
+      if (offset >= len) {
+        return 0;
+      }
+      rec.data[i] = buf[offset++];
+    } else if (ref != nullptr) {
+      rec.data[i] = ref->data[i];
+    }
+  }
+  return offset;
+}
+
+const canRec *RecMirror::find(uint32_t id) const {
+  uint8_t slot = index.find(id);
+  return slot == index.EMPTY ? nullptr : &recs[slot];
+}
+
+void RecMirror::store(const canRec &rec) {
+  uint8_t slot = index.find(rec.id);
+  if (slot == index.EMPTY) {
+    if (count >= REC_MIRROR_SIZE) {
+      return;
+    }
+    slot = count++;
+    index.insert(rec.id, slot);
+  }
+  recs[slot] = rec;
+}
+
+void RecMirror::clear() {
+  index.clear();
+  count = 0;
+}
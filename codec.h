@@ -0,0 +1,67 @@
+/*
+Record codec
+
+Compact wire encoding of canRec inside TDMA payloads
+
+Record forms:
+- Standard: [0 | id 10..4][id 3..0 | dlc] + dlc data bytes (2-byte header)
+- Dictionary: [1 | index] + dlc data bytes (1-byte header)
+  index into kRecDict; the entry fixes both id and dlc
+
+- Long: [0xFF][ext | fd | brs | 0 | dlc code][id, 2 bytes (11-bit) or
+  4 bytes (29-bit), big-endian] + data bytes of the DLC code (3 or 5-byte
+  header after the escape); for 29-bit IDs and CAN FD frames, which the
+  other forms cannot express
+  Header byte 0xFF is dictionary index 0x7F, which is never used
+
+Delta records (uplink TDMA_FORMAT_DELTA*):
+- Same header, then (if dlc > 0) a mask byte with bit i set when data group i
+  follows; the other groups are taken from the last record seen for the ID
+- A group is one byte up to dlc 8, and dlc / 8 bytes rounded up above (so
+  at most 8 groups; the last one may be short)
+- A mask with all group bits set is a full record and needs no history
+- RecMirror holds that history; sender and receiver must stay in step, which
+  the TDMA layer ensures with sequence numbers and keyframes
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "can.h"
+
+#define REC_HEADER_MAX 6  // long form, 29-bit ID
+#define REC_MAX_ENCODED_LEN (REC_HEADER_MAX + CAN_MAX_DLEN)
+#define REC_MAX_DELTA_LEN (REC_MAX_ENCODED_LEN + 1)  // plus the change mask
+
+#define REC_DICT_FLAG 0x80
+#define REC_DICT_MAX 127  // 0x7F is the long form escape
+
+#define REC_LONG_ESCAPE 0xFF
+#define REC_LONG_EXT 0x80
+#define REC_LONG_FD 0x40
+#define REC_LONG_BRS 0x20
+
+size_t recEncodedLen(const canRec &rec); // compact form, delta adds at most 1; 0 if not encodable
+size_t recEncode(const canRec &rec, uint8_t *out, size_t cap); // bytes written, 0 if it does not fit
+size_t recDecode(const uint8_t *buf, size_t len, canRec &rec); // bytes consumed, 0 if malformed
+
+#define REC_MIRROR_SIZE 64  // IDs tracked for delta records (FOLLOWER_MAX_CAN_RECORDS)
+
+class RecMirror {
+public:
+  const canRec *find(uint32_t id) const;
+  void store(const canRec &rec);  // new IDs are not tracked once full
+  void clear();
+
+private:
+  IdMap<REC_MIRROR_SIZE * 2> index;
+  canRec recs[REC_MIRROR_SIZE];
+  uint8_t count = 0;
+};
+
+// ref: last record sent for rec.id, or nullptr to force a full record
+size_t recEncodeDelta(const canRec &rec, const canRec *ref, uint8_t *out, size_t cap);
+// Bytes consumed, 0 if malformed. missingRef is set when the record needs
+// history the mirror does not have; rec is then incomplete and must be dropped.
+size_t recDecodeDelta(const uint8_t *buf, size_t len, const RecMirror &mirror, canRec &rec, bool &missingRef);
@@ -0,0 +1,124 @@
+#include <string.h>
+#include "fec.h"
+#include "tdma.h"
+#include "stats.h"
+
+// Running xor of one group of one generation
+struct fecGroup {
+  uint8_t acc[FOLLOWER_PAYLOAD_LEN];
+  uint8_t len;     // longest packet folded in
+  uint8_t lenXor;
+  uint8_t first;   // seq of the group's first packet
+  uint8_t mask;    // bit j: packet first + j * FEC_DEPTH folded in
+  bool used;
+};
+
+static fecGroup txGroups[FEC_DEPTH];
+static int8_t txReady;  // group whose parity waits, -1 if none
+static fecGroup rxGroups[TDMA_FOLLOWERS][FEC_DEPTH];
+
+// Points g at the group starting with first, empty unless it already was
+static void fecStart(fecGroup &g, uint8_t first) {
+  if (!g.used || g.first != first) {
+    memset(g.acc, 0, sizeof(g.acc));
+    g.len = 0;
+    g.lenXor = 0;
+    g.first = first;
+    g.mask = 0;
+    g.used = true;
+  }
+}
+
+static void fecFold(fecGroup &g, uint8_t seq, const uint8_t *pkt, size_t len) {
+  uint8_t first = (uint8_t)(seq - seq % FEC_GENERATION + seq % FEC_DEPTH);
+  fecStart(g, first);
+  if (len > sizeof(g.acc)) {
+    len = sizeof(g.acc);
+  }
+  for (size_t i = 0; i < len; i++) {
+    g.acc[i] ^= pkt[i];
+  }
+  g.len = (len > g.len) ? (uint8_t)len : g.len;
+  g.lenXor ^= (uint8_t)len;
+  g.mask |= (uint8_t)(1u << ((uint8_t)(seq - first) / FEC_DEPTH));
+}
+
+void fecTxReset() {
+  for (fecGroup &g : txGroups) {
+    g.used = false;
+  }
+  txReady = -1;
+}
+
+void fecTxAdd(uint8_t seq, const uint8_t *pkt, size_t len) {
+  uint8_t group = seq % FEC_DEPTH;
+  fecFold(txGroups[group], seq, pkt, len);
+  if ((uint8_t)(seq - txGroups[group].first) / FEC_DEPTH == FEC_K - 1) {
+    txReady = (int8_t)group;
+  }
+}
+
+bool fecTxReady() {
+  return txReady >= 0;
+}
+
+size_t fecTxParityLen() {
+  return (txReady >= 0) ? FEC_PARITY_OVERHEAD + txGroups[txReady].len : 0;
+}
+
+void fecTxParity(uint8_t *out) {
+  fecGroup &g = txGroups[txReady];
+  out[0] = g.first;
+  out[1] = g.mask;
+  out[2] = g.lenXor;
+  memcpy(&out[FEC_PARITY_OVERHEAD], g.acc, g.len);
+  g.used = false;
+  txReady = -1;
+  stats.fecParitySent++;
+}
+
+void fecTxDrop() {
+  if (txReady >= 0) {
+    txGroups[txReady].used = false;
+    txReady = -1;
+    stats.fecParityDropped++;
+  }
+}
+
+void fecRxReset() {
+  for (fecGroup (&groups)[FEC_DEPTH] : rxGroups) {
+    for (fecGroup &g : groups) {
+      g.used = false;
+    }
+  }
+}
+
+void fecRxAdd(uint8_t node, uint8_t seq, const uint8_t *pkt, size_t len) {
+  fecFold(rxGroups[node - 1][seq % FEC_DEPTH], seq, pkt, len);
+}
+
+size_t fecRxParity(uint8_t node, const uint8_t *buf, size_t len, uint8_t *out) {
+  if (len < FEC_PARITY_OVERHEAD) {
+    return 0;
+  }
+  uint8_t first = buf[0];
+  fecGroup &g = rxGroups[node - 1][first % FEC_DEPTH];
+  fecStart(g, first);  // nothing received: a one-packet group can still be rebuilt
+  uint8_t missing = (uint8_t)(buf[1] & ~g.mask);
+  size_t parityLen = len - FEC_PARITY_OVERHEAD;
+  if (missing == 0 || (missing & (missing - 1)) != 0 || parityLen > sizeof(g.acc)) {
+    g.used = false;  // complete, or more lost than one parity can rebuild
+    return 0;
+  }
+  size_t rebuilt = buf[2] ^ g.lenXor;
+  if (rebuilt == 0 || rebuilt > parityLen) {
+    g.used = false;
+    return 0;
+  }
+  for (size_t i = 0; i < rebuilt; i++) {
+    out[i] = buf[FEC_PARITY_OVERHEAD + i] ^ g.acc[i];
+  }
+  g.used = false;
+  stats.fecRebuilt++;
+  return rebuilt;
+}
@@ -0,0 +1,62 @@
+/*
+Uplink erasure coding
+
+XOR parity over groups of uplink packets (TDMA_ENABLE_FEC), so the master
+can rebuild one lost packet per group without a retransmission
+
+Groups:
+- Uplink seq numbers are cut into generations of FEC_K * FEC_DEPTH packets;
+  packet s belongs to group s % FEC_DEPTH of its generation, so a group's
+  FEC_K packets are FEC_DEPTH apart and a burst of up to FEC_DEPTH lost
+  packets hits each group once
+- Code rate FEC_K / (FEC_K + 1): one parity packet per group
+
+Parity packet (TDMA_FORMAT_PARITY, uplink header seq not advanced):
+  [tdmaUplinkHeader][first seq][mask][length xor][xor of the packets]
+- The packets are whole uplink packets (header included), zero padded to
+  the longest; the length byte is the xor of their lengths
+- Bit j of the mask: packet first + j * FEC_DEPTH is covered (a group cut
+  short by a follower restart covers fewer)
+- The follower sends it right after the packet that completes the group,
+  before any other data; one that does not fit a fresh UPLINK is dropped
+
+Master:
+- Keeps the groups of each follower apart (by node, tdma.h)
+- Folds each received packet into its group's running xor (one pass over
+  the packet, no copies kept); on the parity packet, if exactly one packet of
+  the group is missing, parity xor running xor is that packet
+- Rebuilt packets only yield records in TDMA_FORMAT_COMPACT: delta records
+  depend on an order the rebuilt packet arrives too late for. They reach
+  rxBuf up to FEC_K * FEC_DEPTH packets late
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef FEC_K
+#define FEC_K 4  // data packets per parity packet
+#endif
+#ifndef FEC_DEPTH
+#define FEC_DEPTH 2  // interleaved groups
+#endif
+#define FEC_GENERATION (FEC_K * FEC_DEPTH)
+#define FEC_PARITY_OVERHEAD 3  // first seq, packet mask, length xor
+
+static_assert(FEC_K >= 2 && FEC_K <= 8, "FEC_K: group bitmap is 8 bits");
+static_assert(256 % FEC_GENERATION == 0, "FEC generations must tile the 8-bit seq");
+
+// Follower
+void fecTxReset();
+void fecTxAdd(uint8_t seq, const uint8_t *pkt, size_t len);  // after each data packet
+bool fecTxReady();            // a parity packet is waiting
+size_t fecTxParityLen();      // its payload length after the uplink header
+void fecTxParity(uint8_t *out);  // write that payload, clears the parity
+void fecTxDrop();
+
+// Master; node: TDMA_NODE_ID of the follower that sent the packet
+void fecRxReset();
+void fecRxAdd(uint8_t node, uint8_t seq, const uint8_t *pkt, size_t len);  // each received data packet
+// Parity payload in; the rebuilt packet's length, 0 if nothing to rebuild
+size_t fecRxParity(uint8_t node, const uint8_t *buf, size_t len, uint8_t *out);
@@ -0,0 +1,814 @@
+#include <Arduino.h>
+#include <string.h>
+#include "flightlog.h"
+#include "arq.h"
+#include "codec.h"
+#include "gcsstream.h"
+#include "stats.h"
+
+#if FLOG_ENABLE
+
+#define BUF_MASK (FLOG_BUF_LEN - 1)
+#define NO_SEQ 0xFFFFFFFFu
+#define NO_ERASES 0xFFFFu
+#define ENTRY_MAX (5 + 5 + REC_MAX_ENCODED_LEN)  // gap, time, record
+#define BUF_ENTRY_HEADER 9  // [len][seq u32][ms u32] in the RAM buffer
+
+static_assert((FLOG_BUF_LEN & BUF_MASK) == 0, "buffer length must be a power of two");
+static_assert((FLOG_TRACK_SEQS & (FLOG_TRACK_SEQS - 1)) == 0, "window must be a power of two");
+static_assert(sizeof(flogPageHeader) <= FLOG_UNIT, "page header fits one unit");
+static_assert(FLASH_PAGE_SIZE % FLOG_UNIT == 0, "pages hold whole units");
+static_assert(FLOG_ERASE_AHEAD >= 1 && FLOG_ERASE_AHEAD < FLOG_PAGES, "erase budget");
+
+static TdmaRole role;
+
+// ---- Flash --------------------------------------------------------------
+
+static uint32_t pageAddr(uint16_t page) {
+  return FLOG_FLASH_BASE + (uint32_t)page * FLASH_PAGE_SIZE;
+}
+
+static void flashRead(uint32_t addr, void *buf, size_t len) {
+#ifdef BRAGE_HOST
+  simFlashRead(addr, buf, len);
+#else
+  memcpy(buf, (const void *)addr, len);
+#endif
+}
+
+static bool flashProgram(uint32_t addr, const uint8_t *unit) {
+  HAL_FLASH_Unlock();
+#if defined (STM32U5xx)
+  HAL_StatusTypeDef ret = HAL_FLASH_Program(FLASH_TYPEPROGRAM_QUADWORD, addr, (uint32_t)unit);
+#else
+  static_assert(FLOG_UNIT == 8, "doubleword programming");
+  uint64_t doubleword;
+  memcpy(&doubleword, unit, sizeof(doubleword));
+  HAL_StatusTypeDef ret = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, addr, doubleword);
+#endif
+  HAL_FLASH_Lock();
+  return ret == HAL_OK;
+}
+
+static bool flashErase(uint16_t page) {
+  FLASH_EraseInitTypeDef erase = {};
+  erase.TypeErase = FLASH_TYPEERASE_PAGES;
+#ifdef FLOG_FLASH_BANK
+  erase.Banks = FLOG_FLASH_BANK;
+#endif
+  erase.Page = FLOG_FIRST_PAGE + page;
+  erase.NbPages = 1;
+  uint32_t pageError;
+  HAL_FLASH_Unlock();
+  HAL_StatusTypeDef ret = HAL_FLASHEx_Erase(&erase, &pageError);
+  HAL_FLASH_Lock();
+  return ret == HAL_OK;
+}
+
+static bool flashBlank(uint16_t page) {
+  uint8_t chunk[64];
+  for (uint32_t offset = 0; offset < FLASH_PAGE_SIZE; offset += sizeof(chunk)) {
+    flashRead(pageAddr(page) + offset, chunk, sizeof(chunk));
+    for (uint8_t b : chunk) {
+      if (b != 0xFF) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// ---- Entries ------------------------------------------------------------
+
+static void put32(uint8_t *p, uint32_t v) {
+  memcpy(p, &v, sizeof(v));
+}
+
+static uint32_t get32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// One entry; seq and ms hold the previous entry's and become this one's.
+// Bytes consumed, 0 if malformed, cut off or padding
+static size_t parseEntry(const uint8_t *buf, size_t len, uint32_t &seq, uint32_t &ms, canRec &rec) {
+  size_t offset = 0;
+  uint32_t next = seq + 1;
+  if (len > 0 && buf[0] == FLOG_CODE_GAP) {
+    if (len < 5) {
+      return 0;
+    }
+    next += get32(&buf[1]);
+    offset = 5;
+  }
+  if (offset >= len || buf[offset] == FLOG_CODE_PAD || buf[offset] == FLOG_CODE_GAP) {
+    return 0;
+  }
+  uint32_t at = ms + buf[offset];
+  if (buf[offset] == FLOG_CODE_TIME) {
+    if (len < offset + 5) {
+      return 0;
+    }
+    at = get32(&buf[offset + 1]);
+    offset += 4;
+  }
+  offset++;
+  size_t used = recDecode(&buf[offset], len - offset, rec);
+  if (used == 0) {
+    return 0;
+  }
+  seq = next;
+  ms = at;
+  return offset + used;
+}
+
+// Codes for an entry after (seq, ms); bytes written
+static size_t encodeCode(uint8_t *out, uint32_t prevSeq, uint32_t prevMs, uint32_t seq, uint32_t ms, bool absolute) {
+  size_t n = 0;
+  if (seq != prevSeq + 1) {
+    out[n++] = FLOG_CODE_GAP;
+    put32(&out[n], seq - prevSeq - 1);
+    n += 4;
+  }
+  if (absolute || ms - prevMs > FLOG_CODE_DT_MAX) {
+    out[n++] = FLOG_CODE_TIME;
+    put32(&out[n], ms);
+    n += 4;
+  } else {
+    out[n++] = (uint8_t)(ms - prevMs);
+  }
+  return n;
+}
+
+// ---- Follower: writer ---------------------------------------------------
+
+static uint32_t pageFirst[FLOG_PAGES];  // first number per page, NO_SEQ if none
+static bool retired[FLOG_PAGES];
+
+static uint8_t ring[FLOG_BUF_LEN];  // [len][seq][ms][record] per entry
+static uint16_t bufHead;
+static uint16_t bufTail;
+static uint32_t nextSeq;           // next number flogAppend() gives
+static uint32_t lastAppendMs;
+
+static uint16_t headPage;          // being filled
+static bool pageOpen;              // header written, entries go in
+static uint32_t writeAddr;         // next unit to program
+static uint8_t unit[FLOG_UNIT];
+static uint8_t unitFill;
+static uint32_t unitSeq;           // entries below end in unit or before
+static uint32_t flashSeq;          // entries below are programmed
+static uint32_t placedSeq;         // last entry placed in the page
+static uint32_t placedMs;
+
+static uint8_t entry[ENTRY_MAX];   // coded entry going into units
+static uint8_t entryLen;
+static uint8_t entryOff;
+static uint32_t entrySeq;
+
+static uint16_t eraseCount[FLOG_PAGES];  // for the next header, as in the last one
+static bool erased[FLOG_PAGES];    // blank, ahead of headPage
+static uint16_t erasedPages;       // how many, at most FLOG_ERASE_AHEAD
+static uint16_t eraseFront;        // last page erased ahead
+
+static uint16_t bufUsed() {
+  return (uint16_t)(bufTail - bufHead);
+}
+
+static void bufPut(const void *src, size_t len) {
+  const uint8_t *p = (const uint8_t *)src;
+  for (size_t i = 0; i < len; i++) {
+    ring[(bufTail + i) & BUF_MASK] = p[i];
+  }
+  bufTail += len;
+}
+
+static void bufPeek(uint16_t at, void *dst, size_t len) {
+  uint8_t *p = (uint8_t *)dst;
+  for (size_t i = 0; i < len; i++) {
+    p[i] = ring[(bufHead + at + i) & BUF_MASK];
+  }
+}
+
+static uint16_t ringNext(uint16_t page) {
+  return (uint16_t)((page + 1) % FLOG_PAGES);
+}
+
+static void setErasedPages(uint16_t n) {
+  erasedPages = n;
+  stats.flogErasedPages = n;
+  if (n < stats.flogErasedMin) {
+    stats.flogErasedMin = n;
+  }
+}
+
+// Erases the page after the last one erased ahead, skipping retired ones;
+// false if none is left to erase
+static bool eraseNext() {
+  uint16_t page = eraseFront;
+  for (uint16_t tries = 0; tries < FLOG_PAGES; tries++) {
+    page = ringNext(page);
+    if (page == headPage) {
+      return false;  // wrapped around to the page being filled
+    }
+    if (retired[page]) {
+      continue;
+    }
+    if (eraseCount[page] >= FLOG_MAX_ERASES) {
+      retired[page] = true;
+      continue;
+    }
+    eraseFront = page;
+    pageFirst[page] = NO_SEQ;
+    stats.flogErases++;
+    if (!flashErase(page) || !flashBlank(page)) {
+      Serial.printf("[FLOG] Page %u retired\n", page);
+      retired[page] = true;
+      return true;  // next poll tries the one after
+    }
+    eraseCount[page]++;
+    erased[page] = true;
+    setErasedPages(erasedPages + 1);
+    return true;
+  }
+  return false;
+}
+
+static void programUnit() {
+  if (!flashProgram(writeAddr, unit)) {
+    Serial.printf("[FLOG] Program failed at 0x%lx\n", (unsigned long)writeAddr);
+  }
+  writeAddr += FLOG_UNIT;
+  unitFill = 0;
+  flashSeq = unitSeq;
+}
+
+// Starts the first page erased ahead with the entry at the front of buf
+static void openPage(uint32_t firstSeq) {
+  uint16_t page = ringNext(headPage);
+  while (!erased[page]) {
+    page = ringNext(page);  // past retired ones
+  }
+  memset(unit, 0xFF, sizeof(unit));
+  flogPageHeader h = {FLOG_MAGIC, eraseCount[page], firstSeq};
+  memcpy(unit, &h, sizeof(h));
+  headPage = page;
+  erased[page] = false;
+  setErasedPages(erasedPages - 1);
+  writeAddr = pageAddr(headPage);
+  unitFill = FLOG_UNIT;
+  programUnit();
+  pageFirst[headPage] = firstSeq;
+  pageOpen = true;
+}
+
+// Codes the entry at the front of buf into entry[]; false if the page is full
+static bool takeEntry() {
+  uint8_t len;
+  uint32_t seq;
+  uint32_t ms;
+  bufPeek(0, &len, 1);
+  bufPeek(1, &seq, 4);
+  bufPeek(5, &ms, 4);
+  bool first = writeAddr == pageAddr(headPage) + FLOG_UNIT && unitFill == 0;
+  size_t n = encodeCode(entry, first ? seq - 1 : placedSeq, placedMs, seq, ms, first);
+  if (writeAddr + unitFill + n + len > pageAddr(headPage) + FLASH_PAGE_SIZE) {
+    return false;
+  }
+  bufPeek(BUF_ENTRY_HEADER, &entry[n], len);
+  bufHead += BUF_ENTRY_HEADER + len;
+  entryLen = (uint8_t)(n + len);
+  entryOff = 0;
+  entrySeq = seq;
+  placedSeq = seq;
+  placedMs = ms;
+  return true;
+}
+
+// Moves entries into flash while quietUs allows programs
+static void flogWrite(uint32_t quietUs) {
+  while (true) {
+    if (unitFill == FLOG_UNIT) {
+      if (quietUs < FLOG_PROGRAM_US) {
+        return;
+      }
+      quietUs -= FLOG_PROGRAM_US;
+      programUnit();
+      continue;
+    }
+    if (entryOff < entryLen) {
+      uint8_t n = entryLen - entryOff;
+      if (n > FLOG_UNIT - unitFill) {
+        n = FLOG_UNIT - unitFill;
+      }
+      memcpy(&unit[unitFill], &entry[entryOff], n);
+      unitFill += n;
+      entryOff += n;
+      if (entryOff == entryLen) {
+        unitSeq = entrySeq + 1;
+      }
+      continue;
+    }
+    if (bufUsed() == 0) {
+      if (unitFill > 0 && millis() - lastAppendMs >= FLOG_FLUSH_MS) {
+        memset(&unit[unitFill], FLOG_CODE_PAD, FLOG_UNIT - unitFill);
+        unitFill = FLOG_UNIT;
+        continue;
+      }
+      return;
+    }
+    if (!pageOpen) {
+      if (erasedPages == 0 || quietUs < FLOG_PROGRAM_US) {
+        return;
+      }
+      quietUs -= FLOG_PROGRAM_US;
+      uint32_t seq;
+      bufPeek(1, &seq, 4);
+      openPage(seq);
+      continue;
+    }
+    if (!takeEntry()) {
+      // Page full: pad out the last unit, then the next entry opens a page
+      if (unitFill > 0) {
+        memset(&unit[unitFill], FLOG_CODE_PAD, FLOG_UNIT - unitFill);
+        unitFill = FLOG_UNIT;
+      } else {
+        pageOpen = false;
+      }
+    }
+  }
+}
+
+void flogAppend(canRec &rec) {
+  if (role != TDMA_FOLLOWER) {
+    return;
+  }
+  rec.flags |= CAN_REC_LOGGED;
+  rec.logSeq = (uint16_t)nextSeq;
+  uint32_t seq = nextSeq++;
+  uint8_t record[REC_MAX_ENCODED_LEN];
+  uint8_t len = (uint8_t)recEncode(rec, record, sizeof(record));
+  if (len == 0 || FLOG_BUF_LEN - bufUsed() < BUF_ENTRY_HEADER + len) {
+    stats.flogDropped++;  // the gap goes into the log
+    return;
+  }
+  uint32_t ms = millis();
+  bufPut(&len, 1);
+  bufPut(&seq, 4);
+  bufPut(&ms, 4);
+  bufPut(record, len);
+  lastAppendMs = ms;
+}
+
+// Boot: the page with the highest first number is the head; its entries
+// give the next number. A page without a header (erased ahead before the
+// reset) takes the highest erase count found, as the ring wears pages evenly
+static void flogRecover() {
+  bool found = false;
+  uint16_t highest = 0;
+  for (uint16_t p = 0; p < FLOG_PAGES; p++) {
+    flogPageHeader h;
+    flashRead(pageAddr(p), &h, sizeof(h));
+    bool valid = h.magic == FLOG_MAGIC && h.firstSeq != NO_SEQ;
+    pageFirst[p] = valid ? h.firstSeq : NO_SEQ;
+    eraseCount[p] = (h.magic == FLOG_MAGIC) ? h.eraseCount : NO_ERASES;
+    retired[p] = valid && h.eraseCount >= FLOG_MAX_ERASES;
+    if (eraseCount[p] != NO_ERASES && eraseCount[p] > highest) {
+      highest = eraseCount[p];
+    }
+    if (valid && (!found || h.firstSeq > pageFirst[headPage])) {
+      headPage = p;
+      found = true;
+    }
+  }
+  for (uint16_t &count : eraseCount) {
+    if (count == NO_ERASES) {
+      count = highest;
+    }
+  }
+  nextSeq = 0;
+  if (found) {
+    uint32_t seq = pageFirst[headPage] - 1;
+    uint32_t ms = 0;
+    uint32_t addr = pageAddr(headPage) + FLOG_UNIT;
+    uint32_t end = pageAddr(headPage) + FLASH_PAGE_SIZE;
+    while (addr < end) {
+      uint8_t e[ENTRY_MAX];
+      size_t len = (end - addr < sizeof(e)) ? end - addr : sizeof(e);
+      flashRead(addr, e, len);
+      canRec rec;
+      size_t used = parseEntry(e, len, seq, ms, rec);
+      if (used == 0) {
+        // Padding: the next entry starts at the next unit
+        addr = (addr / FLOG_UNIT + 1) * FLOG_UNIT;
+        continue;
+      }
+      addr += used;
+    }
+    nextSeq = seq + 1;
+    Serial.printf("[FLOG] Log continues at %lu (page %u)\n", (unsigned long)nextSeq, headPage);
+  } else {
+    headPage = FLOG_PAGES - 1;  // so page 0 comes first
+    Serial.println("[FLOG] No log found, starting a new one");
+  }
+  flashSeq = unitSeq = nextSeq;
+  eraseFront = headPage;
+}
+
+// ---- Follower: backfill reader ------------------------------------------
+
+struct flogRange {
+  uint32_t seq;
+  uint16_t count;
+};
+
+static flogRange requests[FLOG_REQUESTS];
+static uint8_t requestCount;
+
+// Read position: the entry at rdAddr follows rdSeq / rdMs
+static bool rdValid;
+static uint16_t rdPage;
+static uint32_t rdPageFirst;  // to notice the page being erased
+static uint32_t rdAddr;
+static uint32_t rdSeq;
+static uint32_t rdMs;
+
+static void dropRequest() {
+  memmove(&requests[0], &requests[1], sizeof(requests) - sizeof(requests[0]));
+  requestCount--;
+}
+
+bool flogHandleRequest(const canRec &rec) {
+  if (rec.id != TDMA_CMD_CAN_ID || rec.dlc < 4 || rec.data[0] != TDMA_CMD_BACKFILL) {
+    return false;
+  }
+  if (rec.dlc >= 5 && rec.data[4] != 0 && rec.data[4] != TDMA_NODE_ID) {
+    return true;  // for another follower
+  }
+  stats.flogRequests++;
+  uint16_t seq = rec.data[1] | (rec.data[2] << 8);
+  uint8_t count = rec.data[3];
+  if (count == 0 || nextSeq == 0) {
+    return true;
+  }
+  // The newest logged number with these low bits
+  uint32_t last = nextSeq - 1;
+  uint32_t first = last - (uint16_t)((uint16_t)last - seq);
+  if (first > last) {
+    return true;  // before the log started
+  }
+  for (uint8_t i = 0; i < requestCount; i++) {
+    if (requests[i].seq == first) {
+      return true;  // asked again before it was served
+    }
+  }
+  if (requestCount == FLOG_REQUESTS) {
+    dropRequest();
+  }
+  requests[requestCount++] = {first, count};
+  return true;
+}
+
+bool flogBackfillPending() {
+  return role == TDMA_FOLLOWER && requestCount > 0 && requests[0].seq < flashSeq;
+}
+
+// Page holding seq, -1 if it is no longer logged
+static int16_t pageFor(uint32_t seq) {
+  int16_t found = -1;
+  for (uint16_t p = 0; p < FLOG_PAGES; p++) {
+    if (pageFirst[p] != NO_SEQ && pageFirst[p] <= seq && (found < 0 || pageFirst[p] > pageFirst[found])) {
+      found = (int16_t)p;
+    }
+  }
+  return found;
+}
+
+// Read position at the start of page
+static void seek(uint16_t page) {
+  rdPage = page;
+  rdPageFirst = pageFirst[page];
+  rdAddr = pageAddr(page) + FLOG_UNIT;
+  rdSeq = rdPageFirst - 1;
+  rdMs = 0;
+  rdValid = true;
+}
+
+// Oldest page still logged
+static uint32_t oldestSeq() {
+  uint32_t oldest = NO_SEQ;
+  for (uint32_t first : pageFirst) {
+    if (first < oldest) {
+      oldest = first;
+    }
+  }
+  return oldest;
+}
+
+// Next entry at the read position into e; its length, 0 at the end of what
+// is programmed
+static size_t readEntry(uint8_t *e, uint32_t &seq, uint32_t &ms, canRec &rec) {
+  while (rdValid) {
+    if (pageFirst[rdPage] != rdPageFirst) {
+      rdValid = false;  // erased under us
+      break;
+    }
+    uint32_t end = (rdPage == headPage && pageOpen) ? writeAddr : pageAddr(rdPage) + FLASH_PAGE_SIZE;
+    if (rdAddr >= end) {
+      if (rdPage == headPage) {
+        return 0;  // not programmed yet
+      }
+      // On to the page that continues the numbering
+      uint16_t next = ringNext(rdPage);
+      if (pageFirst[next] == NO_SEQ || pageFirst[next] <= rdPageFirst) {
+        rdValid = false;
+        break;
+      }
+      rdPage = next;
+      rdPageFirst = pageFirst[next];
+      rdAddr = pageAddr(next) + FLOG_UNIT;
+      rdSeq = rdPageFirst - 1;
+      continue;
+    }
+    size_t len = (end - rdAddr < ENTRY_MAX) ? end - rdAddr : ENTRY_MAX;
+    flashRead(rdAddr, e, len);
+    seq = rdSeq;
+    ms = rdMs;
+    size_t used = parseEntry(e, len, seq, ms, rec);
+    if (used == 0) {
+      if (rdPage == headPage && e[0] != FLOG_CODE_PAD) {
+        return 0;
+      }
+      rdAddr = (rdAddr / FLOG_UNIT + 1) * FLOG_UNIT;
+      continue;
+    }
+    return used;
+  }
+  return 0;
+}
+
+size_t flogBackfill(uint8_t *out, size_t cap, uint8_t &num) {
+  num = 0;
+  size_t offset = sizeof(flogBackfillHeader);
+  uint32_t lastSeq = 0;
+  uint32_t lastMs = 0;
+  while (requestCount > 0 && num < FOLLOWER_MAX_CAN_RECORDS) {
+    flogRange &r = requests[0];
+    uint32_t oldest = oldestSeq();
+    if (oldest == NO_SEQ || r.seq + r.count <= oldest) {
+      dropRequest();  // overwritten already
+      continue;
+    }
+    if (r.seq < oldest) {
+      r.count -= (uint16_t)(oldest - r.seq);
+      r.seq = oldest;
+    }
+    if (r.seq >= flashSeq) {
+      break;
+    }
+    int16_t page = pageFor(r.seq);
+    if (page < 0) {
+      dropRequest();
+      continue;
+    }
+    if (!rdValid || rdSeq >= r.seq || pageFirst[rdPage] != rdPageFirst || rdPage != page) {
+      seek((uint16_t)page);
+    }
+
+    uint8_t e[ENTRY_MAX];
+    uint32_t seq;
+    uint32_t ms;
+    canRec rec;
+    size_t used = readEntry(e, seq, ms, rec);
+    if (used == 0) {
+      if (!rdValid) {
+        dropRequest();
+        continue;
+      }
+      break;
+    }
+    if (seq < r.seq) {
+      rdAddr += used;
+      rdSeq = seq;
+      rdMs = ms;
+      continue;
+    }
+    if (seq >= r.seq + r.count) {
+      dropRequest();
+      continue;
+    }
+
+    // Same record bytes, codes for this packet
+    size_t recLen = recEncodedLen(rec);
+    uint8_t codes[10] = {0};
+    size_t n = (num == 0) ? 1 : encodeCode(codes, lastSeq, lastMs, seq, ms, false);
+    if (offset + n + recLen > cap) {
+      break;
+    }
+    if (num == 0) {
+      flogBackfillHeader h = {(uint16_t)seq, ms};
+      memcpy(out, &h, sizeof(h));
+    }
+    memcpy(&out[offset], codes, n);
+    memcpy(&out[offset + n], &e[used - recLen], recLen);
+    offset += n + recLen;
+    num++;
+    lastSeq = seq;
+    lastMs = ms;
+
+    rdAddr += used;
+    rdSeq = seq;
+    rdMs = ms;
+    r.count -= (uint16_t)(seq + 1 - r.seq);
+    r.seq = seq + 1;
+    if (r.count == 0) {
+      dropRequest();
+    }
+  }
+  stats.flogBackfill += num;
+  return num > 0 ? offset : 0;
+}
+
+// ---- Master: tracker ----------------------------------------------------
+
+// One per follower: each numbers its own log
+struct flogTracker {
+  uint8_t seen[FLOG_TRACK_SEQS / 8];
+  bool tracking;
+  uint32_t first;   // first number heard
+  uint32_t head;    // newest + 1
+};
+
+static flogTracker trackers[TDMA_FOLLOWERS];
+static uint32_t lastRequestMs;
+
+// The number with these low bits nearest to the newest one
+static uint32_t trackExtend(const flogTracker &t, uint16_t seq) {
+  uint32_t newest = t.head - 1;
+  return newest + (int16_t)(seq - (uint16_t)newest);
+}
+
+static bool bitSeen(const flogTracker &t, uint32_t seq) {
+  return t.seen[(seq & (FLOG_TRACK_SEQS - 1)) / 8] & (1u << (seq & 7));
+}
+
+static void trackUnmark(flogTracker &t, uint32_t seq) {
+  t.seen[(seq & (FLOG_TRACK_SEQS - 1)) / 8] &= ~(1u << (seq & 7));
+}
+
+// True if seq is new and inside the window
+static bool trackMark(flogTracker &t, uint32_t seq) {
+  if (!t.tracking) {
+    t.tracking = true;
+    t.first = seq;
+    t.head = seq;
+    memset(t.seen, 0, sizeof(t.seen));
+  }
+  if (seq >= t.head) {
+    if (seq - t.head >= FLOG_TRACK_SEQS) {
+      memset(t.seen, 0, sizeof(t.seen));
+    } else {
+      for (uint32_t s = t.head; s <= seq; s++) {
+        trackUnmark(t, s);
+      }
+    }
+    t.head = seq + 1;
+  } else if (t.head - seq > FLOG_TRACK_SEQS || seq < t.first) {
+    return false;
+  }
+  if (bitSeen(t, seq)) {
+    return false;
+  }
+  t.seen[(seq & (FLOG_TRACK_SEQS - 1)) / 8] |= 1u << (seq & 7);
+  return true;
+}
+
+// node 0: every follower
+static void pushRequest(uint16_t seq, uint8_t count, uint8_t node) {
+  canRec cmd;
+  cmd.id = TDMA_CMD_CAN_ID;
+  cmd.dlc = (node != 0) ? 5 : 4;
+  cmd.flags = 0;
+  memset(cmd.data, 0, sizeof(cmd.data));
+  cmd.data[0] = TDMA_CMD_BACKFILL;
+  cmd.data[1] = (uint8_t)seq;
+  cmd.data[2] = (uint8_t)(seq >> 8);
+  cmd.data[3] = count;
+  cmd.data[4] = node;
+  txBuf.push(cmd);
+  stats.flogRequests++;
+}
+
+// Asks each follower for its oldest run not received, settled behind its
+// newest number; one the follower served is marked by the next round. A round
+// waits for an idle downlink (txBuf and the ARQ window empty), so requests
+// never queue ahead of GCS commands and at most one per follower is in flight
+static void requestMissing() {
+  if (millis() - lastRequestMs < FLOG_REQUEST_MS) {
+    return;
+  }
+  if (!txBuf.isEmpty() || (TDMA_ENABLE_ARQ && !arqTxIdle())) {
+    return;
+  }
+  lastRequestMs = millis();
+  for (uint8_t node = 1; node <= TDMA_FOLLOWERS; node++) {
+    const flogTracker &t = trackers[node - 1];
+    if (!t.tracking) {
+      continue;
+    }
+    uint32_t seq = (t.head - t.first > FLOG_TRACK_SEQS) ? t.head - FLOG_TRACK_SEQS : t.first;
+    uint32_t hi = (t.head - seq > FLOG_SETTLE_SEQS) ? t.head - FLOG_SETTLE_SEQS : seq;
+    while (seq < hi && bitSeen(t, seq)) {
+      seq++;
+    }
+    if (seq >= hi) {
+      continue;
+    }
+    uint32_t count = 1;
+    while (count < FLOG_REQUEST_MAX && seq + count < hi && !bitSeen(t, seq + count)) {
+      count++;
+    }
+    pushRequest((uint16_t)seq, (uint8_t)count, (TDMA_FOLLOWERS > 1) ? node : 0);
+  }
+}
+
+void flogForwardRequest(const uint8_t *data, uint8_t dlc) {
+  pushRequest(data[1] | (data[2] << 8), data[3], (dlc >= 5) ? data[4] : 0);
+}
+
+void flogReceived(canRec &rec, uint16_t seq, uint8_t node) {
+  rec.flags |= CAN_REC_LOGGED;
+  rec.logSeq = seq;
+  flogTracker &t = trackers[node - 1];
+  trackMark(t, t.tracking ? trackExtend(t, seq) : seq);
+}
+
+void flogReceiveBackfill(uint8_t node, const uint8_t *buf, size_t len, uint8_t num) {
+  flogTracker &t = trackers[node - 1];
+  flogBackfillHeader h;
+  if (len < sizeof(h) || !t.tracking) {
+    return;
+  }
+  memcpy(&h, buf, sizeof(h));
+  uint32_t seq = trackExtend(t, h.seq) - 1;
+  uint32_t ms = h.ms;
+  size_t offset = sizeof(h);
+  for (uint8_t i = 0; i < num; i++) {
+    canRec rec;
+    size_t used = parseEntry(&buf[offset], len - offset, seq, ms, rec);
+    if (used == 0) {
+      break;
+    }
+    offset += used;
+    if (trackMark(t, seq)) {
+      rec.flags |= CAN_REC_LOGGED;
+      rec.logSeq = (uint16_t)seq;
+      if (gcsStreamBackfill(rec, ms)) {
+        stats.flogBackfill++;
+      } else {
+        trackUnmark(t, seq);  // the stream is busy, ask again
+      }
+    }
+  }
+}
+
+// ---- Both ---------------------------------------------------------------
+
+void flogInit(TdmaRole r) {
+  role = r;
+  if (role != TDMA_FOLLOWER) {
+    return;
+  }
+  flogRecover();
+  // The whole budget, before the radio runs and before FDCAN takes frames
+  while (erasedPages < FLOG_ERASE_AHEAD && eraseNext()) {
+  }
+  stats.flogErasedMin = erasedPages;
+  Serial.printf("[FLOG] %u pages erased ahead\n", erasedPages);
+}
+
+void flogPoll() {
+  if (role != TDMA_FOLLOWER) {
+    requestMissing();
+    return;
+  }
+  uint32_t quietUs = tdmaQuietUs();
+  uint32_t filled = pageOpen ? writeAddr - pageAddr(headPage) : FLASH_PAGE_SIZE;
+  bool urgent = bufUsed() > FLOG_BUF_LEN / 2 || (erasedPages == 0 && filled > FLASH_PAGE_SIZE / 2);
+  if (!urgent && !txBuf.isEmpty()) {
+    return;  // live records first
+  }
+  // On the C0 the erase holds the FDCAN interrupt as well, and the 3-element
+  // RX FIFOs overflow within it on a busy bus: a frame lost there is lost to
+  // the log too. The budget is topped up on a quiet bus only; a busy stretch
+  // logs into it, and once it runs out the log drops records (flogDropped),
+  // not the bridge frames
+  bool busQuiet = !FLOG_HOLDS_IRQS || canRxQuiet(FLOG_BUS_QUIET_US);
+  if (erasedPages < FLOG_ERASE_AHEAD && quietUs >= FLOG_ERASE_US && busQuiet && eraseNext()) {
+    quietUs -= FLOG_ERASE_US;
+  }
+  flogWrite(quietUs);
+}
+
+#endif
@@ -0,0 +1,153 @@
+/*
+Flight log
+
+Store-and-forward copy of every record the follower sends up, kept in
+onboard flash, and backfill of the ranges the ground missed (FLOG_ENABLE;
+build both ends alike)
+
+Logging (follower):
+- flogAppend() numbers every record taken for txBuf (bus frames that pass
+  the rate limits, stats frames) and queues it in a FLOG_BUF_LEN byte RAM
+  buffer; the low 16 bits go up with the record as canRec.logSeq
+  (TDMA_FORMAT_LOG_TAGS, tdma.h), so the master knows which ones it got
+- flogPoll() moves the buffer into flash one program unit (FLOG_UNIT) at a
+  time; a partly filled unit is padded and written after FLOG_FLUSH_MS
+  without new records
+- A full buffer drops the record; its number stays used and the log
+  records the gap
+
+Page layout (region and geometry in pin_config.h):
+- Header unit: flogPageHeader, padded to FLOG_UNIT
+- Entries: [code][record], records in the codec.h compact form; an entry
+  never crosses a page end
+  - code 0x00-0xFC: ms since the previous entry
+  - 0xFD + u32: numbers skipped before this entry, then its own code
+  - 0xFE + u32: millis() of the entry; the first one of a page and after
+    a pause
+  - 0xFF: padding or erased, the next entry starts at the next unit
+
+Wear:
+- Pages are filled in ring order, so erases spread evenly; up to
+  FLOG_ERASE_AHEAD pages after the one being filled are kept erased, so the
+  log keeps the newest FLOG_PAGES - FLOG_ERASE_AHEAD pages with the budget
+  full and more as it is used up
+- Each header carries the page's erase count, read back at boot; a page at
+  FLOG_MAX_ERASES or not blank after an erase is retired. A page erased
+  ahead lost its header, so at boot it takes the highest count found
+- At boot the page with the highest first number is the head; numbering
+  continues after its last entry, in a fresh page
+
+CPU stalls:
+- The C0 has a single flash bank: a program stalls every fetch for
+  FLOG_PROGRAM_US, a page erase for FLOG_ERASE_US, interrupts included
+- flogPoll() only starts one when tdmaQuietUs() leaves that long before
+  anything time-critical (the follower's UPLINK, up to the next DOWNLINK),
+  and only with txBuf empty unless the RAM buffer or the page being filled
+  is half full without room ahead
+- The FDCAN controller keeps receiving through a stall, but its interrupt
+  waits, and 22 ms fill a 3-element RX FIFO on a busy bus. With
+  FLOG_HOLDS_IRQS an erase also waits for canRxQuiet(FLOG_BUS_QUIET_US):
+  a busy stretch logs into the pages erased ahead, and the budget is topped
+  up one page per quiet gap. Only once it runs out does the log fall behind
+  and drop records (flogDropped) rather than bridge frames; a burst during
+  an erase is counted in canRxFifoLost. stats.flogErasedPages is the
+  headroom left, stats.flogErasedMin the lowest it got
+- flogInit() runs before initCan() and erases the whole budget, so the
+  boot erases lose nothing (FLOG_ERASE_AHEAD * FLOG_ERASE_US, 0.7 s on the
+  C0)
+
+Backfill:
+- Master: marks the numbers it receives in a FLOG_TRACK_SEQS window from
+  the first one it heard, one window per follower (tdma.h); every
+  FLOG_REQUEST_MS it asks each for the oldest run it still lacks
+  FLOG_SETTLE_SEQS behind the newest, as a TDMA_CMD_BACKFILL link command in
+  its own txBuf (so ARQ carries it), addressed to that node if there is more
+  than one. A round waits until txBuf and the ARQ window are empty, so
+  requests never delay GCS commands and one per follower is in flight. The
+  same command on the GCS bus is forwarded as well, to every follower if it
+  names no node
+- Follower: takes the command out of rxBuf instead of bridging it, drops it
+  if it names another node, and keeps FLOG_REQUESTS ranges, the oldest
+  dropped first
+- When txBuf is empty in its UPLINK, the follower fills the packet with
+  logged entries of the oldest range (TDMA_FORMAT_BACKFILL, flogBackfillHeader
+  then entries as in flash); live records always go first and the master
+  never sizes UPLINK for backfill
+- The master passes each backfilled record once, to the GCS stream only
+  (gcsstream.h), never to the GCS bus; a lost packet, or a record the
+  stream refused, is asked for again
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "can.h"
+#include "tdma.h"
+
+#ifndef FLOG_ENABLE
+#define FLOG_ENABLE 0
+#endif
+
+#ifndef FLOG_ERASE_AHEAD
+#define FLOG_ERASE_AHEAD (FLOG_PAGES / 2)  // pages kept erased ahead of the one being filled
+#endif
+
+#ifndef FLOG_BUS_QUIET_US
+#define FLOG_BUS_QUIET_US (2 * FLOG_ERASE_US)  // 0: erase on a busy bus too
+#endif
+
+#define FLOG_BUF_LEN 1024      // power of two
+#define FLOG_FLUSH_MS 50
+#define FLOG_MAX_ERASES 10000  // rated endurance
+#define FLOG_MAGIC 0xB10C
+
+#define FLOG_TRACK_SEQS 4096   // master, power of two
+#define FLOG_SETTLE_SEQS 256   // in flight or still queued on the follower
+#define FLOG_REQUEST_MS 200
+#define FLOG_REQUEST_MAX 255   // numbers per request
+#define FLOG_REQUESTS 4        // follower
+
+// Entry codes
+#define FLOG_CODE_DT_MAX 0xFC
+#define FLOG_CODE_GAP 0xFD
+#define FLOG_CODE_TIME 0xFE
+#define FLOG_CODE_PAD 0xFF
+
+struct flogPageHeader {
+  uint16_t magic;       // FLOG_MAGIC
+  uint16_t eraseCount;  // of this page, including the erase before it
+  uint32_t firstSeq;    // number of the first entry
+} __attribute__((packed));
+
+// Start of a TDMA_FORMAT_BACKFILL payload; the first entry's code is 0
+struct flogBackfillHeader {
+  uint16_t seq;  // of the first entry
+  uint32_t ms;
+} __attribute__((packed));
+
+#if FLOG_ENABLE
+void flogInit(TdmaRole role);  // follower: finds the head of the log, erases FLOG_ERASE_AHEAD pages
+void flogPoll();  // run every loop iteration
+void flogAppend(canRec &rec);  // follower: logs rec and sets its logSeq; before txBuf.push()
+bool flogHandleRequest(const canRec &rec);  // follower: true if rec was a backfill command
+bool flogBackfillPending();  // follower: a requested entry is in flash
+// Follower: flogBackfillHeader and entries into out; bytes written, 0 if none
+size_t flogBackfill(uint8_t *out, size_t cap, uint8_t &num);
+void flogForwardRequest(const uint8_t *data, uint8_t dlc);  // master: a GCS bus command
+void flogReceived(canRec &rec, uint16_t seq, uint8_t node);  // master: live record with its number
+void flogReceiveBackfill(uint8_t node, const uint8_t *buf, size_t len, uint8_t num);  // master
+#else
+static inline void flogInit(TdmaRole) {}
+static inline void flogPoll() {}
+static inline void flogAppend(canRec &) {}
+static inline bool flogHandleRequest(const canRec &) { return false; }
+static inline bool flogBackfillPending() { return false; }
+static inline size_t flogBackfill(uint8_t *, size_t, uint8_t &) { return 0; }
+static inline void flogForwardRequest(const uint8_t *, uint8_t) {}
+static inline void flogReceived(canRec &rec, uint16_t seq, uint8_t) {
+  rec.flags |= CAN_REC_LOGGED;
+  rec.logSeq = seq;
+}
+static inline void flogReceiveBackfill(uint8_t, const uint8_t *, size_t, uint8_t) {}
+#endif
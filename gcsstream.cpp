@@ -0,0 +1,126 @@
+#include <Arduino.h>
+#include "gcsstream.h"
+#include "adr.h"
+
+#if GCS_STREAM_ENABLE
+
+#define RING_MASK (GCS_STREAM_BUF_LEN - 1)
+static_assert((GCS_STREAM_BUF_LEN & RING_MASK) == 0, "buffer length must be a power of two");
+static_assert(CAN_MAX_DLEN <= 64, "frame layout holds at most 64 data bytes");
+
+// Main loop only: records are delivered and written out from loop()
+static uint8_t ring[GCS_STREAM_BUF_LEN];
+static uint16_t head;  // next byte to write out
+static uint16_t tail;  // next free byte
+static uint16_t seq;
+static bool midFrame;  // the last write ended inside a frame
+static int roomMax;    // largest availableForWrite() seen: the Serial TX buffer
+static gcsStreamHeader packet;  // node, rx_us, rssi and snr of the current packet
+
+// COBS: every zero is replaced by the distance to the next one, the first
+// code byte leads; out holds len + len / 254 + 1 bytes
+static size_t cobsEncode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t code = 0;
+  size_t o = 1;
+  for (size_t i = 0; i < len; i++) {
+    if (in[i] != 0) {
+      out[o++] = in[i];
+    }
+    if (in[i] == 0 || o - code == 0xFF) {
+      out[code] = (uint8_t)(o - code);
+      code = o++;
+    }
+  }
+  out[code] = (uint8_t)(o - code);
+  return o;
+}
+
+void gcsStreamPacket(uint8_t node, uint32_t rxUs, float rssi, float snr) {
+  packet.node = node;
+  packet.rx_us = rxUs;
+  packet.rssi = adrQuantizeRssi(rssi);
+  packet.snr = adrQuantizeSnr(snr);
+}
+
+static void gcsStreamFrame(gcsStreamHeader &h, const canRec &rec) {
+  uint8_t frame[GCS_STREAM_FRAME_MAX];
+  h.seq = seq++;
+  h.id = (rec.id & GCS_STREAM_ID_MASK) | ((rec.id & CAN_EXT_FLAG) ? GCS_STREAM_ID_EXT : 0) |
+         ((rec.flags & CAN_REC_FD) ? GCS_STREAM_ID_FD : 0) | ((rec.flags & CAN_REC_BRS) ? GCS_STREAM_ID_BRS : 0);
+  h.len = rec.dlc;
+  h.log_seq = (rec.flags & CAN_REC_LOGGED) ? rec.logSeq : 0;
+  memcpy(frame, &h, sizeof(h));
+  memcpy(&frame[sizeof(h)], rec.data, h.len);
+  size_t len = sizeof(h) + h.len;
+  uint16_t crc = gcsStreamCrc(frame, len);
+  frame[len++] = (uint8_t)crc;
+  frame[len++] = (uint8_t)(crc >> 8);
+
+  uint8_t encoded[GCS_STREAM_ENCODED_MAX];
+  size_t n = cobsEncode(frame, len, encoded);
+  encoded[n++] = 0x00;
+  if ((size_t)(GCS_STREAM_BUF_LEN - (uint16_t)(tail - head)) < n) {
+    return;  // dropped, the seq gap tells the host
+  }
+  for (size_t i = 0; i < n; i++) {
+    ring[(tail + i) & RING_MASK] = encoded[i];
+  }
+  tail += n;
+}
+
+void gcsStreamRecord(const canRec &rec) {
+  gcsStreamHeader h = packet;
+  h.type = (rec.flags & CAN_REC_LOGGED) ? GCS_STREAM_TYPE_LOGGED : GCS_STREAM_TYPE_RECORD;
+  gcsStreamFrame(h, rec);
+}
+
+bool gcsStreamBackfill(const canRec &rec, uint32_t logMs) {
+  if ((uint16_t)(tail - head) > GCS_STREAM_BUF_LEN / 2) {
+    return false;
+  }
+  gcsStreamHeader h = packet;
+  h.type = GCS_STREAM_TYPE_BACKFILL;
+  h.rx_us = logMs;  // ms: micros() would wrap after 71 minutes
+  gcsStreamFrame(h, rec);
+  return true;
+}
+
+void gcsStreamPoll() {
+  uint16_t queued = tail - head;
+  if (queued == 0) {
+    return;
+  }
+  uint16_t start = head & RING_MASK;
+  uint16_t chunk = GCS_STREAM_BUF_LEN - start;  // up to the end of the ring
+  if (chunk > queued) {
+    chunk = queued;
+  }
+  int room = Serial.availableForWrite();
+  if (room > roomMax) {
+    roomMax = room;
+  }
+  if (room <= 0) {
+    return;
+  }
+  if (chunk > (uint16_t)room) {
+    chunk = (uint16_t)room;
+  }
+
+  // End on a delimiter, so a log line printed between two writes lands
+  // between frames; only a frame larger than the free space is split
+  uint16_t n = chunk;
+  while (n > 0 && ring[start + n - 1] != 0x00) {
+    n--;
+  }
+  if (n == 0) {
+    if (!midFrame && room < roomMax) {
+      return;  // wait for the TX buffer to drain
+    }
+    n = chunk;
+  }
+  Serial.write(&ring[start], n);
+  head += n;
+  midFrame = ring[start + n - 1] != 0x00;
+}
+
+#endif
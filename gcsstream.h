@@ -0,0 +1,108 @@
+/*
+GCS stream
+
+Binary copy of every record the master's radio delivers, framed for a host
+on the Serial port (GCS_STREAM_ENABLE), so the ground station gets the
+bridged traffic with link metadata without a CAN adapter. The follower does
+not stream: its Serial stays text
+
+Frame (little endian, then COBS encoded and ended by a 0x00 byte):
+- type: GCS_STREAM_TYPE_RECORD, _LOGGED for a record with its flight log
+  number (flightlog.h), _BACKFILL for one sent again from the log
+- node: sender of the radio packet, the follower's TDMA_NODE_ID, so each
+  follower is its own stream
+- seq: counts every frame, also the ones dropped because the buffer was
+  full, so a gap on the host is a lost frame wherever it was lost
+- rx_us: local micros() at the first symbol of the radio packet that
+  carried the record; for _BACKFILL the rocket's millis() when it was
+  logged (ms, so it wraps after 49 days rather than 71 minutes)
+- rssi [dBm], snr [0.25 dB] of that packet
+- id: CAN ID with GCS_STREAM_ID_EXT / _FD / _BRS in the top bits (the ext
+  bit is SocketCAN's CAN_EFF_FLAG), then len
+- log_seq: low 16 bits of the flight log number, 0 for _RECORD
+- then the data bytes
+- crc: CRC-16/CCITT-FALSE over everything before it
+
+Output:
+- gcsStreamRecord() encodes into a GCS_STREAM_BUF_LEN byte ring; a frame
+  that does not fit is dropped whole
+- gcsStreamBackfill() only takes a record while the ring is at most half
+  full, so backfill never crowds out live records; the flight log asks
+  again for one it refused
+- gcsStreamPoll() writes what the Serial TX buffer takes without blocking,
+  one contiguous chunk per loop iteration
+- Serial runs at GCS_STREAM_BAUD; text logs still go out and a line that
+  lands inside a frame costs that frame (the host sees a CRC error and
+  resyncs on the next 0x00)
+
+host/tools/gcs_decode turns the stream into candump lines and reports
+throughput, lost and corrupt frames and which logged numbers never arrived
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef GCS_STREAM_ENABLE
+#define GCS_STREAM_ENABLE 0
+#endif
+
+#define GCS_STREAM_BAUD 921600
+#define GCS_STREAM_BUF_LEN 1024  // power of two
+
+#define GCS_STREAM_TYPE_RECORD 0x01
+#define GCS_STREAM_TYPE_LOGGED 0x02
+#define GCS_STREAM_TYPE_BACKFILL 0x03
+#define GCS_STREAM_ID_EXT 0x80000000u
+#define GCS_STREAM_ID_FD 0x40000000u
+#define GCS_STREAM_ID_BRS 0x20000000u
+#define GCS_STREAM_ID_MASK 0x1FFFFFFFu
+
+struct __attribute__((packed)) gcsStreamHeader {
+  uint8_t type;
+  uint8_t node;
+  uint16_t seq;
+  uint32_t rx_us;
+  int8_t rssi;
+  int8_t snr;
+  uint32_t id;
+  uint8_t len;
+  uint16_t log_seq;
+};  // then len data bytes and the CRC
+
+#define GCS_STREAM_CRC_LEN 2
+#define GCS_STREAM_FRAME_MAX (sizeof(gcsStreamHeader) + 64 + GCS_STREAM_CRC_LEN)  // CAN FD payload
+// COBS adds one byte per 254 and the delimiter
+#define GCS_STREAM_ENCODED_MAX (GCS_STREAM_FRAME_MAX + GCS_STREAM_FRAME_MAX / 254 + 2)
+
+// CRC-16/CCITT-FALSE, bytewise without a table
+static inline uint16_t gcsStreamCrc(const uint8_t *buf, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc = (uint16_t)((crc >> 8) | (crc << 8));
+    crc ^= buf[i];
+    crc ^= (crc & 0xFF) >> 4;
+    crc ^= (uint16_t)(crc << 12);
+    crc ^= (uint16_t)((crc & 0xFF) << 5);
+  }
+  return crc;
+}
+
+// Host tools include the wire format alone
+#ifndef GCS_STREAM_WIRE_ONLY
+#include "can.h"
+
+#if GCS_STREAM_ENABLE
+void gcsStreamPacket(uint8_t node, uint32_t rxUs, float rssi, float snr);  // metadata for the records that follow
+void gcsStreamRecord(const canRec &rec);  // a record went to rxBuf
+bool gcsStreamBackfill(const canRec &rec, uint32_t logMs);  // a record came from the flight log; false if refused
+void gcsStreamPoll();  // run every loop iteration
+#else
+static inline void gcsStreamPacket(uint8_t, uint32_t, float, float) {}
+static inline void gcsStreamRecord(const canRec &) {}
+static inline bool gcsStreamBackfill(const canRec &, uint32_t) { return true; }
+static inline void gcsStreamPoll() {}
+#endif
+
+#endif
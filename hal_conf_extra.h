@@ -3,3 +3,9 @@
 // Enable FDCAN HAL driver so HAL_FDCAN_* symbols are linked in
 #define HAL_FDCAN_MODULE_ENABLED
 
+// TIM16 and FDCAN IT0 share one vector on the C0; keep the core's
+// HardwareTimer from defining that handler so can.cpp can own it
+#if defined (STM32C0xx)
+  #define HAL_TIM_MODULE_ONLY
+#endif
+
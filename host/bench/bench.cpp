@@ -0,0 +1,531 @@
+// Microbenchmarks of the bridge's per-record hot paths: uplink and downlink
+// packet packing (tdmaBuildPacket(), what tdmaTransmit() runs), their parsing
+// (tdmaProcessRx() with processHeader()), the queues records pass through and
+// the DLC conversions. The firmware sources are linked as they are, against
+// the stubs/ stand-ins with a frozen clock; tdma.cpp is included below so its
+// static functions can be called directly.
+//
+//   brage_bench                        table on stdout
+//   brage_bench --json > base.json     one case per line, keep as a baseline
+//   brage_bench --baseline base.json   same table with the change against it
+//
+// Each case runs --rounds rounds of at least --time-ms / rounds and reports
+// the fastest, so scheduler noise raises no number. Timer overhead is
+// measured at start and taken off every timed region.
+
+#include "tdma.cpp"
+#include "sim_api.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+// ---- Host side of sim_api.h: a frozen clock, no radio, no flash -----------
+
+static uint32_t nowUs = 1000000;
+static bool verbose;
+
+uint64_t simHostNowUs() { return nowUs; }
+uint32_t simHostMicros() { return nowUs; }
+void simHostConsume(uint32_t) {}
+void simHostStall(uint32_t) {}
+void simHostLog(const char *text, size_t len) {
+  if (verbose) {
+    fwrite(text, 1, len, stderr);
+  }
+}
+void simHostRadioMode(SimRadioMode) {}
+void simHostRadioTx(const uint8_t *, size_t, uint32_t) {}
+uint32_t simHostTimeOnAir(uint32_t model_us) { return model_us; }
+void simHostSpiConflict() {}
+void simHostTimerArm(uint32_t) {}
+void simHostTimerCancel() {}
+void simHostSpiDma(uint32_t) {}
+void simHostSpiAbort() {}
+const char *simHostFlashFile() { return nullptr; }
+
+// ---- Workload -------------------------------------------------------------
+
+struct Options {
+  double timeMs = 200;  // per case
+  int rounds = 5;
+  int profile = RADIO_PROFILE_DEFAULT;
+  const char *filter = nullptr;  // substring of "bench/mix"
+  const char *baseline = nullptr;
+  bool json = false;
+};
+
+// Payload mixes: data lengths drawn uniformly from dlcMin-dlcMax (valid FD
+// lengths only above 8), IDs from 0x100 up, or 29-bit from 0x18FF0000
+struct Mix {
+  const char *name;
+  uint8_t dlcMin;
+  uint8_t dlcMax;
+  uint16_t ids;
+  bool ext;
+  bool fd;
+};
+
+static const Mix kMixes[] = {
+  {"std8_ids32", 8, 8, 32, false, false},
+  {"std2-8_ids64", 2, 8, 64, false, false},
+  {"std0-8_ids4", 0, 8, 4, false, false},
+  {"ext8_ids32", 8, 8, 32, true, false},
+  {"fd8-64_ids32", 8, 64, 32, false, true},  // CAN_ENABLE_FD=1 builds only
+};
+
+static const uint8_t kBursts[] = {1, 8, 32};  // records queued per packing run
+
+#define BENCH_POOL_LEN 4096  // records generated per mix
+#define BENCH_PKT_MAX 256
+
+static uint32_t rng = 1;
+
+static uint32_t nextRandom() {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+static uint8_t randomLen(const Mix &m) {
+  static const uint8_t kLens[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64};
+  uint8_t options[16];
+  uint8_t n = 0;
+  for (uint8_t len : kLens) {
+    if (len >= m.dlcMin && len <= m.dlcMax) {
+      options[n++] = len;
+    }
+  }
+  return options[nextRandom() % n];
+}
+
+static std::vector<canRec> makePool(const Mix &m) {
+  rng = 1;
+  std::vector<canRec> pool(BENCH_POOL_LEN);
+  for (canRec &rec : pool) {
+    memset(&rec, 0, sizeof(rec));
+    uint32_t n = nextRandom() % m.ids;
+    rec.id = m.ext ? (0x18FF0000u + n) | CAN_EXT_FLAG : 0x100 + n;
+    rec.dlc = randomLen(m);
+    rec.flags = m.fd ? (CAN_REC_FD | CAN_REC_BRS) : 0;
+    for (uint8_t i = 0; i < rec.dlc; i++) {
+      rec.data[i] = (uint8_t)nextRandom();
+    }
+  }
+  return pool;
+}
+
+// ---- Timing ---------------------------------------------------------------
+
+static double timerOverheadNs;
+
+static double clockNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void calibrateTimer() {
+  timerOverheadNs = 1e9;
+  for (int i = 0; i < 10000; i++) {
+    double t0 = clockNs();
+    double t1 = clockNs();
+    if (t1 - t0 < timerOverheadNs) {
+      timerOverheadNs = t1 - t0;
+    }
+  }
+}
+
+// What one pass over the pool did
+struct Pass {
+  double ns = 0;         // timed, overhead removed
+  uint64_t records = 0;
+  uint64_t packets = 0;
+  uint64_t bytes = 0;    // on the wire, headers included
+};
+
+static void addTime(Pass &p, double t0, double t1) {
+  double ns = t1 - t0 - timerOverheadNs;
+  p.ns += ns > 0 ? ns : 0;
+}
+
+// ---- Link state -----------------------------------------------------------
+
+// A node in the middle of its TX slot, every packet sized to the full
+// profile payload: the follower in UPLINK, the master in DOWNLINK
+static void linkSetup(TdmaRole role, uint8_t profile) {
+  tdmaInit(role);
+  tdmaApplyProfile(profile);
+  state.synced = true;
+  state.clockOffsetUs = 0;
+  uint32_t uplinkUs[TDMA_FOLLOWERS];
+  for (uint8_t i = 0; i < TDMA_FOLLOWERS; i++) {
+    uplinkUs[i] = state.timing.uplinkMaxUs;
+    state.uplinkLen[i] = state.timing.payloadLen;
+  }
+  tdmaSetSlots(TDMA_SLOTS_US - TDMA_FOLLOWERS * state.timing.uplinkMaxUs, uplinkUs);
+  state.frameStartUs = nowUs - tdmaTxWindow().startUs;
+  state.currentSlot = tdmaTxWindow().id;
+  state.currentWindow = tdmaTxIndex();
+  txBuf.clear();
+  rxBuf.clear();
+  txBuf.setCoalescing(role == TDMA_FOLLOWER);
+}
+
+static uint8_t packetRecords(TdmaRole role, const uint8_t *pkt) {
+  return (role == TDMA_MASTER) ? ((const tdmaHeader *)pkt)->num_records
+                               : ((const tdmaUplinkHeader *)pkt)->num_records;
+}
+
+// Packs burst records at a time until txBuf (and on the master the ARQ
+// window, acknowledged as it goes) is empty; keeps the packets if asked
+static void packPass(TdmaRole role, const std::vector<canRec> &pool, uint8_t burst, Pass &p,
+                     std::vector<std::vector<uint8_t>> *keep) {
+  uint8_t pkt[BENCH_PKT_MAX];
+  for (size_t i = 0; i < pool.size(); i += burst) {
+    for (size_t j = i; j < i + burst && j < pool.size(); j++) {
+      txBuf.push(pool[j]);
+    }
+    state.slotTxCount = 0;
+    double t0 = clockNs();
+    for (;;) {
+      size_t len = tdmaBuildPacket(pkt);
+      if (len == 0) {
+        break;
+      }
+      uint8_t n = packetRecords(role, pkt);
+      txBuf.commit();
+      if (TDMA_ENABLE_ARQ && role == TDMA_MASTER) {
+        arqTxAck(1, (uint8_t)(arqTxBase() + n), 0);
+      }
+      state.slotTxCount++;
+      p.records += n;
+      p.packets++;
+      p.bytes += len;
+      if (keep != nullptr) {
+        keep->emplace_back(pkt, pkt + len);
+      }
+    }
+    addTime(p, t0, clockNs());
+    txBuf.clear();  // a record the packet could not take
+  }
+}
+
+// ---- Benchmarks -------------------------------------------------------------
+
+typedef void (*BenchFn)(const std::vector<canRec> &pool, uint8_t burst, Pass &p);
+
+static uint8_t benchProfile;
+static std::vector<std::vector<uint8_t>> corpus;  // packets of the last pack run
+
+// canLenDlc() and canDlcLen() of every record's length
+static void benchDlc(const std::vector<canRec> &pool, uint8_t, Pass &p) {
+  volatile uint8_t sink = 0;
+  double t0 = clockNs();
+  for (const canRec &rec : pool) {
+    sink = sink + canDlcLen(canLenDlc(rec.dlc));
+  }
+  addTime(p, t0, clockNs());
+  p.records += pool.size();
+}
+
+// rxBuf's class queue: push() burst records, then shift() them
+static void benchRing(const std::vector<canRec> &pool, uint8_t burst, Pass &p) {
+  static CircularBuffer<canRec, CAN_QUEUE_LEN_NORMAL> ring;
+  volatile uint32_t sink = 0;
+  double t0 = clockNs();
+  for (size_t i = 0; i < pool.size(); i += burst) {
+    size_t end = (i + burst < pool.size()) ? i + burst : pool.size();
+    for (size_t j = i; j < end; j++) {
+      ring.push(pool[j]);
+    }
+    while (!ring.isEmpty()) {
+      sink = sink + ring.shift().id;
+    }
+  }
+  addTime(p, t0, clockNs());
+  p.records += pool.size();
+}
+
+// txBuf as on the follower (coalescing): push() burst records, take() and
+// commit() what is left of them; per record pushed
+static void benchTxQueue(const std::vector<canRec> &pool, uint8_t burst, Pass &p) {
+  txBuf.clear();
+  txBuf.setCoalescing(true);
+  volatile uint32_t sink = 0;
+  double t0 = clockNs();
+  for (size_t i = 0; i < pool.size(); i += burst) {
+    size_t end = (i + burst < pool.size()) ? i + burst : pool.size();
+    for (size_t j = i; j < end; j++) {
+      txBuf.push(pool[j]);
+    }
+    while (!txBuf.isEmpty()) {
+      sink = sink + txBuf.take().id;
+    }
+    txBuf.commit();
+  }
+  addTime(p, t0, clockNs());
+  p.records += pool.size();
+}
+
+// Per record packed: coalescing leaves fewer than were pushed
+static void benchPackUp(const std::vector<canRec> &pool, uint8_t burst, Pass &p) {
+  linkSetup(TDMA_FOLLOWER, benchProfile);
+  packPass(TDMA_FOLLOWER, pool, burst, p, nullptr);
+}
+
+static void benchPackDown(const std::vector<canRec> &pool, uint8_t burst, Pass &p) {
+  linkSetup(TDMA_MASTER, benchProfile);
+  packPass(TDMA_MASTER, pool, burst, p, nullptr);
+}
+
+static void corpusUp(const std::vector<canRec> &pool, uint8_t burst, Pass &p) {
+  linkSetup(TDMA_FOLLOWER, benchProfile);
+  corpus.clear();
+  packPass(TDMA_FOLLOWER, pool, burst, p, &corpus);
+}
+
+static void corpusDown(const std::vector<canRec> &pool, uint8_t burst, Pass &p) {
+  linkSetup(TDMA_MASTER, benchProfile);
+  corpus.clear();
+  packPass(TDMA_MASTER, pool, burst, p, &corpus);
+}
+
+// The packets corpusUp() / corpusDown() built, received by the other role
+static void parsePass(TdmaRole role, Pass &p) {
+  linkSetup(role, benchProfile);
+  double t0 = clockNs();
+  for (const std::vector<uint8_t> &pkt : corpus) {
+    tdmaProcessRx(pkt.data(), pkt.size(), nowUs, true, -70, 8);
+    p.records += packetRecords((role == TDMA_MASTER) ? TDMA_FOLLOWER : TDMA_MASTER, pkt.data());
+    p.packets++;
+    p.bytes += pkt.size();
+  }
+  addTime(p, t0, clockNs());
+}
+
+static void benchParseUp(const std::vector<canRec> &, uint8_t, Pass &p) {
+  parsePass(TDMA_MASTER, p);
+}
+
+static void benchParseDown(const std::vector<canRec> &, uint8_t, Pass &p) {
+  parsePass(TDMA_FOLLOWER, p);
+}
+
+struct Bench {
+  const char *name;
+  BenchFn fn;
+  bool burst;  // runs once per kBursts entry
+  BenchFn setup;  // run once before the rounds, untimed
+};
+
+// parse_* replay the packets pack_* builds for the same mix and burst
+static const Bench kBenches[] = {
+  {"dlc", benchDlc, false, nullptr},
+  {"ring", benchRing, true, nullptr},
+  {"txqueue", benchTxQueue, true, nullptr},
+  {"pack_up", benchPackUp, true, nullptr},
+  {"parse_up", benchParseUp, true, corpusUp},
+  {"pack_down", benchPackDown, true, nullptr},
+  {"parse_down", benchParseDown, true, corpusDown},
+};
+
+// ---- Cases and report -----------------------------------------------------
+
+struct Result {
+  std::string bench;
+  std::string mix;
+  int burst;
+  double nsPerRecord;
+  double recordsPerS;
+  double bytesPerRecord;   // wire bytes, 0 where nothing is packed
+  double recordsPerPacket;
+};
+
+static Result runCase(const Options &opt, const Bench &b, const Mix &m, const std::vector<canRec> &pool,
+                      uint8_t burst) {
+  if (b.setup != nullptr) {
+    Pass ignored;
+    b.setup(pool, burst, ignored);
+  }
+  double roundNs = opt.timeMs * 1e6 / opt.rounds;
+  double best = 0;
+  Pass bestPass;
+  for (int r = 0; r < opt.rounds; r++) {
+    Pass p;
+    double start = clockNs();
+    do {
+      b.fn(pool, burst, p);
+    } while (clockNs() - start < roundNs);
+    double ns = p.records ? p.ns / p.records : 0;
+    if (r == 0 || ns < best) {
+      best = ns;
+      bestPass = p;
+    }
+  }
+  Result res;
+  res.bench = b.name;
+  res.mix = m.name;
+  res.burst = b.burst ? burst : 0;
+  res.nsPerRecord = best;
+  res.recordsPerS = best > 0 ? 1e9 / best : 0;
+  res.bytesPerRecord = (bestPass.packets && bestPass.records) ? (double)bestPass.bytes / bestPass.records : 0;
+  res.recordsPerPacket = bestPass.packets ? (double)bestPass.records / bestPass.packets : 0;
+  return res;
+}
+
+static void printJson(const Result &r) {
+  printf("{\"bench\":\"%s\",\"mix\":\"%s\",\"burst\":%d,\"ns_per_record\":%.2f,\"records_per_s\":%.0f,"
+         "\"bytes_per_record\":%.2f,\"records_per_packet\":%.2f}",
+         r.bench.c_str(), r.mix.c_str(), r.burst, r.nsPerRecord, r.recordsPerS, r.bytesPerRecord,
+         r.recordsPerPacket);
+}
+
+// ns_per_record of a case in a --json output, -1 if it is not there
+static double baselineNs(const std::vector<std::string> &lines, const Result &r) {
+  char key[128];
+  snprintf(key, sizeof(key), "{\"bench\":\"%s\",\"mix\":\"%s\",\"burst\":%d,", r.bench.c_str(), r.mix.c_str(),
+           r.burst);
+  for (const std::string &line : lines) {
+    size_t at = line.find(key);
+    size_t ns = line.find("\"ns_per_record\":", at);
+    if (at != std::string::npos && ns != std::string::npos) {
+      return atof(line.c_str() + ns + strlen("\"ns_per_record\":"));
+    }
+  }
+  return -1;
+}
+
+static bool loadBaseline(const char *path, std::vector<std::string> &lines) {
+  FILE *f = fopen(path, "r");
+  if (f == nullptr) {
+    perror(path);
+    return false;
+  }
+  char buf[512];
+  while (fgets(buf, sizeof(buf), f) != nullptr) {
+    lines.push_back(buf);
+  }
+  fclose(f);
+  return true;
+}
+
+static void usage(const char *argv0) {
+  printf("Usage: %s [options]\n"
+         "  --time-ms N          time per case (200)\n"
+         "  --rounds N           rounds per case, the fastest is reported (5)\n"
+         "  --profile N          radio profile packets are sized for (RADIO_PROFILE_DEFAULT)\n"
+         "  --filter S           only cases whose bench/mix contains S\n"
+         "  --json               one JSON object, one case per line\n"
+         "  --baseline FILE      compare with an earlier --json output\n"
+         "  -v                   print firmware Serial output\n",
+         argv0);
+}
+
+int main(int argc, char **argv) {
+  Options opt;
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    const char *v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+    if (a == "-h" || a == "--help") {
+      usage(argv[0]);
+      return 0;
+    } else if (a == "--json") {
+      opt.json = true;
+    } else if (a == "-v") {
+      verbose = true;
+    } else if (a == "--time-ms" && v) {
+      opt.timeMs = atof(v);
+      i++;
+    } else if (a == "--rounds" && v) {
+      opt.rounds = atoi(v);
+      i++;
+    } else if (a == "--profile" && v) {
+      opt.profile = atoi(v);
+      i++;
+    } else if (a == "--filter" && v) {
+      opt.filter = v;
+      i++;
+    } else if (a == "--baseline" && v) {
+      opt.baseline = v;
+      i++;
+    } else {
+      fprintf(stderr, "Bad option: %s\n", a.c_str());
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (opt.rounds < 1 || opt.timeMs <= 0 || opt.profile < 0 || opt.profile >= RADIO_PROFILE_COUNT) {
+    usage(argv[0]);
+    return 2;
+  }
+  std::vector<std::string> baseline;
+  if (opt.baseline != nullptr && !loadBaseline(opt.baseline, baseline)) {
+    return 1;
+  }
+
+  initRadio();
+  calibrateTimer();
+  benchProfile = (uint8_t)opt.profile;
+  linkSetup(TDMA_FOLLOWER, benchProfile);
+  uint8_t payloadLen = state.timing.payloadLen;
+
+  if (opt.json) {
+    printf("{\"profile\":\"%s\",\"payload_len\":%u,\"can_max_dlen\":%u,\"timer_overhead_ns\":%.1f,\"cases\":[\n",
+           kRadioProfiles[benchProfile].name, payloadLen, CAN_MAX_DLEN, timerOverheadNs);
+  } else {
+    printf("profile %s, %u byte packets, timer overhead %.1f ns\n", kRadioProfiles[benchProfile].name,
+           payloadLen, timerOverheadNs);
+    printf("%-11s %-14s %5s %10s %12s %8s %8s%s\n", "bench", "mix", "burst", "ns/rec", "rec/s", "B/rec",
+           "rec/pkt", baseline.empty() ? "" : "   vs base");
+  }
+
+  bool first = true;
+  for (const Mix &m : kMixes) {
+    if (m.dlcMax > CAN_MAX_DLEN) {
+      continue;
+    }
+    std::vector<canRec> pool = makePool(m);
+    for (const Bench &b : kBenches) {
+      std::string name = std::string(b.name) + "/" + m.name;
+      if (opt.filter != nullptr && name.find(opt.filter) == std::string::npos) {
+        continue;
+      }
+      size_t bursts = b.burst ? sizeof(kBursts) : 1;
+      for (size_t k = 0; k < bursts; k++) {
+        Result r = runCase(opt, b, m, pool, kBursts[k]);
+        if (opt.json) {
+          printf("%s", first ? "" : ",\n");
+          printJson(r);
+          first = false;
+          continue;
+        }
+        char burst[8] = "-";
+        char bytes[16] = "-";
+        char perPacket[16] = "-";
+        if (r.burst > 0) {
+          snprintf(burst, sizeof(burst), "%d", r.burst);
+        }
+        if (r.recordsPerPacket > 0) {
+          snprintf(bytes, sizeof(bytes), "%.2f", r.bytesPerRecord);
+          snprintf(perPacket, sizeof(perPacket), "%.2f", r.recordsPerPacket);
+        }
+        printf("%-11s %-14s %5s %10.1f %12.0f %8s %8s", r.bench.c_str(), r.mix.c_str(), burst, r.nsPerRecord,
+               r.recordsPerS, bytes, perPacket);
+        double base = baselineNs(baseline, r);
+        if (base > 0) {
+          printf("   %+7.1f%%", 100.0 * (r.nsPerRecord - base) / base);
+        }
+        printf("\n");
+      }
+    }
+  }
+  if (opt.json) {
+    printf("\n]}\n");
+  }
+  return 0;
+}
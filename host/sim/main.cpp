@@ -0,0 +1,366 @@
+#include "sim.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+
+static void usage(const char *argv0) {
+  printf("Usage: %s [options]\n"
+         "  --duration S         simulated seconds (10)\n"
+         "  --warmup S           seconds excluded from scoring (1)\n"
+         "  --seed N             random seed (1)\n"
+         "  --loss P             mean radio packet loss probability (0)\n"
+         "  --loss-burst N       mean loss burst length in packets (1 = independent)\n"
+         "  --toa-scale F        scale the air time against the firmware's estimate (1)\n"
+         "  --loop-us N          loop() overhead besides stubbed calls (20)\n"
+         "  --followers N        followers, each with its own rocket bus and --up traffic (1);\n"
+         "                       needs images built with make FOLLOWERS=N\n"
+         "  --ppm F              follower crystal error in ppm, sign alternating by follower (20)\n"
+         "  --can-kbps F         CAN nominal bit rate (500)\n"
+         "  --can-data-kbps F    CAN FD data phase bit rate (2000)\n"
+         "  --rssi F / --snr F   link quality reported by the receiver (-70 / 8)\n"
+         "  --rssi-end F         ramp RSSI to F over the run (--rssi); SNR falls near the noise floor\n"
+         "  --up-rate F          rocket bus frames/s to bridge (400)\n"
+         "  --up-ids N           distinct rocket IDs (16)\n"
+         "  --up-dlc A-B         rocket frame data bytes (2-4), up to 64 with --up-fd\n"
+         "  --up-ext / --up-fd   rocket frames with 29-bit IDs / as CAN FD with BRS\n"
+         "  --down-rate F        GCS bus frames/s to bridge (5)\n"
+         "  --down-ids N         distinct GCS IDs (4)\n"
+         "  --down-dlc A-B       GCS frame data bytes (1-8), up to 64 with --down-fd\n"
+         "  --down-ext / --down-fd  GCS frames with 29-bit IDs / as CAN FD with BRS\n"
+         "  --up-crit-rate F     critical rocket IDs 0x010.. frames/s, scored separately (0)\n"
+         "  --down-crit-rate F   critical GCS IDs 0x020.. frames/s, scored separately (0)\n"
+"  --gcs-frame S:ID:HEX one-off GCS bus frame at S seconds, e.g. 3:7E0:0104 (repeatable)\n"
+         "  --node-dir DIR       directory with node_master.so / node_follower.so\n"
+         "  --serial-out FILE    write the master's raw Serial output to FILE\n"
+         "  --flash-file FILE    back the (first) follower's flash with FILE, kept across runs\n"
+         "  --json               machine-readable report\n"
+         "  -v                   print firmware Serial output\n",
+         argv0);
+}
+
+static bool parseDlc(const char *s, TrafficConfig &tc) {
+  int a, b;
+  if (sscanf(s, "%d-%d", &a, &b) != 2 || a < 0 || b < a || b > 64) {
+    return false;
+  }
+  tc.dlcMin = (uint8_t)a;
+  tc.dlcMax = (uint8_t)b;
+  return true;
+}
+
+// Classic frames carry up to 8 bytes; FD ones need a valid FD length in range
+static bool checkDlc(const TrafficConfig &tc) {
+  if (!tc.fd) {
+    return tc.dlcMax <= 8;
+  }
+  static const uint8_t kFdLens[] = {12, 16, 20, 24, 32, 48, 64};
+  if (tc.dlcMin <= 8) {
+    return true;
+  }
+  for (uint8_t len : kFdLens) {
+    if (len >= tc.dlcMin && len <= tc.dlcMax) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool parseInject(const char *s, SimConfig &cfg) {
+  InjectFrame f = {};
+  char hex[17] = {};
+  unsigned id;
+  if (sscanf(s, "%lf:%x:%16[0-9a-fA-F]", &f.atS, &id, hex) < 2 || f.atS < 0 || id > 0x7FF) {
+    return false;
+  }
+  size_t n = strlen(hex);
+  if (n % 2 != 0) {
+    return false;
+  }
+  f.frame.id = id;
+  f.frame.len = (uint8_t)(n / 2);
+  for (size_t i = 0; i < f.frame.len; i++) {
+    unsigned b;
+    sscanf(hex + 2 * i, "%2x", &b);
+    f.frame.data[i] = (uint8_t)b;
+  }
+  cfg.gcsFrames.push_back(f);
+  return true;
+}
+
+static std::string exeDir() {
+  char buf[PATH_MAX];
+  ssize_t n = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+  if (n <= 0) {
+    return ".";
+  }
+  buf[n] = 0;
+  std::string path(buf);
+  size_t slash = path.rfind('/');
+  return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+static double percentile(std::vector<uint32_t> &v, double p) {
+  if (v.empty()) {
+    return 0.0;
+  }
+  size_t i = (size_t)(p * (double)(v.size() - 1) + 0.5);
+  return v[i] / 1000.0;
+}
+
+struct Summary {
+  double fps;
+  double ratio;
+  double p50, p90, p99, max;
+};
+
+static Summary summarize(LatencyStats &s, double seconds) {
+  std::sort(s.latencyUs.begin(), s.latencyUs.end());
+  Summary r;
+  r.fps = seconds > 0 ? s.delivered / seconds : 0.0;
+  r.ratio = s.generated ? (double)s.delivered / (double)s.generated : 0.0;
+  r.p50 = percentile(s.latencyUs, 0.50);
+  r.p90 = percentile(s.latencyUs, 0.90);
+  r.p99 = percentile(s.latencyUs, 0.99);
+  r.max = s.latencyUs.empty() ? 0.0 : s.latencyUs.back() / 1000.0;
+  return r;
+}
+
+#define DIRS 4
+
+static void printText(const SimReport &rep, LatencyStats *dirs[DIRS], Summary sums[DIRS]) {
+  const char *dirNames[DIRS] = {"uplink (rocket->GCS)", "downlink (GCS->rocket)",
+                                "uplink critical", "downlink critical"};
+  printf("Simulated %.1f s (scored)\n\n", rep.measuredS);
+  for (int d = 0; d < DIRS; d++) {
+    const LatencyStats &s = *dirs[d];
+    if (d >= 2 && s.generated == 0) {
+      continue;
+    }
+    const Summary &m = sums[d];
+    printf("%s\n", dirNames[d]);
+    printf("  generated   %8llu\n", (unsigned long long)s.generated);
+    printf("  delivered   %8llu  (%.1f%%, %.1f frames/s)\n", (unsigned long long)s.delivered,
+           100.0 * m.ratio, m.fps);
+    printf("  duplicates  %8llu\n", (unsigned long long)s.duplicates);
+    printf("  latency ms  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n\n", m.p50, m.p90, m.p99, m.max);
+  }
+  if (rep.nodes > 2) {
+    printf("uplink by follower\n");
+    for (int k = 0; k + 1 < rep.nodes; k++) {
+      LatencyStats s = rep.upNode[k];
+      Summary m = summarize(s, rep.measuredS);
+      printf("  %-10s  %8llu of %8llu  (%.1f%%, %.1f frames/s)  p99 %.1f ms\n", rep.node[k + 1].name,
+             (unsigned long long)s.delivered, (unsigned long long)s.generated, 100.0 * m.ratio, m.fps, m.p99);
+    }
+    printf("\n");
+  }
+  for (int i = 0; i < rep.nodes; i++) {
+    const NodeReport &n = rep.node[i];
+    double samples = n.probeSamples ? (double)n.probeSamples : 1.0;
+    printf("%s\n", n.name);
+    printf("  radio tx    %8llu pkts %8llu bytes  airtime %.1f%%\n", (unsigned long long)n.radioTx,
+           (unsigned long long)n.radioTxBytes, 100.0 * n.airtimeUs / (rep.totalS * 1e6));
+    printf("  radio rx    %8llu ok %8llu crc %8llu missed\n", (unsigned long long)n.radioRxOk,
+           (unsigned long long)n.radioRxCrc, (unsigned long long)n.radioMissed);
+    printf("  fifo lost   %8llu\n", (unsigned long long)n.fifoLost);
+    printf("  spi clash   %8llu RadioLib calls while the DMA queue held the bus\n",
+           (unsigned long long)n.spiConflicts);
+    printf("  bus extra   %8llu frames from the bridge not sent by a generator\n",
+           (unsigned long long)rep.extraFrames[i]);
+    printf("  txBuf       avg %.1f max %u\n", n.txQueuedSum / samples, n.txQueuedMax);
+    printf("  rxBuf       avg %.1f max %u\n", n.rxQueuedSum / samples, n.rxQueuedMax);
+    printf("  drops       tx %u/%u/%u  rx %u/%u/%u  (critical/normal/bulk)\n", n.txDropped[0],
+           n.txDropped[1], n.txDropped[2], n.rxDropped[0], n.rxDropped[1], n.rxDropped[2]);
+    printf("  tx slots    %8u timer %8u polled  late max %u us\n", n.txTimerStarts, n.txPolledStarts,
+           n.txLateMaxUs);
+    if (n.flogErases > 0) {
+      printf("  flight log  %8u erases %8u dropped  erased ahead %u pages, min %u\n", n.flogErases,
+             n.flogDropped, n.flogErasedPages, n.flogErasedMin);
+    }
+    if (!n.syncErrorUs.empty()) {
+      std::vector<uint32_t> err = n.syncErrorUs;
+      std::sort(err.begin(), err.end());
+      printf("  sync error  us p50 %.0f  p99 %.0f  max %u\n", percentile(err, 0.50) * 1000.0,
+             percentile(err, 0.99) * 1000.0, err.back());
+    }
+    for (int k = 0; i == 0 && rep.nodes > 2 && k + 1 < rep.nodes; k++) {
+      printf("  %-10s  %8u pkts %8u lost %8u records\n", rep.node[k + 1].name, n.nodePackets[k], n.nodeLost[k],
+             n.nodeRecords[k]);
+    }
+    printf("\n");
+  }
+}
+
+static void printJson(const SimReport &rep, LatencyStats *dirs[DIRS], Summary sums[DIRS]) {
+  const char *dirNames[DIRS] = {"up", "down", "up_crit", "down_crit"};
+  printf("{\"seconds\":%.1f", rep.measuredS);
+  for (int d = 0; d < DIRS; d++) {
+    const Summary &m = sums[d];
+    printf(",\"%s\":{\"generated\":%llu,\"delivered\":%llu,\"duplicates\":%llu,\"fps\":%.2f,"
+           "\"ratio\":%.4f,\"p50_ms\":%.2f,\"p90_ms\":%.2f,\"p99_ms\":%.2f,\"max_ms\":%.2f}",
+           dirNames[d], (unsigned long long)dirs[d]->generated, (unsigned long long)dirs[d]->delivered,
+           (unsigned long long)dirs[d]->duplicates, m.fps, m.ratio, m.p50, m.p90, m.p99, m.max);
+  }
+  for (int i = 0; i < rep.nodes; i++) {
+    const NodeReport &n = rep.node[i];
+    double samples = n.probeSamples ? (double)n.probeSamples : 1.0;
+    printf(",\"%s\":{\"extra_frames\":%llu,\"radio_tx\":%llu,\"radio_tx_bytes\":%llu,\"radio_rx_ok\":%llu,\"radio_rx_crc\":%llu,"
+           "\"radio_missed\":%llu,\"fifo_lost\":%llu,\"spi_conflicts\":%llu,\"tx_buf_avg\":%.2f,\"tx_buf_max\":%u,"
+           "\"rx_buf_avg\":%.2f,\"rx_buf_max\":%u,\"tx_dropped\":[%u,%u,%u],\"rx_dropped\":[%u,%u,%u],"
+           "\"flog_erases\":%u,\"flog_dropped\":%u,\"flog_erased\":%u,\"flog_erased_min\":%u}",
+           n.name, (unsigned long long)rep.extraFrames[i], (unsigned long long)n.radioTx,
+           (unsigned long long)n.radioTxBytes, (unsigned long long)n.radioRxOk, (unsigned long long)n.radioRxCrc,
+           (unsigned long long)n.radioMissed, (unsigned long long)n.fifoLost,
+           (unsigned long long)n.spiConflicts, n.txQueuedSum / samples,
+           n.txQueuedMax, n.rxQueuedSum / samples, n.rxQueuedMax, n.txDropped[0], n.txDropped[1],
+           n.txDropped[2], n.rxDropped[0], n.rxDropped[1], n.rxDropped[2], n.flogErases, n.flogDropped,
+           n.flogErasedPages, n.flogErasedMin);
+  }
+  if (rep.nodes > 2) {
+    const NodeReport &master = rep.node[0];
+    printf(",\"up_nodes\":[");
+    for (int k = 0; k + 1 < rep.nodes; k++) {
+      LatencyStats s = rep.upNode[k];
+      Summary m = summarize(s, rep.measuredS);
+      printf("%s{\"node\":%d,\"generated\":%llu,\"delivered\":%llu,\"fps\":%.2f,\"ratio\":%.4f,\"p99_ms\":%.2f,"
+             "\"packets\":%u,\"lost\":%u,\"records\":%u}",
+             k ? "," : "", k + 1, (unsigned long long)s.generated, (unsigned long long)s.delivered, m.fps, m.ratio,
+             m.p99, master.nodePackets[k], master.nodeLost[k], master.nodeRecords[k]);
+    }
+    printf("]");
+  }
+  printf("}\n");
+}
+
+int main(int argc, char **argv) {
+  SimConfig cfg;
+  cfg.nodeDir = exeDir();
+  bool rssiEnd = false;
+
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    const char *v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+    bool ok = true;
+    if (a == "-h" || a == "--help") {
+      usage(argv[0]);
+      return 0;
+    } else if (a == "-v") {
+      cfg.verbose = true;
+      continue;
+    } else if (a == "--json") {
+      cfg.json = true;
+      continue;
+    } else if (a == "--up-ext") {
+      cfg.up.ext = true;
+      continue;
+    } else if (a == "--up-fd") {
+      cfg.up.fd = true;
+      continue;
+    } else if (a == "--down-ext") {
+      cfg.down.ext = true;
+      continue;
+    } else if (a == "--down-fd") {
+      cfg.down.fd = true;
+      continue;
+    } else if (v == nullptr) {
+      ok = false;
+    } else if (a == "--duration") {
+      cfg.durationS = atof(v);
+    } else if (a == "--warmup") {
+      cfg.warmupS = atof(v);
+    } else if (a == "--seed") {
+      cfg.seed = (uint32_t)strtoul(v, nullptr, 0);
+    } else if (a == "--loss") {
+      cfg.loss = atof(v);
+    } else if (a == "--loss-burst") {
+      cfg.lossBurst = atof(v);
+    } else if (a == "--toa-scale") {
+      cfg.toaScale = atof(v);
+    } else if (a == "--loop-us") {
+      cfg.loopUs = (uint32_t)strtoul(v, nullptr, 0);
+    } else if (a == "--followers") {
+      int n = atoi(v);
+      ok = n >= 1 && n <= SIM_MAX_FOLLOWERS;
+      cfg.followers = (uint8_t)n;
+    } else if (a == "--ppm") {
+      cfg.followerPpm = atof(v);
+    } else if (a == "--can-kbps") {
+      cfg.canKbps = atof(v);
+    } else if (a == "--can-data-kbps") {
+      cfg.canDataKbps = atof(v);
+    } else if (a == "--rssi") {
+      cfg.rssi = (float)atof(v);
+    } else if (a == "--rssi-end") {
+      cfg.rssiEnd = (float)atof(v);
+      rssiEnd = true;
+    } else if (a == "--snr") {
+      cfg.snr = (float)atof(v);
+    } else if (a == "--up-rate") {
+      cfg.up.rate = atof(v);
+    } else if (a == "--up-ids") {
+      cfg.up.ids = (uint32_t)strtoul(v, nullptr, 0);
+    } else if (a == "--up-dlc") {
+      ok = parseDlc(v, cfg.up);
+    } else if (a == "--down-rate") {
+      cfg.down.rate = atof(v);
+    } else if (a == "--down-ids") {
+      cfg.down.ids = (uint32_t)strtoul(v, nullptr, 0);
+    } else if (a == "--down-dlc") {
+      ok = parseDlc(v, cfg.down);
+    } else if (a == "--up-crit-rate") {
+      cfg.upCrit.rate = atof(v);
+    } else if (a == "--down-crit-rate") {
+      cfg.downCrit.rate = atof(v);
+    } else if (a == "--gcs-frame") {
+      ok = parseInject(v, cfg);
+    } else if (a == "--node-dir") {
+      cfg.nodeDir = v;
+    } else if (a == "--serial-out") {
+      cfg.serialOut = v;
+    } else if (a == "--flash-file") {
+      cfg.flashFile = v;
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      fprintf(stderr, "Bad option: %s\n", a.c_str());
+      usage(argv[0]);
+      return 2;
+    }
+    i++;
+  }
+
+  if (!rssiEnd) {
+    cfg.rssiEnd = cfg.rssi;
+  }
+  if (cfg.warmupS >= cfg.durationS || cfg.loss < 0 || cfg.loss >= 1.0) {
+    fprintf(stderr, "Bad duration/warm-up or loss\n");
+    return 2;
+  }
+  if (!checkDlc(cfg.up) || !checkDlc(cfg.down)) {
+    fprintf(stderr, "Bad DLC range: over 8 bytes needs --up-fd / --down-fd and a valid FD length\n");
+    return 2;
+  }
+
+  SimReport rep;
+  if (!simRun(cfg, rep)) {
+    return 1;
+  }
+
+  LatencyStats *dirs[DIRS] = {&rep.up, &rep.down, &rep.upCrit, &rep.downCrit};
+  Summary sums[DIRS];
+  for (int d = 0; d < DIRS; d++) {
+    sums[d] = summarize(*dirs[d], rep.measuredS);
+  }
+  if (cfg.json) {
+    printJson(rep, dirs, sums);
+  } else {
+    printText(rep, dirs, sums);
+  }
+  return 0;
+}
@@ -0,0 +1,873 @@
+#include "sim.h"
+
+#include <dlfcn.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <random>
+#include <unordered_map>
+
+#define SIM_SAMPLE_US 1000
+#define SIM_MASTER 0
+#define SIM_NODES (1 + SIM_MAX_FOLLOWERS)
+#define SIM_NOISE_FLOOR_DBM -102.0f  // 812.5 kHz channel; SNR is RSSI above it, capped at --snr
+
+namespace {
+
+enum EventType : uint8_t {
+  EV_BOOT,
+  EV_CAN_GEN,       // sensor/command node queues a frame on a bus
+  EV_CAN_BUS_DONE,  // frame on the bus finished
+  EV_RADIO_TX_END,
+  EV_CAN_INJECT,    // one-off frame from SimConfig::gcsFrames
+  EV_TIMER,         // slot timer update interrupt
+  EV_SPI,           // SPI DMA transfer complete
+  EV_STALL_END,     // a node's flash stall is over, its held interrupts run
+  EV_SAMPLE
+};
+
+struct Event {
+  uint64_t t;
+  uint64_t order;
+  EventType type;
+  uint32_t arg;     // node, bus or transmission index
+  uint32_t arg2;    // traffic generator slot
+};
+
+struct EventLater {
+  bool operator()(const Event &a, const Event &b) const {
+    return a.t != b.t ? a.t > b.t : a.order > b.order;
+  }
+};
+
+struct FrameKey {
+  uint32_t id;      // with the ID type and FD flags in bits 31..29
+  uint8_t len;
+  uint8_t data[64];
+
+  bool operator==(const FrameKey &o) const {
+    return id == o.id && len == o.len && memcmp(data, o.data, sizeof(data)) == 0;
+  }
+};
+
+struct FrameKeyHash {
+  size_t operator()(const FrameKey &k) const {
+    uint64_t h = k.id * 0x9E3779B97F4A7C15ull ^ k.len;
+    for (uint8_t b : k.data) {
+      h = (h ^ b) * 0x100000001B3ull;
+    }
+    return (size_t)h;
+  }
+};
+
+// Data lengths a frame can have, by DLC code
+const uint8_t kCanLens[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64};
+
+struct Generator {
+  uint32_t id;
+  bool ext;
+  bool fd;
+  uint8_t len;
+  uint32_t counter;
+  uint8_t fill;     // constant upper bytes
+  double periodUs;
+  LatencyStats *stats;
+  LatencyStats *nodeStats;  // per follower, or nullptr
+};
+
+struct Expected {
+  uint64_t originUs;
+  bool scored;      // generated after the warm-up
+  LatencyStats *stats;
+  LatencyStats *nodeStats;
+};
+
+typedef std::unordered_map<FrameKey, Expected, FrameKeyHash> ExpectMap;
+
+struct PendingFrame {
+  SimCanFrame frame;
+  uint64_t originUs;
+  bool scored;
+};
+
+struct Stream {
+  uint32_t idBase;
+  uint32_t ids;
+  LatencyStats *stats;
+};
+
+struct Node;
+
+struct CanBus {
+  Node *bridge;
+  bool busy = false;
+  bool curFromBridge = false;
+  PendingFrame cur;
+  std::vector<PendingFrame> pending;
+  std::vector<Generator> gens;
+  ExpectMap *expect;             // frames this bus is waiting for
+  std::vector<Stream> expectStreams;  // for telling duplicates from foreign frames
+  std::vector<ExpectMap *> sent;  // frames generated here, expected remotely, once per map
+};
+
+struct Node {
+  const char *name;
+  int index;
+  void *lib = nullptr;
+  void (*setup)() = nullptr;
+  void (*loop)() = nullptr;
+  bool (*canRx)(const SimCanFrame *, bool) = nullptr;
+  void (*canIrq)() = nullptr;
+  bool (*canTxPeek)(SimCanFrame *) = nullptr;
+  void (*canTxDone)() = nullptr;
+  void (*radioTxDone)() = nullptr;
+  void (*radioRx)(const uint8_t *, size_t, bool, float, float) = nullptr;
+  uint32_t (*radioKey)() = nullptr;
+  void (*probe)(SimNodeProbe *) = nullptr;
+  void (*timerIrq)() = nullptr;
+  void (*spiIrq)() = nullptr;
+
+  double ppm = 0;
+  uint64_t bootUs = 0;
+  bool booted = false;
+  uint32_t timerGen = 0;         // bumped on arm/cancel, stale EV_TIMERs are ignored
+  uint32_t spiGen = 0;           // same for EV_SPI
+  uint64_t nextLoopUs = UINT64_MAX;
+  std::deque<std::pair<uint64_t, uint64_t>> stalls;  // flash stalls [start, end), in order
+  std::vector<std::function<void()>> heldIrqs;       // raised during a stall
+  SimRadioMode radioMode = SIM_RADIO_STANDBY;
+  uint64_t radioModeSince = 0;
+  int activeTx = -1;
+  bool lossBad = false;          // Gilbert-Elliott state of the link into this node
+  std::string logLine;
+  FILE *serialOut = nullptr;
+  const char *flashFile = nullptr;
+  CanBus bus;
+  NodeReport *report;
+};
+
+struct Transmission {
+  int sender;
+  uint64_t startUs;
+  uint64_t endUs;
+  uint32_t key;
+  bool aborted;
+  std::vector<uint8_t> data;
+};
+
+struct World {
+  const SimConfig *cfg;
+  SimReport *report;
+  std::priority_queue<Event, std::vector<Event>, EventLater> events;
+  uint64_t order = 0;
+  std::mt19937_64 rng;
+  Node nodes[SIM_NODES];
+  int count = 0;                 // master and followers in use
+  std::deque<Transmission> txs;
+  uint64_t txBase = 0;           // index of txs.front()
+  ExpectMap upExpect;
+  ExpectMap downExpect[SIM_MAX_FOLLOWERS];  // one per rocket bus
+
+  Node *cur = nullptr;           // node whose code is running
+  uint64_t curBaseUs = 0;
+  uint32_t curConsumed = 0;
+};
+
+World *world = nullptr;
+
+uint64_t nowUs() {
+  return world->curBaseUs + world->curConsumed;
+}
+
+// micros() of node n at global time t
+uint32_t localMicros(const Node &n, uint64_t t) {
+  uint64_t since = t > n.bootUs ? t - n.bootUs : 0;
+  return (uint32_t)(uint64_t)((double)since * (1.0 + n.ppm * 1e-6));
+}
+
+void schedule(uint64_t t, EventType type, uint32_t arg, uint32_t arg2 = 0) {
+  world->events.push(Event{t, world->order++, type, arg, arg2});
+}
+
+double uniform() {
+  return std::uniform_real_distribution<double>(0.0, 1.0)(world->rng);
+}
+
+// Runs fn in the context of node n at time t; returns CPU time consumed
+template <typename F>
+uint32_t runOn(Node &n, uint64_t t, F fn) {
+  Node *prevNode = world->cur;
+  uint64_t prevBase = world->curBaseUs;
+  uint32_t prevConsumed = world->curConsumed;
+  world->cur = &n;
+  world->curBaseUs = t;
+  world->curConsumed = 0;
+  fn();
+  uint32_t used = world->curConsumed;
+  world->cur = prevNode;
+  world->curBaseUs = prevBase;
+  world->curConsumed = prevConsumed;
+  return used;
+}
+
+bool stalledAt(const Node &n, uint64_t t) {
+  for (const auto &s : n.stalls) {
+    if (t >= s.first && t < s.second) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Interrupt context: CPU time is stolen from the next loop() iteration. While
+// a flash stall halts the core the interrupt waits for its end, so fn must
+// not capture locals by reference
+template <typename F>
+void interruptOn(Node &n, uint64_t t, F fn) {
+  if (stalledAt(n, t)) {
+    n.heldIrqs.push_back(fn);
+    return;
+  }
+  uint32_t used = runOn(n, t, fn);
+  if (n.nextLoopUs != UINT64_MAX) {
+    n.nextLoopUs += used;
+  }
+}
+
+FrameKey keyOf(const SimCanFrame &f) {
+  FrameKey k = {};
+  k.id = f.id | (f.ext ? 0x80000000u : 0) | (f.fd ? 0x40000000u : 0) | (f.brs ? 0x20000000u : 0);
+  k.len = f.len;
+  memcpy(k.data, f.data, f.len);
+  return k;
+}
+
+uint32_t canFrameUs(const SimCanFrame &f) {
+  const SimConfig &cfg = *world->cfg;
+  if (!f.fd) {
+    // Classic frame bits plus average stuffing
+    uint32_t bits = (f.ext ? 67 : 47) + 8u * f.len;
+    bits += (bits - 13) / 10;
+    return (uint32_t)ceil(bits * 1000.0 / cfg.canKbps);
+  }
+  // FD: arbitration field up to BRS and ACK to IFS at the nominal rate, ESI
+  // to the CRC delimiter at the data rate if BRS is set
+  double arb = f.ext ? 36 : 17;
+  arb += arb / 10;
+  double data = 5 + 8.0 * f.len;  // ESI, DLC, data
+  data += data / 10;
+  uint32_t crc = f.len > 16 ? 21 : 17;
+  data += 4 + crc + (4 + crc) / 4 + 1;  // stuff count, CRC, fixed stuff bits, delimiter
+  double dataKbps = f.brs ? cfg.canDataKbps : cfg.canKbps;
+  return (uint32_t)ceil((arb + 12) * 1000.0 / cfg.canKbps + data * 1000.0 / dataKbps);
+}
+
+// Arbitration order: the base ID first, then a standard frame over an
+// extended one with the same base ID (SRR/IDE recessive), then the ID extension
+uint64_t arbitrationKey(const SimCanFrame &f) {
+  return f.ext ? ((uint64_t)f.id << 1 | 1) : ((uint64_t)f.id << 19);
+}
+
+void tryStartBus(CanBus &bus) {
+  if (bus.busy) {
+    return;
+  }
+
+  SimCanFrame bridgeFrame;
+  bool haveBridge = false;
+  Node &bridge = *bus.bridge;
+  if (bridge.booted) {
+    runOn(bridge, nowUs(), [&] { haveBridge = bridge.canTxPeek(&bridgeFrame); });
+  }
+
+  // Arbitration: lowest identifier wins
+  int best = -1;
+  for (size_t i = 0; i < bus.pending.size(); i++) {
+    if (best < 0 || arbitrationKey(bus.pending[i].frame) < arbitrationKey(bus.pending[(size_t)best].frame)) {
+      best = (int)i;
+    }
+  }
+  if (haveBridge && (best < 0 || arbitrationKey(bridgeFrame) < arbitrationKey(bus.pending[(size_t)best].frame))) {
+    bus.cur = PendingFrame{bridgeFrame, nowUs(), false};
+    bus.curFromBridge = true;
+  } else if (best >= 0) {
+    bus.cur = bus.pending[(size_t)best];
+    bus.pending.erase(bus.pending.begin() + best);
+    bus.curFromBridge = false;
+  } else {
+    return;
+  }
+
+  bus.busy = true;
+  schedule(nowUs() + canFrameUs(bus.cur.frame), EV_CAN_BUS_DONE, (uint32_t)bridge.index);
+}
+
+void onBusDone(Node &n, uint64_t t) {
+  CanBus &bus = n.bus;
+  bus.busy = false;
+
+  if (bus.curFromBridge) {
+    runOn(n, t, [&] { n.canTxDone(); });
+    const SimCanFrame &f = bus.cur.frame;
+    auto it = bus.expect->find(keyOf(f));
+    if (it != bus.expect->end()) {
+      if (it->second.scored) {
+        it->second.stats->delivered++;
+        it->second.stats->latencyUs.push_back((uint32_t)(t - it->second.originUs));
+        if (it->second.nodeStats) {
+          it->second.nodeStats->delivered++;
+          it->second.nodeStats->latencyUs.push_back((uint32_t)(t - it->second.originUs));
+        }
+      }
+      bus.expect->erase(it);
+    } else {
+      LatencyStats *dupStats = nullptr;
+      for (const Stream &s : bus.expectStreams) {
+        if (f.id >= s.idBase && f.id < s.idBase + s.ids) {
+          dupStats = s.stats;
+        }
+      }
+      if (dupStats) {
+        dupStats->duplicates++;
+      } else {
+        world->report->extraFrames[n.index]++;
+      }
+    }
+  } else {
+    // The controller stores the frame while a flash stall halts the core;
+    // only its interrupt waits, so the FIFO overflows as on the board
+    bool accepted = true;
+    if (stalledAt(n, t)) {
+      runOn(n, t, [&] { accepted = n.canRx(&bus.cur.frame, true); });
+      interruptOn(n, t, [p = &n] { p->canIrq(); });
+    } else {
+      interruptOn(n, t, [&] { accepted = n.canRx(&bus.cur.frame, false); });
+    }
+    if (!accepted) {
+      n.report->fifoLost++;
+    }
+  }
+
+  world->curBaseUs = t;
+  world->curConsumed = 0;
+  tryStartBus(bus);
+}
+
+void onCanGen(Node &n, uint32_t slot, uint64_t t) {
+  CanBus &bus = n.bus;
+  Generator &g = bus.gens[slot];
+
+  PendingFrame p = {};
+  p.frame.id = g.id;
+  p.frame.ext = g.ext;
+  p.frame.fd = g.fd;
+  p.frame.brs = g.fd;
+  p.frame.len = g.len;
+  for (uint8_t i = 0; i < g.len; i++) {
+    p.frame.data[i] = (i < 4) ? (uint8_t)(g.counter >> (8 * i)) : (uint8_t)(g.fill + i);
+  }
+  g.counter++;
+  p.originUs = t;
+  p.scored = t >= (uint64_t)(world->cfg->warmupS * 1e6);
+
+  for (ExpectMap *sent : bus.sent) {
+    if (p.scored) {
+      g.stats->generated++;
+      if (g.nodeStats) {
+        g.nodeStats->generated++;
+      }
+    }
+    (*sent)[keyOf(p.frame)] = Expected{t, p.scored, g.stats, g.nodeStats};
+  }
+  bus.pending.push_back(p);
+
+  double jitter = 1.0 + (uniform() - 0.5) * 0.02;
+  schedule(t + (uint64_t)(g.periodUs * jitter), EV_CAN_GEN, (uint32_t)n.index, slot);
+
+  world->curBaseUs = t;
+  world->curConsumed = 0;
+  tryStartBus(bus);
+}
+
+void onCanInject(Node &n, uint32_t index, uint64_t t) {
+  PendingFrame p = {};
+  p.frame = world->cfg->gcsFrames[index].frame;
+  p.originUs = t;
+  p.scored = false;
+  n.bus.pending.push_back(p);
+
+  world->curBaseUs = t;
+  world->curConsumed = 0;
+  tryStartBus(n.bus);
+}
+
+bool lossDraw(Node &rx) {
+  const SimConfig &cfg = *world->cfg;
+  if (cfg.loss <= 0.0) {
+    return false;
+  }
+  if (cfg.lossBurst <= 1.0) {
+    return uniform() < cfg.loss;
+  }
+  // Gilbert-Elliott with every packet lost in the bad state
+  double pBadToGood = 1.0 / cfg.lossBurst;
+  double pGoodToBad = cfg.loss / (cfg.lossBurst * (1.0 - cfg.loss));
+  if (rx.lossBad) {
+    rx.lossBad = uniform() >= pBadToGood;
+  } else {
+    rx.lossBad = uniform() < pGoodToBad;
+  }
+  return rx.lossBad;
+}
+
+// Typical SX1280 sensitivity of the modulation a radio key describes
+float sensitivityDbm(uint32_t key) {
+  if (key & 0x80000000u) {
+    uint32_t bitRate = (key >> 8) & 0xFFFF;
+    return bitRate >= 1300 ? -94.0f : bitRate >= 1000 ? -96.0f : bitRate >= 650 ? -98.0f : -101.0f;
+  }
+  uint32_t sf = (key >> 4) & 0xF;
+  return -103.0f - 3.0f * (float)(sf - 5);
+}
+
+// Lost with rising probability over the last 2 dB above sensitivity
+bool belowSensitivity(uint32_t key, float rssi) {
+  float margin = rssi - sensitivityDbm(key);
+  return margin < 2.0f && uniform() >= margin / 2.0f;
+}
+
+void onRadioTxEnd(uint32_t txIndex, uint64_t t) {
+  Transmission &tx = world->txs[txIndex - world->txBase];
+  Node &sender = world->nodes[tx.sender];
+  sender.activeTx = -1;
+
+  bool collided = false;
+  for (const Transmission &other : world->txs) {
+    if (&other != &tx && other.startUs < tx.endUs && other.endUs > tx.startUs) {
+      collided = true;
+    }
+  }
+
+  for (int i = 0; i < world->count; i++) {
+    Node &rx = world->nodes[i];
+    if (&rx == &sender || !rx.booted) {
+      continue;
+    }
+    uint32_t key = 0;
+    runOn(rx, t, [&] { key = rx.radioKey(); });
+    bool listening = rx.radioMode == SIM_RADIO_RX && rx.radioModeSince <= tx.startUs && key == tx.key;
+    if (!listening || collided || tx.aborted) {
+      rx.report->radioMissed++;
+      continue;
+    }
+
+    const SimConfig &cfg = *world->cfg;
+    float ramp = (cfg.rssiEnd - cfg.rssi) * (float)(t / (cfg.durationS * 1e6));
+    float rssi = cfg.rssi + ramp + (float)((uniform() - 0.5) * 4.0);
+    float snr = std::min(cfg.snr, rssi - SIM_NOISE_FLOOR_DBM) + (float)((uniform() - 0.5) * 2.0);
+    bool lost = lossDraw(rx);
+    lost = belowSensitivity(tx.key, rssi) || lost;
+    if (lost) {
+      rx.report->radioRxCrc++;
+    } else {
+      rx.report->radioRxOk++;
+    }
+    interruptOn(rx, t, [p = &rx, data = tx.data, lost, rssi, snr] {
+      p->radioRx(data.data(), data.size(), !lost, rssi, snr);
+    });
+  }
+
+  if (!tx.aborted) {
+    interruptOn(sender, t, [p = &sender] { p->radioTxDone(); });
+  }
+
+  // Keep transmissions that may still overlap a later one
+  while (!world->txs.empty() && world->txs.front().endUs + 1000000 < t) {
+    world->txs.pop_front();
+    world->txBase++;
+  }
+}
+
+void onSample() {
+  for (int i = 0; i < world->count; i++) {
+    Node &n = world->nodes[i];
+    if (!n.booted) {
+      continue;
+    }
+    SimNodeProbe probe = {};
+    runOn(n, world->curBaseUs, [&] { n.probe(&probe); });
+    NodeReport &r = *n.report;
+    r.probeSamples++;
+    r.txQueuedSum += probe.txQueued;
+    r.rxQueuedSum += probe.rxQueued;
+    r.txQueuedMax = std::max(r.txQueuedMax, probe.txQueued);
+    r.rxQueuedMax = std::max(r.rxQueuedMax, probe.rxQueued);
+    memcpy(r.txDropped, probe.txDropped, sizeof(r.txDropped));
+    memcpy(r.rxDropped, probe.rxDropped, sizeof(r.rxDropped));
+    if (world->curBaseUs >= (uint64_t)(world->cfg->warmupS * 1e6)) {
+      r.txLateMaxUs = std::max(r.txLateMaxUs, probe.txLateMaxUs);  // after the sync-up frames
+    }
+    r.txTimerStarts = probe.txTimerStarts;
+    r.txPolledStarts = probe.txPolledStarts;
+    memcpy(r.nodePackets, probe.nodePackets, sizeof(r.nodePackets));
+    memcpy(r.nodeLost, probe.nodeLost, sizeof(r.nodeLost));
+    memcpy(r.nodeRecords, probe.nodeRecords, sizeof(r.nodeRecords));
+    r.flogErases = probe.flogErases;
+    r.flogDropped = probe.flogDropped;
+    r.flogErasedPages = probe.flogErasedPages;
+    r.flogErasedMin = probe.flogErasedMin;
+    if (n.index != SIM_MASTER && probe.synced) {
+      int32_t error = (int32_t)(probe.micros + (uint32_t)probe.clockOffsetUs -
+                                localMicros(world->nodes[SIM_MASTER], world->curBaseUs));
+      r.syncErrorUs.push_back((uint32_t)(error < 0 ? -error : error));
+    }
+  }
+}
+
+template <typename T>
+bool bind(Node &n, T &fn, const char *sym) {
+  fn = reinterpret_cast<T>(dlsym(n.lib, sym));
+  if (fn == nullptr) {
+    fprintf(stderr, "[SIM] %s: missing symbol %s\n", n.name, sym);
+    return false;
+  }
+  return true;
+}
+
+bool loadNode(Node &n, const std::string &path) {
+  world->cur = &n;
+  n.lib = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  world->cur = nullptr;
+  if (n.lib == nullptr) {
+    fprintf(stderr, "[SIM] %s\n", dlerror());
+    return false;
+  }
+  return bind(n, n.setup, "simNodeSetup") && bind(n, n.loop, "simNodeLoop") &&
+         bind(n, n.canRx, "simNodeCanRx") && bind(n, n.canIrq, "simNodeCanIrq") &&
+         bind(n, n.canTxPeek, "simNodeCanTxPeek") &&
+         bind(n, n.canTxDone, "simNodeCanTxDone") && bind(n, n.radioTxDone, "simNodeRadioTxDone") &&
+         bind(n, n.radioRx, "simNodeRadioRx") && bind(n, n.radioKey, "simNodeRadioKey") &&
+         bind(n, n.probe, "simNodeProbe") && bind(n, n.timerIrq, "simNodeTimerIrq") &&
+         bind(n, n.spiIrq, "simNodeSpiIrq");
+}
+
+// idOffset moves the IDs of each further follower's traffic past the others'
+void initGenerators(Node &n, const TrafficConfig &tc, LatencyStats *stats, uint32_t idOffset = 0,
+                    LatencyStats *nodeStats = nullptr) {
+  for (uint32_t i = 0; i < tc.ids && tc.rate > 0; i++) {
+    Generator g;
+    g.id = tc.idBase + idOffset + i;
+    uint8_t lens[16];
+    uint8_t count = 0;
+    for (uint8_t len : kCanLens) {
+      if (len >= tc.dlcMin && len <= tc.dlcMax && (tc.fd || len <= 8)) {
+        lens[count++] = len;
+      }
+    }
+    uint8_t pick = (uint8_t)(uniform() * count);
+    g.len = lens[pick < count ? pick : count - 1];
+    g.ext = tc.ext;
+    g.fd = tc.fd;
+    g.counter = (uint32_t)(uniform() * 1000);
+    g.fill = (uint8_t)(uniform() * 256);
+    g.periodUs = 1e6 * tc.ids / tc.rate;
+    g.stats = stats;
+    g.nodeStats = nodeStats;
+    n.bus.gens.push_back(g);
+    schedule((uint64_t)(uniform() * g.periodUs), EV_CAN_GEN, (uint32_t)n.index,
+             (uint32_t)n.bus.gens.size() - 1);
+  }
+}
+
+} // namespace
+
+// Host interface used by the node stubs
+
+extern "C" uint64_t simHostNowUs() {
+  return nowUs();
+}
+
+extern "C" uint32_t simHostMicros() {
+  return localMicros(*world->cur, nowUs());
+}
+
+extern "C" void simHostConsume(uint32_t us) {
+  world->curConsumed += us;
+}
+
+extern "C" void simHostStall(uint32_t us) {
+  Node &n = *world->cur;
+  uint64_t start = nowUs();
+  world->curConsumed += us;
+  n.stalls.push_back({start, start + us});
+  schedule(start + us, EV_STALL_END, (uint32_t)n.index);
+}
+
+extern "C" const char *simHostFlashFile() {
+  return world->cur->flashFile;
+}
+
+extern "C" void simHostLog(const char *text, size_t len) {
+  Node &n = *world->cur;
+  if (n.serialOut) {
+    fwrite(text, 1, len, n.serialOut);
+  }
+  for (size_t i = 0; i < len; i++) {
+    if (text[i] == '\n') {
+      if (world->cfg->verbose) {
+        printf("[%10.6f %s] %s\n", (double)nowUs() / 1e6, n.name, n.logLine.c_str());
+      }
+      n.logLine.clear();
+    } else {
+      n.logLine += text[i];
+    }
+  }
+}
+
+extern "C" void simHostRadioMode(SimRadioMode mode) {
+  Node &n = *world->cur;
+  if (n.activeTx >= 0 && mode != SIM_RADIO_TX) {
+    world->txs[(size_t)n.activeTx - world->txBase].aborted = true;
+    n.activeTx = -1;
+  }
+  n.radioMode = mode;
+  n.radioModeSince = nowUs();
+}
+
+extern "C" void simHostRadioTx(const uint8_t *buf, size_t len, uint32_t toa_us) {
+  Node &n = *world->cur;
+  Transmission tx;
+  tx.sender = n.index;
+  tx.startUs = nowUs();
+  tx.endUs = tx.startUs + toa_us;
+  tx.key = n.radioKey();
+  tx.aborted = false;
+  tx.data.assign(buf, buf + len);
+  world->txs.push_back(tx);
+
+  uint64_t index = world->txBase + world->txs.size() - 1;
+  n.activeTx = (int)index;
+  n.report->radioTx++;
+  n.report->radioTxBytes += len;
+  n.report->airtimeUs += toa_us;
+  schedule(tx.endUs, EV_RADIO_TX_END, (uint32_t)index);
+}
+
+extern "C" uint32_t simHostTimeOnAir(uint32_t model_us) {
+  return (uint32_t)(model_us * world->cfg->toaScale);
+}
+
+extern "C" void simHostSpiConflict() {
+  world->cur->report->spiConflicts++;
+}
+
+extern "C" void simHostTimerArm(uint32_t local_us) {
+  Node &n = *world->cur;
+  n.timerGen++;
+  uint64_t delay = (uint64_t)ceil(local_us / (1.0 + n.ppm * 1e-6));
+  schedule(nowUs() + delay, EV_TIMER, (uint32_t)n.index, n.timerGen);
+}
+
+extern "C" void simHostTimerCancel() {
+  world->cur->timerGen++;
+}
+
+extern "C" void simHostSpiDma(uint32_t us) {
+  Node &n = *world->cur;
+  n.spiGen++;
+  schedule(nowUs() + us, EV_SPI, (uint32_t)n.index, n.spiGen);
+}
+
+extern "C" void simHostSpiAbort() {
+  world->cur->spiGen++;
+}
+
+bool simRun(const SimConfig &cfg, SimReport &report) {
+  World w;
+  world = &w;
+  w.cfg = &cfg;
+  w.report = &report;
+  w.rng.seed(cfg.seed);
+  report = SimReport();
+
+  static const char *const names[SIM_NODES] = {"MASTER", "FOLLOWER", "FOLLOWER2", "FOLLOWER3", "FOLLOWER4"};
+  static const char *const libs[SIM_NODES] = {"node_master.so", "node_follower.so", "node_follower2.so",
+                                              "node_follower3.so", "node_follower4.so"};
+  static_assert(SIM_NODES == 5, "one name per node");
+  w.count = 1 + cfg.followers;
+  report.nodes = w.count;
+  for (int i = 0; i < w.count; i++) {
+    Node &n = w.nodes[i];
+    n.name = names[i];
+    n.index = i;
+    n.report = &report.node[i];
+    n.report->name = names[i];
+    n.bus.bridge = &n;
+    if (!loadNode(n, cfg.nodeDir + "/" + libs[i])) {
+      if (i > 1) {
+        fprintf(stderr, "[SIM] --followers %u needs images built with make FOLLOWERS=%u\n", cfg.followers,
+                cfg.followers);
+      }
+      world = nullptr;
+      return false;
+    }
+  }
+
+  Node &master = w.nodes[SIM_MASTER];
+  for (int i = 1; i < w.count; i++) {
+    Node &follower = w.nodes[i];
+    follower.ppm = (i % 2) ? cfg.followerPpm : -cfg.followerPpm;
+    follower.bootUs = cfg.followerBootUs * (uint64_t)i;
+  }
+  if (!cfg.flashFile.empty()) {
+    w.nodes[1].flashFile = cfg.flashFile.c_str();
+  }
+  if (!cfg.serialOut.empty()) {
+    master.serialOut = fopen(cfg.serialOut.c_str(), "wb");
+    if (master.serialOut == nullptr) {
+      perror(cfg.serialOut.c_str());
+      world = nullptr;
+      return false;
+    }
+  }
+
+  // Uplink: rocket bus -> follower -> radio -> master -> GCS bus
+  master.bus.expect = &w.upExpect;
+  for (int i = 1; i < w.count; i++) {
+    Node &follower = w.nodes[i];
+    uint32_t upOffset = cfg.up.ids * (uint32_t)(i - 1);
+    uint32_t critOffset = cfg.upCrit.ids * (uint32_t)(i - 1);
+    LatencyStats *nodeStats = &report.upNode[i - 1];
+    follower.bus.sent = {&w.upExpect};
+    master.bus.expectStreams.push_back({cfg.up.idBase + upOffset, cfg.up.ids, &report.up});
+    master.bus.expectStreams.push_back({cfg.upCrit.idBase + critOffset, cfg.upCrit.ids, &report.upCrit});
+    initGenerators(follower, cfg.up, &report.up, upOffset, nodeStats);
+    initGenerators(follower, cfg.upCrit, &report.upCrit, critOffset, nodeStats);
+  }
+  // Downlink: GCS bus -> master -> radio -> every follower -> its rocket bus
+  for (int i = 1; i < w.count; i++) {
+    Node &follower = w.nodes[i];
+    master.bus.sent.push_back(&w.downExpect[i - 1]);
+    follower.bus.expect = &w.downExpect[i - 1];
+    follower.bus.expectStreams = {{cfg.down.idBase, cfg.down.ids, &report.down},
+                                  {cfg.downCrit.idBase, cfg.downCrit.ids, &report.downCrit}};
+  }
+  initGenerators(master, cfg.down, &report.down);
+  initGenerators(master, cfg.downCrit, &report.downCrit);
+
+  for (int i = 0; i < w.count; i++) {
+    schedule(w.nodes[i].bootUs, EV_BOOT, (uint32_t)i);
+  }
+  for (size_t i = 0; i < cfg.gcsFrames.size(); i++) {
+    schedule((uint64_t)(cfg.gcsFrames[i].atS * 1e6), EV_CAN_INJECT, SIM_MASTER, (uint32_t)i);
+  }
+  schedule(0, EV_SAMPLE, 0);
+
+  const uint64_t endUs = (uint64_t)(cfg.durationS * 1e6);
+  while (true) {
+    Node *next = nullptr;
+    for (int i = 0; i < w.count; i++) {
+      Node &n = w.nodes[i];
+      if (n.booted && (next == nullptr || n.nextLoopUs < next->nextLoopUs)) {
+        next = &n;
+      }
+    }
+    uint64_t loopAt = next ? next->nextLoopUs : UINT64_MAX;
+    uint64_t eventAt = w.events.empty() ? UINT64_MAX : w.events.top().t;
+    uint64_t t = std::min(loopAt, eventAt);
+    if (t >= endUs) {
+      break;
+    }
+
+    if (eventAt <= loopAt) {
+      Event ev = w.events.top();
+      w.events.pop();
+      w.curBaseUs = ev.t;
+      w.curConsumed = 0;
+      Node &n = w.nodes[ev.arg < (uint32_t)w.count ? ev.arg : 0];
+      switch (ev.type) {
+      case EV_BOOT: {
+        uint32_t used = runOn(n, ev.t, [&] { n.setup(); });
+        n.booted = true;
+        n.nextLoopUs = ev.t + used;
+        break;
+      }
+      case EV_CAN_GEN:
+        onCanGen(n, ev.arg2, ev.t);
+        break;
+      case EV_CAN_BUS_DONE:
+        onBusDone(n, ev.t);
+        break;
+      case EV_RADIO_TX_END:
+        onRadioTxEnd(ev.arg, ev.t);
+        break;
+      case EV_CAN_INJECT:
+        onCanInject(n, ev.arg2, ev.t);
+        break;
+      case EV_TIMER:
+        if (n.booted && ev.arg2 == n.timerGen) {
+          interruptOn(n, ev.t, [p = &n, gen = ev.arg2] {
+            if (gen == p->timerGen) {
+              p->timerIrq();
+            }
+          });
+        }
+        break;
+      case EV_SPI:
+        if (n.booted && ev.arg2 == n.spiGen) {
+          interruptOn(n, ev.t, [p = &n, gen = ev.arg2] {
+            if (gen == p->spiGen) {
+              p->spiIrq();
+            }
+          });
+        }
+        break;
+      case EV_STALL_END:
+        while (!n.stalls.empty() && n.stalls.front().second <= ev.t) {
+          n.stalls.pop_front();
+        }
+        // A stall that begins right now is the next doubleword of a
+        // program run: the core takes pending interrupts in between
+        if (n.stalls.empty() || n.stalls.front().first >= ev.t) {
+          std::vector<std::function<void()>> held;
+          held.swap(n.heldIrqs);
+          for (auto &fn : held) {
+            uint32_t used = runOn(n, ev.t, fn);
+            if (n.nextLoopUs != UINT64_MAX) {
+              n.nextLoopUs += used;
+            }
+          }
+        }
+        break;
+      case EV_SAMPLE:
+        onSample();
+        schedule(ev.t + SIM_SAMPLE_US, EV_SAMPLE, 0);
+        break;
+      }
+      continue;
+    }
+
+    Node &n = *next;
+    uint32_t used = runOn(n, n.nextLoopUs, [&] { n.loop(); });
+    w.curBaseUs = n.nextLoopUs + used;
+    w.curConsumed = 0;
+    n.nextLoopUs += used + cfg.loopUs;
+    tryStartBus(n.bus);
+  }
+
+  report.totalS = cfg.durationS;
+  report.measuredS = cfg.durationS - cfg.warmupS;
+  world = nullptr;
+  for (int i = 0; i < w.count; i++) {
+    Node &n = w.nodes[i];
+    if (n.serialOut) {
+      fclose(n.serialOut);
+    }
+    dlclose(n.lib);
+  }
+  return true;
+}
@@ -0,0 +1,126 @@
+/*
+Bridge simulator
+
+Discrete-event model of a master (GCS) and one or more follower (rocket)
+bridges, each running the unmodified firmware loop() from its own shared
+object. The simulator owns:
+
+- the virtual clock: one global time base, with per-node boot offset and
+  crystal error; CPU time spent inside loop() is charged by the stubs
+- one CAN bus per node with sensor/command traffic, priority arbitration and
+  bit-accurate frame times (classic or CAN FD, 11 or 29-bit IDs)
+- the radio channel: half-duplex, collisions, time-on-air from the node's
+  modulation settings, Gilbert-Elliott packet loss and loss below the
+  receiver sensitivity of the modulation
+
+Frames are matched end to end by (ID, ID type, FD flags, data) to measure
+delivery and latency.
+
+With several followers (--followers, images built with make FOLLOWERS=N)
+each one has its own rocket bus with the full uplink traffic, its IDs moved
+up by the ID count per follower so every frame names its source; every
+downlink frame is expected on every rocket bus.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "sim_api.h"
+
+struct TrafficConfig {
+  double rate;        // frames/s over all IDs
+  uint32_t ids;       // distinct IDs, each periodic at rate/ids
+  uint32_t idBase;
+  uint8_t dlcMin;      // bytes; FD picks from the valid FD lengths in range
+  uint8_t dlcMax;
+  bool ext = false;    // 29-bit IDs
+  bool fd = false;     // CAN FD frames with bit-rate switch
+};
+
+struct InjectFrame {
+  double atS;
+  SimCanFrame frame;
+};
+
+struct SimConfig {
+  double durationS = 10.0;
+  double warmupS = 1.0;         // frames generated earlier are not scored
+  uint32_t seed = 1;
+  double loss = 0.0;            // mean packet loss probability
+  double lossBurst = 1.0;       // mean loss burst length in packets
+  double toaScale = 1.0;
+  uint32_t loopUs = 20;         // loop() overhead outside the stubbed calls
+  uint8_t followers = 1;        // TDMA_FOLLOWERS of the node images
+  double followerPpm = 20.0;    // alternating sign from follower to follower
+  uint64_t followerBootUs = 33000;  // times the follower's number
+  double canKbps = 500.0;
+  double canDataKbps = 2000.0;  // FD data phase with BRS
+  float rssi = -70.0f;
+  float snr = 8.0f;
+  float rssiEnd = -70.0f;       // RSSI ramps linearly to this over the run
+  TrafficConfig up = {400.0, 16, 0x100, 2, 4};    // rocket bus -> GCS bus
+  TrafficConfig down = {5.0, 4, 0x200, 1, 8};     // GCS bus -> rocket bus
+  TrafficConfig upCrit = {0.0, 2, 0x010, 8, 8};   // critical IDs, scored separately
+  TrafficConfig downCrit = {0.0, 1, 0x020, 1, 1};
+  std::vector<InjectFrame> gcsFrames;  // one-off GCS bus frames, not scored
+  bool verbose = false;
+  bool json = false;
+  std::string nodeDir;
+  std::string serialOut;        // file for the master's raw Serial bytes
+  std::string flashFile;        // file backing the (first) follower's flash
+};
+
+struct LatencyStats {
+  uint64_t generated = 0;
+  uint64_t delivered = 0;
+  uint64_t duplicates = 0;
+  std::vector<uint32_t> latencyUs;
+};
+
+struct NodeReport {
+  const char *name;
+  uint64_t fifoLost = 0;        // FDCAN RX FIFO overflows
+  uint64_t spiConflicts = 0;    // blocking RadioLib SPI while the DMA queue held the bus
+  uint64_t radioTx = 0;
+  uint64_t radioTxBytes = 0;
+  uint64_t radioRxOk = 0;
+  uint64_t radioRxCrc = 0;      // lost on the channel, delivered as CRC error
+  uint64_t radioMissed = 0;     // not listening, wrong modulation or collision
+  uint64_t airtimeUs = 0;
+  uint64_t probeSamples = 0;
+  uint64_t txQueuedSum = 0;
+  uint64_t rxQueuedSum = 0;
+  uint16_t txQueuedMax = 0;
+  uint16_t rxQueuedMax = 0;
+  uint32_t txDropped[SIM_PRIO_CLASSES] = {};
+  uint32_t rxDropped[SIM_PRIO_CLASSES] = {};
+  uint32_t txLateMaxUs = 0;        // scored part of the run
+  uint32_t txTimerStarts = 0;
+  uint32_t txPolledStarts = 0;
+  std::vector<uint32_t> syncErrorUs;  // follower: |estimated - true master clock| per sample
+  uint32_t nodePackets[SIM_MAX_FOLLOWERS] = {};  // master: SimNodeProbe counters, whole run
+  uint32_t nodeLost[SIM_MAX_FOLLOWERS] = {};
+  uint32_t nodeRecords[SIM_MAX_FOLLOWERS] = {};
+  uint32_t flogErases = 0;         // follower: SimNodeProbe flight log counters, end of run
+  uint32_t flogDropped = 0;
+  uint16_t flogErasedPages = 0;
+  uint16_t flogErasedMin = 0;
+};
+
+struct SimReport {
+  double totalS;
+  double measuredS;
+  LatencyStats up;
+  LatencyStats down;
+  LatencyStats upCrit;
+  LatencyStats downCrit;
+  LatencyStats upNode[SIM_MAX_FOLLOWERS];  // up and upCrit split by follower
+  int nodes;                    // master and followers
+  NodeReport node[1 + SIM_MAX_FOLLOWERS];
+  uint64_t extraFrames[1 + SIM_MAX_FOLLOWERS];  // frames on a bus that no generator sent (diagnostics etc.)
+};
+
+bool simRun(const SimConfig &cfg, SimReport &report);
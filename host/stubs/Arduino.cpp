@@ -0,0 +1,134 @@
+#include <Arduino.h>
+#include "sim_api.h"
+
+// Modelled hardware UART TX buffer of the STM32 core
+#define SIM_SERIAL_TX_BUFFER 64
+
+HardwareSerial Serial;
+
+void HardwareSerial::begin(uint32_t baud) {
+  this->baud = baud;
+}
+
+int HardwareSerial::availableForWrite() {
+  uint64_t now = simHostNowUs();
+  if (drainedAtUs <= now) {
+    return SIM_SERIAL_TX_BUFFER;
+  }
+  uint64_t queued = (drainedAtUs - now) * (baud / 10) / 1000000;
+  return queued >= SIM_SERIAL_TX_BUFFER ? 0 : (int)(SIM_SERIAL_TX_BUFFER - queued);
+}
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t len) {
+  uint64_t now = simHostNowUs();
+  uint64_t byteUs = 10 * 1000000ull / baud;
+  if (drainedAtUs < now) {
+    drainedAtUs = now;
+  }
+  drainedAtUs += len * byteUs;
+
+  // write() blocks while the bytes beyond the buffer drain out
+  uint64_t bufferedUs = SIM_SERIAL_TX_BUFFER * byteUs;
+  if (drainedAtUs > now + bufferedUs) {
+    simHostConsume((uint32_t)(drainedAtUs - now - bufferedUs));
+  }
+  simHostConsume(1 + (uint32_t)(len / 8));
+
+  simHostLog((const char *)buf, len);
+  return len;
+}
+
+size_t HardwareSerial::printf(const char *fmt, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  if (n < 0) {
+    return 0;
+  }
+  return write((const uint8_t *)buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+}
+
+uint32_t micros() {
+  return simHostMicros();
+}
+
+uint32_t millis() {
+  return simHostMicros() / 1000;
+}
+
+void delay(uint32_t ms) {
+  simHostConsume(ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+  simHostConsume(us);
+}
+
+void pinMode(uint32_t pin, uint32_t mode) {
+  (void)pin;
+  (void)mode;
+}
+
+// SX1280 model (RadioLib.cpp): NSS in, DIO1 out; other pins are not modelled
+void simRadioPinWrite(uint32_t pin, uint32_t val);
+int simRadioPinRead(uint32_t pin);
+
+void digitalWrite(uint32_t pin, uint32_t val) {
+  simRadioPinWrite(pin, val);
+}
+
+int digitalRead(uint32_t pin) {
+  return simRadioPinRead(pin);
+}
+
+void attachInterrupt(uint32_t pin, void (*callback)(void), uint32_t mode) {
+  (void)pin;
+  (void)callback;
+  (void)mode;
+}
+
+// ISRs are delivered between loop() calls, so masking is a no-op
+void noInterrupts() {}
+void interrupts() {}
+
+TIM_TypeDef simTim3;
+
+// Only one timer per node is modelled
+static HardwareTimer *simTimer;
+
+void HardwareTimer::pause() {
+  running = false;
+  simHostTimerCancel();
+}
+
+void HardwareTimer::resume() {
+  running = true;
+  simTimer = this;
+  simHostTimerArm(overflowUs);
+}
+
+void HardwareTimer::setCount(uint32_t val, TimerFormat_t format) {
+  (void)val;
+  (void)format;
+}
+
+void HardwareTimer::setOverflow(uint32_t val, TimerFormat_t format) {
+  overflowUs = (format == HERTZ_FORMAT) ? 1000000 / val : val;
+}
+
+void HardwareTimer::simIrq() {
+  if (running && callback != nullptr) {
+    callback();
+  }
+  if (running) {
+    simHostTimerArm(overflowUs);  // periodic until paused
+  }
+}
+
+SIM_EXPORT void simNodeTimerIrq() {
+  if (simTimer != nullptr) {
+    simTimer->simIrq();
+  }
+}
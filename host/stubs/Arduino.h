@@ -0,0 +1,95 @@
+/*
+Arduino core stand-in for host builds
+
+Only the surface the firmware uses. Time comes from the simulator's virtual
+clock; Serial output is forwarded to the simulator and charged at the
+configured baud rate once the (modelled) TX buffer is full.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "stm32_hal_stub.h"
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT  0x0
+#define OUTPUT 0x1
+
+#define CHANGE  2
+#define FALLING 3
+#define RISING  4
+
+#define LED_GREEN 100
+#define LED_BLUE  101
+
+class HardwareSerial {
+public:
+  void begin(uint32_t baud);
+  size_t write(const uint8_t *buf, size_t len);
+  size_t write(uint8_t c) { return write(&c, 1); }
+  int availableForWrite();
+  int available() { return 0; }
+  int read() { return -1; }
+
+  size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+  size_t println(const char *s) { return print(s) + print("\n"); }
+  size_t println() { return print("\n"); }
+  size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+private:
+  uint32_t baud = 115200;
+  uint64_t drainedAtUs = 0;  // time the modelled TX buffer empties
+};
+
+extern HardwareSerial Serial;
+
+uint32_t micros();
+uint32_t millis();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint32_t pin, uint32_t mode);
+void digitalWrite(uint32_t pin, uint32_t val);
+int digitalRead(uint32_t pin);
+// The SX1280 model drives BUSY low throughout, so no edge is ever raised
+void attachInterrupt(uint32_t pin, void (*callback)(void), uint32_t mode);
+#define digitalPinToInterrupt(p) (p)
+
+void noInterrupts();
+void interrupts();
+
+typedef enum {
+  TICK_FORMAT,
+  MICROSEC_FORMAT,
+  HERTZ_FORMAT
+} TimerFormat_t;
+
+// STM32 core timer: a 1 MHz counter whose update interrupt the simulator
+// raises after the overflow period of the node's local clock
+class HardwareTimer {
+public:
+  explicit HardwareTimer(TIM_TypeDef *instance) { (void)instance; }
+  void pause();
+  void resume();
+  void refresh() {}
+  void setPrescaleFactor(uint32_t prescaler) { (void)prescaler; }
+  void setPreloadEnable(bool value) { (void)value; }
+  uint32_t getTimerClkFreq() { return 1000000; }
+  void setCount(uint32_t val, TimerFormat_t format = TICK_FORMAT);
+  void setOverflow(uint32_t val, TimerFormat_t format = TICK_FORMAT);
+  void attachInterrupt(void (*callback)()) { this->callback = callback; }
+
+  void simIrq();
+
+private:
+  uint32_t overflowUs = 0;
+  bool running = false;
+  void (*callback)() = nullptr;
+};
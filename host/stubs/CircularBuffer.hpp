@@ -0,0 +1,82 @@
+/*
+CircularBuffer stand-in for host builds
+
+Same interface and overwrite semantics as rlogiacco/CircularBuffer:
+push()/unshift() return false when they overwrote an element.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T, size_t S, typename IT = uint16_t>
+class CircularBuffer {
+public:
+  static constexpr IT capacity = static_cast<IT>(S);
+  using index_t = IT;
+
+  bool unshift(T value) {
+    head = (head == 0) ? S - 1 : head - 1;
+    buffer[head] = value;
+    if (count == S) {
+      tail = (tail == 0) ? S - 1 : tail - 1;
+      return false;
+    }
+    if (count++ == 0) {
+      tail = head;
+    }
+    return true;
+  }
+
+  bool push(T value) {
+    if (count == 0) {
+      head = tail = 0;
+      buffer[0] = value;
+      count = 1;
+      return true;
+    }
+    tail = (tail + 1) % S;
+    buffer[tail] = value;
+    if (count == S) {
+      head = (head + 1) % S;
+      return false;
+    }
+    count++;
+    return true;
+  }
+
+  T shift() {
+    T result = buffer[head];
+    if (count > 0) {
+      head = (head + 1) % S;
+      count--;
+    }
+    return result;
+  }
+
+  T pop() {
+    T result = buffer[tail];
+    if (count > 0) {
+      tail = (tail == 0) ? S - 1 : tail - 1;
+      count--;
+    }
+    return result;
+  }
+
+  T inline first() const { return buffer[head]; }
+  T inline last() const { return buffer[tail]; }
+  T operator[](IT index) const { return buffer[(head + index) % S]; }
+
+  IT inline size() const { return count; }
+  IT inline available() const { return S - count; }
+  bool inline isEmpty() const { return count == 0; }
+  bool inline isFull() const { return count == S; }
+  void inline clear() { head = tail = count = 0; }
+
+private:
+  T buffer[S];
+  size_t head = 0;
+  size_t tail = 0;
+  IT count = 0;
+};
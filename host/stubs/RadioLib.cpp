@@ -0,0 +1,442 @@
+#include <Arduino.h>
+#include <RadioLib.h>
+#include <math.h>
+#include "radiospi.h"
+#include "sim_api.h"
+
+// SPI at 8 MHz plus command overhead and BUSY turnaround
+#define SIM_SPI_CMD_US 12
+#define SIM_SPI_BYTE_NS 1000
+
+static SX1280 *simRadio = nullptr;
+
+SX1280::SX1280(Module *mod) : mod(mod) {
+  simRadio = this;
+}
+
+int16_t SX1280::begin(float freq, float bw, uint8_t sf, uint8_t cr, uint8_t syncWord, int8_t pwr,
+                      uint16_t preambleLength) {
+  (void)freq;
+  (void)syncWord;
+  (void)pwr;
+  spi(64);
+  this->flrc = false;
+  this->bw = bw;
+  this->sf = sf;
+  this->cr = cr;
+  this->preamble = preambleLength;
+  setMode(SIM_RADIO_STANDBY);
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1280::beginFLRC(float freq, uint16_t br, uint8_t cr, int8_t pwr, uint16_t preambleLength,
+                          uint8_t dataShaping) {
+  (void)freq;
+  (void)pwr;
+  (void)dataShaping;
+  spi(64);
+  this->flrc = true;
+  this->bitRate = br;
+  this->cr = cr;
+  this->preamble = preambleLength;
+  setMode(SIM_RADIO_STANDBY);
+  return RADIOLIB_ERR_NONE;
+}
+
+void SX1280::setRfSwitchTable(const uint32_t (&pins)[Module::RFSWITCH_MAX_PINS],
+                              const Module::RfSwitchMode_t table[]) {
+  (void)pins;
+  (void)table;
+}
+
+void SX1280::setDio1Action(void (*func)(void)) {
+  dio1 = func;
+}
+
+void SX1280::clearDio1Action() {
+  dio1 = nullptr;
+}
+
+int16_t SX1280::setFrequency(float freq) {
+  (void)freq;
+  spi(4);
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1280::setSpreadingFactor(uint8_t sf) {
+  if (flrc) {
+    return RADIOLIB_ERR_WRONG_MODEM;
+  }
+  if (sf < 5 || sf > 12) {
+    return RADIOLIB_ERR_INVALID_SPREADING_FACTOR;
+  }
+  spi(4);
+  this->sf = sf;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1280::setBandwidth(float bw) {
+  if (flrc) {
+    return RADIOLIB_ERR_WRONG_MODEM;
+  }
+  if (fabsf(bw - 203.125f) > 0.001f && fabsf(bw - 406.25f) > 0.001f &&
+      fabsf(bw - 812.5f) > 0.001f && fabsf(bw - 1625.0f) > 0.001f) {
+    return RADIOLIB_ERR_INVALID_BANDWIDTH;
+  }
+  spi(4);
+  this->bw = bw;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1280::setCodingRate(uint8_t cr, bool longInterleaving) {
+  (void)longInterleaving;
+  if (flrc ? (cr < 2 || cr > 4) : (cr < 5 || cr > 8)) {
+    return RADIOLIB_ERR_INVALID_CODING_RATE;
+  }
+  spi(4);
+  this->cr = cr;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1280::setBitRate(float br) {
+  if (!flrc) {
+    return RADIOLIB_ERR_WRONG_MODEM;
+  }
+  uint16_t kbps = (uint16_t)br;
+  if (kbps != 260 && kbps != 325 && kbps != 520 && kbps != 650 && kbps != 1000 && kbps != 1300) {
+    return RADIOLIB_ERR_INVALID_BIT_RATE;
+  }
+  spi(4);
+  bitRate = kbps;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1280::setDataShaping(uint8_t sh) {
+  (void)sh;
+  spi(4);
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1280::setPreambleLength(uint32_t preambleLength) {
+  spi(8);
+  preamble = preambleLength;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1280::setOutputPower(int8_t pwr) {
+  (void)pwr;
+  spi(3);
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1280::variablePacketLengthMode(uint8_t maxLen) {
+  spi(8);
+  this->maxLen = maxLen;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1280::setCRC(uint8_t len, uint32_t initial, uint16_t polynomial) {
+  (void)initial;
+  (void)polynomial;
+  spi(8);
+  crcLen = len;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1280::standby() {
+  spi(2);
+  setMode(SIM_RADIO_STANDBY);
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1280::startReceive() {
+  spi(16);
+  irq = 0;
+  staged = RADIOLIB_RADIO_MODE_NONE;  // RX overwrites the buffer
+  setMode(SIM_RADIO_RX);
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1280::finishReceive() {
+  spi(8);
+  irq = 0;
+  setMode(SIM_RADIO_STANDBY);
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1280::startTransmit(const uint8_t *data, size_t len, uint8_t addr) {
+  RadioModeConfig_t cfg;
+  cfg.transmit = {data, len, addr};
+  int16_t state = stageMode(RADIOLIB_RADIO_MODE_TX, &cfg);
+  if (state != RADIOLIB_ERR_NONE) {
+    return state;
+  }
+  return launchMode();
+}
+
+// Packet params, buffer base, buffer write and IRQ setup; the SX1280 stays
+// in its current mode until launchMode()
+int16_t SX1280::stageMode(RadioModeType_t mode, RadioModeConfig_t *cfg) {
+  if (mode != RADIOLIB_RADIO_MODE_TX) {
+    return RADIOLIB_ERR_UNKNOWN;  // only TX is staged by the firmware
+  }
+  size_t len = cfg->transmit.len;
+  if (len > maxLen) {
+    return RADIOLIB_ERR_PACKET_TOO_LONG;
+  }
+  spi(8 + len);  // with SetTx below, what startTransmit() always cost
+  memcpy(txData, cfg->transmit.data, len);
+  txLen = len;
+  txToaUs = getTimeOnAir(len);
+  staged = mode;
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1280::launchMode() {
+  if (staged != RADIOLIB_RADIO_MODE_TX) {
+    return RADIOLIB_ERR_UNKNOWN;
+  }
+  staged = RADIOLIB_RADIO_MODE_NONE;
+  spi(4);  // SetTx
+  irq = 0;
+  setMode(SIM_RADIO_TX);
+  simHostRadioTx(txData, txLen, txToaUs);
+  return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1280::finishTransmit() {
+  spi(8);
+  irq = 0;
+  setMode(SIM_RADIO_STANDBY);
+  return RADIOLIB_ERR_NONE;
+}
+
+uint16_t SX1280::getIrqStatus() {
+  spi(4);
+  return irq;
+}
+
+size_t SX1280::getPacketLength(bool update) {
+  (void)update;
+  spi(4);
+  return rxLen;
+}
+
+int16_t SX1280::readData(uint8_t *data, size_t len) {
+  spi(4 + len);
+  if (irq & RADIOLIB_SX128X_IRQ_CRC_ERROR) {
+    return RADIOLIB_ERR_CRC_MISMATCH;
+  }
+  memcpy(data, rxData, len < rxLen ? len : rxLen);
+  return RADIOLIB_ERR_NONE;
+}
+
+RadioLibTime_t SX1280::getTimeOnAir(size_t len) {
+  spi(3);  // getPacketType()
+  return timeOnAir(len);
+}
+
+uint32_t SX1280::timeOnAir(size_t len) const {
+  float us;
+  if (!flrc) {
+    // RadioLib SX128x::getTimeOnAir(), legacy LoRa coding rates
+    float coeff1 = (sf < 7) ? 6.25f : 4.25f;
+    int16_t coeff2 = (sf < 7) ? 4 * sf : 4 * sf + 8;
+    int16_t sfDivisor = (sf < 11) ? 4 * sf : 4 * (sf - 2);
+    int16_t bits = (int16_t)(8 * len) + (crcLen ? 16 : 0) - coeff2 + 20;
+    float symbols = (float)preamble + coeff1 + 8.0f +
+                    ceilf((float)(bits > 0 ? bits : 0) / (float)sfDivisor) * (float)cr;
+    float symbolUs = (float)(1u << sf) / (bw / 1000.0f);
+    us = symbols * symbolUs;
+  } else {
+    // FLRC: preamble, 32-bit sync word and 2-byte header uncoded, payload and
+    // CRC coded at 1/2, 3/4 or 1/1 plus the 6-bit tail
+    float rate = (cr == 2) ? 0.5f : (cr == 3) ? 0.75f : 1.0f;
+    float coded = ((float)(8 * (len + crcLen)) + 6.0f) / rate;
+    float bits = (float)preamble + 32.0f + 16.0f + coded;
+    us = bits * 1000.0f / (float)bitRate;
+  }
+  return simHostTimeOnAir((uint32_t)us);
+}
+
+float SX1280::getRSSI() {
+  spi(4);
+  return rssi;
+}
+
+float SX1280::getSNR() {
+  spi(4);
+  return snr;
+}
+
+void SX1280::simTxDone() {
+  if (mode != SIM_RADIO_TX) {
+    return;
+  }
+  irq |= RADIOLIB_SX128X_IRQ_TX_DONE;
+  setMode(SIM_RADIO_STANDBY);
+  if (dio1) {
+    dio1();
+  }
+}
+
+void SX1280::simRx(const uint8_t *buf, size_t len, bool crc_ok, float rssi, float snr) {
+  if (mode != SIM_RADIO_RX) {
+    return;
+  }
+  if (len > sizeof(rxData)) {
+    len = sizeof(rxData);
+  }
+  memcpy(rxData, buf, len);
+  rxLen = len;
+  this->rssi = rssi;
+  this->snr = snr;
+  irq |= RADIOLIB_SX128X_IRQ_RX_DONE | (crc_ok ? 0 : RADIOLIB_SX128X_IRQ_CRC_ERROR);
+  if (dio1) {
+    dio1();
+  }
+}
+
+uint32_t SX1280::simKey() const {
+  if (flrc) {
+    return 0x80000000u | ((uint32_t)bitRate << 8) | cr;
+  }
+  return ((uint32_t)(bw * 8) << 8) | ((uint32_t)sf << 4) | cr;
+}
+
+void SX1280::simNss(bool low) {
+  if (low && !nssLow) {
+    spiIdx = 0;
+  } else if (!low && nssLow && spiIdx > 0) {
+    spiExecute();
+  }
+  nssLow = low;
+}
+
+void SX1280::simSpi(const uint8_t *tx, uint8_t *rx, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    uint8_t b = spiByte(tx ? tx[i] : 0);
+    if (rx) {
+      rx[i] = b;
+    }
+  }
+}
+
+// One byte in, one out; responses follow the opcode and a status NOP
+uint8_t SX1280::spiByte(uint8_t b) {
+  size_t i = spiIdx++;
+  if (i < sizeof(spiCmd)) {
+    spiCmd[i] = b;
+  }
+  const uint8_t status = 0x40;
+  if (i < 2) {
+    return status;
+  }
+  switch (spiCmd[0]) {
+  case 0x15:  // GetIrqStatus
+    return i == 2 ? (uint8_t)(irq >> 8) : (uint8_t)irq;
+  case 0x17:  // GetRxBufferStatus: length, start offset
+    return i == 2 ? (uint8_t)rxLen : 0;
+  case 0x1D:  // GetPacketStatus: LoRa RssiSync, Snr; FLRC RssiAvg, RssiSync
+    if (i == 2) {
+      return (uint8_t)(-rssi * 2.0f);
+    }
+    if (i == 3) {
+      return flrc ? (uint8_t)(-rssi * 2.0f) : (uint8_t)(int8_t)(snr * 4.0f);
+    }
+    return 0;
+  case 0x1A: {  // WriteBuffer: offset, data
+    size_t at = spiCmd[1] + i - 2;
+    if (at < sizeof(txData)) {
+      txData[at] = b;
+    }
+    return status;
+  }
+  case 0x1B: {  // ReadBuffer: offset, NOP, data
+    if (i < 3) {
+      return status;
+    }
+    size_t at = spiCmd[1] + i - 3;
+    return at < sizeof(rxData) ? rxData[at] : 0;
+  }
+  default:
+    return status;
+  }
+}
+
+void SX1280::spiExecute() {
+  switch (spiCmd[0]) {
+  case 0x80:  // SetStandby
+    setMode(SIM_RADIO_STANDBY);
+    break;
+  case 0x82:  // SetRx
+    staged = RADIOLIB_RADIO_MODE_NONE;
+    setMode(SIM_RADIO_RX);
+    break;
+  case 0x83:  // SetTx
+    setMode(SIM_RADIO_TX);
+    simHostRadioTx(txData, txLen, timeOnAir(txLen));
+    break;
+  case 0x8C:  // SetPacketParams: payload length
+    txLen = spiCmd[flrc ? 5 : 3];
+    break;
+  case 0x8D:  // SetDioIrqParams: DIO1 mask
+    dio1Mask = (uint16_t)((spiCmd[3] << 8) | spiCmd[4]);
+    break;
+  case 0x97:  // ClearIrqStatus
+    irq &= (uint16_t)~((spiCmd[1] << 8) | spiCmd[2]);
+    break;
+  }
+}
+
+void SX1280::setMode(uint8_t mode) {
+  if (this->mode != mode) {
+    this->mode = mode;
+    simHostRadioMode((SimRadioMode)mode);
+  }
+}
+
+// A blocking transaction; radiospi.h keeps the DMA queue off the bus meanwhile
+void SX1280::spi(size_t bytes) {
+#if RADIO_ENABLE_DMA_SPI
+  if (!radioSpiIdle()) {
+    simHostSpiConflict();
+  }
+#endif
+  simHostConsume(SIM_SPI_CMD_US + (uint32_t)(bytes * SIM_SPI_BYTE_NS / 1000));
+}
+
+void simRadioSpi(const uint8_t *tx, uint8_t *rx, size_t len) {
+  if (simRadio) {
+    simRadio->simSpi(tx, rx, len);
+  }
+}
+
+void simRadioPinWrite(uint32_t pin, uint32_t val) {
+  if (simRadio && pin == simRadio->simModule()->cs) {
+    simRadio->simNss(val == LOW);
+  }
+}
+
+int simRadioPinRead(uint32_t pin) {
+  if (simRadio && pin == simRadio->simModule()->irq) {
+    return simRadio->simDio1() ? HIGH : LOW;
+  }
+  return LOW;
+}
+
+SIM_EXPORT void simNodeRadioTxDone() {
+  if (simRadio) {
+    simRadio->simTxDone();
+  }
+}
+
+SIM_EXPORT void simNodeRadioRx(const uint8_t *buf, size_t len, bool crc_ok, float rssi, float snr) {
+  if (simRadio) {
+    simRadio->simRx(buf, len, crc_ok, rssi, snr);
+  }
+}
+
+SIM_EXPORT uint32_t simNodeRadioKey() {
+  return simRadio ? simRadio->simKey() : 0;
+}
@@ -0,0 +1,183 @@
+/*
+RadioLib stand-in for host builds
+
+Implements the SX1280 calls the firmware makes, with RadioLib's signatures,
+return codes and IRQ bits. Transmissions are handed to the simulator's
+channel model; receptions arrive through simNodeRadioRx() and raise DIO1
+like the real chip. Time-on-air follows RadioLib's SX128x formulas, and each
+SPI transaction is charged to the node's CPU time.
+
+The same model also answers raw SX1280 commands clocked in over SPI DMA
+(hal_spi.cpp): bytes stream in between NSS falling and rising, and the
+command runs on the rising edge. These cost no CPU time here.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define RADIOLIB_NC (0xFFFFFFFF)
+
+#define RADIOLIB_ERR_NONE                 (0)
+#define RADIOLIB_ERR_UNKNOWN              (-1)
+#define RADIOLIB_ERR_PACKET_TOO_LONG      (-4)
+#define RADIOLIB_ERR_TX_TIMEOUT           (-5)
+#define RADIOLIB_ERR_RX_TIMEOUT           (-6)
+#define RADIOLIB_ERR_CRC_MISMATCH         (-7)
+#define RADIOLIB_ERR_INVALID_BANDWIDTH    (-8)
+#define RADIOLIB_ERR_INVALID_SPREADING_FACTOR (-9)
+#define RADIOLIB_ERR_INVALID_CODING_RATE  (-10)
+#define RADIOLIB_ERR_INVALID_BIT_RATE     (-101)
+#define RADIOLIB_ERR_WRONG_MODEM          (-20)
+
+#define RADIOLIB_SX128X_IRQ_TX_DONE       0x0001
+#define RADIOLIB_SX128X_IRQ_RX_DONE       0x0002
+#define RADIOLIB_SX128X_IRQ_HEADER_VALID  0x0010
+#define RADIOLIB_SX128X_IRQ_HEADER_ERROR  0x0020
+#define RADIOLIB_SX128X_IRQ_CRC_ERROR     0x0040
+#define RADIOLIB_SX128X_IRQ_RX_TX_TIMEOUT 0x4000
+
+#define RADIOLIB_SX128X_MAX_PACKET_LENGTH 255
+#define RADIOLIB_SX128X_SYNC_WORD_PRIVATE 0x12
+
+#define RADIOLIB_SHAPING_NONE 0x00
+#define RADIOLIB_SHAPING_0_5  0x02
+#define RADIOLIB_SHAPING_1_0  0x04
+
+typedef uint32_t RadioLibTime_t;
+
+enum RadioModeType_t {
+  RADIOLIB_RADIO_MODE_NONE = 0,
+  RADIOLIB_RADIO_MODE_STANDBY,
+  RADIOLIB_RADIO_MODE_SLEEP,
+  RADIOLIB_RADIO_MODE_RX,
+  RADIOLIB_RADIO_MODE_TX,
+  RADIOLIB_RADIO_MODE_SCAN,
+};
+
+struct ReceiveConfig_t {
+  RadioLibTime_t timeout;
+  uint32_t irqFlags;
+  uint32_t irqMask;
+  size_t len;
+};
+
+struct TransmitConfig_t {
+  const uint8_t *data;
+  size_t len;
+  uint8_t addr;
+};
+
+union RadioModeConfig_t {
+  ReceiveConfig_t receive;
+  TransmitConfig_t transmit;
+};
+
+class Module {
+public:
+  static const uint8_t RFSWITCH_MAX_PINS = 5;
+
+  enum OpMode_t {
+    MODE_END_OF_TABLE = 0,
+    MODE_IDLE,
+    MODE_RX,
+    MODE_TX,
+  };
+
+  struct RfSwitchMode_t {
+    uint8_t mode;
+    uint32_t values[RFSWITCH_MAX_PINS];
+  };
+
+  Module(uint32_t cs, uint32_t irq, uint32_t rst, uint32_t gpio = RADIOLIB_NC)
+    : cs(cs), irq(irq), rst(rst), gpio(gpio) {}
+
+  uint32_t cs, irq, rst, gpio;
+};
+
+class SX1280 {
+public:
+  SX1280(Module *mod);
+
+  int16_t begin(float freq = 2400.0, float bw = 812.5, uint8_t sf = 9, uint8_t cr = 7,
+                uint8_t syncWord = RADIOLIB_SX128X_SYNC_WORD_PRIVATE, int8_t pwr = 10,
+                uint16_t preambleLength = 12);
+  int16_t beginFLRC(float freq = 2400.0, uint16_t br = 650, uint8_t cr = 3, int8_t pwr = 10,
+                    uint16_t preambleLength = 16, uint8_t dataShaping = RADIOLIB_SHAPING_0_5);
+
+  void setRfSwitchTable(const uint32_t (&pins)[Module::RFSWITCH_MAX_PINS], const Module::RfSwitchMode_t table[]);
+  void setDio1Action(void (*func)(void));
+  void clearDio1Action();
+
+  int16_t setFrequency(float freq);
+  int16_t setSpreadingFactor(uint8_t sf);
+  int16_t setBandwidth(float bw);
+  int16_t setCodingRate(uint8_t cr, bool longInterleaving = false);
+  int16_t setBitRate(float br);
+  int16_t setDataShaping(uint8_t sh);
+  int16_t setPreambleLength(uint32_t preambleLength);
+  int16_t setOutputPower(int8_t pwr);
+  int16_t variablePacketLengthMode(uint8_t maxLen = RADIOLIB_SX128X_MAX_PACKET_LENGTH);
+  int16_t setCRC(uint8_t len, uint32_t initial = 0x1D0F, uint16_t polynomial = 0x1021);
+
+  int16_t standby();
+  int16_t startReceive();
+  int16_t finishReceive();
+  int16_t startTransmit(const uint8_t *data, size_t len, uint8_t addr = 0);
+  int16_t finishTransmit();
+  int16_t stageMode(RadioModeType_t mode, RadioModeConfig_t *cfg);  // TX: buffer write, no SetTx
+  int16_t launchMode();
+
+  uint16_t getIrqStatus();
+  size_t getPacketLength(bool update = true);
+  int16_t readData(uint8_t *data, size_t len);
+  RadioLibTime_t getTimeOnAir(size_t len);
+  float getRSSI();
+  float getSNR();
+
+  // Simulator hooks (not part of RadioLib)
+  void simTxDone();
+  void simRx(const uint8_t *buf, size_t len, bool crc_ok, float rssi, float snr);
+  uint32_t simKey() const;
+  void simNss(bool low);
+  void simSpi(const uint8_t *tx, uint8_t *rx, size_t len);
+  bool simDio1() const { return (irq & dio1Mask) != 0; }
+  const Module *simModule() const { return mod; }
+
+private:
+  void setMode(uint8_t mode);
+  void spi(size_t bytes);
+  uint32_t timeOnAir(size_t len) const;
+  uint8_t spiByte(uint8_t b);
+  void spiExecute();
+
+  Module *mod;
+  void (*dio1)(void) = nullptr;
+
+  bool flrc = false;
+  uint8_t sf = 9;
+  float bw = 812.5;
+  uint8_t cr = 7;
+  uint16_t bitRate = 650;
+  uint32_t preamble = 12;
+  uint8_t crcLen = 2;
+  uint8_t maxLen = RADIOLIB_SX128X_MAX_PACKET_LENGTH;
+
+  uint8_t mode = 0;
+  uint16_t irq = 0;
+  uint8_t rxData[RADIOLIB_SX128X_MAX_PACKET_LENGTH];
+  uint8_t txData[RADIOLIB_SX128X_MAX_PACKET_LENGTH];
+  size_t txLen = 0;
+  uint32_t txToaUs = 0;
+  RadioModeType_t staged = RADIOLIB_RADIO_MODE_NONE;
+  size_t rxLen = 0;
+  float rssi = 0;
+  float snr = 0;
+
+  // Raw command in progress (NSS low)
+  bool nssLow = false;
+  size_t spiIdx = 0;
+  uint8_t spiCmd[16];
+  uint16_t dio1Mask = 0xFFFF;
+};
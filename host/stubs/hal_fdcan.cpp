@@ -0,0 +1,364 @@
+#include <Arduino.h>
+#include "sim_api.h"
+
+// Per-node FDCAN model: this file is linked into every node shared object,
+// so the statics below are private to one simulated board.
+
+#define SIM_FDCAN_RX_FIFO_LEN 3
+#define SIM_FDCAN_TX_FIFO_LEN 3
+#define SIM_FDCAN_MAX_STD_FILTERS 28
+#define SIM_FDCAN_MAX_EXT_FILTERS 8
+
+// Rough CPU cost of a register-level HAL call on the C0 at 48 MHz
+#define SIM_FDCAN_CALL_US 2
+#define SIM_FDCAN_MSG_US 6
+
+FDCAN_GlobalTypeDef simFdcan1;
+GPIO_TypeDef simGpioD;
+
+struct SimFifo {
+  SimCanFrame frames[SIM_FDCAN_TX_FIFO_LEN > SIM_FDCAN_RX_FIFO_LEN ? SIM_FDCAN_TX_FIFO_LEN : SIM_FDCAN_RX_FIFO_LEN];
+  uint8_t head;
+  uint8_t count;
+};
+
+static SimFifo rxFifo[2];
+static SimFifo txFifo;
+static FDCAN_FilterTypeDef stdFilters[SIM_FDCAN_MAX_STD_FILTERS];
+static FDCAN_FilterTypeDef extFilters[SIM_FDCAN_MAX_EXT_FILTERS];
+static uint32_t nonMatchingStd = FDCAN_ACCEPT_IN_RX_FIFO0;
+static uint32_t nonMatchingExt = FDCAN_ACCEPT_IN_RX_FIFO0;
+static FDCAN_HandleTypeDef *activeHandle = nullptr;
+static bool started = false;
+static uint32_t startedUs = 0;    // setup() runs as one block: frames stamped earlier missed it
+static bool fdMode = false;        // CCCR.FDOE / BRSE
+static bool brsMode = false;
+static uint32_t activeITs = 0;     // IE register
+static uint32_t pendingITs = 0;    // IR register, RX FIFO bits only
+static bool it0Enabled = false;    // NVIC
+
+static const uint8_t kDlcBytes[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64};
+
+static uint32_t bytesToDlcCode(uint8_t len) {
+  for (uint32_t i = 0; i < 16; i++) {
+    if (kDlcBytes[i] >= len) {
+      return i;
+    }
+  }
+  return 15;
+}
+
+extern "C" __attribute__((weak)) void HAL_FDCAN_MspInit(FDCAN_HandleTypeDef *hfdcan) {
+  (void)hfdcan;
+}
+
+extern "C" __attribute__((weak)) void HAL_FDCAN_RxFifo0Callback(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo0ITs) {
+  (void)hfdcan;
+  (void)RxFifo0ITs;
+}
+
+extern "C" __attribute__((weak)) void HAL_FDCAN_RxFifo1Callback(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo1ITs) {
+  (void)hfdcan;
+  (void)RxFifo1ITs;
+}
+
+// Vector table entry; defined by the firmware when it uses FDCAN interrupts
+extern "C" __attribute__((weak)) void TIM16_FDCAN_IT0_IRQHandler(void);
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority) {
+  (void)IRQn;
+  (void)PreemptPriority;
+  (void)SubPriority;
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn) {
+  if (IRQn == TIM16_FDCAN_IT0_IRQn) {
+    it0Enabled = true;
+  }
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn) {
+  if (IRQn == TIM16_FDCAN_IT0_IRQn) {
+    it0Enabled = false;
+  }
+}
+
+// Called from simulator interrupt context whenever IR changes
+static void raiseIt0() {
+  if (it0Enabled && (pendingITs & activeITs) && TIM16_FDCAN_IT0_IRQHandler) {
+    TIM16_FDCAN_IT0_IRQHandler();
+  }
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *port, GPIO_InitTypeDef *init) {
+  (void)port;
+  (void)init;
+}
+
+HAL_StatusTypeDef HAL_FDCAN_Init(FDCAN_HandleTypeDef *hfdcan) {
+  if (hfdcan == nullptr || hfdcan->Instance != FDCAN1 ||
+      hfdcan->Init.StdFiltersNbr > SIM_FDCAN_MAX_STD_FILTERS ||
+      hfdcan->Init.ExtFiltersNbr > SIM_FDCAN_MAX_EXT_FILTERS) {
+    return HAL_ERROR;
+  }
+  HAL_FDCAN_MspInit(hfdcan);
+  memset(rxFifo, 0, sizeof(rxFifo));
+  memset(&txFifo, 0, sizeof(txFifo));
+  memset(stdFilters, 0, sizeof(stdFilters));
+  memset(extFilters, 0, sizeof(extFilters));
+  nonMatchingStd = FDCAN_ACCEPT_IN_RX_FIFO0;
+  nonMatchingExt = FDCAN_ACCEPT_IN_RX_FIFO0;
+  hfdcan->ErrorCode = HAL_FDCAN_ERROR_NONE;
+  activeHandle = hfdcan;
+  fdMode = hfdcan->Init.FrameFormat != FDCAN_FRAME_CLASSIC;
+  brsMode = hfdcan->Init.FrameFormat == FDCAN_FRAME_FD_BRS;
+  started = false;
+  activeITs = 0;
+  pendingITs = 0;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FDCAN_ConfigFilter(FDCAN_HandleTypeDef *hfdcan, FDCAN_FilterTypeDef *sFilterConfig) {
+  if (sFilterConfig->IdType == FDCAN_STANDARD_ID) {
+    if (sFilterConfig->FilterIndex >= hfdcan->Init.StdFiltersNbr) {
+      hfdcan->ErrorCode |= HAL_FDCAN_ERROR_PARAM;
+      return HAL_ERROR;
+    }
+    stdFilters[sFilterConfig->FilterIndex] = *sFilterConfig;
+  } else {
+    if (sFilterConfig->FilterIndex >= hfdcan->Init.ExtFiltersNbr) {
+      hfdcan->ErrorCode |= HAL_FDCAN_ERROR_PARAM;
+      return HAL_ERROR;
+    }
+    extFilters[sFilterConfig->FilterIndex] = *sFilterConfig;
+  }
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FDCAN_ConfigGlobalFilter(FDCAN_HandleTypeDef *hfdcan, uint32_t NonMatchingStd,
+                                               uint32_t NonMatchingExt, uint32_t RejectRemoteStd,
+                                               uint32_t RejectRemoteExt) {
+  (void)hfdcan;
+  (void)RejectRemoteStd;
+  (void)RejectRemoteExt;
+  nonMatchingStd = NonMatchingStd;
+  nonMatchingExt = NonMatchingExt;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FDCAN_ConfigTxDelayCompensation(FDCAN_HandleTypeDef *hfdcan, uint32_t TdcOffset,
+                                                      uint32_t TdcFilter) {
+  (void)TdcFilter;
+  if (TdcOffset > 0x7F) {
+    hfdcan->ErrorCode |= HAL_FDCAN_ERROR_PARAM;
+    return HAL_ERROR;
+  }
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FDCAN_EnableTxDelayCompensation(FDCAN_HandleTypeDef *hfdcan) {
+  (void)hfdcan;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FDCAN_Start(FDCAN_HandleTypeDef *hfdcan) {
+  (void)hfdcan;
+  started = true;
+  startedUs = micros();
+  return HAL_OK;
+}
+
+static SimFifo *rxFifoFor(uint32_t location) {
+  if (location == FDCAN_RX_FIFO0) {
+    return &rxFifo[0];
+  }
+  if (location == FDCAN_RX_FIFO1) {
+    return &rxFifo[1];
+  }
+  return nullptr;
+}
+
+uint32_t HAL_FDCAN_GetRxFifoFillLevel(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo) {
+  (void)hfdcan;
+  simHostConsume(SIM_FDCAN_CALL_US);
+  SimFifo *fifo = rxFifoFor(RxFifo);
+  return fifo ? fifo->count : 0;
+}
+
+HAL_StatusTypeDef HAL_FDCAN_GetRxMessage(FDCAN_HandleTypeDef *hfdcan, uint32_t RxLocation,
+                                         FDCAN_RxHeaderTypeDef *pRxHeader, uint8_t *pRxData) {
+  simHostConsume(SIM_FDCAN_MSG_US);
+  SimFifo *fifo = rxFifoFor(RxLocation);
+  if (fifo == nullptr) {
+    hfdcan->ErrorCode |= HAL_FDCAN_ERROR_PARAM;
+    return HAL_ERROR;
+  }
+  if (fifo->count == 0) {
+    hfdcan->ErrorCode |= HAL_FDCAN_ERROR_FIFO_EMPTY;
+    return HAL_ERROR;
+  }
+
+  const SimCanFrame &f = fifo->frames[fifo->head];
+  memset(pRxHeader, 0, sizeof(*pRxHeader));
+  pRxHeader->Identifier    = f.id;
+  pRxHeader->IdType        = f.ext ? FDCAN_EXTENDED_ID : FDCAN_STANDARD_ID;
+  pRxHeader->RxFrameType   = FDCAN_DATA_FRAME;
+  pRxHeader->DataLength    = bytesToDlcCode(f.len);
+  pRxHeader->BitRateSwitch = f.brs ? FDCAN_BRS_ON : FDCAN_BRS_OFF;
+  pRxHeader->FDFormat      = f.fd ? FDCAN_FD_CAN : FDCAN_CLASSIC_CAN;
+  pRxHeader->RxTimestamp   = (uint16_t)simHostMicros();
+  memcpy(pRxData, f.data, kDlcBytes[pRxHeader->DataLength]);
+
+  fifo->head = (fifo->head + 1) % SIM_FDCAN_RX_FIFO_LEN;
+  fifo->count--;
+  return HAL_OK;
+}
+
+uint32_t HAL_FDCAN_GetTxFifoFreeLevel(FDCAN_HandleTypeDef *hfdcan) {
+  (void)hfdcan;
+  simHostConsume(SIM_FDCAN_CALL_US);
+  return SIM_FDCAN_TX_FIFO_LEN - txFifo.count;
+}
+
+HAL_StatusTypeDef HAL_FDCAN_AddMessageToTxFifoQ(FDCAN_HandleTypeDef *hfdcan, FDCAN_TxHeaderTypeDef *pTxHeader,
+                                                uint8_t *pTxData) {
+  simHostConsume(SIM_FDCAN_MSG_US);
+  if (txFifo.count >= SIM_FDCAN_TX_FIFO_LEN) {
+    hfdcan->ErrorCode |= HAL_FDCAN_ERROR_FIFO_FULL;
+    return HAL_ERROR;
+  }
+  if (pTxHeader->DataLength > FDCAN_DLC_BYTES_64) {
+    hfdcan->ErrorCode |= HAL_FDCAN_ERROR_PARAM;
+    return HAL_ERROR;
+  }
+  bool fd = fdMode && pTxHeader->FDFormat == FDCAN_FD_CAN;
+
+  SimCanFrame &f = txFifo.frames[(txFifo.head + txFifo.count) % SIM_FDCAN_TX_FIFO_LEN];
+  memset(&f, 0, sizeof(f));
+  f.id  = pTxHeader->Identifier;
+  f.ext = pTxHeader->IdType == FDCAN_EXTENDED_ID;
+  f.fd  = fd;
+  f.brs = fd && brsMode && pTxHeader->BitRateSwitch == FDCAN_BRS_ON;
+  f.len = kDlcBytes[pTxHeader->DataLength];
+  if (!fd && f.len > 8) {
+    f.len = 8;  // classic DLC 9-15
+  }
+  memcpy(f.data, pTxData, f.len);
+  txFifo.count++;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FDCAN_ActivateNotification(FDCAN_HandleTypeDef *hfdcan, uint32_t ActiveITs,
+                                                 uint32_t BufferIndexes) {
+  (void)hfdcan;
+  (void)BufferIndexes;
+  simHostConsume(SIM_FDCAN_CALL_US);
+  activeITs |= ActiveITs;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FDCAN_DeactivateNotification(FDCAN_HandleTypeDef *hfdcan, uint32_t InactiveITs) {
+  (void)hfdcan;
+  simHostConsume(SIM_FDCAN_CALL_US);
+  activeITs &= ~InactiveITs;
+  return HAL_OK;
+}
+
+void HAL_FDCAN_IRQHandler(FDCAN_HandleTypeDef *hfdcan) {
+  simHostConsume(SIM_FDCAN_CALL_US);
+  uint32_t its = pendingITs & activeITs;
+  pendingITs &= ~its;
+
+  uint32_t fifo0 = its & (FDCAN_IT_RX_FIFO0_NEW_MESSAGE | FDCAN_IT_RX_FIFO0_FULL | FDCAN_IT_RX_FIFO0_MESSAGE_LOST);
+  uint32_t fifo1 = its & (FDCAN_IT_RX_FIFO1_NEW_MESSAGE | FDCAN_IT_RX_FIFO1_FULL | FDCAN_IT_RX_FIFO1_MESSAGE_LOST);
+  if (fifo0) {
+    HAL_FDCAN_RxFifo0Callback(hfdcan, fifo0);
+  }
+  if (fifo1) {
+    HAL_FDCAN_RxFifo1Callback(hfdcan, fifo1);
+  }
+}
+
+// Returns the FIFO a frame is stored in, or nullptr if the filters reject it
+static SimFifo *filterFrame(const SimCanFrame &f) {
+  const FDCAN_FilterTypeDef *filters = f.ext ? extFilters : stdFilters;
+  uint32_t count = f.ext ? activeHandle->Init.ExtFiltersNbr : activeHandle->Init.StdFiltersNbr;
+
+  for (uint32_t i = 0; i < count; i++) {
+    const FDCAN_FilterTypeDef &flt = filters[i];
+    bool match = false;
+    switch (flt.FilterType) {
+    case FDCAN_FILTER_RANGE: match = f.id >= flt.FilterID1 && f.id <= flt.FilterID2; break;
+    case FDCAN_FILTER_DUAL:  match = f.id == flt.FilterID1 || f.id == flt.FilterID2; break;
+    case FDCAN_FILTER_MASK:  match = (f.id & flt.FilterID2) == (flt.FilterID1 & flt.FilterID2); break;
+    }
+    if (!match || flt.FilterConfig == FDCAN_FILTER_DISABLE) {
+      continue;
+    }
+    switch (flt.FilterConfig) {
+    case FDCAN_FILTER_TO_RXFIFO0: return &rxFifo[0];
+    case FDCAN_FILTER_TO_RXFIFO1: return &rxFifo[1];
+    default: return nullptr;
+    }
+  }
+
+  uint32_t nonMatching = f.ext ? nonMatchingExt : nonMatchingStd;
+  if (nonMatching == FDCAN_ACCEPT_IN_RX_FIFO0) {
+    return &rxFifo[0];
+  }
+  if (nonMatching == FDCAN_ACCEPT_IN_RX_FIFO1) {
+    return &rxFifo[1];
+  }
+  return nullptr;
+}
+
+SIM_EXPORT bool simNodeCanRx(const SimCanFrame *frame, bool held) {
+  if (!started || activeHandle == nullptr || (int32_t)(micros() - startedUs) < 0) {
+    return true;  // controller not running yet: not received, but not a FIFO overflow either
+  }
+  if (frame->fd && !fdMode) {
+    return true;  // error frame, not a FIFO overflow
+  }
+  SimFifo *fifo = filterFrame(*frame);
+  if (fifo == nullptr) {
+    return true;  // rejected by acceptance filtering, not a loss
+  }
+  uint32_t shift = (fifo == &rxFifo[0]) ? 0 : 3;  // RF1x bits follow RF0x
+  if (fifo->count >= SIM_FDCAN_RX_FIFO_LEN) {
+    pendingITs |= FDCAN_IT_RX_FIFO0_MESSAGE_LOST << shift;
+    if (!held) {
+      raiseIt0();
+    }
+    return false;  // FIFO in blocking mode: new message lost
+  }
+  fifo->frames[(fifo->head + fifo->count) % SIM_FDCAN_RX_FIFO_LEN] = *frame;
+  fifo->count++;
+  pendingITs |= FDCAN_IT_RX_FIFO0_NEW_MESSAGE << shift;
+  if (fifo->count == SIM_FDCAN_RX_FIFO_LEN) {
+    pendingITs |= FDCAN_IT_RX_FIFO0_FULL << shift;
+  }
+  if (!held) {
+    raiseIt0();
+  }
+  return true;
+}
+
+SIM_EXPORT void simNodeCanIrq() {
+  raiseIt0();
+}
+
+SIM_EXPORT bool simNodeCanTxPeek(SimCanFrame *frame) {
+  if (!started || txFifo.count == 0) {
+    return false;
+  }
+  *frame = txFifo.frames[txFifo.head];
+  return true;
+}
+
+SIM_EXPORT void simNodeCanTxDone() {
+  if (txFifo.count == 0) {
+    return;
+  }
+  txFifo.head = (txFifo.head + 1) % SIM_FDCAN_TX_FIFO_LEN;
+  txFifo.count--;
+}
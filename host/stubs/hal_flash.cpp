@@ -0,0 +1,104 @@
+#include <Arduino.h>
+#include <stdio.h>
+#include <string.h>
+#include "sim_api.h"
+
+// Per-node flash model: the whole array in memory, erased to 0xFF, and
+// mirrored to the file the simulator names for this node (--flash-file), so
+// a later run boots with what the last one wrote. Programming follows the
+// C0 rules: unlocked, doubleword aligned, only into an erased doubleword.
+// Program and erase time stall the node's core as on the C0: interrupts wait
+// until it is over, while the FDCAN controller keeps filling its FIFOs.
+
+#define SIM_FLASH_PROGRAM_US 85
+#define SIM_FLASH_ERASE_US 22000
+
+static uint8_t flash[FLASH_SIZE];
+static bool loaded;
+static bool unlocked;
+static FILE *backing;
+
+static void flashLoad() {
+  if (loaded) {
+    return;
+  }
+  loaded = true;
+  memset(flash, 0xFF, sizeof(flash));
+  const char *path = simHostFlashFile();
+  if (path == nullptr) {
+    return;
+  }
+  backing = fopen(path, "r+b");
+  if (backing != nullptr) {
+    size_t n = fread(flash, 1, sizeof(flash), backing);
+    (void)n;  // a short file leaves the rest erased
+    return;
+  }
+  backing = fopen(path, "w+b");
+  if (backing != nullptr) {
+    fwrite(flash, 1, sizeof(flash), backing);
+    fflush(backing);
+  }
+}
+
+static void flashStore(uint32_t offset, size_t len) {
+  if (backing != nullptr) {
+    fseek(backing, (long)offset, SEEK_SET);
+    fwrite(&flash[offset], 1, len, backing);
+    fflush(backing);
+  }
+}
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void) {
+  flashLoad();
+  unlocked = true;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void) {
+  unlocked = false;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data) {
+  flashLoad();
+  uint32_t offset = Address - FLASH_BASE;
+  if (!unlocked || TypeProgram != FLASH_TYPEPROGRAM_DOUBLEWORD || Address < FLASH_BASE ||
+      offset + 8 > FLASH_SIZE || (offset & 7) != 0) {
+    return HAL_ERROR;
+  }
+  for (uint32_t i = 0; i < 8; i++) {
+    if (flash[offset + i] != 0xFF) {
+      return HAL_ERROR;  // PROGERR: the doubleword was not erased
+    }
+  }
+  simHostStall(SIM_FLASH_PROGRAM_US);
+  memcpy(&flash[offset], &Data, 8);
+  flashStore(offset, 8);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *PageError) {
+  flashLoad();
+  *PageError = 0xFFFFFFFF;
+  if (!unlocked || pEraseInit->TypeErase != FLASH_TYPEERASE_PAGES ||
+      pEraseInit->Page + pEraseInit->NbPages > FLASH_SIZE / FLASH_PAGE_SIZE) {
+    return HAL_ERROR;
+  }
+  for (uint32_t p = pEraseInit->Page; p < pEraseInit->Page + pEraseInit->NbPages; p++) {
+    simHostStall(SIM_FLASH_ERASE_US);
+    memset(&flash[p * FLASH_PAGE_SIZE], 0xFF, FLASH_PAGE_SIZE);
+    flashStore(p * FLASH_PAGE_SIZE, FLASH_PAGE_SIZE);
+  }
+  return HAL_OK;
+}
+
+void simFlashRead(uint32_t addr, void *buf, size_t len) {
+  flashLoad();
+  uint32_t offset = addr - FLASH_BASE;
+  if (addr < FLASH_BASE || offset + len > FLASH_SIZE) {
+    memset(buf, 0xFF, len);
+    return;
+  }
+  memcpy(buf, &flash[offset], len);
+}
@@ -0,0 +1,118 @@
+#include <Arduino.h>
+#include "sim_api.h"
+
+// Per-node SPI + DMA model: one transfer at a time on SPI1. The bytes are
+// shifted through the SX1280 model (RadioLib.cpp) when the transfer
+// completes, then the DMA interrupt is raised like the hardware's transfer
+// complete flag.
+
+#define SIM_SPI_START_US 1     // HAL_SPI_*_DMA register setup, CPU
+#define SIM_SPI_PHASE_US 1     // DMA request to first clock, last clock to TC
+#define SIM_SPI_BYTE_NS 1000   // 8 MHz
+
+SPI_TypeDef simSpi1;
+DMA_Channel_TypeDef simDma1Channel2;
+DMA_Channel_TypeDef simDma1Channel3;
+
+void simRadioSpi(const uint8_t *tx, uint8_t *rx, size_t len);  // RadioLib.cpp
+
+struct SimSpiTransfer {
+  SPI_HandleTypeDef *hspi;
+  const uint8_t *tx;
+  uint8_t *rx;     // nullptr for transmit only
+  uint16_t len;
+};
+
+static SimSpiTransfer running;   // on the bus
+static SimSpiTransfer complete;  // TC flag set, not handled yet
+
+extern "C" __attribute__((weak)) void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi) {
+  (void)hspi;
+}
+
+extern "C" __attribute__((weak)) void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) {
+  (void)hspi;
+}
+
+extern "C" __attribute__((weak)) void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi) {
+  (void)hspi;
+}
+
+// Vector table entry; defined by the firmware when it uses SPI DMA
+extern "C" __attribute__((weak)) void DMA1_Channel2_3_IRQHandler(void);
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma) {
+  (void)hdma;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef *hspi) {
+  if (hspi == nullptr || hspi->Instance != SPI1) {
+    return HAL_ERROR;
+  }
+  hspi->State = HAL_SPI_STATE_READY;
+  return HAL_OK;
+}
+
+static HAL_StatusTypeDef start(SPI_HandleTypeDef *hspi, const uint8_t *tx, uint8_t *rx, uint16_t len) {
+  simHostConsume(SIM_SPI_START_US);
+  if (hspi->State != HAL_SPI_STATE_READY || running.hspi != nullptr) {
+    return HAL_BUSY;
+  }
+  hspi->State = HAL_SPI_STATE_BUSY;
+  running = SimSpiTransfer{hspi, tx, rx, len};
+  simHostSpiDma(SIM_SPI_PHASE_US + (uint32_t)(len * SIM_SPI_BYTE_NS / 1000));
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, const uint8_t *pData, uint16_t Size) {
+  return start(hspi, pData, nullptr, Size);
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi, const uint8_t *pTxData, uint8_t *pRxData,
+                                              uint16_t Size) {
+  return start(hspi, pTxData, pRxData, Size);
+}
+
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef *hspi) {
+  simHostSpiAbort();
+  running = SimSpiTransfer{};
+  complete = SimSpiTransfer{};
+  hspi->State = HAL_SPI_STATE_READY;
+  return HAL_OK;
+}
+
+// The RX channel completes a full-duplex transfer, the TX channel a
+// transmit-only one
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma) {
+  simHostConsume(SIM_SPI_START_US);
+  SPI_HandleTypeDef *hspi = complete.hspi;
+  if (hspi == nullptr || hdma != (complete.rx ? hspi->hdmarx : hspi->hdmatx)) {
+    return;
+  }
+  bool rx = complete.rx != nullptr;
+  complete = SimSpiTransfer{};
+  hspi->State = HAL_SPI_STATE_READY;
+  if (rx) {
+    HAL_SPI_TxRxCpltCallback(hspi);
+  } else {
+    HAL_SPI_TxCpltCallback(hspi);
+  }
+}
+
+// SPI v1 closes DMA transfers from the DMA interrupt alone
+void HAL_SPI_IRQHandler(SPI_HandleTypeDef *hspi) {
+  (void)hspi;
+}
+
+SIM_EXPORT void simNodeSpiIrq() {
+  if (running.hspi == nullptr) {
+    return;
+  }
+  simRadioSpi(running.tx, running.rx, running.len);
+  complete = running;
+  running = SimSpiTransfer{};
+  if (DMA1_Channel2_3_IRQHandler) {
+    DMA1_Channel2_3_IRQHandler();
+  }
+}
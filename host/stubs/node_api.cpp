@@ -0,0 +1,44 @@
+#include <Arduino.h>
+#include "sim_api.h"
+#include "can.h"
+#include "tdma.h"
+#include "stats.h"
+
+// Entry points the simulator uses to drive one firmware instance
+
+void setup();
+void loop();
+
+SIM_EXPORT void simNodeSetup() {
+  setup();
+}
+
+SIM_EXPORT void simNodeLoop() {
+  loop();
+}
+
+SIM_EXPORT void simNodeProbe(SimNodeProbe *probe) {
+  probe->txQueued = txBuf.size();
+  probe->rxQueued = rxBuf.size();
+  static_assert(CAN_PRIO_COUNT == SIM_PRIO_CLASSES, "probe class count");
+  for (uint8_t c = 0; c < CAN_PRIO_COUNT; c++) {
+    probe->txDropped[c] = txBuf.dropped(c);
+    probe->rxDropped[c] = rxBuf.dropped(c);
+  }
+  probe->synced = tdmaIsSynced();
+  probe->micros = micros();
+  probe->clockOffsetUs = tdmaClockOffsetUs();
+  probe->txLateMaxUs = stats.txLateMax;
+  probe->txTimerStarts = stats.slotTimerStarts;
+  probe->txPolledStarts = stats.slotPolledStarts;
+  static_assert(TDMA_FOLLOWERS <= SIM_MAX_FOLLOWERS, "probe follower count");
+  for (uint8_t i = 0; i < TDMA_FOLLOWERS; i++) {
+    probe->nodePackets[i] = stats.nodePackets[i];
+    probe->nodeLost[i] = stats.nodeLost[i];
+    probe->nodeRecords[i] = stats.nodeRecords[i];
+  }
+  probe->flogErases = stats.flogErases;
+  probe->flogDropped = stats.flogDropped;
+  probe->flogErasedPages = stats.flogErasedPages;
+  probe->flogErasedMin = stats.flogErasedMin;
+}
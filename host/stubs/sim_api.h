@@ -0,0 +1,91 @@
+/*
+Simulator interface
+
+Narrow C interface between one simulated node (firmware + stubs, built as a
+shared object) and the host simulator that owns the virtual clock, the CAN
+buses and the radio channel.
+
+- simHost*: implemented by the simulator executable, called from the stubs
+- simNode*: exported by every node shared object, called by the simulator
+
+All simHost* calls act on the node the simulator is currently running.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SIM_EXPORT extern "C" __attribute__((visibility("default")))
+
+struct SimCanFrame {
+  uint32_t id;
+  uint8_t ext;       // 29-bit identifier
+  uint8_t fd;        // CAN FD frame
+  uint8_t brs;       // bit-rate switch
+  uint8_t len;       // data length in bytes
+  uint8_t data[64];
+};
+
+enum SimRadioMode : uint8_t {
+  SIM_RADIO_STANDBY,
+  SIM_RADIO_RX,
+  SIM_RADIO_TX
+};
+
+#define SIM_PRIO_CLASSES 3
+#define SIM_MAX_FOLLOWERS 4
+
+// Firmware queue depths and counters sampled by the simulator
+struct SimNodeProbe {
+  uint16_t txQueued;   // CAN -> radio
+  uint16_t rxQueued;   // radio -> CAN
+  uint32_t txDropped[SIM_PRIO_CLASSES];   // per priority class, cumulative
+  uint32_t rxDropped[SIM_PRIO_CLASSES];
+  bool synced;         // follower: TDMA synced to the master
+  uint32_t micros;     // local clock
+  int32_t clockOffsetUs;  // estimate of master - local
+  uint32_t txLateMaxUs;   // slot edge to first preamble symbol, worst this stats period
+  uint32_t txTimerStarts; // TX slots started by the slot timer, cumulative
+  uint32_t txPolledStarts;
+  uint32_t nodePackets[SIM_MAX_FOLLOWERS];  // master, per follower: uplink packets received, cumulative
+  uint32_t nodeLost[SIM_MAX_FOLLOWERS];     // uplink packets missed
+  uint32_t nodeRecords[SIM_MAX_FOLLOWERS];  // records delivered
+  uint32_t flogErases;       // follower, flight log: pages erased, cumulative
+  uint32_t flogDropped;      // records the log had no room for
+  uint16_t flogErasedPages;  // pages erased ahead
+  uint16_t flogErasedMin;    // lowest since boot
+};
+
+// Host side (simulator executable)
+extern "C" {
+uint64_t simHostNowUs();                  // global virtual time
+uint32_t simHostMicros();                 // local clock of the running node
+void simHostConsume(uint32_t us);         // charge CPU time to the running node
+void simHostStall(uint32_t us);           // same, with the core halted: interrupts wait until it is over
+void simHostLog(const char *text, size_t len);
+void simHostRadioMode(SimRadioMode mode);
+void simHostRadioTx(const uint8_t *buf, size_t len, uint32_t toa_us);
+uint32_t simHostTimeOnAir(uint32_t model_us);  // apply configured ToA scaling
+void simHostSpiConflict();                // RadioLib used SPI while the DMA queue held it
+void simHostTimerArm(uint32_t local_us);  // raise simNodeTimerIrq() after local_us, replaces an armed one
+void simHostTimerCancel();
+void simHostSpiDma(uint32_t us);          // raise simNodeSpiIrq() after us, one transfer at a time
+void simHostSpiAbort();
+const char *simHostFlashFile();           // file mirroring the node's flash, nullptr: memory only
+}
+
+// Node side (node shared object)
+SIM_EXPORT void simNodeSetup();
+SIM_EXPORT void simNodeLoop();
+SIM_EXPORT bool simNodeCanRx(const SimCanFrame *frame, bool held);  // false if dropped by the controller;
+                                                                    // held: stored, interrupt left pending
+SIM_EXPORT void simNodeCanIrq();                         // raise pending FDCAN interrupts after a hold
+SIM_EXPORT bool simNodeCanTxPeek(SimCanFrame *frame);    // next frame waiting in the TX FIFO
+SIM_EXPORT void simNodeCanTxDone();                      // head of TX FIFO went out on the bus
+SIM_EXPORT void simNodeRadioTxDone();
+SIM_EXPORT void simNodeRadioRx(const uint8_t *buf, size_t len, bool crc_ok, float rssi, float snr);
+SIM_EXPORT uint32_t simNodeRadioKey();                   // modulation signature, must match to receive
+SIM_EXPORT void simNodeProbe(SimNodeProbe *probe);
+SIM_EXPORT void simNodeTimerIrq();
+SIM_EXPORT void simNodeSpiIrq();                         // SPI DMA transfer complete
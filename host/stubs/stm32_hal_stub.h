@@ -0,0 +1,195 @@
+/*
+STM32 HAL stand-in for host builds
+
+Types, handles and macros referenced by the firmware outside the FDCAN
+driver (GPIO, RCC, status codes, SPI with DMA, flash). Register-level peripherals are plain
+structs so the firmware can take their addresses.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+  HAL_OK      = 0x00U,
+  HAL_ERROR   = 0x01U,
+  HAL_BUSY    = 0x02U,
+  HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+#define DISABLE 0U
+#define ENABLE  1U
+
+typedef struct {
+  uint32_t Pin;
+  uint32_t Mode;
+  uint32_t Pull;
+  uint32_t Speed;
+  uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+typedef struct {
+  uint32_t MODER;
+} GPIO_TypeDef;
+
+extern GPIO_TypeDef simGpioD;
+#define GPIOD (&simGpioD)
+
+#define GPIO_PIN_0 ((uint16_t)0x0001)
+#define GPIO_PIN_1 ((uint16_t)0x0002)
+
+#define GPIO_MODE_AF_PP       0x00000002U
+#define GPIO_NOPULL           0x00000000U
+#define GPIO_SPEED_FREQ_HIGH  0x00000002U
+#define GPIO_AF4_FDCAN1       ((uint8_t)0x04)
+
+void HAL_GPIO_Init(GPIO_TypeDef *port, GPIO_InitTypeDef *init);
+
+typedef struct {
+  uint32_t CNT;
+} TIM_TypeDef;
+
+extern TIM_TypeDef simTim3;
+#define TIM3 (&simTim3)
+
+typedef enum {
+  DMA1_Channel2_3_IRQn = 10,
+  TIM16_FDCAN_IT0_IRQn = 21,
+  TIM17_FDCAN_IT1_IRQn = 22
+} IRQn_Type;
+
+// Only the FDCAN lines are modelled (hal_fdcan.cpp); the SPI DMA vector is
+// always enabled (hal_spi.cpp)
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority);
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn);
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn);
+
+#define __HAL_RCC_GPIOD_CLK_ENABLE()  do {} while (0)
+#define __HAL_RCC_FDCAN1_CLK_ENABLE() do {} while (0)
+#define __HAL_RCC_DMA1_CLK_ENABLE()   do {} while (0)
+
+// SPI and DMA (hal_spi.cpp): one SPI with its RX and TX channels
+typedef struct {
+  uint32_t CR1;
+} SPI_TypeDef;
+
+typedef struct {
+  uint32_t CCR;
+} DMA_Channel_TypeDef;
+
+extern SPI_TypeDef simSpi1;
+extern DMA_Channel_TypeDef simDma1Channel2;
+extern DMA_Channel_TypeDef simDma1Channel3;
+#define SPI1 (&simSpi1)
+#define DMA1_Channel2 (&simDma1Channel2)
+#define DMA1_Channel3 (&simDma1Channel3)
+
+#define DMA_REQUEST_SPI1_RX 16U
+#define DMA_REQUEST_SPI1_TX 17U
+#define DMA_PERIPH_TO_MEMORY 0x00000000U
+#define DMA_MEMORY_TO_PERIPH 0x00000010U
+#define DMA_NORMAL           0x00000000U
+#define DMA_PINC_DISABLE     0x00000000U
+#define DMA_MINC_ENABLE      0x00000080U
+#define DMA_PDATAALIGN_BYTE  0x00000000U
+#define DMA_MDATAALIGN_BYTE  0x00000000U
+#define DMA_PRIORITY_HIGH    0x00002000U
+
+typedef struct {
+  uint32_t Request;
+  uint32_t Direction;
+  uint32_t PeriphInc;
+  uint32_t MemInc;
+  uint32_t PeriphDataAlignment;
+  uint32_t MemDataAlignment;
+  uint32_t Mode;
+  uint32_t Priority;
+} DMA_InitTypeDef;
+
+typedef struct __DMA_HandleTypeDef {
+  DMA_Channel_TypeDef *Instance;
+  DMA_InitTypeDef Init;
+  void *Parent;
+} DMA_HandleTypeDef;
+
+#define SPI_MODE_MASTER            0x00000104U
+#define SPI_DIRECTION_2LINES       0x00000000U
+#define SPI_DATASIZE_8BIT          0x00000700U
+#define SPI_POLARITY_LOW           0x00000000U
+#define SPI_PHASE_1EDGE            0x00000000U
+#define SPI_NSS_SOFT               0x00000200U
+#define SPI_BAUDRATEPRESCALER_8    0x00000010U
+#define SPI_FIRSTBIT_MSB           0x00000000U
+#define SPI_TIMODE_DISABLE         0x00000000U
+#define SPI_CRCCALCULATION_DISABLE 0x00000000U
+#define SPI_NSS_PULSE_DISABLE      0x00000000U
+
+typedef struct {
+  uint32_t Mode;
+  uint32_t Direction;
+  uint32_t DataSize;
+  uint32_t CLKPolarity;
+  uint32_t CLKPhase;
+  uint32_t NSS;
+  uint32_t BaudRatePrescaler;
+  uint32_t FirstBit;
+  uint32_t TIMode;
+  uint32_t CRCCalculation;
+  uint32_t CRCPolynomial;
+  uint32_t CRCLength;
+  uint32_t NSSPMode;
+} SPI_InitTypeDef;
+
+typedef enum {
+  HAL_SPI_STATE_RESET = 0x00U,
+  HAL_SPI_STATE_READY = 0x01U,
+  HAL_SPI_STATE_BUSY  = 0x02U
+} HAL_SPI_StateTypeDef;
+
+typedef struct __SPI_HandleTypeDef {
+  SPI_TypeDef *Instance;
+  SPI_InitTypeDef Init;
+  DMA_HandleTypeDef *hdmatx;
+  DMA_HandleTypeDef *hdmarx;
+  volatile HAL_SPI_StateTypeDef State;
+} SPI_HandleTypeDef;
+
+#define __HAL_LINKDMA(__HANDLE__, __PPP_DMA_FIELD__, __DMA_HANDLE__) \
+  do {                                                             \
+    (__HANDLE__)->__PPP_DMA_FIELD__ = &(__DMA_HANDLE__);           \
+    (__DMA_HANDLE__).Parent = (__HANDLE__);                        \
+  } while (0)
+#define __HAL_SPI_ENABLE(__HANDLE__) ((__HANDLE__)->Instance->CR1 |= 0x40U)
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma);
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma);
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef *hspi);
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, const uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi, const uint8_t *pTxData, uint8_t *pRxData,
+                                              uint16_t Size);
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef *hspi);
+void HAL_SPI_IRQHandler(SPI_HandleTypeDef *hspi);
+
+// Flash (hal_flash.cpp): the C0's 256 KB in 2 KB pages, doubleword
+// programming. Target addresses are not mapped on the host, so the
+// firmware reads through simFlashRead()
+#define FLASH_BASE 0x08000000UL
+#define FLASH_SIZE (256 * 1024)
+#define FLASH_PAGE_SIZE 0x800U
+#define FLASH_TYPEPROGRAM_DOUBLEWORD 0x01U
+#define FLASH_TYPEERASE_PAGES 0x02U
+
+typedef struct {
+  uint32_t TypeErase;
+  uint32_t Page;
+  uint32_t NbPages;
+} FLASH_EraseInitTypeDef;
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *PageError);
+void simFlashRead(uint32_t addr, void *buf, size_t len);
+
+#include "stm32c0xx_hal_fdcan.h"
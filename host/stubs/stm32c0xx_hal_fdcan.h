@@ -0,0 +1,183 @@
+/*
+STM32 FDCAN HAL stand-in for host builds
+
+Mirrors the subset of stm32c0xx_hal_fdcan.h used by the firmware, with the
+same constant values as the G4/C0/U5 FDCAN driver. The message RAM is
+modelled with 3-element RX FIFOs and a 3-element TX FIFO, and filters are
+evaluated like the hardware filter elements. A controller left in
+FDCAN_FRAME_CLASSIC mode does not receive FD frames (protocol error) and
+sends every frame as classic. RX FIFO interrupts raise
+interrupt line 0 (TIM16_FDCAN_IT0_IRQHandler) when enabled in the NVIC.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+typedef struct {
+  uint32_t reserved;
+} FDCAN_GlobalTypeDef;
+
+extern FDCAN_GlobalTypeDef simFdcan1;
+#define FDCAN1 (&simFdcan1)
+
+typedef struct {
+  uint32_t ClockDivider;
+  uint32_t FrameFormat;
+  uint32_t Mode;
+  uint32_t AutoRetransmission;
+  uint32_t TransmitPause;
+  uint32_t ProtocolException;
+  uint32_t NominalPrescaler;
+  uint32_t NominalSyncJumpWidth;
+  uint32_t NominalTimeSeg1;
+  uint32_t NominalTimeSeg2;
+  uint32_t DataPrescaler;
+  uint32_t DataSyncJumpWidth;
+  uint32_t DataTimeSeg1;
+  uint32_t DataTimeSeg2;
+  uint32_t StdFiltersNbr;
+  uint32_t ExtFiltersNbr;
+  uint32_t TxFifoQueueMode;
+} FDCAN_InitTypeDef;
+
+typedef struct {
+  FDCAN_GlobalTypeDef *Instance;
+  FDCAN_InitTypeDef Init;
+  volatile uint32_t ErrorCode;
+} FDCAN_HandleTypeDef;
+
+typedef struct {
+  uint32_t IdType;
+  uint32_t FilterIndex;
+  uint32_t FilterType;
+  uint32_t FilterConfig;
+  uint32_t FilterID1;
+  uint32_t FilterID2;
+} FDCAN_FilterTypeDef;
+
+typedef struct {
+  uint32_t Identifier;
+  uint32_t IdType;
+  uint32_t TxFrameType;
+  uint32_t DataLength;
+  uint32_t ErrorStateIndicator;
+  uint32_t BitRateSwitch;
+  uint32_t FDFormat;
+  uint32_t TxEventFifoControl;
+  uint32_t MessageMarker;
+} FDCAN_TxHeaderTypeDef;
+
+typedef struct {
+  uint32_t Identifier;
+  uint32_t IdType;
+  uint32_t RxFrameType;
+  uint32_t DataLength;
+  uint32_t ErrorStateIndicator;
+  uint32_t BitRateSwitch;
+  uint32_t FDFormat;
+  uint32_t RxTimestamp;
+  uint32_t FilterIndex;
+  uint32_t IsFilterMatchingFrame;
+} FDCAN_RxHeaderTypeDef;
+
+#define FDCAN_CLOCK_DIV1          ((uint32_t)0x00000000U)
+
+#define FDCAN_FRAME_CLASSIC       ((uint32_t)0x00000000U)
+#define FDCAN_FRAME_FD_NO_BRS     ((uint32_t)0x00000100U)
+#define FDCAN_FRAME_FD_BRS        ((uint32_t)0x00000300U)
+
+#define FDCAN_MODE_NORMAL         ((uint32_t)0x00000000U)
+
+#define FDCAN_TX_FIFO_OPERATION   ((uint32_t)0x00000000U)
+#define FDCAN_TX_QUEUE_OPERATION  ((uint32_t)0x01000000U)
+
+#define FDCAN_STANDARD_ID         ((uint32_t)0x00000000U)
+#define FDCAN_EXTENDED_ID         ((uint32_t)0x40000000U)
+
+#define FDCAN_DATA_FRAME          ((uint32_t)0x00000000U)
+#define FDCAN_REMOTE_FRAME        ((uint32_t)0x20000000U)
+
+#define FDCAN_ESI_ACTIVE          ((uint32_t)0x00000000U)
+#define FDCAN_ESI_PASSIVE         ((uint32_t)0x80000000U)
+
+#define FDCAN_BRS_OFF             ((uint32_t)0x00000000U)
+#define FDCAN_BRS_ON              ((uint32_t)0x00100000U)
+
+#define FDCAN_CLASSIC_CAN         ((uint32_t)0x00000000U)
+#define FDCAN_FD_CAN              ((uint32_t)0x00200000U)
+
+#define FDCAN_NO_TX_EVENTS        ((uint32_t)0x00000000U)
+
+#define FDCAN_DLC_BYTES_0         ((uint32_t)0x00000000U)
+#define FDCAN_DLC_BYTES_1         ((uint32_t)0x00000001U)
+#define FDCAN_DLC_BYTES_2         ((uint32_t)0x00000002U)
+#define FDCAN_DLC_BYTES_3         ((uint32_t)0x00000003U)
+#define FDCAN_DLC_BYTES_4         ((uint32_t)0x00000004U)
+#define FDCAN_DLC_BYTES_5         ((uint32_t)0x00000005U)
+#define FDCAN_DLC_BYTES_6         ((uint32_t)0x00000006U)
+#define FDCAN_DLC_BYTES_7         ((uint32_t)0x00000007U)
+#define FDCAN_DLC_BYTES_8         ((uint32_t)0x00000008U)
+#define FDCAN_DLC_BYTES_12        ((uint32_t)0x00000009U)
+#define FDCAN_DLC_BYTES_16        ((uint32_t)0x0000000AU)
+#define FDCAN_DLC_BYTES_20        ((uint32_t)0x0000000BU)
+#define FDCAN_DLC_BYTES_24        ((uint32_t)0x0000000CU)
+#define FDCAN_DLC_BYTES_32        ((uint32_t)0x0000000DU)
+#define FDCAN_DLC_BYTES_48        ((uint32_t)0x0000000EU)
+#define FDCAN_DLC_BYTES_64        ((uint32_t)0x0000000FU)
+
+#define FDCAN_FILTER_RANGE        ((uint32_t)0x00000000U)
+#define FDCAN_FILTER_DUAL         ((uint32_t)0x00000001U)
+#define FDCAN_FILTER_MASK         ((uint32_t)0x00000002U)
+
+#define FDCAN_FILTER_DISABLE      ((uint32_t)0x00000000U)
+#define FDCAN_FILTER_TO_RXFIFO0   ((uint32_t)0x00000001U)
+#define FDCAN_FILTER_TO_RXFIFO1   ((uint32_t)0x00000002U)
+#define FDCAN_FILTER_REJECT       ((uint32_t)0x00000003U)
+
+#define FDCAN_ACCEPT_IN_RX_FIFO0  ((uint32_t)0x00000000U)
+#define FDCAN_ACCEPT_IN_RX_FIFO1  ((uint32_t)0x00000001U)
+#define FDCAN_REJECT              ((uint32_t)0x00000002U)
+
+#define FDCAN_FILTER_REMOTE       ((uint32_t)0x00000000U)
+#define FDCAN_REJECT_REMOTE       ((uint32_t)0x00000001U)
+
+#define FDCAN_RX_FIFO0            ((uint32_t)0x00000040U)
+#define FDCAN_RX_FIFO1            ((uint32_t)0x00000041U)
+
+#define FDCAN_IT_RX_FIFO0_NEW_MESSAGE  ((uint32_t)0x00000001U)
+#define FDCAN_IT_RX_FIFO0_FULL         ((uint32_t)0x00000002U)
+#define FDCAN_IT_RX_FIFO0_MESSAGE_LOST ((uint32_t)0x00000004U)
+#define FDCAN_IT_RX_FIFO1_NEW_MESSAGE  ((uint32_t)0x00000008U)
+#define FDCAN_IT_RX_FIFO1_FULL         ((uint32_t)0x00000010U)
+#define FDCAN_IT_RX_FIFO1_MESSAGE_LOST ((uint32_t)0x00000020U)
+
+#define HAL_FDCAN_ERROR_NONE      ((uint32_t)0x00000000U)
+#define HAL_FDCAN_ERROR_PARAM     ((uint32_t)0x00000080U)
+#define HAL_FDCAN_ERROR_FIFO_EMPTY ((uint32_t)0x00000200U)
+#define HAL_FDCAN_ERROR_FIFO_FULL ((uint32_t)0x00000400U)
+
+HAL_StatusTypeDef HAL_FDCAN_Init(FDCAN_HandleTypeDef *hfdcan);
+HAL_StatusTypeDef HAL_FDCAN_ConfigFilter(FDCAN_HandleTypeDef *hfdcan, FDCAN_FilterTypeDef *sFilterConfig);
+HAL_StatusTypeDef HAL_FDCAN_ConfigGlobalFilter(FDCAN_HandleTypeDef *hfdcan, uint32_t NonMatchingStd,
+                                               uint32_t NonMatchingExt, uint32_t RejectRemoteStd,
+                                               uint32_t RejectRemoteExt);
+HAL_StatusTypeDef HAL_FDCAN_ConfigTxDelayCompensation(FDCAN_HandleTypeDef *hfdcan, uint32_t TdcOffset,
+                                                      uint32_t TdcFilter);
+HAL_StatusTypeDef HAL_FDCAN_EnableTxDelayCompensation(FDCAN_HandleTypeDef *hfdcan);
+HAL_StatusTypeDef HAL_FDCAN_Start(FDCAN_HandleTypeDef *hfdcan);
+uint32_t HAL_FDCAN_GetRxFifoFillLevel(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo);
+HAL_StatusTypeDef HAL_FDCAN_GetRxMessage(FDCAN_HandleTypeDef *hfdcan, uint32_t RxLocation,
+                                         FDCAN_RxHeaderTypeDef *pRxHeader, uint8_t *pRxData);
+uint32_t HAL_FDCAN_GetTxFifoFreeLevel(FDCAN_HandleTypeDef *hfdcan);
+HAL_StatusTypeDef HAL_FDCAN_AddMessageToTxFifoQ(FDCAN_HandleTypeDef *hfdcan, FDCAN_TxHeaderTypeDef *pTxHeader,
+                                                uint8_t *pTxData);
+
+HAL_StatusTypeDef HAL_FDCAN_ActivateNotification(FDCAN_HandleTypeDef *hfdcan, uint32_t ActiveITs,
+                                                 uint32_t BufferIndexes);
+HAL_StatusTypeDef HAL_FDCAN_DeactivateNotification(FDCAN_HandleTypeDef *hfdcan, uint32_t InactiveITs);
+void HAL_FDCAN_IRQHandler(FDCAN_HandleTypeDef *hfdcan);
+
+extern "C" void HAL_FDCAN_MspInit(FDCAN_HandleTypeDef *hfdcan);
+extern "C" void HAL_FDCAN_RxFifo0Callback(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo0ITs);
+extern "C" void HAL_FDCAN_RxFifo1Callback(FDCAN_HandleTypeDef *hfdcan, uint32_t RxFifo1ITs);
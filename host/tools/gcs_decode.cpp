@@ -0,0 +1,435 @@
+// Decoder for the GCS stream (gcsstream.h): reads the bridge's Serial
+// output from a serial port, a capture file or stdin, prints the records
+// as candump log lines and reports throughput, lost and corrupt frames and,
+// with the flight log, which logged records never arrived live or as backfill.
+// Each follower (the frame's node) is its own interface and flight log.
+//
+//   gcs_decode /dev/ttyACM0 -b 921600 > flight.log
+//   brage_sim --serial-out cap.bin && gcs_decode -q cap.bin
+
+#define GCS_STREAM_WIRE_ONLY
+#include "gcsstream.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+struct Options {
+  const char *input = "-";
+  uint32_t baud = GCS_STREAM_BAUD;
+  const char *iface = "can0";
+  const char *backfillIface = "bf0";
+  bool quiet = false;      // no candump lines
+  bool text = false;       // echo text logs to stderr
+  double reportS = 0;      // periodic report on stderr, 0: only at the end
+  bool json = false;
+};
+
+struct Counters {
+  uint64_t records = 0;
+  uint64_t dataBytes = 0;
+  uint64_t lineBytes = 0;
+  uint64_t lost = 0;       // seq gaps, corrupt frames included
+  uint64_t gaps = 0;       // places where frames went missing
+  uint64_t corrupt = 0;    // COBS, length or CRC errors
+  uint64_t textLines = 0;  // firmware logs between frames
+  uint64_t restarts = 0;   // seq jumped backwards
+  uint64_t firstUs = 0;    // device time, 64-bit extended
+  uint64_t lastUs = 0;
+  uint64_t maxGapUs = 0;   // longest time between records
+  uint64_t logLive = 0;    // flight log numbers first seen live
+  uint64_t logBackfill = 0;  // first seen as backfill
+  uint64_t logDuplicates = 0;
+};
+
+// Per sending node: every follower numbers its own flight log
+struct NodeLog {
+  uint64_t records = 0;
+  uint64_t dataBytes = 0;
+  std::set<uint64_t> logSeen;  // flight log numbers, 16-bit wire value extended
+  uint64_t logNewest = 0;
+};
+
+static Counters total;
+static bool started;
+static uint16_t nextSeq;
+static uint32_t lastRxUs;
+static uint64_t deviceUs;
+static std::map<uint8_t, NodeLog> nodes;
+
+static void usage(const char *argv0) {
+  printf("Usage: %s [options] [INPUT]\n"
+         "  INPUT                serial device, capture file or - for stdin (-)\n"
+         "  -b BAUD              serial device bit rate (%u)\n"
+         "  -i IFACE             interface name in candump lines (can0); follower N > 1 gets IFACE.N\n"
+         "  -I IFACE             interface name of backfilled records, at the rocket's time (bf0)\n"
+         "  -q                   no candump lines, report only\n"
+         "  -t                   echo firmware text logs to stderr\n"
+         "  -r S                 report every S seconds of input\n"
+         "  --json               final report as JSON on stdout\n",
+         argv0, GCS_STREAM_BAUD);
+}
+
+static speed_t baudFlag(uint32_t baud) {
+  switch (baud) {
+  case 115200: return B115200;
+  case 230400: return B230400;
+  case 460800: return B460800;
+  case 921600: return B921600;
+  case 1000000: return B1000000;
+  case 2000000: return B2000000;
+  default: return 0;
+  }
+}
+
+static int openInput(const Options &opt) {
+  if (strcmp(opt.input, "-") == 0) {
+    return STDIN_FILENO;
+  }
+  int fd = open(opt.input, O_RDONLY | O_NOCTTY);
+  if (fd < 0) {
+    perror(opt.input);
+    return -1;
+  }
+  if (!isatty(fd)) {
+    return fd;
+  }
+  speed_t speed = baudFlag(opt.baud);
+  struct termios tio;
+  if (speed == 0 || tcgetattr(fd, &tio) != 0) {
+    fprintf(stderr, "%s: cannot set %u baud\n", opt.input, opt.baud);
+    close(fd);
+    return -1;
+  }
+  cfmakeraw(&tio);
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+  tio.c_cc[VMIN] = 1;
+  tio.c_cc[VTIME] = 0;
+  tcsetattr(fd, TCSANOW, &tio);
+  tcflush(fd, TCIFLUSH);
+  return fd;
+}
+
+// Returns the decoded length, 0 if the block is not valid COBS
+static size_t cobsDecode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t o = 0;
+  size_t i = 0;
+  while (i < len) {
+    uint8_t code = in[i++];
+    if (code == 0 || i + code - 1 > len) {
+      return 0;
+    }
+    for (uint8_t k = 1; k < code; k++) {
+      out[o++] = in[i++];
+    }
+    if (code != 0xFF && i < len) {
+      out[o++] = 0;
+    }
+  }
+  return o;
+}
+
+static bool isText(const uint8_t *buf, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    uint8_t c = buf[i];
+    if ((c < 0x20 || c > 0x7E) && c != '\n' && c != '\r' && c != '\t') {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void handleText(const Options &opt, const uint8_t *buf, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    total.textLines += (buf[i] == '\n');
+  }
+  if (opt.text) {
+    fwrite(buf, 1, len, stderr);
+  }
+}
+
+static void printRecord(const gcsStreamHeader &h, const uint8_t *data, uint64_t us, const char *base) {
+  char iface[64];
+  if (h.node > 1) {
+    snprintf(iface, sizeof(iface), "%s.%u", base, h.node);
+  } else {
+    snprintf(iface, sizeof(iface), "%s", base);
+  }
+  uint32_t id = h.id & GCS_STREAM_ID_MASK;
+  bool ext = h.id & GCS_STREAM_ID_EXT;
+  bool fd = h.id & GCS_STREAM_ID_FD;
+  char line[32 + 2 * 64];
+  int n = snprintf(line, sizeof(line), ext ? "%08X#" : "%03X#", id);
+  if (fd) {
+    n += snprintf(&line[n], sizeof(line) - n, "#%X", (h.id & GCS_STREAM_ID_BRS) ? 1 : 0);
+  }
+  for (uint8_t i = 0; i < h.len; i++) {
+    n += snprintf(&line[n], sizeof(line) - n, "%02X", data[i]);
+  }
+  printf("(%llu.%06llu) %s %s\n", (unsigned long long)(us / 1000000), (unsigned long long)(us % 1000000), iface,
+         line);
+}
+
+static bool decodeFrame(const uint8_t *buf, size_t len, uint8_t *frame, gcsStreamHeader &h) {
+  size_t n = len <= GCS_STREAM_ENCODED_MAX ? cobsDecode(buf, len, frame) : 0;
+  if (n < sizeof(h) + GCS_STREAM_CRC_LEN) {
+    return false;
+  }
+  memcpy(&h, frame, sizeof(h));
+  return h.type >= GCS_STREAM_TYPE_RECORD && h.type <= GCS_STREAM_TYPE_BACKFILL && h.len <= 64 && n == sizeof(h) + h.len + GCS_STREAM_CRC_LEN &&
+         gcsStreamCrc(frame, n - GCS_STREAM_CRC_LEN) == (frame[n - 2] | frame[n - 1] << 8);
+}
+
+// One block between two 0x00 bytes: a frame, log lines, or log lines
+// followed by a frame (logs carry no delimiter of their own)
+static void handleBlock(const Options &opt, const std::vector<uint8_t> &block) {
+  if (block.empty()) {
+    return;
+  }
+  uint8_t frame[GCS_STREAM_ENCODED_MAX];
+  gcsStreamHeader h;
+  bool ok = decodeFrame(block.data(), block.size(), frame, h);
+  for (size_t i = 0; !ok && i < block.size() && isText(block.data(), i + 1); i++) {
+    if (block[i] == '\n' && decodeFrame(&block[i + 1], block.size() - i - 1, frame, h)) {
+      handleText(opt, block.data(), i + 1);
+      ok = true;
+    }
+  }
+  if (!ok) {
+    if (isText(block.data(), block.size())) {
+      handleText(opt, block.data(), block.size());
+    } else {
+      total.corrupt++;
+    }
+    return;
+  }
+
+  NodeLog &node = nodes[h.node];
+  node.records++;
+  node.dataBytes += h.len;
+  if (h.type != GCS_STREAM_TYPE_RECORD) {
+    uint64_t seq = h.log_seq;
+    if (!node.logSeen.empty()) {
+      seq = node.logNewest + (int16_t)(h.log_seq - (uint16_t)node.logNewest);
+    }
+    if (node.logSeen.empty() || seq > node.logNewest) {
+      node.logNewest = seq;
+    }
+    if (!node.logSeen.insert(seq).second) {
+      total.logDuplicates++;
+    } else if (h.type == GCS_STREAM_TYPE_BACKFILL) {
+      total.logBackfill++;
+    } else {
+      total.logLive++;
+    }
+  }
+  if (h.type == GCS_STREAM_TYPE_BACKFILL) {
+    // Not on the link's timeline: rx_us is the rocket's time of logging in ms
+    nextSeq = h.seq + 1;
+    total.records++;
+    total.dataBytes += h.len;
+    if (!opt.quiet) {
+      printRecord(h, &frame[sizeof(h)], (uint64_t)h.rx_us * 1000, opt.backfillIface);
+    }
+    return;
+  }
+
+  if (started) {
+    uint16_t gap = (uint16_t)(h.seq - nextSeq);
+    if (gap >= 0x8000) {
+      total.restarts++;  // the bridge rebooted or frames came back out of order
+    } else if (gap > 0) {
+      total.lost += gap;
+      total.gaps++;
+    }
+    // Small steps back happen when ARQ releases older records with a newer packet
+    int32_t step = (int32_t)(h.rx_us - lastRxUs);
+    deviceUs += step;
+    if (step > 0 && (uint64_t)step > total.maxGapUs) {
+      total.maxGapUs = (uint64_t)step;
+    }
+  } else {
+    deviceUs = h.rx_us;
+    total.firstUs = deviceUs;
+    started = true;
+  }
+  nextSeq = h.seq + 1;
+  lastRxUs = h.rx_us;
+  total.lastUs = deviceUs;
+  total.records++;
+  total.dataBytes += h.len;
+
+  if (!opt.quiet) {
+    printRecord(h, &frame[sizeof(h)], deviceUs, opt.iface);
+  }
+}
+
+// Numbers between the first and the newest seen that never arrived
+static uint64_t logMissing(const NodeLog &node, uint64_t &ranges) {
+  ranges = 0;
+  if (node.logSeen.empty()) {
+    return 0;
+  }
+  uint64_t missing = 0;
+  uint64_t prev = *node.logSeen.begin();
+  for (uint64_t seq : node.logSeen) {
+    if (seq > prev + 1) {
+      missing += seq - prev - 1;
+      ranges++;
+    }
+    prev = seq;
+  }
+  return missing;
+}
+
+static void report(FILE *out, bool json) {
+  uint64_t ranges = 0;
+  uint64_t missing = 0;
+  bool logged = false;
+  for (const auto &n : nodes) {
+    uint64_t r;
+    missing += logMissing(n.second, r);
+    ranges += r;
+    logged = logged || !n.second.logSeen.empty();
+  }
+  double spanS = total.lastUs > total.firstUs ? (total.lastUs - total.firstUs) / 1e6 : 0;
+  double rate = spanS > 0 ? total.records / spanS : 0;
+  double dataRate = spanS > 0 ? total.dataBytes / spanS : 0;
+  double lineRate = spanS > 0 ? total.lineBytes / spanS : 0;
+  double lossPct = total.records + total.lost ? 100.0 * total.lost / (total.records + total.lost) : 0;
+  if (json) {
+    fprintf(out, "{\"records\":%llu,\"span_s\":%.3f,\"records_per_s\":%.1f,\"data_bytes_per_s\":%.1f,"
+            "\"line_bytes_per_s\":%.1f,\"lost\":%llu,\"gaps\":%llu,\"loss_pct\":%.3f,\"corrupt\":%llu,"
+            "\"text_lines\":%llu,\"restarts\":%llu,\"max_gap_ms\":%.3f,\"log_live\":%llu,"
+            "\"log_backfill\":%llu,\"log_duplicates\":%llu,\"log_missing\":%llu,\"log_missing_ranges\":%llu,"
+            "\"nodes\":[",
+            (unsigned long long)total.records, spanS, rate, dataRate, lineRate, (unsigned long long)total.lost,
+            (unsigned long long)total.gaps, lossPct, (unsigned long long)total.corrupt,
+            (unsigned long long)total.textLines, (unsigned long long)total.restarts, total.maxGapUs / 1e3,
+            (unsigned long long)total.logLive, (unsigned long long)total.logBackfill,
+            (unsigned long long)total.logDuplicates, (unsigned long long)missing, (unsigned long long)ranges);
+    const char *sep = "";
+    for (const auto &n : nodes) {
+      uint64_t r;
+      uint64_t m = logMissing(n.second, r);
+      fprintf(out, "%s{\"node\":%u,\"records\":%llu,\"records_per_s\":%.1f,\"data_bytes_per_s\":%.1f,"
+              "\"log_missing\":%llu}",
+              sep, n.first, (unsigned long long)n.second.records, spanS > 0 ? n.second.records / spanS : 0,
+              spanS > 0 ? n.second.dataBytes / spanS : 0, (unsigned long long)m);
+      sep = ",";
+    }
+    fprintf(out, "]}\n");
+    return;
+  }
+  fprintf(out, "[GCS] %llu records over %.3f s: %.1f rec/s, %.1f data B/s, %.1f line B/s\n",
+          (unsigned long long)total.records, spanS, rate, dataRate, lineRate);
+  fprintf(out, "[GCS] lost %llu frames in %llu gaps (%.3f%%), %llu corrupt, %llu text lines, %llu restarts, "
+          "longest silence %.3f ms\n",
+          (unsigned long long)total.lost, (unsigned long long)total.gaps, lossPct,
+          (unsigned long long)total.corrupt, (unsigned long long)total.textLines,
+          (unsigned long long)total.restarts, total.maxGapUs / 1e3);
+  if (logged) {
+    fprintf(out, "[GCS] flight log %llu live, %llu backfilled, %llu duplicates, %llu missing in %llu ranges\n",
+            (unsigned long long)total.logLive, (unsigned long long)total.logBackfill,
+            (unsigned long long)total.logDuplicates, (unsigned long long)missing, (unsigned long long)ranges);
+  }
+  if (nodes.size() > 1) {
+    for (const auto &n : nodes) {
+      uint64_t r;
+      uint64_t m = logMissing(n.second, r);
+      fprintf(out, "[GCS] node %u: %llu records, %.1f rec/s, %.1f data B/s, %llu log numbers missing\n", n.first,
+              (unsigned long long)n.second.records, spanS > 0 ? n.second.records / spanS : 0,
+              spanS > 0 ? n.second.dataBytes / spanS : 0, (unsigned long long)m);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  Options opt;
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    const char *v = (i + 1 < argc) ? argv[i + 1] : nullptr;
+    if (a == "-h" || a == "--help") {
+      usage(argv[0]);
+      return 0;
+    } else if (a == "-q") {
+      opt.quiet = true;
+    } else if (a == "-t") {
+      opt.text = true;
+    } else if (a == "--json") {
+      opt.json = true;
+    } else if (a == "-b" && v) {
+      opt.baud = (uint32_t)strtoul(v, nullptr, 0);
+      i++;
+    } else if (a == "-i" && v) {
+      opt.iface = v;
+      i++;
+    } else if (a == "-I" && v) {
+      opt.backfillIface = v;
+      i++;
+    } else if (a == "-r" && v) {
+      opt.reportS = atof(v);
+      i++;
+    } else if (a[0] != '-' || a == "-") {
+      opt.input = argv[i];
+    } else {
+      fprintf(stderr, "Bad option: %s\n", a.c_str());
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  int fd = openInput(opt);
+  if (fd < 0) {
+    return 1;
+  }
+
+  std::vector<uint8_t> block;
+  uint8_t buf[4096];
+  uint64_t nextReportUs = 0;
+  while (true) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    total.lineBytes += (uint64_t)n;
+    for (ssize_t i = 0; i < n; i++) {
+      if (buf[i] != 0) {
+        block.push_back(buf[i]);
+        continue;
+      }
+      handleBlock(opt, block);
+      block.clear();
+    }
+    if (opt.reportS > 0 && started && total.lastUs >= nextReportUs) {
+      if (nextReportUs != 0) {
+        report(stderr, false);
+      }
+      nextReportUs = total.lastUs + (uint64_t)(opt.reportS * 1e6);
+    }
+  }
+  if (isText(block.data(), block.size())) {
+    handleBlock(opt, block);  // a log line after the last frame
+  } else if (!block.empty()) {
+    total.corrupt++;  // cut off mid frame
+  }
+
+  fflush(stdout);
+  report(opt.json ? stdout : stderr, opt.json);
+  if (fd != STDIN_FILENO) {
+    close(fd);
+  }
+  return 0;
+}
@@ -21,6 +21,39 @@
   #define FDCAN_TX_GPIO GPIO_PIN_1
   #define FDCAN_ALTERNATE GPIO_AF4_FDCAN1
 
+  // FDCAN interrupt line 0 shares its vector with TIM16
+  #define FDCAN_IT0_IRQn TIM16_FDCAN_IT0_IRQn
+  #define FDCAN_IT0_IRQHandler TIM16_FDCAN_IT0_IRQHandler
+
+  // Slot timer: TIM16/17 share vectors with FDCAN; the core's HardwareTimer
+  // is compiled out here (hal_conf_extra.h), so slottimer.cpp owns the vector
+  #define SLOT_TIMER TIM3
+  #define SLOT_TIMER_IRQn TIM3_IRQn
+  #define SLOT_TIMER_IRQHandler TIM3_IRQHandler
+  #define SLOT_TIMER_CLK_ENABLE() __HAL_RCC_TIM3_CLK_ENABLE()
+
+  // SX1280 on the core's default SPI; DMA for radiospi.cpp, both channels
+  // on one vector
+  #define RADIO_SPI SPI1
+  #define RADIO_SPI_PRESCALER SPI_BAUDRATEPRESCALER_8  // 6 MHz from 48 MHz
+  #define RADIO_SPI_DMA_RX DMA1_Channel2
+  #define RADIO_SPI_DMA_TX DMA1_Channel3
+  #define RADIO_SPI_DMA_RX_REQUEST DMA_REQUEST_SPI1_RX
+  #define RADIO_SPI_DMA_TX_REQUEST DMA_REQUEST_SPI1_TX
+  #define RADIO_SPI_DMA_CLK_ENABLE() __HAL_RCC_DMA1_CLK_ENABLE()
+  #define RADIO_SPI_DMA_IRQn DMA1_Channel2_3_IRQn
+  #define RADIO_SPI_DMA_IRQHandler DMA1_Channel2_3_IRQHandler
+
+  // Flight log (flightlog.h): upper half of the 256 KB single-bank flash.
+  // Programming and erasing stall every fetch from flash, interrupts included
+  #define FLOG_FLASH_BASE 0x08020000
+  #define FLOG_FIRST_PAGE 64     // FLASH_PAGE_SIZE (2 KB) pages from FLASH_BASE
+  #define FLOG_PAGES 64
+  #define FLOG_UNIT 8            // doubleword programming
+  #define FLOG_PROGRAM_US 85     // per unit
+  #define FLOG_ERASE_US 22000    // per page
+  #define FLOG_HOLDS_IRQS 1      // interrupts wait for a program or erase too
+
 #endif
 
 #if defined (STM32U5xx)
@@ -43,4 +76,34 @@
   #define FDCAN_TX_GPIO GPIO_PIN_9
   #define FDCAN_ALTERNATE GPIO_AF9_FDCAN1
 
+  #define FDCAN_IT0_IRQn FDCAN1_IT0_IRQn
+  #define FDCAN_IT0_IRQHandler FDCAN1_IT0_IRQHandler
+
+  #define SLOT_TIMER TIM3
+
+  #define RADIO_SPI SPI1
+  #define RADIO_SPI_PRESCALER SPI_BAUDRATEPRESCALER_16  // 10 MHz from 160 MHz
+  #define RADIO_SPI_DMA_RX GPDMA1_Channel0
+  #define RADIO_SPI_DMA_TX GPDMA1_Channel1
+  #define RADIO_SPI_DMA_RX_REQUEST GPDMA1_REQUEST_SPI1_RX
+  #define RADIO_SPI_DMA_TX_REQUEST GPDMA1_REQUEST_SPI1_TX
+  #define RADIO_SPI_DMA_CLK_ENABLE() __HAL_RCC_GPDMA1_CLK_ENABLE()
+  #define RADIO_SPI_DMA_RX_IRQn GPDMA1_Channel0_IRQn
+  #define RADIO_SPI_DMA_RX_IRQHandler GPDMA1_Channel0_IRQHandler
+  #define RADIO_SPI_DMA_TX_IRQn GPDMA1_Channel1_IRQn
+  #define RADIO_SPI_DMA_TX_IRQHandler GPDMA1_Channel1_IRQHandler
+  #define RADIO_SPI_IRQn SPI1_IRQn
+  #define RADIO_SPI_IRQHandler SPI1_IRQHandler
+
+  // Flight log (flightlog.h): start of bank 2 of a 2 MB part, 8 KB pages;
+  // the code runs from bank 1 and keeps running while bank 2 is busy
+  #define FLOG_FLASH_BASE 0x08100000
+  #define FLOG_FLASH_BANK FLASH_BANK_2
+  #define FLOG_FIRST_PAGE 0      // FLASH_PAGE_SIZE pages from the bank start
+  #define FLOG_PAGES 64
+  #define FLOG_UNIT 16           // quadword programming
+  #define FLOG_PROGRAM_US 120
+  #define FLOG_ERASE_US 1500
+  #define FLOG_HOLDS_IRQS 0
+
 #endif
\ No newline at end of file
@@ -0,0 +1,32 @@
+#include "pktpool.h"
+#include "stats.h"
+
+static_assert(PKT_POOL_LEN <= 8, "pool bitmap");
+
+static radioPacket pool[PKT_POOL_LEN];
+static uint8_t used;  // bit i: pool[i] taken
+
+radioPacket *pktAlloc() {
+  for (uint8_t i = 0; i < PKT_POOL_LEN; i++) {
+    if (!(used & (1u << i))) {
+      used |= (uint8_t)(1u << i);
+      return &pool[i];
+    }
+  }
+  stats.pktPoolEmpty++;
+  return nullptr;
+}
+
+void pktFree(radioPacket *pkt) {
+  if (pkt != nullptr) {
+    used &= (uint8_t)~(1u << (pkt - pool));
+  }
+}
+
+uint8_t pktFreeCount() {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < PKT_POOL_LEN; i++) {
+    n += !(used & (1u << i));
+  }
+  return n;
+}
@@ -0,0 +1,33 @@
+/*
+Packet pool
+
+Static radio packet buffers shared by the TDMA and radio layers, so a
+packet is packed once in place and then only passed by pointer
+
+Ownership:
+- TX: tdma.cpp takes a buffer and packs it; radioTransmit() or
+  radioStageTx() take it over and free it on TX_DONE, on failure or when
+  the staged packet is cancelled
+- RX: handleRadioRx() reads the packet into a buffer and frees it once
+  tdmaProcessRx() returns
+- Only the main loop allocates and frees (the slot timer interrupt sends a
+  staged packet but never releases it)
+- One TX packet is in flight at a time and RX is handled in between, so
+  PKT_POOL_LEN leaves one spare
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define PKT_MAX_LEN 250  // MAX_PAYLOAD_LENGTH
+#define PKT_POOL_LEN 3
+
+struct radioPacket {
+  uint8_t len;
+  uint8_t data[PKT_MAX_LEN];
+};
+
+radioPacket *pktAlloc();  // nullptr if the pool is empty (counted in stats)
+void pktFree(radioPacket *pkt);
+uint8_t pktFreeCount();
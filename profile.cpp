@@ -0,0 +1,169 @@
+#include "profile.h"
+
+#if PROFILE_ENABLE
+
+#include <Arduino.h>
+#include <stdio.h>
+
+#define PROFILE_LINE_MAX 64  // smallest stm32duino Serial TX buffer
+
+struct profileStage {
+  uint32_t count;
+  uint32_t max;
+  uint32_t hist[PROFILE_BUCKETS];
+};
+
+static profileStage stages[PROF_STAGE_COUNT];
+
+static const char *const kStageNames[PROF_STAGE_COUNT] = {
+  "loop", "can_rx", "can_isr", "radio_irq", "radio_read",
+  "tdma_rx", "tdma_update", "tdma_tx", "can_tx",
+};
+
+// Dump cursor: stage being printed, next bucket (-1 = stage summary line)
+static uint8_t dumpStage = PROF_STAGE_COUNT;
+static int8_t dumpBucket;
+static bool dumpBanner;
+#if PROFILE_AUTO_DUMP_MS
+static uint32_t lastDumpMs;
+#endif
+
+void profileInit() {
+  memset(stages, 0, sizeof(stages));
+#if !defined(BRAGE_HOST) && __CORTEX_M >= 3
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+}
+
+uint32_t profileCycles() {
+#if defined(BRAGE_HOST)
+  return micros() * PROFILE_HOST_MHZ;
+#elif __CORTEX_M >= 3
+  return DWT->CYCCNT;
+#else
+  // Re-read if the tick interrupt ran in between
+  uint32_t ms, val;
+  do {
+    ms = HAL_GetTick();
+    val = SysTick->VAL;
+  } while (ms != HAL_GetTick());
+  uint32_t reload = SysTick->LOAD;
+  return ms * (reload + 1) + (reload - val);
+#endif
+}
+
+static uint8_t bucketOf(uint32_t cycles) {
+  uint8_t b = 0;
+  while (cycles != 0 && b < PROFILE_BUCKETS - 1) {
+    cycles >>= 1;
+    b++;
+  }
+  return b;
+}
+
+void profileRecord(ProfileStage stage, uint32_t cycles) {
+  profileStage &s = stages[stage];
+  s.count++;
+  if (cycles > s.max) {
+    s.max = cycles;
+  }
+  s.hist[bucketOf(cycles)]++;
+}
+
+static uint32_t coreMhz() {
+#if defined(BRAGE_HOST)
+  return PROFILE_HOST_MHZ;
+#else
+  return SystemCoreClock / 1000000;
+#endif
+}
+
+// Builds the next dump line into line and advances the cursor; returns its
+// length, 0 when the dump is finished
+static int nextLine(char *line) {
+  if (dumpBanner) {
+    dumpBanner = false;
+    return snprintf(line, PROFILE_LINE_MAX, "[PROF] cycles at %lu MHz, b<n> = [2^(n-1), 2^n)\n",
+                    (unsigned long)coreMhz());
+  }
+  while (dumpStage < PROF_STAGE_COUNT) {
+    const profileStage &s = stages[dumpStage];
+    const char *name = kStageNames[dumpStage];
+
+    if (dumpBucket < 0) {
+      dumpBucket = 0;
+      return snprintf(line, PROFILE_LINE_MAX, "[PROF] %s n=%lu max=%lu\n",
+                      name, (unsigned long)s.count, (unsigned long)s.max);
+    }
+
+    // As many non-empty buckets as fit the line
+    int len = snprintf(line, PROFILE_LINE_MAX, "[PROF] %s", name);
+    int head = len;
+    while (dumpBucket < PROFILE_BUCKETS) {
+      if (s.hist[dumpBucket] == 0) {
+        dumpBucket++;
+        continue;
+      }
+      char item[24];
+      int n = snprintf(item, sizeof(item), " b%d:%lu", dumpBucket, (unsigned long)s.hist[dumpBucket]);
+      if (len + n + 1 >= PROFILE_LINE_MAX) {
+        break;
+      }
+      memcpy(line + len, item, n);
+      len += n;
+      dumpBucket++;
+    }
+    if (len > head) {
+      line[len++] = '\n';
+      line[len] = '\0';
+      return len;
+    }
+
+    dumpStage++;
+    dumpBucket = -1;
+  }
+  return 0;
+}
+
+void profilePoll() {
+  bool start = false;
+  while (Serial.available() > 0) {
+    if (Serial.read() == PROFILE_DUMP_CHAR) {
+      start = true;
+    }
+  }
+#if PROFILE_AUTO_DUMP_MS
+  if (millis() - lastDumpMs >= PROFILE_AUTO_DUMP_MS) {
+    lastDumpMs = millis();
+    start = true;
+  }
+#endif
+  if (start && dumpStage >= PROF_STAGE_COUNT) {
+    dumpStage = 0;
+    dumpBucket = -1;
+    dumpBanner = true;
+  }
+  if (dumpStage >= PROF_STAGE_COUNT && !dumpBanner) {
+    return;
+  }
+
+  // Peek the next line's length first: only emit it if it will not block
+  uint8_t stage = dumpStage;
+  int8_t bucket = dumpBucket;
+  bool banner = dumpBanner;
+  char line[PROFILE_LINE_MAX];
+  int len = nextLine(line);
+  if (len > 0 && Serial.availableForWrite() < len) {
+    dumpStage = stage;
+    dumpBucket = bucket;
+    dumpBanner = banner;
+    return;
+  }
+  if (len > 0) {
+    Serial.write((const uint8_t *)line, len);
+  }
+}
+
+#endif
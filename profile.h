@@ -0,0 +1,87 @@
+/*
+Loop profiler
+
+Optional cycle timing of the main loop's stages (PROFILE_ENABLE). With it off
+every macro expands to nothing and this layer adds no code or RAM.
+
+Cycle source:
+- Cortex-M33 (STM32U5): DWT->CYCCNT
+- Cortex-M0+ (STM32C0, no DWT cycle counter): HAL tick * SysTick reload plus
+  the SysTick down-counter, exact to a cycle between tick interrupts
+- Host builds: micros() of the simulator clock, scaled to PROFILE_HOST_MHZ
+
+Per stage:
+- Call count, max and a log2 histogram: bucket 0 holds 0 cycles, bucket
+  b > 0 holds [2^(b-1), 2^b) cycles, the last bucket everything above
+- Stages nest (PROF_LOOP contains the rest, PROF_TDMA_UPDATE contains
+  PROF_TDMA_TX, PROF_RADIO_IRQ contains PROF_RADIO_READ and PROF_TDMA_RX);
+  PROF_CAN_ISR is the FDCAN RX interrupt and lands inside whatever it hit
+
+Dump:
+- Send PROFILE_DUMP_CHAR on Serial (or set PROFILE_AUTO_DUMP_MS)
+- profilePoll() prints at most one line per loop iteration and only when it
+  fits the Serial TX buffer, so dumping never blocks the loop
+- The counters keep running; a dump is not a consistent snapshot
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#ifndef PROFILE_ENABLE
+#define PROFILE_ENABLE 0
+#endif
+
+#ifndef PROFILE_AUTO_DUMP_MS
+#define PROFILE_AUTO_DUMP_MS 0  // 0: dump only on PROFILE_DUMP_CHAR
+#endif
+
+#define PROFILE_DUMP_CHAR 'p'
+#define PROFILE_BUCKETS 24
+#define PROFILE_HOST_MHZ 48  // host builds: cycles per simulated microsecond
+
+enum ProfileStage : uint8_t {
+  PROF_LOOP,
+  PROF_CAN_RX,       // pollCanRx()
+  PROF_CAN_ISR,      // HAL_FDCAN_RxFifo0Callback()
+  PROF_RADIO_IRQ,    // handleRadioIrq()
+  PROF_RADIO_READ,   // SPI read of a received packet (RADIO_ENABLE_DMA_SPI=0)
+  PROF_TDMA_RX,      // tdmaProcessRx()
+  PROF_TDMA_UPDATE,  // tdmaUpdate()
+  PROF_TDMA_TX,      // tdmaTransmit()
+  PROF_CAN_TX,       // processCanTx()
+  PROF_STAGE_COUNT
+};
+
+#if PROFILE_ENABLE
+
+void profileInit();
+void profilePoll();  // run every loop iteration: starts and paces dumps
+uint32_t profileCycles();
+void profileRecord(ProfileStage stage, uint32_t cycles);
+
+class ProfileScope {
+public:
+  explicit ProfileScope(ProfileStage s) : stage(s), start(profileCycles()) {}
+  ~ProfileScope() { profileRecord(stage, profileCycles() - start); }
+
+private:
+  ProfileStage stage;
+  uint32_t start;
+};
+
+#define PROFILE_INIT() profileInit()
+#define PROFILE_POLL() profilePoll()
+#define PROFILE_SCOPE(stage) ProfileScope profileScope_##stage(stage)
+#define PROFILE_START(stage) uint32_t profileStart_##stage = profileCycles()
+#define PROFILE_STOP(stage) profileRecord(stage, profileCycles() - profileStart_##stage)
+
+#else
+
+#define PROFILE_INIT() do {} while (0)
+#define PROFILE_POLL() do {} while (0)
+#define PROFILE_SCOPE(stage) do {} while (0)
+#define PROFILE_START(stage) do {} while (0)
+#define PROFILE_STOP(stage) do {} while (0)
+
+#endif
@@ -2,8 +2,12 @@
 #include "radio.h"
 #include "can.h"
 #include "tdma.h"
+#include "stats.h"
+#include "profile.h"
 #include "pin_config.h"
 
+static_assert(PKT_MAX_LEN == MAX_PAYLOAD_LENGTH, "pool packets hold any radio packet");
+
 SX1280 radio = new Module(SX_CS, SX_DIO1, SX_RESET, SX_BUSY);
 
 static const uint32_t rfswitch_pins[] = {PA_EN, RX_EN, TX_EN, RADIOLIB_NC, RADIOLIB_NC};
@@ -11,17 +15,134 @@ static const Module::RfSwitchMode_t rfswitch_table[] = {
   {Module::MODE_IDLE, {LOW, LOW, LOW}},
   {Module::MODE_RX,   {LOW, HIGH, LOW}},
   {Module::MODE_TX,   {HIGH, LOW, HIGH}},
-  Module::MODE_END_OF_TABLE,
+  {Module::MODE_END_OF_TABLE, {}},
+};
+
+const RadioProfile kRadioProfiles[RADIO_PROFILE_COUNT] = {
+  {"LoRa SF8",  false, 8, 812.5, 0,    5, 8,  -112, -40},
+  {"LoRa SF7",  false, 7, 812.5, 0,    5, 8,  -109, -30},
+  {"LoRa SF6",  false, 6, 812.5, 0,    5, 8,  -106, -20},
+  {"LoRa SF5",  false, 5, 812.5, 0,    5, 8,  -103, -10},
+  {"FLRC 325",  true,  0, 0,     325,  2, 16, -101, 0},
+  {"FLRC 650",  true,  0, 0,     650,  3, 16, -98,  0},
+  {"FLRC 1000", true,  0, 0,     1000, 3, 16, -96,  0},
+  {"FLRC 1300", true,  0, 0,     1300, 4, 16, -94,  0},
 };
 
+static uint8_t activeProfile = RADIO_PROFILE_COUNT;  // none applied yet
+
 volatile bool radioFlag;
 static volatile bool radioBusy = false;
-static volatile uint32_t lastRxDoneUs = 0;
+static volatile uint32_t lastIrqUs = 0;  // DIO1 edge, the RX_DONE time for received packets
+static volatile bool lastIrqFresh;       // lastIrqUs not yet claimed by an IRQ read
+
+enum StagedState : uint8_t {
+  STAGED_NONE,
+  STAGED_WAITING,  // for radioFireTx()
+  STAGED_DUE,      // edge passed while the radio was held
+  STAGED_SENT
+};
+
+static radioPacket *volatile stagedPkt;
+static int16_t stagedStampAt;
+static uint32_t stagedAtUs;
+static volatile StagedState stagedState = STAGED_NONE;
+static volatile bool stagedInChip;  // stagedPkt is in the SX1280 buffer as stamped
+static radioPacket *volatile txPkt;  // on air until TX_DONE
+static volatile uint32_t txStartUs;
+static volatile uint8_t radioHeld;  // main-loop RadioLib calls in progress
+
+#if RADIO_ENABLE_DMA_SPI
+static volatile bool irqActive;  // DIO1 being served, up to the end of a packet read
+static volatile uint32_t irqUs;  // its edge
+static bool irqStamped;          // irqUs is this IRQ's own edge
+static radioPacket *rxPkt;       // being read
+static void sxSetup();
+static void irqStart();
+#endif
+
+static void radioSendStaged();
+static bool radioWriteStaged(radioPacket *pkt);
 
 static void setFlag() {
+  lastIrqUs = micros();
+  lastIrqFresh = true;
   radioFlag = true;
+#if RADIO_ENABLE_DMA_SPI
+  irqStart();
+#endif
+}
+
+// TX over (TX_DONE, or aborted if !sent): release the packet and tell TDMA
+static void radioTxEnd(bool sent) {
+  bool wasBusy = radioBusy;
+  radioBusy = false;
+  radioPacket *pkt = txPkt;
+  txPkt = nullptr;
+  pktFree(pkt);
+  if (wasBusy) {
+    tdmaTxDone(sent);
+  }
 }
 
+// Held around every main-loop RadioLib call; a slot edge that fires
+// meanwhile is served when the outermost one returns
+struct RadioHold {
+  RadioHold() {
+    radioHeld++;
+  }
+  ~RadioHold() {
+    if (--radioHeld == 0 && stagedState == STAGED_DUE) {
+      radioSendStaged();
+    }
+  }
+};
+
+#if !RADIO_ENABLE_DMA_SPI
+// Radio not held by the main loop; an ongoing TX keeps the packet due.
+// Only SetTx if the buffer holds the packet with a stamp that still holds
+static void radioSendStaged() {
+  if (radioBusy) {
+    return;
+  }
+  uint32_t now = micros();
+  int32_t offUs = (int32_t)(now - stagedAtUs);
+  bool onTime = stagedStampAt < 0 || (offUs >= -RADIO_STAGE_SLACK_US && offUs <= RADIO_STAGE_SLACK_US);
+  radioPacket *pkt = stagedPkt;
+  int16_t state;
+  if (stagedInChip && onTime) {
+    txStartUs = now + RADIO_LAUNCH_DELAY_US;
+    state = radio.launchMode();
+  } else {
+    txStartUs = now + radioTxDelayUs(pkt->len);
+    if (stagedStampAt >= 0) {
+      uint32_t txUs = txStartUs;
+      memcpy(&pkt->data[stagedStampAt], &txUs, sizeof(txUs));
+    }
+    state = radio.startTransmit(pkt->data, pkt->len);
+  }
+  stagedInChip = false;
+  if (state == RADIOLIB_ERR_NONE) {
+    radioBusy = true;
+    txPkt = pkt;
+    stagedPkt = nullptr;
+    stagedState = STAGED_SENT;
+  } else {
+    stagedState = STAGED_NONE;
+    radio.startReceive();
+  }
+}
+
+static bool radioWriteStaged(radioPacket *pkt) {
+  RadioModeConfig_t cfg;
+  cfg.transmit.data = pkt->data;
+  cfg.transmit.len = pkt->len;
+  cfg.transmit.addr = 0;
+  radio.standby();
+  return radio.stageMode(RADIOLIB_RADIO_MODE_TX, &cfg) == RADIOLIB_ERR_NONE;
+}
+#endif
+
 void initRadio() {
   Serial.println("[SX1280] Initializing...");
 
@@ -39,22 +160,332 @@ void initRadio() {
 
   radio.setRfSwitchTable(rfswitch_pins, rfswitch_table);
   radio.setDio1Action(setFlag);
+#if RADIO_ENABLE_DMA_SPI
+  radioSpiBegin();
+#endif
   Serial.println("[SX1280] Initialized");
 }
 
 void configRadio() {
+  radioSetProfile(RADIO_PROFILE_DEFAULT);
+}
+
+bool radioSetProfile(uint8_t id) {
+  if (id >= RADIO_PROFILE_COUNT) {
+    return false;
+  }
+  RadioHold hold;
+  stagedInChip = false;
+#if RADIO_ENABLE_DMA_SPI
+  radioSpiReset();  // RadioLib has the bus until radioSpiBegin()
+  pktFree(rxPkt);
+  rxPkt = nullptr;
+  irqActive = false;
+#endif
+  const RadioProfile &p = kRadioProfiles[id];
+  bool sameModem = activeProfile < RADIO_PROFILE_COUNT && kRadioProfiles[activeProfile].flrc == p.flrc;
 
-  radio.setSpreadingFactor(6);
-  radio.setBandwidth(812.5);
-  radio.setCodingRate(5);
-  radio.setPreambleLength(8);
-  radio.setOutputPower(13);
+  int state;
+  if (!sameModem && p.flrc) {
+    state = radio.beginFLRC(RADIO_FREQ_MHZ, p.bitRate, p.cr, RADIO_POWER_DBM, p.preamble);
+  } else if (!sameModem) {
+    state = radio.begin(RADIO_FREQ_MHZ, p.bw, p.sf, p.cr, RADIOLIB_SX128X_SYNC_WORD_PRIVATE,
+                        RADIO_POWER_DBM, p.preamble);
+  } else if (p.flrc) {
+    state = radio.setBitRate(p.bitRate);
+    if (state == RADIOLIB_ERR_NONE) {
+      state = radio.setCodingRate(p.cr);
+    }
+  } else {
+    state = radio.setSpreadingFactor(p.sf);
+    if (state == RADIOLIB_ERR_NONE) {
+      state = radio.setBandwidth(p.bw);
+    }
+    if (state == RADIOLIB_ERR_NONE) {
+      state = radio.setCodingRate(p.cr);
+    }
+    if (state == RADIOLIB_ERR_NONE) {
+      state = radio.setPreambleLength(p.preamble);
+    }
+  }
+  if (state != RADIOLIB_ERR_NONE) {
+    Serial.printf("[SX1280] Profile %s failed: %d\n", p.name, state);
+#if RADIO_ENABLE_DMA_SPI
+    radioSpiBegin();
+#endif
+    return false;
+  }
 
+  radio.setOutputPower(RADIO_POWER_DBM);
   radio.variablePacketLengthMode(MAX_PAYLOAD_LENGTH);
   radio.setCRC(2);
+  radioTxEnd(false);
+  activeProfile = id;
+#if RADIO_ENABLE_DMA_SPI
+  radioSpiBegin();
+  sxSetup();
+#endif
+  Serial.printf("[SX1280] Profile %s\n", p.name);
+  return true;
+}
+
+uint8_t radioProfile() {
+  return activeProfile;
+}
+
+#if RADIO_ENABLE_DMA_SPI
+
+// Per-packet work goes through the DMA queue (radiospi.h): the IRQ status,
+// packet reads and writes, SetTx / SetRx. Callbacks run from handleRadioIrq()
+
+#define RADIO_IRQ_MASK (RADIOLIB_SX128X_IRQ_TX_DONE | RADIOLIB_SX128X_IRQ_RX_DONE | \
+                        RADIOLIB_SX128X_IRQ_HEADER_ERROR | RADIOLIB_SX128X_IRQ_CRC_ERROR | \
+                        RADIOLIB_SX128X_IRQ_RX_TX_TIMEOUT)
+#define SX_TX_CMDS 4  // sxWriteTx() and sxSetTx()
+
+// Both buffers at 0 as RadioLib has them; every IRQ handled here on DIO1
+static void sxSetup() {
+  const uint8_t base[] = {SX1280_CMD_SET_BUFFER_BASE_ADDRESS, 0, 0};
+  const uint8_t dio[] = {SX1280_CMD_SET_DIO_IRQ_PARAMS, RADIO_IRQ_MASK >> 8, RADIO_IRQ_MASK & 0xFF,
+                         RADIO_IRQ_MASK >> 8, RADIO_IRQ_MASK & 0xFF, 0, 0, 0, 0};
+  radioSpiQueue(base, sizeof(base));
+  radioSpiQueue(dio, sizeof(dio));
+}
+
+// len: the payload to send, or the largest accepted in RX. Both ends frame
+// packets the same way from the profile table
+static void sxPacketParams(uint8_t len) {
+  uint8_t id = activeProfile < RADIO_PROFILE_COUNT ? activeProfile : (uint8_t)RADIO_PROFILE_DEFAULT;
+  const RadioProfile &p = kRadioProfiles[id];
+  uint8_t c[8] = {SX1280_CMD_SET_PACKET_PARAMS};
+  if (p.flrc) {
+    c[1] = (uint8_t)((p.preamble / 4 - 1) << 4);  // bits, in steps of 4
+    c[2] = SX1280_FLRC_SYNC_WORD_LEN_32;
+    c[3] = SX1280_FLRC_SYNC_MATCH_1;
+    c[4] = SX1280_FLRC_PACKET_VARIABLE;
+    c[5] = len;
+    c[6] = SX1280_FLRC_CRC_2_BYTE;
+    c[7] = SX1280_FLRC_WHITENING_OFF;
+  } else {
+    c[1] = (uint8_t)p.preamble;  // symbols: mantissa, exponent 0
+    c[2] = SX1280_LORA_HEADER_EXPLICIT;
+    c[3] = len;
+    c[4] = SX1280_LORA_CRC_ON;
+    c[5] = SX1280_LORA_IQ_STANDARD;
+  }
+  radioSpiQueue(c, sizeof(c));
+}
+
+// Standby, packet params and the buffer write straight from the packet
+static void sxWriteTx(radioPacket *pkt) {
+  const uint8_t standby[] = {SX1280_CMD_SET_STANDBY, SX1280_STANDBY_RC};
+  const uint8_t write[] = {SX1280_CMD_WRITE_BUFFER, 0};
+  radioSpiQueue(standby, sizeof(standby));
+  sxPacketParams(pkt->len);
+  radioSpiQueue(write, sizeof(write), nullptr, pkt->data, pkt->len);
+}
+
+static void sxSetTx() {
+  const uint8_t tx[] = {SX1280_CMD_SET_TX, SX1280_PERIOD_BASE_1_MS, SX1280_TIMEOUT_NONE >> 8,
+                        SX1280_TIMEOUT_NONE & 0xFF};
+  radioSpiQueue(tx, sizeof(tx));
+}
+
+// Interrupt safe: the timer interrupt sends from here when the queue is
+// idle, so SetTx is the next frame on the bus; otherwise it stays due for
+// handleRadioIrq(). Only SetTx if the buffer holds the packet with a stamp
+// that still holds
+static void radioSendStaged() {
+  if (radioBusy || !radioSpiIdle()) {
+    return;
+  }
+  radioPacket *pkt = stagedPkt;
+  uint32_t now = micros();
+  int32_t offUs = (int32_t)(now - stagedAtUs);
+  bool onTime = stagedStampAt < 0 || (offUs >= -RADIO_STAGE_SLACK_US && offUs <= RADIO_STAGE_SLACK_US);
+  if (stagedInChip && onTime) {
+    txStartUs = now + RADIO_LAUNCH_DELAY_US;
+  } else {
+    txStartUs = now + radioTxDelayUs(pkt->len);
+    if (stagedStampAt >= 0) {
+      uint32_t txUs = txStartUs;
+      memcpy(&pkt->data[stagedStampAt], &txUs, sizeof(txUs));
+    }
+    sxWriteTx(pkt);
+  }
+  stagedInChip = false;
+  radioBusy = true;
+  txPkt = pkt;
+  stagedPkt = nullptr;
+  stagedState = STAGED_SENT;
+  sxSetTx();
+}
+
+static bool radioWriteStaged(radioPacket *pkt) {
+  if (radioSpiFree() < SX_TX_CMDS) {
+    return false;
+  }
+  sxWriteTx(pkt);
+  return true;
 }
 
 void startRx() {
+  stagedInChip = false;  // RX writes to the same buffer
+  const uint8_t rx[] = {SX1280_CMD_SET_RX, SX1280_PERIOD_BASE_1_MS, SX1280_TIMEOUT_CONTINUOUS >> 8,
+                        SX1280_TIMEOUT_CONTINUOUS & 0xFF};
+  sxPacketParams(MAX_PAYLOAD_LENGTH);
+  if (!radioSpiQueue(rx, sizeof(rx))) {
+    Serial.println("[SX1280] Start RX failed: SPI queue full");
+  }
+}
+
+static void onIrqStatus(const RadioSpiCmd &cmd);
+
+// Interrupt safe: queues the status read for a pending DIO1 edge unless a
+// chain is already running, straight from the edge so it is back by the
+// next handleRadioIrq(). The queue keeps room for a whole chain
+static void irqStart() {
+  noInterrupts();
+  if (irqActive || !radioFlag) {
+    interrupts();
+    return;
+  }
+  irqActive = true;
+  radioFlag = false;
+  irqUs = lastIrqUs;
+  irqStamped = lastIrqFresh;  // restarted on a DIO1 still high: no edge of its own
+  lastIrqFresh = false;
+  interrupts();
+
+  const uint8_t status[] = {SX1280_CMD_GET_IRQ_STATUS, 0, 0, 0};
+  if (radioSpiFree() < 8 || !radioSpiQueue(status, sizeof(status), onIrqStatus)) {
+    irqActive = false;
+    radioFlag = true;  // retried from handleRadioIrq()
+  }
+}
+
+// DIO1 is level triggered on the chip but edge triggered here: an IRQ
+// raised between the status read and the clear leaves it high
+static void irqDone() {
+  irqActive = false;
+  if (digitalRead(SX_DIO1) == HIGH) {
+    radioFlag = true;
+  }
+  irqStart();
+}
+
+static void onRxDone(const RadioSpiCmd &cmd) {
+  radioPacket *pkt = rxPkt;
+  rxPkt = nullptr;
+  // Packet status after opcode and NOP: LoRa RSSI and SNR, FLRC RSSI second
+  bool flrc = kRadioProfiles[activeProfile].flrc;
+  float rssi = -(float)cmd.reply[flrc ? 3 : 2] / 2.0f;
+  float snr = flrc ? 0.0f : (float)(int8_t)cmd.reply[3] / 4.0f;
+  // RX_DONE is the end of the packet; report its start. A newer edge while
+  // the chain ran (a stalled loop) means the buffer may hold that packet
+  uint32_t rx_time_us = irqUs - radioTimeOnAir(pkt->len) - RADIO_RX_DELAY_US;
+  bool stamped = irqStamped && !lastIrqFresh;
+  statsRadioRx(rssi, snr);
+  tdmaProcessRx(pkt->data, pkt->len, rx_time_us, stamped, rssi, snr);
+  pktFree(pkt);
+  irqDone();
+}
+
+static void onRxBufferStatus(const RadioSpiCmd &cmd) {
+  uint8_t len = cmd.reply[2];
+  if (len > MAX_PAYLOAD_LENGTH) {
+    len = MAX_PAYLOAD_LENGTH;
+  }
+  rxPkt->len = len;
+  const uint8_t read[] = {SX1280_CMD_READ_BUFFER, cmd.reply[3], 0};
+  const uint8_t status[] = {SX1280_CMD_GET_PACKET_STATUS, 0, 0, 0, 0, 0, 0};
+  radioSpiQueue(read, sizeof(read), nullptr, rxPkt->data, len, true);
+  radioSpiQueue(status, sizeof(status), onRxDone);
+}
+
+static void onIrqStatus(const RadioSpiCmd &cmd) {
+  uint16_t irq = (uint16_t)((cmd.reply[2] << 8) | cmd.reply[3]);
+  const uint8_t clear[] = {SX1280_CMD_CLEAR_IRQ_STATUS, (uint8_t)(irq >> 8), (uint8_t)irq};
+  radioSpiQueue(clear, sizeof(clear));
+
+  bool reading = false;
+  if (irq & RADIOLIB_SX128X_IRQ_RX_DONE) {
+    if (irq & (RADIOLIB_SX128X_IRQ_CRC_ERROR | RADIOLIB_SX128X_IRQ_HEADER_ERROR)) {
+      stats.radioCrcErrors++;
+      Serial.println("[SX1280] CRC error");
+    } else if ((rxPkt = pktAlloc()) != nullptr) {  // else counted by the pool; the packet is lost
+      const uint8_t status[] = {SX1280_CMD_GET_RX_BUFFER_STATUS, 0, 0, 0};
+      radioSpiQueue(status, sizeof(status), onRxBufferStatus);
+      reading = true;
+    }
+  }
+
+  // The chip stays in continuous RX after a packet, so only TX restarts it
+  if (irq & RADIOLIB_SX128X_IRQ_TX_DONE) {
+    // Serial.println("[SX1280] TX done");
+    radioTxEnd(true);
+    startRx();
+  }
+
+  if (irq & RADIOLIB_SX128X_IRQ_RX_TX_TIMEOUT) {
+    if (radioBusy) {
+      radioTxEnd(false);
+    }
+    startRx();
+  }
+
+  if (!reading) {
+    irqDone();
+  }
+}
+
+void handleRadioIrq() {
+  if (!radioFlag && !radioSpiPending() && stagedState != STAGED_DUE) {
+    return;
+  }
+  PROFILE_SCOPE(PROF_RADIO_IRQ);
+  radioSpiPoll();
+  if (stagedState == STAGED_DUE) {
+    radioSendStaged();
+  }
+  irqStart();
+}
+
+bool radioTransmit(radioPacket *pkt) {
+  noInterrupts();
+  if (radioBusy) {
+    interrupts();
+    stats.radioTxBlocked++;
+    Serial.println("[SX1280] TX blocked: already transmitting");
+    return false;
+  }
+  if (radioSpiFree() < SX_TX_CMDS) {
+    interrupts();
+    Serial.println("[SX1280] TX failed: SPI queue full");
+    return false;
+  }
+  radioBusy = true;
+  txPkt = pkt;
+  interrupts();
+
+  stagedInChip = false;
+  txStartUs = micros() + radioTxDelayUs(pkt->len);
+  sxWriteTx(pkt);
+  sxSetTx();
+  return true;
+}
+
+void radioIdle() {
+  const uint8_t standby[] = {SX1280_CMD_SET_STANDBY, SX1280_STANDBY_RC};
+  radioSpiQueue(standby, sizeof(standby));
+  radioTxEnd(false);
+}
+
+#else
+
+void startRx() {
+  RadioHold hold;
+  stagedInChip = false;  // RX writes to the same buffer
   int state = radio.startReceive();
   if (state != RADIOLIB_ERR_NONE) {
     Serial.printf("[SX1280] Start RX failed: %d\n", state);
@@ -62,12 +493,23 @@ void startRx() {
 }
 
 static void handleRadioRx() {
-  uint8_t buf[MAX_PAYLOAD_LENGTH] = {0};
-  uint32_t rx_time_us = lastRxDoneUs;
+  noInterrupts();
+  uint32_t rx_time_us = lastIrqUs;
+  bool stamped = lastIrqFresh;
+  lastIrqFresh = false;
+  interrupts();
+  radioPacket *pkt = pktAlloc();
+  if (pkt == nullptr) {  // counted by the pool; the packet is lost
+    radio.finishReceive();
+    startRx();
+    return;
+  }
+  uint8_t *buf = pkt->data;
 
   int16_t len = radio.getPacketLength();
   if (len < 0) {
     Serial.printf("[SX1280] getPacketLength failed: %d\n", len);
+    pktFree(pkt);
     return;
   }
 
@@ -75,50 +517,62 @@ static void handleRadioRx() {
     len = MAX_PAYLOAD_LENGTH;
   }
   
+  PROFILE_START(PROF_RADIO_READ);
   int state = radio.readData(buf, len);
+  PROFILE_STOP(PROF_RADIO_READ);
   if (state == RADIOLIB_ERR_NONE) {
-    // Adjust RX timestamp to packet midpoint
-    uint32_t toa_us = (uint32_t)radio.getTimeOnAir(len);
-    uint32_t midpoint_offset = toa_us / 2;
-    if (midpoint_offset < rx_time_us) {
-      rx_time_us -= midpoint_offset;
-    }
+    // RX_DONE is the end of the packet; report its start. A newer edge
+    // during the read means the buffer may hold that packet
+    rx_time_us -= radioTimeOnAir(len) + RADIO_RX_DELAY_US;
+    stamped = stamped && !lastIrqFresh;
 
-    tdmaProcessRx(buf, (size_t)len, rx_time_us);
+    float rssi = radio.getRSSI();
+    float snr = radio.getSNR();  // 0 on FLRC
+    statsRadioRx(rssi, snr);
+    tdmaProcessRx(buf, (size_t)len, rx_time_us, stamped, rssi, snr);
   } else if (state == RADIOLIB_ERR_CRC_MISMATCH) {
+    stats.radioCrcErrors++;
     Serial.println("[SX1280] CRC error");
   } else {
+    stats.radioRxErrors++;
     Serial.printf("[SX1280] RX error: %d\n", state);
   }
+  pktFree(pkt);
 
   radio.finishReceive();
   startRx();
 }
 
-void radioTransmit(const uint8_t *buf, size_t len) {
+bool radioTransmit(radioPacket *pkt) {
+  RadioHold hold;
   noInterrupts();
   if (radioBusy) {
     interrupts();
+    stats.radioTxBlocked++;
     Serial.println("[SX1280] TX blocked: already transmitting");
-    return;
+    return false;
   }
 
-  int state = radio.startTransmit(buf, len);
+  stagedInChip = false;
+  txStartUs = micros() + radioTxDelayUs(pkt->len);
+  int state = radio.startTransmit(pkt->data, pkt->len);
   if (state == RADIOLIB_ERR_NONE) {
     radioBusy = true;
+    txPkt = pkt;
     interrupts();
 
     // Serial.printf("[SX1280] TX len=%u\n", (unsigned int)len);
     // Serial.printf("[SX1280] TX HEX: ");
-    // for (size_t i = 0; i < len; i++) {
-    //   Serial.printf("0x%x ", buf[i]);
+    // for (size_t i = 0; i < pkt->len; i++) {
+    //   Serial.printf("0x%x ", pkt->data[i]);
     // }
     // Serial.println();
-  } else {
-    interrupts();
-    Serial.printf("[SX1280] TX failed: %d\n", state);
-    startRx();
+    return true;
   }
+  interrupts();
+  Serial.printf("[SX1280] TX failed: %d\n", state);
+  startRx();
+  return false;
 }
 
 void handleRadioIrq() {
@@ -130,25 +584,26 @@ void handleRadioIrq() {
   if (!flag) {
     return;
   }
+  PROFILE_SCOPE(PROF_RADIO_IRQ);
+  RadioHold hold;
 
   uint32_t irqStatus = radio.getIrqStatus();
 
   if (irqStatus & RADIOLIB_SX128X_IRQ_RX_DONE) {
-    lastRxDoneUs = micros();
     handleRadioRx();
   }
 
   if (irqStatus & RADIOLIB_SX128X_IRQ_TX_DONE) {
     radio.finishTransmit();
-    radioBusy = false;
     // Serial.println("[SX1280] TX done");
+    radioTxEnd(true);
     startRx();
   }
 
   if (irqStatus & RADIOLIB_SX128X_IRQ_RX_TX_TIMEOUT) {
     if (radioBusy) {
       radio.finishTransmit();
-      radioBusy = false;
+      radioTxEnd(false);
     } else {
       radio.finishReceive();
     }
@@ -157,6 +612,96 @@ void handleRadioIrq() {
 }
 
 void radioIdle() {
-  radioBusy = false;
+  RadioHold hold;
   radio.standby();
+  radioTxEnd(false);
+}
+
+#endif
+
+// From the profile table alone: RadioLib's getTimeOnAir() first reads the
+// packet type over SPI, which the DMA queue may hold. SX1280 datasheet
+// formulas with CRC on and an explicit LoRa header, as configured above
+uint32_t radioTimeOnAir(size_t len) {
+  uint8_t id = activeProfile < RADIO_PROFILE_COUNT ? activeProfile : (uint8_t)RADIO_PROFILE_DEFAULT;
+  const RadioProfile &p = kRadioProfiles[id];
+  if (p.flrc) {
+    // Preamble, 32-bit sync word and 16-bit header uncoded; payload, CRC and
+    // the 6-bit tail coded at 1/2, 3/4 or 1/1. In thirds of a bit
+    uint32_t coded = 8 * ((uint32_t)len + 2) + 6;
+    uint32_t thirds = 3 * ((uint32_t)p.preamble + 48) + coded * (p.cr == 2 ? 6 : p.cr == 3 ? 4 : 3);
+    return thirds * 1000 / (3 * (uint32_t)p.bitRate);
+  }
+  // Preamble, 4.25 symbols (6.25 below SF7) and 8 more, then header, payload
+  // and CRC in blocks of 4 * sf bits (4 * (sf - 2) from SF11), cr symbols
+  // each; SF7 and up spend 8 of those bits otherwise. In quarter symbols
+  int32_t bits = 8 * (int32_t)len + 16 + 20 - (p.sf < 7 ? 4 * p.sf : 4 * p.sf + 8);
+  int32_t perBlock = (p.sf < 11) ? 4 * p.sf : 4 * (p.sf - 2);
+  uint32_t blocks = bits > 0 ? (uint32_t)((bits + perBlock - 1) / perBlock) : 0;
+  uint32_t quarters = 4 * ((uint32_t)p.preamble + 8) + (p.sf < 7 ? 25 : 17) + 4 * blocks * p.cr;
+  uint32_t symbolNs = (uint32_t)((float)(1000000u << p.sf) / p.bw);
+  return quarters * symbolNs / 4000;
+}
+
+uint32_t radioTxDelayUs(size_t len) {
+  return RADIO_TX_DELAY_US + (uint32_t)(len * RADIO_TX_DELAY_NS_PER_BYTE / 1000);
+}
+
+uint32_t radioTxStartUs() {
+  return txStartUs;
+}
+
+void radioStageTx(radioPacket *pkt, int16_t stampAt, uint32_t atUs) {
+  RadioHold hold;
+  radioCancelStaged();
+  stagedPkt = pkt;
+  stagedStampAt = stampAt;
+  stagedAtUs = atUs;
+  if (stampAt >= 0) {
+    uint32_t txUs = atUs + RADIO_LAUNCH_DELAY_US;
+    memcpy(&pkt->data[stampAt], &txUs, sizeof(txUs));
+  }
+  // Nothing is received in the GUARD before a node's own slot; a radio
+  // still sending keeps the packet in RAM until the edge
+  if (!radioBusy) {
+    stagedInChip = radioWriteStaged(pkt);
+  }
+  stagedState = STAGED_WAITING;
+}
+
+void radioFireTx() {
+  if (stagedState != STAGED_WAITING) {
+    return;
+  }
+  stagedState = STAGED_DUE;
+  if (radioHeld == 0) {
+    radioSendStaged();
+  }
+}
+
+bool radioStagedSent() {
+  return stagedState == STAGED_SENT;
+}
+
+// Frees a packet that did not go out; a sent one belongs to the TX in flight
+void radioCancelStaged() {
+  noInterrupts();
+  radioPacket *pkt = stagedPkt;
+  stagedPkt = nullptr;
+  stagedState = STAGED_NONE;
+  stagedInChip = false;
+  interrupts();
+  pktFree(pkt);
+}
+
+bool radioTxBusy() {
+  return radioBusy;
+}
+
+bool radioSpiSettled() {
+#if RADIO_ENABLE_DMA_SPI
+  return radioSpiIdle();  // the next command only starts from the DMA interrupt
+#else
+  return true;  // RadioLib calls return once the chip has the command
+#endif
 }
@@ -1,11 +1,55 @@
 /*
 Radio layer
 
-Used to communicate with the RadioLib api
+Used to communicate with the RadioLib api; with RADIO_ENABLE_DMA_SPI the
+per-packet commands bypass it (radiospi.h)
 
 Configuration settings:
-- Bitrate
-- Coding rate
+- Modulation profiles (kRadioProfiles): LoRa SF5-SF8 at 812.5 kHz and FLRC
+  325-1300 kbps, ordered from most robust to fastest: sensitivity gets
+  worse with every entry (adr.h relies on it)
+- Switching between LoRa and FLRC re-runs begin()/beginFLRC(); within a
+  modem only the changed parameters are written
+
+DMA SPI (RADIO_ENABLE_DMA_SPI, default):
+- handleRadioIrq() is a state machine over the radiospi.h queue: a DIO1
+  edge queues GetIrqStatus; its callback clears the IRQ and, for RX_DONE,
+  queues the buffer status, the read into a pool packet and the packet
+  status, whose callback hands the packet to TDMA. Nothing waits on the
+  SPI bus or BUSY, so CAN work in loop() runs while a packet is moved
+- radioTransmit() queues standby, packet params, the buffer write and
+  SetTx, and returns at once; startRx() queues SetRx in continuous mode
+- Packet params (SetPacketParams) come from the profile table, the rest of
+  the modem setup still from RadioLib in radioSetProfile(), which drops
+  the queue first
+
+Timestamps:
+- Received packets: the DIO1 edge is stamped in the ISR; the packet start
+  is reported as that edge less time-on-air and RADIO_RX_DELAY_US
+- Transmitted packets: radioTxDelayUs() estimates radioTransmit() to the
+  first preamble symbol (command overhead plus the buffer write over SPI),
+  RADIO_LAUNCH_DELAY_US the same for a packet already in the buffer;
+  radioTxStartUs() is that estimate for the last packet sent
+
+Packets (pktpool.h):
+- radioTransmit() and radioStageTx() take a pool packet by pointer; it is
+  freed on TX_DONE, or when the TX fails, times out or is cancelled, and
+  tdmaTxDone() is told which
+
+Staged TX:
+- radioStageTx() takes one packet for a slot edge at atUs, puts the radio
+  in standby and writes the packet into the SX1280 buffer ahead of it
+  (RadioLib stageMode(), or the queued write); radioFireTx(), called from
+  the slot timer interrupt (or polled as fallback), then only issues SetTx
+  (launchMode(), or SetTx queued behind an idle queue)
+- stampAt: offset of a uint32 holding the TX start, -1 for none; written
+  in advance as atUs + RADIO_LAUNCH_DELAY_US
+- A launch more than RADIO_STAGE_SLACK_US off atUs would carry a wrong
+  stamp, and startRx() or radioTransmit() reuse the buffer; either way the
+  packet is stamped again and written in full at the edge
+- If the main loop is inside a RadioLib call at that moment the packet goes
+  out as soon as the call returns, so SPI is never shared with the
+  interrupt; with DMA SPI the same holds for commands still in the queue
 
 Modes:
 - transmit
@@ -16,15 +60,84 @@ Modes:
 #pragma once
 
 #include <RadioLib.h>
+#include "pktpool.h"
+#include "radiospi.h"
 
 #define MAX_PAYLOAD_LENGTH  250
+#define RADIO_FREQ_MHZ 2400.0
+#define RADIO_POWER_DBM 13
+
+// Timestamp calibration, see above; the DMA queue skips RadioLib's per-call
+// overhead
+#ifndef RADIO_TX_DELAY_US
+#if RADIO_ENABLE_DMA_SPI
+#define RADIO_TX_DELAY_US 35
+#else
+#define RADIO_TX_DELAY_US 40
+#endif
+#endif
+#ifndef RADIO_TX_DELAY_NS_PER_BYTE
+#define RADIO_TX_DELAY_NS_PER_BYTE 1000  // 8 MHz SPI
+#endif
+#ifndef RADIO_LAUNCH_DELAY_US
+#if RADIO_ENABLE_DMA_SPI
+#define RADIO_LAUNCH_DELAY_US 6  // SetTx frame and BUSY
+#else
+#define RADIO_LAUNCH_DELAY_US 16  // SetTx command and BUSY
+#endif
+#endif
+#define RADIO_STAGE_SLACK_US 2  // launch vs. staged time before the stamp is redone
+#ifndef RADIO_RX_DELAY_US
+#define RADIO_RX_DELAY_US 0  // last symbol to the DIO1 edge
+#endif
+
+enum RadioProfileId : uint8_t {
+  RADIO_PROFILE_LORA_SF8,
+  RADIO_PROFILE_LORA_SF7,
+  RADIO_PROFILE_LORA_SF6,
+  RADIO_PROFILE_LORA_SF5,
+  RADIO_PROFILE_FLRC_325,
+  RADIO_PROFILE_FLRC_650,
+  RADIO_PROFILE_FLRC_1000,
+  RADIO_PROFILE_FLRC_1300,
+  RADIO_PROFILE_COUNT
+};
+
+#ifndef RADIO_PROFILE_DEFAULT
+#define RADIO_PROFILE_DEFAULT RADIO_PROFILE_LORA_SF6
+#endif
+
+struct RadioProfile {
+  const char *name;
+  bool flrc;
+  uint8_t sf;         // LoRa spreading factor
+  float bw;           // LoRa bandwidth [kHz]
+  uint16_t bitRate;   // FLRC [kbps]
+  uint8_t cr;         // LoRa 5-8 = 4/5-4/8, FLRC 2-4 = 1/2, 3/4, 1/1
+  uint16_t preamble;  // LoRa symbols, FLRC bits
+  int8_t sensitivityDbm;  // typical, datasheet
+  int8_t snrMin;      // LoRa demodulation limit [0.25 dB]
+};
+
+extern const RadioProfile kRadioProfiles[RADIO_PROFILE_COUNT];
 
 extern volatile bool radioFlag;
 
 void initRadio();
-void configRadio();     // sets modulation parameters and flrc settings
+void configRadio();     // applies RADIO_PROFILE_DEFAULT
+bool radioSetProfile(uint8_t id);  // reconfigures the modem, leaves it in standby
+uint8_t radioProfile();  // active RadioProfileId
 void startRx();         // puts radio in rx mode
 void handleRadioIrq();  // handles dio1 interrupt (check if rx or tx irq)
-void radioTransmit(const uint8_t *buf, size_t len);   // transmit whatever is in txBuf
+bool radioTransmit(radioPacket *pkt);  // false if not started; on true the radio frees pkt after TX
 void radioIdle();       // enter standby mode
+uint32_t radioTimeOnAir(size_t len);  // us on air for a len-byte packet with the current profile, no SPI
+uint32_t radioTxDelayUs(size_t len);  // radioTransmit() of len bytes to TX start
+uint32_t radioTxStartUs();  // estimated first preamble symbol of the last packet sent
+void radioStageTx(radioPacket *pkt, int16_t stampAt, uint32_t atUs);  // the radio frees pkt
+void radioFireTx();     // interrupt safe
+bool radioStagedSent(); // staged packet went out, see radioTxStartUs()
+void radioCancelStaged();
+bool radioTxBusy();     // TX started and TX_DONE not handled yet
+bool radioSpiSettled(); // no SPI command queued or in flight, e.g. the SetTx of a started TX
 
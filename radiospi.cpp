@@ -0,0 +1,233 @@
+#include <Arduino.h>
+#include "radiospi.h"
+#include "pktpool.h"
+#include "pin_config.h"
+
+#if RADIO_ENABLE_DMA_SPI
+
+#define QUEUE_MASK (RADIO_SPI_QUEUE_LEN - 1)
+static_assert((RADIO_SPI_QUEUE_LEN & QUEUE_MASK) == 0, "queue length must be a power of two");
+
+static SPI_HandleTypeDef hspi;
+static DMA_HandleTypeDef dmaRx;
+static DMA_HandleTypeDef dmaTx;
+static bool dmaReady;
+
+// head: oldest completed command not yet reported (main loop)
+// active: in flight, or next to start (interrupts)
+// tail: next free entry
+static RadioSpiCmd queue[RADIO_SPI_QUEUE_LEN];
+static volatile uint8_t head;
+static volatile uint8_t active;
+static volatile uint8_t tail;
+static volatile bool running;    // NSS low
+static volatile bool dataPhase;
+
+static const uint8_t zeros[PKT_MAX_LEN] = {0};  // clocked out during a read
+
+static void dmaInit(DMA_HandleTypeDef &h, DMA_Channel_TypeDef *instance, uint32_t request, bool toPeriph) {
+  h.Instance = instance;
+  h.Init.Request = request;
+  h.Init.Direction = toPeriph ? DMA_MEMORY_TO_PERIPH : DMA_PERIPH_TO_MEMORY;
+  h.Init.Mode = DMA_NORMAL;
+#if defined (STM32U5xx)
+  h.Init.BlkHWRequest = DMA_BREQ_SINGLE_BURST;
+  h.Init.SrcInc = toPeriph ? DMA_SINC_INCREMENTED : DMA_SINC_FIXED;
+  h.Init.DestInc = toPeriph ? DMA_DINC_FIXED : DMA_DINC_INCREMENTED;
+  h.Init.SrcDataWidth = DMA_SRC_DATAWIDTH_BYTE;
+  h.Init.DestDataWidth = DMA_DEST_DATAWIDTH_BYTE;
+  h.Init.Priority = DMA_HIGH_PRIORITY;
+  h.Init.SrcBurstLength = 1;
+  h.Init.DestBurstLength = 1;
+  h.Init.TransferAllocatedPort = DMA_SRC_ALLOCATED_PORT0 | DMA_DEST_ALLOCATED_PORT0;
+  h.Init.TransferEventMode = DMA_TCEM_BLOCK_TRANSFER;
+#else
+  h.Init.PeriphInc = DMA_PINC_DISABLE;
+  h.Init.MemInc = DMA_MINC_ENABLE;
+  h.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  h.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  h.Init.Priority = DMA_PRIORITY_HIGH;
+#endif
+  HAL_DMA_Init(&h);
+}
+
+// From the main loop with interrupts off, or from an interrupt
+static void startNext() {
+  if (running || active == tail || digitalRead(SX_BUSY) == HIGH) {
+    return;  // the BUSY falling edge comes back here
+  }
+  RadioSpiCmd &c = queue[active & QUEUE_MASK];
+  running = true;
+  dataPhase = false;
+  digitalWrite(SX_CS, LOW);
+  HAL_SPI_TransmitReceive_DMA(&hspi, c.hdr, c.reply, c.hdrLen);
+}
+
+static void onBusyLow() {
+  startNext();
+}
+
+// DMA completion interrupt: the data phase, or the end of the NSS frame
+static void phaseDone() {
+  RadioSpiCmd &c = queue[active & QUEUE_MASK];
+  if (!dataPhase && c.dataLen > 0) {
+    dataPhase = true;
+    if (c.read) {
+      HAL_SPI_TransmitReceive_DMA(&hspi, (uint8_t *)zeros, c.data, c.dataLen);
+    } else {
+      HAL_SPI_Transmit_DMA(&hspi, c.data, c.dataLen);
+    }
+    return;
+  }
+  digitalWrite(SX_CS, HIGH);
+  c.doneUs = micros();
+  running = false;
+  active++;
+  delayMicroseconds(1);  // BUSY rises shortly after NSS
+  startNext();
+}
+
+extern "C" void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *h) {
+  if (h == &hspi) {
+    phaseDone();
+  }
+}
+
+extern "C" void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *h) {
+  if (h == &hspi) {
+    phaseDone();
+  }
+}
+
+// A failed transfer still ends its frame; the reply is whatever came in
+extern "C" void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *h) {
+  if (h == &hspi) {
+    dataPhase = true;
+    phaseDone();
+  }
+}
+
+#if defined (RADIO_SPI_DMA_IRQHandler)
+extern "C" void RADIO_SPI_DMA_IRQHandler(void) {
+  HAL_DMA_IRQHandler(&dmaRx);
+  HAL_DMA_IRQHandler(&dmaTx);
+}
+#else
+extern "C" void RADIO_SPI_DMA_RX_IRQHandler(void) {
+  HAL_DMA_IRQHandler(&dmaRx);
+}
+
+extern "C" void RADIO_SPI_DMA_TX_IRQHandler(void) {
+  HAL_DMA_IRQHandler(&dmaTx);
+}
+#endif
+
+#if defined (RADIO_SPI_IRQHandler)
+// SPI v2 (U5) closes DMA transfers from the SPI interrupt
+extern "C" void RADIO_SPI_IRQHandler(void) {
+  HAL_SPI_IRQHandler(&hspi);
+}
+#endif
+
+// Same frame format RadioLib uses, so either can drive the bus
+void radioSpiBegin() {
+  if (!dmaReady) {
+    RADIO_SPI_DMA_CLK_ENABLE();
+    dmaInit(dmaRx, RADIO_SPI_DMA_RX, RADIO_SPI_DMA_RX_REQUEST, false);
+    dmaInit(dmaTx, RADIO_SPI_DMA_TX, RADIO_SPI_DMA_TX_REQUEST, true);
+    // Same level as the slot timer, which also queues commands
+#if defined (RADIO_SPI_DMA_IRQHandler)
+    HAL_NVIC_SetPriority(RADIO_SPI_DMA_IRQn, 1, 0);
+    HAL_NVIC_EnableIRQ(RADIO_SPI_DMA_IRQn);
+#else
+    HAL_NVIC_SetPriority(RADIO_SPI_DMA_RX_IRQn, 1, 0);
+    HAL_NVIC_EnableIRQ(RADIO_SPI_DMA_RX_IRQn);
+    HAL_NVIC_SetPriority(RADIO_SPI_DMA_TX_IRQn, 1, 0);
+    HAL_NVIC_EnableIRQ(RADIO_SPI_DMA_TX_IRQn);
+#endif
+#if defined (RADIO_SPI_IRQHandler)
+    HAL_NVIC_SetPriority(RADIO_SPI_IRQn, 1, 0);
+    HAL_NVIC_EnableIRQ(RADIO_SPI_IRQn);
+#endif
+    attachInterrupt(digitalPinToInterrupt(SX_BUSY), onBusyLow, FALLING);
+    dmaReady = true;
+  }
+
+  hspi.Instance = RADIO_SPI;
+  hspi.Init.Mode = SPI_MODE_MASTER;
+  hspi.Init.Direction = SPI_DIRECTION_2LINES;
+  hspi.Init.DataSize = SPI_DATASIZE_8BIT;
+  hspi.Init.CLKPolarity = SPI_POLARITY_LOW;
+  hspi.Init.CLKPhase = SPI_PHASE_1EDGE;
+  hspi.Init.NSS = SPI_NSS_SOFT;
+  hspi.Init.BaudRatePrescaler = RADIO_SPI_PRESCALER;
+  hspi.Init.FirstBit = SPI_FIRSTBIT_MSB;
+  hspi.Init.TIMode = SPI_TIMODE_DISABLE;
+  hspi.Init.CRCCalculation = SPI_CRCCALCULATION_DISABLE;
+  hspi.Init.NSSPMode = SPI_NSS_PULSE_DISABLE;
+  HAL_SPI_Init(&hspi);
+  __HAL_LINKDMA(&hspi, hdmarx, dmaRx);
+  __HAL_LINKDMA(&hspi, hdmatx, dmaTx);
+}
+
+void radioSpiReset() {
+  if (!dmaReady) {
+    return;  // radioSpiBegin() not called yet
+  }
+  noInterrupts();
+  if (running) {
+    HAL_SPI_Abort(&hspi);
+    digitalWrite(SX_CS, HIGH);
+    running = false;
+  }
+  head = active = tail;
+  interrupts();
+  __HAL_SPI_ENABLE(&hspi);  // left on for the core's SPI driver
+}
+
+bool radioSpiQueue(const uint8_t *hdr, uint8_t hdrLen, RadioSpiDone done, uint8_t *data, uint8_t dataLen,
+                   bool read) {
+  noInterrupts();
+  if ((uint8_t)(tail - head) >= RADIO_SPI_QUEUE_LEN) {
+    interrupts();
+    return false;
+  }
+  RadioSpiCmd &c = queue[tail & QUEUE_MASK];
+  memcpy(c.hdr, hdr, hdrLen);
+  c.hdrLen = hdrLen;
+  c.data = data;
+  c.dataLen = dataLen;
+  c.read = read;
+  c.done = done;
+  tail++;
+  startNext();
+  interrupts();
+  return true;
+}
+
+uint8_t radioSpiFree() {
+  return RADIO_SPI_QUEUE_LEN - (uint8_t)(tail - head);
+}
+
+bool radioSpiIdle() {
+  return active == tail;
+}
+
+bool radioSpiPending() {
+  return head != active;
+}
+
+void radioSpiPoll() {
+  while (head != active) {
+    RadioSpiCmd &c = queue[head & QUEUE_MASK];
+    if (c.done != nullptr) {
+      c.done(c);
+    }
+    head++;
+  }
+  noInterrupts();
+  startNext();  // in case a BUSY edge was missed
+  interrupts();
+}
+
+#endif
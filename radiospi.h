@@ -0,0 +1,90 @@
+/*
+Radio SPI transport
+
+Non-blocking SX1280 commands over SPI with DMA for the per-packet work of
+the radio layer, so a packet read or write overlaps with the CAN work in
+loop() instead of stalling it; RadioLib keeps init and profile changes
+
+Commands:
+- radioSpiQueue() appends one command: a header (opcode and parameters, or
+  NOPs that clock in the response) and an optional data phase written from
+  or read into the caller's buffer, so WriteBuffer / ReadBuffer go straight
+  from and into a pool packet. Interrupt safe
+- Each command is one NSS frame: the header and the data phase are DMA
+  transfers, and NSS is raised from the DMA completion interrupt
+- The next command starts from that interrupt, or from the BUSY falling
+  edge if the SX1280 is still busy, so a chain runs without loop()
+- radioSpiPoll() hands completed commands to their callback on the main
+  loop, in order; reply[] holds what was clocked in with the header
+  (status byte first)
+
+Sharing the bus:
+- RadioLib's blocking calls and the queue never overlap: radioSpiReset()
+  aborts the transfer in flight and drops the queue before RadioLib is
+  used, radioSpiBegin() takes the peripheral back after it
+
+RADIO_ENABLE_DMA_SPI=0 keeps every radio call on RadioLib
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#ifndef RADIO_ENABLE_DMA_SPI
+#define RADIO_ENABLE_DMA_SPI 1
+#endif
+
+#define RADIO_SPI_QUEUE_LEN 16  // power of two
+#define RADIO_SPI_HDR_MAX 9     // SetDioIrqParams
+
+// SX1280 opcodes and parameters (datasheet, section 11)
+#define SX1280_CMD_SET_STANDBY 0x80
+#define SX1280_CMD_SET_TX 0x83
+#define SX1280_CMD_SET_RX 0x82
+#define SX1280_CMD_SET_PACKET_PARAMS 0x8C
+#define SX1280_CMD_SET_BUFFER_BASE_ADDRESS 0x8F
+#define SX1280_CMD_SET_DIO_IRQ_PARAMS 0x8D
+#define SX1280_CMD_GET_IRQ_STATUS 0x15
+#define SX1280_CMD_CLEAR_IRQ_STATUS 0x97
+#define SX1280_CMD_GET_RX_BUFFER_STATUS 0x17
+#define SX1280_CMD_GET_PACKET_STATUS 0x1D
+#define SX1280_CMD_WRITE_BUFFER 0x1A
+#define SX1280_CMD_READ_BUFFER 0x1B
+
+#define SX1280_STANDBY_RC 0x00
+#define SX1280_PERIOD_BASE_1_MS 0x02
+#define SX1280_TIMEOUT_NONE 0x0000    // SetTx: single, no timeout
+#define SX1280_TIMEOUT_CONTINUOUS 0xFFFF  // SetRx: stays in RX after a packet
+
+#define SX1280_LORA_HEADER_EXPLICIT 0x00
+#define SX1280_LORA_CRC_ON 0x20
+#define SX1280_LORA_IQ_STANDARD 0x40
+#define SX1280_FLRC_SYNC_WORD_LEN_32 0x04
+#define SX1280_FLRC_SYNC_MATCH_1 0x10
+#define SX1280_FLRC_PACKET_VARIABLE 0x20
+#define SX1280_FLRC_CRC_2_BYTE 0x10
+#define SX1280_FLRC_WHITENING_OFF 0x08
+
+struct RadioSpiCmd;
+typedef void (*RadioSpiDone)(const RadioSpiCmd &cmd);
+
+struct RadioSpiCmd {
+  uint8_t hdr[RADIO_SPI_HDR_MAX];    // opcode and parameters
+  uint8_t reply[RADIO_SPI_HDR_MAX];  // clocked in with hdr
+  uint8_t hdrLen;
+  uint8_t dataLen;
+  uint8_t *data;       // data phase after hdr, written from or read into
+  bool read;
+  RadioSpiDone done;   // main loop, after NSS went high; may be nullptr
+  uint32_t doneUs;     // micros() when NSS went high
+};
+
+void radioSpiBegin();   // takes the SPI peripheral (again) after RadioLib
+void radioSpiReset();   // aborts and drops everything; callbacks are not run
+// false if the queue is full; the caller keeps data valid until done
+bool radioSpiQueue(const uint8_t *hdr, uint8_t hdrLen, RadioSpiDone done = nullptr,
+                   uint8_t *data = nullptr, uint8_t dataLen = 0, bool read = false);
+uint8_t radioSpiFree();  // commands that still fit the queue
+bool radioSpiIdle();     // nothing queued or in flight
+bool radioSpiPending();  // completed commands waiting for radioSpiPoll()
+void radioSpiPoll();     // run every loop iteration: completion callbacks
@@ -0,0 +1,88 @@
+#include <Arduino.h>
+#include "slottimer.h"
+#include "pin_config.h"
+
+static void (*slotCallback)();
+
+#if defined (HAL_TIM_MODULE_ONLY)
+
+// Registers directly: one-pulse mode stops the counter at the update event
+
+void slotTimerInit(void (*callback)()) {
+  slotCallback = callback;
+  SLOT_TIMER_CLK_ENABLE();
+  uint32_t clk = HAL_RCC_GetPCLK1Freq();
+  if ((RCC->CFGR & RCC_CFGR_PPRE) != 0) {
+    clk *= 2;  // timer clock runs at twice a divided APB clock
+  }
+  SLOT_TIMER->CR1 = TIM_CR1_OPM | TIM_CR1_URS;  // only an overflow raises the interrupt
+  SLOT_TIMER->PSC = clk / 1000000 - 1;
+  SLOT_TIMER->EGR = TIM_EGR_UG;  // load the prescaler
+  SLOT_TIMER->SR = 0;
+  SLOT_TIMER->DIER = TIM_DIER_UIE;
+  HAL_NVIC_SetPriority(SLOT_TIMER_IRQn, 1, 0);  // below FDCAN, whose FIFO is 3 deep
+  HAL_NVIC_EnableIRQ(SLOT_TIMER_IRQn);
+}
+
+bool slotTimerArm(uint32_t atUs) {
+  SLOT_TIMER->CR1 &= ~TIM_CR1_CEN;
+  int32_t delayUs = (int32_t)(atUs - micros());
+  if (delayUs <= 0 || delayUs > SLOT_TIMER_MAX_US) {
+    return false;
+  }
+  SLOT_TIMER->CNT = 0;
+  SLOT_TIMER->ARR = (uint32_t)delayUs - 1;
+  SLOT_TIMER->SR = 0;
+  SLOT_TIMER->CR1 |= TIM_CR1_CEN;
+  return true;
+}
+
+void slotTimerCancel() {
+  SLOT_TIMER->CR1 &= ~TIM_CR1_CEN;
+  SLOT_TIMER->SR = 0;
+}
+
+extern "C" void SLOT_TIMER_IRQHandler(void) {
+  SLOT_TIMER->SR = 0;
+  slotCallback();
+}
+
+#else
+
+static HardwareTimer *slotTimer;
+
+static void slotTimerIsr() {
+  slotTimer->pause();
+  slotCallback();
+}
+
+void slotTimerInit(void (*callback)()) {
+  slotCallback = callback;
+  if (slotTimer != nullptr) {
+    return;
+  }
+  slotTimer = new HardwareTimer(SLOT_TIMER);
+  slotTimer->pause();
+  slotTimer->setPrescaleFactor(slotTimer->getTimerClkFreq() / 1000000);
+  slotTimer->setPreloadEnable(false);  // a new overflow applies at once
+  slotTimer->refresh();  // loads the prescaler, before the interrupt is attached
+  slotTimer->attachInterrupt(slotTimerIsr);
+}
+
+bool slotTimerArm(uint32_t atUs) {
+  slotTimer->pause();
+  int32_t delayUs = (int32_t)(atUs - micros());
+  if (delayUs <= 0 || delayUs > SLOT_TIMER_MAX_US) {
+    return false;
+  }
+  slotTimer->setCount(0);
+  slotTimer->setOverflow((uint32_t)delayUs, TICK_FORMAT);
+  slotTimer->resume();
+  return true;
+}
+
+void slotTimerCancel() {
+  slotTimer->pause();
+}
+
+#endif
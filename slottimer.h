@@ -0,0 +1,20 @@
+/*
+Slot timer
+
+One-shot hardware timer (SLOT_TIMER, pin_config.h) that calls back at a
+micros() deadline, so TDMA slot edges do not wait for loop() to come
+around; 1 us ticks, deadlines up to SLOT_TIMER_MAX_US ahead
+
+STM32duino HardwareTimer where the core has it; on the C0 it is compiled
+out (hal_conf_extra.h), so the timer is driven through its registers
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#define SLOT_TIMER_MAX_US 65000  // 16-bit counter
+
+void slotTimerInit(void (*callback)());  // callback runs in interrupt context
+bool slotTimerArm(uint32_t atUs);  // false if atUs has passed or is too far ahead
+void slotTimerCancel();
@@ -0,0 +1,78 @@
+/*
+SPSC ring
+
+Lock-free single-producer/single-consumer ring for handing data from one
+interrupt handler to the main loop on a single core. The producer only
+writes head, the consumer only writes tail; signal fences keep the compiler
+from moving the element copy past the index update.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, uint16_t N>
+class SpscRing {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing length must be a power of two");
+
+public:
+  // Producer side; returns false if the ring is full
+  bool push(const T &item) {
+    uint16_t h = head;
+    if ((uint16_t)(h - tail) == N) {
+      return false;
+    }
+    buf[h & (N - 1)] = item;
+    std::atomic_signal_fence(std::memory_order_release);
+    head = h + 1;
+    return true;
+  }
+
+  // Producer side, in place: claim() a slot (nullptr if full), fill it, then
+  // publish() it
+  T *claim() {
+    return ((uint16_t)(head - tail) == N) ? nullptr : &buf[head & (N - 1)];
+  }
+
+  void publish() {
+    std::atomic_signal_fence(std::memory_order_release);
+    head = head + 1;
+  }
+
+  // Consumer side, in place: the oldest item (nullptr if empty) stays valid
+  // until drop()
+  const T *peek() const {
+    uint16_t t = tail;
+    if (t == head) {
+      return nullptr;
+    }
+    std::atomic_signal_fence(std::memory_order_acquire);
+    return &buf[t & (N - 1)];
+  }
+
+  void drop() {
+    std::atomic_signal_fence(std::memory_order_acq_rel);
+    tail = tail + 1;
+  }
+
+  // Consumer side; returns false if the ring is empty
+  bool pop(T &item) {
+    uint16_t t = tail;
+    if (t == head) {
+      return false;
+    }
+    item = buf[t & (N - 1)];
+    std::atomic_signal_fence(std::memory_order_acq_rel);
+    tail = t + 1;
+    return true;
+  }
+
+  uint16_t size() const { return (uint16_t)(head - tail); }
+  bool isEmpty() const { return head == tail; }
+
+private:
+  T buf[N];
+  volatile uint16_t head = 0;
+  volatile uint16_t tail = 0;
+};
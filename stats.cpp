@@ -0,0 +1,172 @@
+#include "stats.h"
+#include "can.h"
+#include "clocksync.h"
+#include "flightlog.h"
+
+#include <Arduino.h>
+#include <string.h>
+
+linkStats stats;
+
+static_assert(STATS_NUM_FRAMES <= 8, "stats frames must fit the node's 8 reserved IDs");
+
+static uint32_t statsCanId;    // first reserved ID of this node
+static bool statsViaRadio;     // follower: also queue for the uplink
+static uint32_t lastPublishMs;
+
+static void put16(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static uint8_t sat8(uint32_t v) {
+  return v > 0xFF ? 0xFF : (uint8_t)v;
+}
+
+static uint8_t toI8(float v) {
+  if (v < -127.0f) {
+    v = -127.0f;
+  } else if (v > 127.0f) {
+    v = 127.0f;
+  }
+  return (uint8_t)(int8_t)v;
+}
+
+static void resetPeriod() {
+  stats.syncResidualSum = 0;
+  stats.syncResidualMax = 0;
+  stats.syncSamples = 0;
+  stats.txLateSum = 0;
+  stats.txLateMax = 0;
+  stats.txLateSlots = 0;
+  stats.rssiMin = 0.0f;
+  stats.rssiSum = 0.0f;
+  stats.snrMin = 0.0f;
+  stats.snrSum = 0.0f;
+  stats.linkSamples = 0;
+}
+
+void statsInit(TdmaRole role) {
+  memset(&stats, 0, sizeof(stats));
+  resetPeriod();
+  statsCanId = STATS_CAN_ID_BASE + (role == TDMA_MASTER ? 0 : 8);
+  statsViaRadio = (role == TDMA_FOLLOWER);
+  lastPublishMs = millis();
+}
+
+void statsRadioRx(float rssi, float snr) {
+  if (stats.linkSamples == 0 || rssi < stats.rssiMin) {
+    stats.rssiMin = rssi;
+  }
+  if (stats.linkSamples == 0 || snr < stats.snrMin) {
+    stats.snrMin = snr;
+  }
+  stats.rssiSum += rssi;
+  stats.snrSum += snr;
+  stats.linkSamples++;
+}
+
+void statsSyncResidual(int32_t residualUs) {
+  uint32_t error = (uint32_t)(residualUs < 0 ? -residualUs : residualUs);
+  stats.syncResidualSum += error;
+  if (error > stats.syncResidualMax) {
+    stats.syncResidualMax = error;
+  }
+  stats.syncSamples++;
+}
+
+void statsHighWater(uint16_t &mark, uint16_t size) {
+  if (size > mark) {
+    mark = size;
+  }
+}
+
+static void publish(canRec &rec, uint8_t index) {
+  rec.id = statsCanId + index;
+  rec.dlc = 8;
+  rec.flags = 0;
+  rxBuf.push(rec);
+  if (statsViaRadio) {
+    flogAppend(rec);
+    txBuf.push(rec);
+  }
+}
+
+void statsUpdate() {
+  if (!STATS_ENABLE_PUBLISH || millis() - lastPublishMs < STATS_PERIOD_MS) {
+    return;
+  }
+  lastPublishMs += STATS_PERIOD_MS;
+
+  uint32_t txDrops = 0;
+  uint32_t rxDrops = 0;
+  for (uint8_t c = 0; c < CAN_PRIO_COUNT; c++) {
+    txDrops += txBuf.dropped(c);
+    rxDrops += rxBuf.dropped(c);
+  }
+
+  canRec rec;
+
+  memset(rec.data, 0, sizeof(rec.data));
+  put16(&rec.data[0], txDrops);
+  put16(&rec.data[2], rxDrops);
+  rec.data[4] = sat8(stats.txBufHigh);
+  rec.data[5] = sat8(stats.rxBufHigh);
+  put16(&rec.data[6], stats.canTxFifoFull);
+  publish(rec, 0);
+
+  put16(&rec.data[0], canRxFifoLost);
+  put16(&rec.data[2], canRxRingFull);
+  put16(&rec.data[4], stats.radioCrcErrors);
+  put16(&rec.data[6], stats.radioRxErrors);
+  publish(rec, 1);
+
+  uint32_t residualAvg = stats.syncSamples ? stats.syncResidualSum / stats.syncSamples : 0;
+  put16(&rec.data[0], stats.radioTxBlocked);
+  put16(&rec.data[2], stats.syncLosses);
+  put16(&rec.data[4], residualAvg > 0xFFFF ? 0xFFFF : residualAvg);
+  put16(&rec.data[6], stats.syncResidualMax > 0xFFFF ? 0xFFFF : stats.syncResidualMax);
+  publish(rec, 2);
+
+  put16(&rec.data[0], stats.slotPackets[DOWNLINK]);
+  put16(&rec.data[2], stats.slotPackets[UPLINK]);
+  put16(&rec.data[4], stats.slotBytes[DOWNLINK]);
+  put16(&rec.data[6], stats.slotBytes[UPLINK]);
+  publish(rec, 3);
+
+  memset(rec.data, 0, sizeof(rec.data));
+  if (stats.linkSamples > 0) {
+    rec.data[0] = toI8(stats.rssiMin);
+    rec.data[1] = toI8(stats.rssiSum / stats.linkSamples);
+    rec.data[2] = toI8(stats.snrMin * 4.0f);
+    rec.data[3] = toI8(stats.snrSum * 4.0f / stats.linkSamples);
+  } else {
+    rec.data[0] = rec.data[1] = rec.data[2] = rec.data[3] = 0x80;
+  }
+  put16(&rec.data[4], stats.arqRetransmits);
+  rec.data[6] = (uint8_t)stats.arqExpired;
+  rec.data[7] = (uint8_t)stats.arqDuplicates;
+  publish(rec, 4);
+
+  memset(rec.data, 0, sizeof(rec.data));
+  put16(&rec.data[0], stats.fecParitySent);
+  put16(&rec.data[2], stats.fecParityDropped);
+  put16(&rec.data[4], stats.fecRebuilt);
+  put16(&rec.data[6], (uint16_t)(int16_t)(clockSyncDrift() * 1e7f));
+  publish(rec, 5);
+
+  uint32_t lateAvg = stats.txLateSlots ? stats.txLateSum / stats.txLateSlots : 0;
+  put16(&rec.data[0], lateAvg > 0xFFFF ? 0xFFFF : lateAvg);
+  put16(&rec.data[2], stats.txLateMax > 0xFFFF ? 0xFFFF : stats.txLateMax);
+  put16(&rec.data[4], stats.slotTimerStarts);
+  put16(&rec.data[6], stats.slotPolledStarts);
+  publish(rec, 6);
+
+  put16(&rec.data[0], stats.txRequeued);
+  put16(&rec.data[2], stats.txRequeueDropped);
+  put16(&rec.data[4], stats.txAborted);
+  put16(&rec.data[6], stats.pktPoolEmpty);
+  publish(rec, 7);
+
+  resetPeriod();
+}
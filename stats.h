@@ -0,0 +1,110 @@
+/*
+Statistics layer
+
+Counters for everything the bridge drops or works around, published as
+reserved-ID CAN frames
+
+Publishing (every STATS_PERIOD_MS):
+- Local bus: pushed into rxBuf, sent by processCanTx()
+- Radio: the follower also queues them in txBuf, so the GCS bus carries
+  both ends' counters
+- IDs STATS_CAN_ID_BASE + 8 * role + frame, BULK priority class; every
+  follower uses the same IDs, the GCS stream tells them apart by node
+
+Frames (8 bytes, little endian, 16-bit counters wrap):
+- 0: txBuf drops, rxBuf drops, txBuf high-water, rxBuf high-water,
+     FDCAN TX FIFO full events
+- 1: FDCAN RX FIFO lost, RX ring full, radio CRC errors, radio RX errors
+- 2: radio TX blocked, sync losses, clock sync residual avg / max [us]
+     (follower, |measured - predicted offset|, see clocksync.h)
+- 3: DOWNLINK packets, UPLINK packets, DOWNLINK bytes, UPLINK bytes
+     (sent and received, counted by the slot they belong to)
+- 4: RSSI min / avg [dBm], SNR min / avg [0.25 dB] over the last period,
+     0x80 when nothing was received; ARQ retransmits, ARQ expired and ARQ
+     duplicates (16, 8 and 8 bits, wrapping)
+- 5: FEC parity packets sent, parity packets dropped, uplink packets
+     rebuilt from parity, clock drift estimate [0.1 ppm] (signed)
+- 6: slot edge to first preamble symbol avg / max [us], TX slots
+     started by the slot timer, TX slots started by polling
+- 7: records requeued after a failed TX, records dropped instead (a newer
+     sample of the ID was queued meanwhile), TX aborted, packet pool empty
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "tdma.h"
+
+#ifndef STATS_ENABLE_PUBLISH
+#define STATS_ENABLE_PUBLISH 1
+#endif
+
+#define STATS_PERIOD_MS 1000
+#define STATS_CAN_ID_BASE 0x7F0
+#define STATS_NUM_FRAMES 8
+
+struct linkStats {
+  uint16_t txBufHigh;
+  uint16_t rxBufHigh;
+  uint32_t canTxFifoFull;   // processCanTx() left records waiting
+
+  uint32_t radioCrcErrors;
+  uint32_t radioRxErrors;
+  uint32_t radioTxBlocked;
+
+  uint32_t slotPackets[2];  // indexed by SlotId DOWNLINK / UPLINK
+  uint32_t slotBytes[2];
+
+  uint32_t syncLosses;
+  uint32_t syncResidualSum; // |clock sync residual|, this period
+  uint32_t syncResidualMax;
+  uint16_t syncSamples;
+
+  float rssiMin;            // this period
+  float rssiSum;
+  float snrMin;
+  float snrSum;
+  uint16_t linkSamples;
+
+  uint32_t arqRetransmits;  // master: DOWNLINK records sent again
+  uint32_t arqExpired;      // master: records given up after ARQ_MAX_TRIES
+  uint32_t arqDuplicates;   // follower: records received again and dropped
+
+  uint32_t fecParitySent;   // follower
+  uint32_t fecParityDropped;  // follower: did not fit a fresh UPLINK
+  uint32_t fecRebuilt;      // master
+
+  uint32_t txLateSum;       // first packet of a TX slot, this period
+  uint32_t txLateMax;
+  uint16_t txLateSlots;
+  uint32_t slotTimerStarts;
+  uint32_t slotPolledStarts;
+
+  uint32_t txRequeued;      // records rolled back into txBuf
+  uint32_t txRequeueDropped;  // rolled back but superseded by a newer one
+  uint32_t txAborted;       // TX failed or timed out after it started
+  uint32_t pktPoolEmpty;    // pktAlloc() found no free packet
+
+  uint32_t canRxDecimated;  // bus frames dropped by the rate limits (canfilter.h), not published
+
+  // Flight log (flightlog.h), not published
+  uint32_t flogDropped;     // follower: records the RAM buffer had no room for
+  uint32_t flogErases;      // follower: pages erased
+  uint16_t flogErasedPages; // follower: pages erased ahead, the logging headroom left
+  uint16_t flogErasedMin;   // follower: lowest flogErasedPages since boot
+  uint32_t flogBackfill;    // follower: records sent again, master: new ones received
+  uint32_t flogRequests;    // master: ranges asked for, follower: requests received
+
+  // Master, per follower by node ID - 1 (tdma.h), not published
+  uint32_t nodePackets[TDMA_FOLLOWERS];  // uplink packets received
+  uint32_t nodeLost[TDMA_FOLLOWERS];     // uplink packets missed, from seq gaps
+  uint32_t nodeRecords[TDMA_FOLLOWERS];  // records delivered to rxBuf
+};
+
+extern linkStats stats;
+
+void statsInit(TdmaRole role);
+void statsUpdate();  // run every loop iteration: publishes when the period is over
+void statsRadioRx(float rssi, float snr);
+void statsSyncResidual(int32_t residualUs);
+void statsHighWater(uint16_t &mark, uint16_t size);
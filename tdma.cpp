@@ -1,8 +1,18 @@
 #include <stdint.h>
 #include "tdma.h"
 #include "can.h"
+#include "codec.h"
+#include "arq.h"
+#include "fec.h"
+#include "clocksync.h"
 #include "radio.h"
+#include "stats.h"
+#include "profile.h"
+#include "slottimer.h"
+#include "gcsstream.h"
+#include "flightlog.h"
 #include <Arduino.h>
+#include <stddef.h>
 
 #ifndef TDMA_ENABLE_DEBUG
 #define TDMA_ENABLE_DEBUG 0
@@ -10,32 +20,320 @@
 
 #define TDMA_LOGF(...) do { if (TDMA_ENABLE_DEBUG) Serial.printf(__VA_ARGS__); } while (0)
 
+// Largest DOWNLINK record on the wire
+#define TDMA_DOWNLINK_REC_LEN (REC_MAX_ENCODED_LEN + (TDMA_ENABLE_ARQ ? 1 : 0))
+
+// What a parity packet adds to the longest packet of its group
+#define TDMA_PARITY_HEADER_LEN (sizeof(tdmaUplinkHeader) + FEC_PARITY_OVERHEAD)
+
+#define TDMA_LOG_TAG_NONE -128  // record without a flight log number
+
 static struct tdmaState state;
-static void tdmaEnterSlot(SlotId next_slot);
+static RecMirror deltaMirror;  // follower: last sent per ID
+static uint8_t deltaSinceKey;  // follower: uplinks since the last keyframe
+
+// Master: what it knows of one follower, by node ID - 1
+struct tdmaPeer {
+  uint8_t uplinkSeq;     // last received
+  bool keyframeNeeded;   // ask it to restart its delta mirrors
+  uint8_t depth;         // backlog from its last uplink
+  uint8_t recBytes;      // average encoded record size seen
+  bool reported;         // uplink received this frame
+  uint8_t framesSinceUplink;
+  uint16_t linkHistory;  // frames it was heard in, bit 0 = this frame
+  adrLink link;          // its report
+  RecMirror deltaMirror; // last received per ID
+};
+
+static tdmaPeer peers[TDMA_FOLLOWERS];
+
+static void tdmaEnterSlot(uint8_t window);
 static void tdmaTransmit();
+static void tdmaStage();
+static void tdmaStartSlot();
+static void tdmaCancelStaged();
 
 struct SlotWindow {
   SlotId id;
+  uint8_t node;      // UPLINK: the follower it belongs to
   uint32_t startUs;
   uint32_t endUs;
 };
 
-static const SlotWindow kFrameSlots[] = {
-    {GUARD, 0, GUARD_TIME_US},
-    {DOWNLINK, GUARD_TIME_US, GUARD_TIME_US + DOWNLINK_TIME_US},
-    {GUARD, GUARD_TIME_US + DOWNLINK_TIME_US,
-     GUARD_TIME_US + DOWNLINK_TIME_US + GUARD_TIME_US},
-    {UPLINK, GUARD_TIME_US + DOWNLINK_TIME_US + GUARD_TIME_US, FRAME_LEN_US},
-};
+// Slot table of the current frame, rebuilt from the announced slot map
+static SlotWindow frameSlots[TDMA_WINDOWS];
+
+// uplinkUs: one per follower, in node order
+static void tdmaSetSlots(uint32_t downlinkUs, const uint32_t *uplinkUs) {
+  state.downlinkUs = downlinkUs;
+  frameSlots[0] = {GUARD, 0, 0, GUARD_TIME_US};
+  frameSlots[1] = {DOWNLINK, 0, GUARD_TIME_US, GUARD_TIME_US + downlinkUs};
+  uint32_t t = GUARD_TIME_US + downlinkUs;
+  for (uint8_t i = 0; i < TDMA_FOLLOWERS; i++) {
+    state.uplinkUs[i] = uplinkUs[i];
+    frameSlots[2 + 2 * i] = {GUARD, 0, t, t + GUARD_TIME_US};
+    t += GUARD_TIME_US;
+    frameSlots[3 + 2 * i] = {UPLINK, (uint8_t)(i + 1), t, t + uplinkUs[i]};
+    t += uplinkUs[i];
+  }
+}
+
+// Largest payload whose airtime fits in us
+static uint8_t tdmaPayloadFor(uint32_t us) {
+  size_t lo = 0;
+  size_t hi = FOLLOWER_PAYLOAD_LEN;
+  while (lo < hi) {
+    size_t mid = (lo + hi + 1) / 2;
+    if (radioTimeOnAir(mid) <= us) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return (uint8_t)lo;
+}
+
+static int64_t tdmaFrameElapsedUs() {
+  return (int64_t)micros() + (int64_t)state.clockOffsetUs - (int64_t)state.frameStartUs;
+}
+
+// Slot table index of this node's TX slot: DOWNLINK for the master, its own
+// UPLINK for a follower
+static uint8_t tdmaTxIndex() {
+  return (state.role == TDMA_MASTER) ? 1 : 1 + 2 * TDMA_NODE_ID;
+}
+
+static const SlotWindow &tdmaTxWindow() {
+  return frameSlots[tdmaTxIndex()];
+}
+
+// Airtime left in the TX slot, less TDMA_SLOT_MARGIN_US; counted from the
+// slot start for a packet staged ahead of it
+static uint32_t tdmaSlotRemainingUs() {
+  const SlotWindow &w = tdmaTxWindow();
+  int64_t elapsed = tdmaFrameElapsedUs();
+  if (elapsed < w.startUs) {
+    elapsed = w.startUs;
+  }
+  int64_t left = (int64_t)w.endUs - elapsed - TDMA_SLOT_MARGIN_US;
+  return left > 0 ? (uint32_t)left : 0;
+}
+
+// Start of the TX slot on the local clock
+static uint32_t tdmaTxEdgeUs() {
+  return state.frameStartUs + tdmaTxWindow().startUs - (uint32_t)state.clockOffsetUs;
+}
+
+// Slot length for airUs of packets, rounded up to the slot map unit
+static uint32_t tdmaSlotFor(uint32_t airUs) {
+  uint32_t us = airUs + TDMA_SLOT_MARGIN_US;
+  return (us + TDMA_SLOT_UNIT_US - 1) / TDMA_SLOT_UNIT_US * TDMA_SLOT_UNIT_US;
+}
+
+// Slot bounds of the active radio profile
+static void tdmaDeriveTiming() {
+  tdmaTiming &t = state.timing;
+  t.downlinkMinUs = tdmaSlotFor(radioTimeOnAir(MASTER_PAYLOAD_LEN));
+  t.uplinkMaxUs = tdmaSlotFor(radioTimeOnAir(FOLLOWER_PAYLOAD_LEN));
+  if (t.uplinkMaxUs < UPLINK_SHARE_US) {
+    t.uplinkMaxUs = UPLINK_SHARE_US;
+  }
+  // Every follower's UPLINK at its ceiling still leaves the DOWNLINK floor
+  uint32_t splitUs = (TDMA_SLOTS_US - t.downlinkMinUs) / TDMA_FOLLOWERS / TDMA_SLOT_UNIT_US * TDMA_SLOT_UNIT_US;
+  if (t.uplinkMaxUs > splitUs) {
+    t.uplinkMaxUs = splitUs;
+  }
+  t.uplinkMinUs = tdmaSlotFor(radioTimeOnAir(UPLINK_MIN_PAYLOAD_LEN));
+  if (t.uplinkMinUs > t.uplinkMaxUs) {
+    t.uplinkMinUs = t.uplinkMaxUs;
+  }
+  t.payloadLen = tdmaPayloadFor(t.uplinkMaxUs - TDMA_SLOT_MARGIN_US);
+  // A record too long for the sync packet (CAN FD) goes in a burst packet
+  t.downlinkLongUs = t.downlinkMinUs;
+  if (sizeof(tdmaHeader) + TDMA_DOWNLINK_REC_LEN > MASTER_PAYLOAD_LEN) {
+    t.downlinkLongUs = tdmaSlotFor(radioTimeOnAir(MASTER_PAYLOAD_LEN) + TDMA_BURST_GAP_US +
+                                   radioTimeOnAir(sizeof(tdmaHeader) + TDMA_DOWNLINK_REC_LEN));
+  }
+}
+
+static void tdmaDefaultSlots() {
+  uint32_t uplinkUs[TDMA_FOLLOWERS];
+  for (uint8_t i = 0; i < TDMA_FOLLOWERS; i++) {
+    uplinkUs[i] = state.timing.uplinkMinUs;
+    state.uplinkLen[i] = tdmaPayloadFor(state.timing.uplinkMinUs - TDMA_SLOT_MARGIN_US);
+  }
+  tdmaSetSlots(TDMA_SLOTS_US - TDMA_FOLLOWERS * state.timing.uplinkMinUs, uplinkUs);
+}
+
+static void tdmaResetLink() {
+  state.link = {ADR_NO_SAMPLE, ADR_NO_SAMPLE, 0};
+  state.linkHistory = 0xFFFF;
+  for (tdmaPeer &peer : peers) {
+    peer.link = {ADR_NO_SAMPLE, ADR_NO_SAMPLE, 0};
+    peer.linkHistory = 0xFFFF;
+  }
+  adrReset();
+}
+
+// Reconfigures the radio at a frame rollover; keeps the old profile if that fails
+static void tdmaApplyProfile(uint8_t profile) {
+  tdmaCancelStaged();  // sized for the old profile
+  state.switchPending = false;
+  if (profile != radioProfile() && !radioSetProfile(profile)) {
+    return;
+  }
+  state.profile = radioProfile();
+  state.framesSinceUplink = 0;
+  for (tdmaPeer &peer : peers) {
+    peer.framesSinceUplink = 0;
+  }
+  tdmaResetLink();  // measured with the old profile
+  tdmaDeriveTiming();
+  tdmaDefaultSlots();
+  startRx();
+}
+
+// Airtime of a burst carrying bytes of records after a headerLen header
+static uint32_t tdmaBurstUs(size_t bytes, size_t headerLen) {
+  const tdmaTiming &t = state.timing;
+  size_t perPacket = t.payloadLen - headerLen;
+  uint32_t airUs = 0;
+  while (bytes > perPacket && airUs < TDMA_SLOTS_US) {
+    airUs += radioTimeOnAir(t.payloadLen) + TDMA_BURST_GAP_US;
+    bytes -= perPacket;
+  }
+  return airUs + radioTimeOnAir(headerLen + bytes);
+}
+
+// Master: bit i set for follower i + 1 if it was heard within
+// TDMA_PROFILE_FALLBACK_FRAMES; all of them if none was
+static uint8_t tdmaLivePeers() {
+  uint8_t live = 0;
+  for (uint8_t i = 0; i < TDMA_FOLLOWERS; i++) {
+    if (peers[i].framesSinceUplink < TDMA_PROFILE_FALLBACK_FRAMES) {
+      live |= (uint8_t)(1u << i);
+    }
+  }
+  return live ? live : (uint8_t)((1u << TDMA_FOLLOWERS) - 1);
+}
+
+// Master: size each follower's UPLINK to its last reported backlog and
+// DOWNLINK to its own; DOWNLINK and each live follower's UPLINK get equal
+// parts of the time nobody needs, so a fast profile leaves the followers
+// room to send what arrives in their slots
+static void tdmaPlanSlots() {
+  const tdmaTiming &t = state.timing;
+  uint32_t uplinkUs[TDMA_FOLLOWERS];
+  uint32_t uplinkSumUs = 0;
+  for (uint8_t i = 0; i < TDMA_FOLLOWERS; i++) {
+    tdmaPeer &peer = peers[i];
+    uint8_t depth = peer.reported ? peer.depth : 0;
+    peer.reported = false;
+    uplinkUs[i] = tdmaSlotFor(tdmaBurstUs((size_t)depth * peer.recBytes, sizeof(tdmaUplinkHeader)));
+    if (uplinkUs[i] < t.uplinkMinUs) {
+      uplinkUs[i] = t.uplinkMinUs;
+    }
+    uplinkSumUs += uplinkUs[i];
+  }
+  size_t downRecs = txBuf.size() + (TDMA_ENABLE_ARQ ? arqTxDueCount() : 0);
+  uint32_t downlinkUs = tdmaSlotFor(tdmaBurstUs(downRecs * TDMA_DOWNLINK_REC_LEN, sizeof(tdmaHeader)));
+  uint32_t downlinkFloorUs = (downRecs > 0) ? t.downlinkLongUs : t.downlinkMinUs;
+  if (downlinkUs < downlinkFloorUs) {
+    downlinkUs = downlinkFloorUs;
+  }
+  uint8_t live = tdmaLivePeers();
+  uint8_t liveCount = 0;
+  for (uint8_t i = 0; i < TDMA_FOLLOWERS; i++) {
+    liveCount += (live >> i) & 1;
+  }
+  uint32_t spareUs = 0;
+  if (uplinkSumUs + downlinkUs < TDMA_SLOTS_US) {
+    spareUs = (TDMA_SLOTS_US - uplinkSumUs - downlinkUs) / (liveCount + 1) / TDMA_SLOT_UNIT_US * TDMA_SLOT_UNIT_US;
+  }
+  uplinkSumUs = 0;
+  for (uint8_t i = 0; i < TDMA_FOLLOWERS; i++) {
+    if (live & (1u << i)) {
+      uplinkUs[i] += spareUs;
+    }
+    if (uplinkUs[i] > t.uplinkMaxUs) {
+      uplinkUs[i] = t.uplinkMaxUs;
+    }
+    uplinkSumUs += uplinkUs[i];
+    state.uplinkLen[i] = tdmaPayloadFor(uplinkUs[i] - TDMA_SLOT_MARGIN_US);
+  }
+
+  tdmaSetSlots(TDMA_SLOTS_US - uplinkSumUs, uplinkUs);
+}
+
+// Folds a follower's report into the worst one so far; no sample is not worse
+static void tdmaWorstLink(adrLink &worst, const adrLink &link) {
+  if (link.rssi != ADR_NO_SAMPLE && (worst.rssi == ADR_NO_SAMPLE || link.rssi < worst.rssi)) {
+    worst.rssi = link.rssi;
+  }
+  if (link.snr != ADR_NO_SAMPLE && (worst.snr == ADR_NO_SAMPLE || link.snr < worst.snr)) {
+    worst.snr = link.snr;
+  }
+  if (link.loss > worst.loss) {
+    worst.loss = link.loss;
+  }
+}
+
+// Master: feed the frame that just ended to the rate policy; of the
+// followers heard lately the worst uplink loss and report count
+static void tdmaAdapt() {
+  adrLink up = state.link;
+  adrLink down = {ADR_NO_SAMPLE, ADR_NO_SAMPLE, 0};
+  bool reported = false;
+  uint8_t live = tdmaLivePeers();
+  up.loss = 0;
+  for (uint8_t i = 0; i < TDMA_FOLLOWERS; i++) {
+    if (live & (1u << i)) {
+      uint8_t loss = adrLossCount(peers[i].linkHistory);
+      up.loss = (loss > up.loss) ? loss : up.loss;
+      tdmaWorstLink(down, peers[i].link);
+    }
+    reported = reported || peers[i].reported;
+  }
+  if (state.adr && !state.switchPending) {
+    uint8_t next = adrUpdate(state.profile, reported, up, down);
+    if (next != state.profile) {
+      tdmaRequestProfile(next);
+    }
+  }
+}
 
 void tdmaInit(TdmaRole role) {
   state.role = role;
   state.currentSlot = GUARD;
+  state.currentWindow = 0;
   state.frameSeq = 0;
   state.clockOffsetUs = 0;
+  state.uplinkSeq = 0;
+  state.keyframeNeeded = (role == TDMA_FOLLOWER);
+  for (tdmaPeer &peer : peers) {
+    peer.uplinkSeq = 0;
+    peer.keyframeNeeded = false;
+    peer.depth = 0;
+    peer.recBytes = REC_MAX_ENCODED_LEN;
+    peer.reported = false;
+  }
+  state.adr = TDMA_ENABLE_ADR;
+  state.staged = false;
+  slotTimerInit(radioFireTx);
+  arqTxReset();
+  arqRxReset();
+  fecTxReset();
+  fecRxReset();
+  clockSyncReset();
+  tdmaApplyProfile(TDMA_FALLBACK_PROFILE);
+  tdmaDeriveTiming();  // even if the radio kept another profile
+  tdmaDefaultSlots();
 
-  Serial.printf("[TDMA] Initializing %s\n",
-                (role == TDMA_MASTER) ? "MASTER" : "FOLLOWER");
+  if (role == TDMA_MASTER) {
+    Serial.printf("[TDMA] Initializing MASTER, %u follower(s)\n", TDMA_FOLLOWERS);
+  } else {
+    Serial.printf("[TDMA] Initializing FOLLOWER %u of %u\n", TDMA_NODE_ID, TDMA_FOLLOWERS);
+  }
 
   if (role == TDMA_MASTER) {
     state.frameStartUs = micros();
@@ -45,11 +343,41 @@ void tdmaInit(TdmaRole role) {
     state.frameStartUs = 0;
     state.synced = false;
     state.lastSyncUs = micros();
+    txBuf.setCoalescing(true);  // telemetry: only the freshest sample per ID matters
     startRx();  // Follower starts listening immediately
   }
 }
 
+// Records (or a parity packet) waiting for the current TX slot
+static bool tdmaHasRecords() {
+  if (TDMA_ENABLE_ARQ && state.role == TDMA_MASTER) {
+    arqTxFill();
+    return arqTxDue(-1) >= 0;
+  }
+  return !txBuf.isEmpty() || (TDMA_ENABLE_FEC && fecTxReady()) ||
+         (state.role == TDMA_FOLLOWER && flogBackfillPending());
+}
+
+// Follower: uplink records carry their flight log numbers
+static bool tdmaLogTags() {
+  return FLOG_ENABLE && state.role == TDMA_FOLLOWER;
+}
+
+// Longest wire form of the record the next packet starts with; 0 if none
+static size_t tdmaNextRecLen() {
+  if (TDMA_ENABLE_ARQ && state.role == TDMA_MASTER) {
+    arqTxFill();
+    int8_t i = arqTxDue(-1);
+    return (i < 0) ? 0 : 1 + recEncodedLen(arqTxRec(i));
+  }
+  if (txBuf.isEmpty()) {
+    return 0;
+  }
+  return recEncodedLen(txBuf.first()) + 1 + (tdmaLogTags() ? 3 : 0);  // delta mask, log base and tag
+}
+
 void tdmaUpdate() {
+  PROFILE_SCOPE(PROF_TDMA_UPDATE);
   int64_t now = (int64_t)micros() + (int64_t)state.clockOffsetUs;
   int64_t elapsed = now - (int64_t)state.frameStartUs;
 
@@ -61,10 +389,15 @@ void tdmaUpdate() {
   if (state.role == TDMA_FOLLOWER && state.synced) {
     if (micros() - state.lastSyncUs >= FRAME_LEN_US * 10) {
       Serial.println("[TDMA] Lost sync");
+      stats.syncLosses++;
       state.synced = false;
       state.clockOffsetUs = 0;
       state.frameStartUs = micros();
-      startRx();
+      tdmaCancelStaged();
+      clockSyncReset();
+      arqRxReset();
+      fecTxReset();
+      tdmaApplyProfile(TDMA_FALLBACK_PROFILE);  // where the master falls back too
       return;
     }
   }
@@ -74,111 +407,389 @@ void tdmaUpdate() {
     state.frameStartUs += FRAME_LEN_US;
     state.frameSeq++;
     elapsed = now - (int64_t)state.frameStartUs;
-    tdmaEnterSlot(GUARD);
+    if (state.role == TDMA_MASTER) {
+      tdmaAdapt();
+    }
+    if (state.role == TDMA_FOLLOWER && state.synced) {
+      state.clockOffsetUs = clockSyncOffset(micros());  // follow the drift through missed frames
+    }
+    state.link = {ADR_NO_SAMPLE, ADR_NO_SAMPLE, 0};
+    state.linkHistory <<= 1;
+    for (tdmaPeer &peer : peers) {
+      peer.linkHistory <<= 1;
+      if (peer.framesSinceUplink < 255) {
+        peer.framesSinceUplink++;
+      }
+    }
+    if (state.switchPending && state.frameSeq == state.switchSeq) {
+      tdmaApplyProfile(state.nextProfile);
+    }
+    if (state.role == TDMA_MASTER) {
+      if (state.framesSinceUplink < 255) {
+        state.framesSinceUplink++;
+      }
+      if (state.framesSinceUplink >= TDMA_PROFILE_FALLBACK_FRAMES && state.profile != TDMA_FALLBACK_PROFILE) {
+        Serial.println("[TDMA] No uplink, falling back to the most robust profile");
+        tdmaApplyProfile(TDMA_FALLBACK_PROFILE);
+      }
+      if (TDMA_ENABLE_ARQ) {
+        arqTxNewFrame(tdmaLivePeers());
+      }
+      tdmaPlanSlots();
+    }
+    tdmaEnterSlot(0);  // GUARD
   }
 
   // Find current slot
-  SlotId slot = state.currentSlot;
-  for (const SlotWindow &frameSlot : kFrameSlots) {
-    if (elapsed >= frameSlot.startUs && elapsed < frameSlot.endUs) {
-      slot = frameSlot.id;
+  uint8_t window = state.currentWindow;
+  for (uint8_t i = 0; i < TDMA_WINDOWS; i++) {
+    if (elapsed >= frameSlots[i].startUs && elapsed < frameSlots[i].endUs) {
+      window = i;
       break;
     }
   }
 
-  if (slot != state.currentSlot) {
-    tdmaEnterSlot(slot);
+  if (window != state.currentWindow) {
+    tdmaEnterSlot(window);
+  } else if (state.burstPending && (int32_t)(micros() - state.burstDueUs) >= 0 && tdmaHasRecords()) {
+    // Records that arrive later in the slot still go out in it
+    state.burstPending = false;
+    tdmaTransmit();
   }
 }
 
-static void tdmaBuildHeader(struct tdmaHeader &header, uint8_t num_records) {
-  header.slot_id = state.currentSlot;
+// len: the whole packet, for the TX start estimate
+static void tdmaBuildHeader(struct tdmaHeader &header, uint8_t num_records, size_t len) {
+  header.format = TDMA_ENABLE_ARQ ? TDMA_FORMAT_ARQ : TDMA_FORMAT_COMPACT;
+  header.slot_id = tdmaTxWindow().id;  // also when staged ahead of it
   header.frame_seq = state.frameSeq;
   header.epoch_us = state.frameStartUs;
+  header.tx_us = micros() + radioTxDelayUs(len);
+  header.num_records = num_records;
+  header.flags = 0;
+  for (uint8_t i = 0; i < TDMA_FOLLOWERS; i++) {
+    if (peers[i].keyframeNeeded) {
+      header.flags |= (uint8_t)(TDMA_FLAG_KEYFRAME << i);
+      peers[i].keyframeNeeded = false;
+    }
+    header.uplink_units[i] = (uint8_t)(state.uplinkUs[i] / TDMA_SLOT_UNIT_US);
+    header.uplink_len[i] = state.uplinkLen[i];
+  }
+  header.downlink_units = (uint8_t)(state.downlinkUs / TDMA_SLOT_UNIT_US);
+  header.profile = state.profile;
+  header.next_profile = state.nextProfile;
+  header.switch_in = state.switchPending ? (uint8_t)(state.switchSeq - state.frameSeq) : 0;
+  header.arq_base = arqTxBase();
+}
+
+// pending: txBuf depth to report
+static void tdmaBuildUplinkHeader(struct tdmaUplinkHeader &header, uint8_t format, uint8_t num_records,
+                                  uint16_t pending) {
+  header.format = format;
+  header.node = TDMA_NODE_ID;
+  header.seq = state.uplinkSeq;
+  header.queue_depth = (pending > 255) ? 255 : (uint8_t)pending;
   header.num_records = num_records;
+  header.rssi = state.link.rssi;
+  header.snr = state.link.snr;
+  header.loss = adrLossCount(state.linkHistory);
+  header.ack_base = arqRxAckBase();
+  header.ack_mask = arqRxAckMask();
 }
 
-static void tdmaEnterSlot(SlotId next_slot) {
-  state.currentSlot = next_slot;
+static void tdmaEnterSlot(uint8_t window) {
+  const SlotWindow &next = frameSlots[window];
+  state.currentSlot = next.id;
+  state.currentWindow = window;
+  state.slotTxCount = 0;
+  state.burstPending = false;
 
-  switch (next_slot) {
+  switch (next.id) {
   case GUARD:
-    // Do nothing - radio is already in correct mode
+    // Radio is already in correct mode
     // Master: in RX from previous UPLINK
-    // Follower: stays in RX
+    // Follower: stays in RX, also through the other followers' UPLINKs
+    // Either: stage the packet for the TX slot that follows
+    if (TDMA_ENABLE_SLOT_TIMER && state.synced && !state.staged) {
+      int64_t elapsed = tdmaFrameElapsedUs();
+      const SlotWindow &w = tdmaTxWindow();
+      if (elapsed < w.startUs && elapsed + GUARD_TIME_US >= w.startUs) {
+        tdmaStage();
+      }
+    }
     break;
 
   case DOWNLINK:
     if (state.role == TDMA_MASTER) {
-      tdmaTransmit();  // startTransmit() handles mode switch
+      tdmaStartSlot();  // startTransmit() handles mode switch
     } else {
       startRx();  // Follower listens for master
     }
     break;
 
   case UPLINK:
-    if (state.role == TDMA_FOLLOWER) {
-      if (state.synced && !txBuf.isEmpty()) {
-        tdmaTransmit();
-      }
-      // else stay in RX (already there)
+    if (state.role == TDMA_FOLLOWER && state.synced && next.node == TDMA_NODE_ID) {
+      tdmaStartSlot();  // even if empty: the master needs the backlog report and a sign of life
     }
-    // Master is already in RX from TX_DONE, do nothing
+    // Master is already in RX from TX_DONE, do nothing; another
+    // follower's UPLINK is not ours
     break;
   }
 }
 
-static bool processHeader(const uint8_t *buf, uint32_t rx_time){
+// stamped: rx_time is this packet's own RX_DONE edge. Without it the packet
+// is used but not the time. A packet too short for the header or for the
+// records it announces (at least one byte each, plus the ARQ sequence) is
+// dropped before it touches the clock
+static bool processHeader(const uint8_t *buf, size_t len, uint32_t rx_time, bool stamped){
   tdmaHeader h;
-  
+  if (len < sizeof(h)) {
+    return false;
+  }
   memcpy(&h, buf, sizeof(tdmaHeader));
 
-  if (h.slot_id != DOWNLINK && h.slot_id != UPLINK && h.slot_id != GUARD) {
-    TDMA_LOGF("[TDMA] Invalid slot ID\n");
+  if (h.format != TDMA_FORMAT_COMPACT && h.format != TDMA_FORMAT_ARQ) {
+    TDMA_LOGF("[TDMA] Unknown payload format %u\n", h.format);
+    return false;
+  }
+  size_t minRecLen = (h.format == TDMA_FORMAT_ARQ) ? 2 : 1;
+  if (len - sizeof(h) < h.num_records * minRecLen) {
+    TDMA_LOGF("[TDMA] Truncated downlink: %u records in %u bytes\n", h.num_records, (unsigned)len);
+    return false;
+  }
+
+  if (h.slot_id != DOWNLINK) {
+    TDMA_LOGF("[TDMA] Not from the master: %u\n", h.slot_id);  // another follower's uplink
     return false;
   }
 
   TDMA_LOGF("[TDMA] RX header: slot=%d frame=%d epoch=%lu records=%d\n",
-              h.slot_id, h.frame_seq, h.epoch_us, h.num_records);
+              h.slot_id, h.frame_seq, (unsigned long)h.epoch_us, h.num_records);
+
 
+  if (h.profile != state.profile) {
+    TDMA_LOGF("[TDMA] Profile mismatch %u\n", h.profile);
+    return false;
+  }
+
+  const tdmaTiming &t = state.timing;
+  uint32_t downlinkUs = (uint32_t)h.downlink_units * TDMA_SLOT_UNIT_US;
+  uint32_t uplinkUs[TDMA_FOLLOWERS];
+  uint32_t totalUs = downlinkUs;
+  bool valid = downlinkUs >= t.downlinkMinUs;
+  for (uint8_t i = 0; i < TDMA_FOLLOWERS; i++) {
+    uplinkUs[i] = (uint32_t)h.uplink_units[i] * TDMA_SLOT_UNIT_US;
+    valid = valid && uplinkUs[i] >= t.uplinkMinUs && uplinkUs[i] <= t.uplinkMaxUs;
+    totalUs += uplinkUs[i];
+  }
+  if (!valid || totalUs != TDMA_SLOTS_US) {
+    TDMA_LOGF("[TDMA] Invalid slot map %lu/%lu\n", (unsigned long)downlinkUs,
+              (unsigned long)(totalUs - downlinkUs));
+    return false;
+  }
 
   if (h.slot_id == DOWNLINK) {
-    uint32_t rx_est = rx_time;
-    uint32_t downlink_mid = GUARD_TIME_US + (DOWNLINK_TIME_US / 2);
-    if (rx_est > downlink_mid) {
-      rx_est -= downlink_mid;
+    tdmaSetSlots(downlinkUs, uplinkUs);
+    memcpy(state.uplinkLen, h.uplink_len, sizeof(state.uplinkLen));
+    if (h.flags & (TDMA_FLAG_KEYFRAME << (TDMA_NODE_ID - 1))) {
+      state.keyframeNeeded = true;
+    }
+    if (h.format == TDMA_FORMAT_ARQ) {
+      // The master counts frames from 0 again after a restart
+      if (state.synced && h.frame_seq != state.frameSeq) {
+        arqRxReset();
+      }
+      arqRxBase(h.arq_base);
+    }
+    if (h.switch_in > 0 && h.next_profile < RADIO_PROFILE_COUNT) {
+      state.nextProfile = h.next_profile;
+      state.switchSeq = h.frame_seq + h.switch_in;
+      state.switchPending = true;
+    }
+
+    if (stamped) {
+      // rx_time is the packet start on the local clock, tx_us on the master's
+      int32_t residual = clockSyncSample(rx_time, (int32_t)(h.tx_us - rx_time));
+      if (state.synced) {
+        statsSyncResidual(residual);
+      }
+      state.clockOffsetUs = clockSyncOffset(micros());
+      state.synced = true;
+      state.lastSyncUs = rx_time;
     }
-    state.clockOffsetUs = (int32_t)(h.epoch_us - rx_est);
     state.frameSeq = h.frame_seq;
     state.frameStartUs = h.epoch_us;
-    state.synced = true;
-    state.lastSyncUs = rx_time;
   }
 
   return true;
 }
 
-void tdmaProcessRx(const uint8_t *buf, size_t len, uint32_t rx_time) {
+// Records of one packet into rxBuf (DOWNLINK ARQ records through the window);
+// peer: the follower that sent an uplink, nullptr for a DOWNLINK
+static void tdmaExtractRecords(tdmaPeer *peer, const uint8_t *buf, size_t len, size_t offset, uint8_t format,
+                               uint8_t num_records) {
+  bool tagged = format & TDMA_FORMAT_LOG_TAGS;
+  format &= ~TDMA_FORMAT_LOG_TAGS;
+  uint16_t logBase = 0;
+  if (tagged) {
+    if (offset + 2 > len) {
+      return;
+    }
+    logBase = buf[offset] | (buf[offset + 1] << 8);
+    offset += 2;
+  }
+  for (uint8_t i = 0; i < num_records; i++) {
+    canRec rec;
+    int8_t tag = TDMA_LOG_TAG_NONE;
+    if (tagged) {
+      if (offset >= len) {
+        break;
+      }
+      tag = (int8_t)buf[offset++];
+    }
+    if (format == TDMA_FORMAT_ARQ) {
+      size_t used = (offset < len) ? recDecode(&buf[offset + 1], len - offset - 1, rec) : 0;
+      if (used == 0) {
+        TDMA_LOGF("[TDMA] Malformed record %u/%u\n", i, num_records);
+        break;
+      }
+      arqRxRecord(buf[offset], rec);  // in order, once
+      offset += 1 + used;
+      continue;
+    }
+    bool missingRef = false;
+    size_t used = (format == TDMA_FORMAT_COMPACT || peer == nullptr)
+                    ? recDecode(&buf[offset], len - offset, rec)
+                    : recDecodeDelta(&buf[offset], len - offset, peer->deltaMirror, rec, missingRef);
+    if (used == 0) {
+      TDMA_LOGF("[TDMA] Malformed record %u/%u\n", i, num_records);
+      break;
+    }
+    offset += used;
+    if (missingRef) {
+      peer->keyframeNeeded = true;  // cannot rebuild this one until the next keyframe
+      continue;
+    }
+    if (format != TDMA_FORMAT_COMPACT && peer != nullptr) {
+      peer->deltaMirror.store(rec);
+    }
+    if (tag != TDMA_LOG_TAG_NONE && peer != nullptr) {
+      flogReceived(rec, (uint16_t)(logBase + tag), (uint8_t)(peer - peers + 1));
+    }
+    if (peer != nullptr) {
+      stats.nodeRecords[peer - peers]++;
+    }
+    rxBuf.push(rec);
+    if (state.role == TDMA_MASTER) {
+      gcsStreamRecord(rec);  // the rocket's Serial stays text
+    }
+    TDMA_LOGF("  RX CAN id=0x%lx dlc=%u\n", (unsigned long)rec.id, rec.dlc);
+  }
+}
+
+// Master: a lost uplink packet rebuilt from parity only yields compact
+// records; its header is stale and delta records need the mirror it missed
+static void tdmaProcessParity(uint8_t node, const uint8_t *parity, size_t len) {
+  uint8_t rebuilt[FOLLOWER_PAYLOAD_LEN];
+  size_t n = fecRxParity(node, parity, len, rebuilt);
+  tdmaUplinkHeader h;
+  if (n < sizeof(h)) {
+    return;
+  }
+  memcpy(&h, rebuilt, sizeof(h));
+  TDMA_LOGF("[TDMA] Rebuilt uplink node=%u seq=%u format=%u records=%u\n", node, h.seq, h.format, h.num_records);
+  if ((h.format & ~TDMA_FORMAT_LOG_TAGS) == TDMA_FORMAT_COMPACT) {
+    tdmaExtractRecords(&peers[node - 1], rebuilt, n, sizeof(h), h.format, h.num_records);
+  } else if (h.format == TDMA_FORMAT_BACKFILL) {
+    flogReceiveBackfill(node, &rebuilt[sizeof(h)], n - sizeof(h), h.num_records);
+  }
+}
+
+void tdmaProcessRx(const uint8_t *buf, size_t len, uint32_t rx_time, bool stamped, float rssi, float snr) {
+  PROFILE_SCOPE(PROF_TDMA_RX);
   size_t offset = 0;
+  uint8_t num_records = 0;
+  uint8_t format = TDMA_FORMAT_COMPACT;
+  uint8_t node = 0;  // sender
+  tdmaPeer *peer = nullptr;
 
   if (state.role == TDMA_FOLLOWER) {
-    if (len < sizeof(tdmaHeader)) {
+    if (!processHeader(buf, len, rx_time, stamped)) {
       return;
-    } 
-    if (!processHeader(buf, rx_time)) {
+    }
+    tdmaHeader h;
+    memcpy(&h, buf, sizeof(h));
+    format = h.format;
+    num_records = h.num_records;
+    offset = sizeof(h);
+  } else {
+    tdmaUplinkHeader h;
+    if (len < sizeof(h)) {
       return;
     }
-    offset = sizeof(tdmaHeader);
+    memcpy(&h, buf, sizeof(h));
+    uint8_t base = h.format & ~TDMA_FORMAT_LOG_TAGS;
+    if (base != TDMA_FORMAT_COMPACT && base != TDMA_FORMAT_DELTA && base != TDMA_FORMAT_DELTA_KEY &&
+        base != TDMA_FORMAT_PARITY && base != TDMA_FORMAT_BACKFILL) {
+      TDMA_LOGF("[TDMA] Unknown payload format %u\n", h.format);
+      return;
+    }
+    if (h.node < 1 || h.node > TDMA_FOLLOWERS) {
+      TDMA_LOGF("[TDMA] Unknown node %u\n", h.node);
+      return;
+    }
+    node = h.node;
+    peer = &peers[node - 1];
+    gcsStreamPacket(node, rx_time, rssi, snr);
+
+    if (base != TDMA_FORMAT_PARITY) {
+      // A missed uplink leaves the delta history behind the follower's
+      uint8_t lost = (uint8_t)(h.seq - peer->uplinkSeq - 1);
+      peer->uplinkSeq = h.seq;
+      stats.nodeLost[node - 1] += lost;
+      if (base == TDMA_FORMAT_DELTA_KEY) {
+        peer->deltaMirror.clear();
+      } else if (base == TDMA_FORMAT_DELTA && lost > 0) {
+        TDMA_LOGF("[TDMA] Uplink gap at node %u seq %u, requesting keyframe\n", node, h.seq);
+        peer->deltaMirror.clear();
+        peer->keyframeNeeded = true;
+      }
+      fecRxAdd(node, h.seq, buf, len);
+    }
+
+    format = h.format;
+    num_records = h.num_records;
+    offset = sizeof(h);
+
+    peer->depth = h.queue_depth;
+    peer->reported = true;
+    peer->link = {h.rssi, h.snr, h.loss};
+    if (TDMA_ENABLE_ARQ) {
+      arqTxAck(node, h.ack_base, h.ack_mask);
+    }
+    peer->framesSinceUplink = 0;
+    peer->linkHistory |= 1;
+    state.framesSinceUplink = 0;
+    if (num_records > 0 && base != TDMA_FORMAT_BACKFILL) {
+      peer->recBytes = (uint8_t)((len - offset + num_records - 1) / num_records);
+    }
+    stats.nodePackets[node - 1]++;
   }
 
-  // Extract CAN records
-  while (offset + sizeof(canRec) <= len) {
-    canRec rec;
-    memcpy(&rec, &buf[offset], sizeof(rec));
-    offset += sizeof(rec);
-    rxBuf.push(rec);
-    TDMA_LOGF("  RX CAN id=0x%lx dlc=%u\n", rec.id, rec.dlc);
+  SlotId slot = (state.role == TDMA_FOLLOWER) ? DOWNLINK : UPLINK;
+  stats.slotPackets[slot]++;
+  stats.slotBytes[slot] += len;
+  adrWorst(state.link, rssi, snr);
+  state.linkHistory |= 1;
+
+  if (format == TDMA_FORMAT_PARITY) {
+    tdmaProcessParity(node, &buf[offset], len - offset);
+  } else if (format == TDMA_FORMAT_BACKFILL) {
+    flogReceiveBackfill(node, &buf[offset], len - offset, num_records);
+  } else {
+    tdmaExtractRecords(peer, buf, len, offset, format, num_records);
   }
+  statsHighWater(stats.rxBufHigh, rxBuf.size());
   
   // Serial.printf("[SX1280] RX len=%d\n", len);
   // Serial.printf("[SX1280] RX HEX: ");
@@ -188,42 +799,378 @@ void tdmaProcessRx(const uint8_t *buf, size_t len, uint32_t rx_time) {
   // Serial.println();
 }
 
-static void tdmaTransmit() {
+// Next packet of the TX slot, once this one is off the air
+static void tdmaScheduleBurst() {
+  if (state.currentWindow == tdmaTxIndex()) {
+    state.burstPending = true;
+    state.burstDueUs = micros() + TDMA_BURST_GAP_US;
+  }
+}
+
+// The records taken for a packet that never went out go back to the front
+// of txBuf; the delta and FEC state they were built into starts over
+static void tdmaRollback() {
+  uint16_t taken = txBuf.takenSize();
+  uint16_t requeued = txBuf.rollback();
+  stats.txRequeued += requeued;
+  stats.txRequeueDropped += taken - requeued;
+  if (state.role == TDMA_FOLLOWER) {
+    state.keyframeNeeded = TDMA_ENABLE_DELTA;
+    if (TDMA_ENABLE_FEC) {
+      fecTxReset();
+    }
+  }
+}
+
+void tdmaTxDone(bool sent) {
+  if (!sent) {
+    stats.txAborted++;
+    tdmaRollback();
+    return;
+  }
+  txBuf.commit();
+  tdmaScheduleBurst();
+}
+
+static void tdmaCountPacket(size_t len) {
+  SlotId slot = (state.role == TDMA_MASTER) ? DOWNLINK : UPLINK;
+  stats.slotPackets[slot]++;
+  stats.slotBytes[slot] += len;
+  state.slotTxCount++;
+}
+
+// TX start after the slot edge
+static void tdmaTxLateness(int32_t lateUs) {
+  if (lateUs < 0) {
+    lateUs = 0;
+  }
+  stats.txLateSum += lateUs;
+  if ((uint32_t)lateUs > stats.txLateMax) {
+    stats.txLateMax = lateUs;
+  }
+  stats.txLateSlots++;
+}
+
+// Builds one packet sized to the airtime left in the TX slot; 0 if there is
+// nothing to send
+static size_t tdmaBuildPacket(uint8_t *payload) {
   size_t offset = 0;
   uint8_t num_records = 0;
 
-  // Select payload limit and max records based on role
-  const size_t max_payload = (state.role == TDMA_MASTER) ? MASTER_PAYLOAD_LEN : FOLLOWER_PAYLOAD_LEN;
-  const uint8_t max_records = (state.role == TDMA_MASTER) ? MASTER_MAX_CAN_RECORDS : FOLLOWER_MAX_CAN_RECORDS;
+  // The master's sync packet is short; everything else is limited by the
+  // profile's packet size, the budget the master announced for this frame and the
+  // airtime left in the slot
+  bool syncPacket = (state.role == TDMA_MASTER && state.slotTxCount == 0);
+  size_t max_payload = syncPacket ? MASTER_PAYLOAD_LEN : state.timing.payloadLen;
+  const uint8_t max_records = syncPacket ? MASTER_MAX_CAN_RECORDS : FOLLOWER_MAX_CAN_RECORDS;
+  if (state.role == TDMA_FOLLOWER && state.uplinkLen[TDMA_NODE_ID - 1] < max_payload) {
+    max_payload = state.uplinkLen[TDMA_NODE_ID - 1];
+  }
+  size_t fit = tdmaPayloadFor(tdmaSlotRemainingUs());
+  if (!syncPacket && fit < max_payload) {
+    max_payload = fit;
+  }
+  if (max_payload < sizeof(tdmaUplinkHeader)) {
+    return 0;
+  }
 
-  uint8_t payload[max_payload];
+  // Follower with FEC: a waiting parity packet goes before any data; one that
+  // does not even fit a fresh slot is given up
+  if (TDMA_ENABLE_FEC && state.role == TDMA_FOLLOWER) {
+    if (fecTxReady()) {
+      size_t len = sizeof(tdmaUplinkHeader) + fecTxParityLen();
+      if (len <= max_payload) {
+        tdmaUplinkHeader header;
+        tdmaBuildUplinkHeader(header, TDMA_FORMAT_PARITY, 0, txBuf.size());
+        memcpy(&payload[0], &header, sizeof(header));
+        fecTxParity(&payload[sizeof(header)]);
+        TDMA_LOGF("[TDMA] TX UPLINK parity: group=%u\n", payload[sizeof(header)]);
+        return len;
+      }
+      if (state.slotTxCount > 0) {
+        return 0;
+      }
+      fecTxDrop();
+    }
+    if (max_payload > state.timing.payloadLen - TDMA_PARITY_HEADER_LEN) {
+      max_payload = state.timing.payloadLen - TDMA_PARITY_HEADER_LEN;
+    }
+  }
 
-  // Master builds header first
-  if (state.role == TDMA_MASTER) {
-    offset = sizeof(tdmaHeader);
+  // Follower: UPLINK room that live records leave carries flight log backfill
+  if (state.role == TDMA_FOLLOWER && txBuf.isEmpty() && flogBackfillPending()) {
+    uint8_t num;
+    size_t len = flogBackfill(&payload[sizeof(tdmaUplinkHeader)], max_payload - sizeof(tdmaUplinkHeader), num);
+    if (len > 0) {
+      tdmaUplinkHeader header;
+      state.uplinkSeq++;
+      tdmaBuildUplinkHeader(header, TDMA_FORMAT_BACKFILL, num, 0);
+      memcpy(&payload[0], &header, sizeof(header));
+      len += sizeof(header);
+      TDMA_LOGF("[TDMA] TX UPLINK backfill: seq=%u records=%u\n", header.seq, num);
+      if (TDMA_ENABLE_FEC) {
+        fecTxAdd(header.seq, payload, len);
+      }
+      return len;
+    }
+  }
+
+  uint16_t pending = txBuf.size();
+
+  // Leave room for the role's header
+  offset = (state.role == TDMA_MASTER) ? sizeof(tdmaHeader) : sizeof(tdmaUplinkHeader);
+
+  // Later burst packets only go out if they carry at least one record; checked
+  // before the delta state below is touched
+  if (state.slotTxCount > 0) {
+    size_t next = tdmaNextRecLen();
+    if (next == 0 || max_payload < offset + next) {
+      return 0;
+    }
   }
 
-  // Pack CAN records up to role-specific limit
-  while (!txBuf.isEmpty() && num_records < max_records && (offset + sizeof(canRec)) <= max_payload) {
-    canRec rec = txBuf.shift();
-    memcpy(&payload[offset], &rec, sizeof(rec));
-    offset += sizeof(rec);
+  uint8_t format = TDMA_FORMAT_COMPACT;
+  if (TDMA_ENABLE_DELTA && state.role == TDMA_FOLLOWER) {
+    format = TDMA_FORMAT_DELTA;
+    if (state.keyframeNeeded || deltaSinceKey >= TDMA_DELTA_KEYFRAME_INTERVAL - 1) {
+      format = TDMA_FORMAT_DELTA_KEY;
+      deltaMirror.clear();
+      deltaSinceKey = 0;
+      state.keyframeNeeded = false;
+    } else {
+      deltaSinceKey++;
+    }
+  }
+
+  // Master with ARQ: due window entries, oldest first, each behind its seq
+  if (TDMA_ENABLE_ARQ && state.role == TDMA_MASTER) {
+    arqTxFill();
+    for (int8_t i = arqTxDue(-1); i >= 0 && num_records < max_records; i = arqTxDue(i)) {
+      size_t used = (offset + 1 < max_payload)
+                      ? recEncode(arqTxRec(i), &payload[offset + 1], max_payload - offset - 1)
+                      : 0;
+      if (used == 0) {
+        break;
+      }
+      payload[offset] = arqTxSeq(i);
+      arqTxSent(i);
+      offset += 1 + used;
+      num_records++;
+    }
+  }
+
+  // Log numbers relative to the first record's
+  bool tagged = tdmaLogTags() && !txBuf.isEmpty();
+  uint16_t logBase = 0;
+  if (tagged) {
+    logBase = txBuf.first().logSeq;
+    payload[offset++] = (uint8_t)logBase;
+    payload[offset++] = (uint8_t)(logBase >> 8);
+  }
+
+  // Pack CAN records up to role-specific limit; a record that does not fit stays queued
+  while (!(TDMA_ENABLE_ARQ && state.role == TDMA_MASTER) && !txBuf.isEmpty() && num_records < max_records) {
+    const canRec &rec = txBuf.first();
+    size_t tagLen = tagged ? 1 : 0;
+    int16_t tag = TDMA_LOG_TAG_NONE;
+    if (tagged && (rec.flags & CAN_REC_LOGGED)) {
+      tag = (int16_t)(rec.logSeq - logBase);
+      if (tag <= TDMA_LOG_TAG_NONE || tag > 127) {
+        break;
+      }
+    }
+    if (offset + tagLen >= max_payload) {
+      break;
+    }
+    size_t used = (format == TDMA_FORMAT_COMPACT)
+                    ? recEncode(rec, &payload[offset + tagLen], max_payload - offset - tagLen)
+                    : recEncodeDelta(rec, deltaMirror.find(rec.id), &payload[offset + tagLen],
+                                     max_payload - offset - tagLen);
+    if (used == 0) {
+      break;
+    }
+    if (tagged) {
+      payload[offset] = (uint8_t)(int8_t)tag;
+    }
+    txBuf.take();
+    if (format != TDMA_FORMAT_COMPACT) {
+      deltaMirror.store(rec);
+    }
+    offset += tagLen + used;
     num_records++;
   }
+  if (tagged) {
+    format |= TDMA_FORMAT_LOG_TAGS;
+  }
 
-  // Write header for master
+  // Write header
   if (state.role == TDMA_MASTER) {
     tdmaHeader header;
-    tdmaBuildHeader(header, num_records);
+    tdmaBuildHeader(header, num_records, offset);
     memcpy(&payload[0], &header, sizeof(header));
     TDMA_LOGF("[TDMA] TX DOWNLINK: frame=%u records=%u\n", header.frame_seq, num_records);
   } else {
-    TDMA_LOGF("[TDMA] TX UPLINK: records=%u\n", num_records);
+    tdmaUplinkHeader header;
+    state.uplinkSeq++;
+    tdmaBuildUplinkHeader(header, format, num_records, pending);
+    memcpy(&payload[0], &header, sizeof(header));
+    TDMA_LOGF("[TDMA] TX UPLINK: seq=%u format=%u records=%u\n", header.seq, format, num_records);
+    if (TDMA_ENABLE_FEC) {
+      fecTxAdd(header.seq, payload, offset);
+    }
   }
 
-  radioTransmit(payload, offset);
+  return offset;
+}
+
+static_assert(FOLLOWER_PAYLOAD_LEN <= PKT_MAX_LEN, "payload buffer");
+
+// Builds straight into a pool packet; nullptr if there is nothing to send
+// or no packet free
+static radioPacket *tdmaBuildPooled() {
+  radioPacket *pkt = pktAlloc();
+  if (pkt == nullptr) {
+    return nullptr;
+  }
+  pkt->len = (uint8_t)tdmaBuildPacket(pkt->data);
+  if (pkt->len == 0) {
+    pktFree(pkt);
+    return nullptr;
+  }
+  return pkt;
+}
+
+// Sends one packet now
+static void tdmaTransmit() {
+  PROFILE_SCOPE(PROF_TDMA_TX);
+  radioPacket *pkt = tdmaBuildPooled();
+  if (pkt == nullptr) {
+    return;
+  }
+  uint8_t len = pkt->len;
+  if (radioTransmit(pkt)) {
+    tdmaCountPacket(len);
+  } else {
+    pktFree(pkt);
+    tdmaRollback();
+  }
+}
+
+// Builds the first packet of the TX slot during the GUARD before it and
+// writes it into the radio; the slot timer only starts it at the slot edge
+static void tdmaStage() {
+  PROFILE_SCOPE(PROF_TDMA_TX);
+  radioPacket *pkt = tdmaBuildPooled();
+  if (pkt == nullptr) {
+    return;
+  }
+  state.edgeUs = tdmaTxEdgeUs();
+  state.staged = true;
+  state.stagedLen = pkt->len;
+  radioStageTx(pkt, (state.role == TDMA_MASTER) ? (int16_t)offsetof(tdmaHeader, tx_us) : -1,
+               state.edgeUs);
+  slotTimerArm(state.edgeUs);  // if the edge is too close, the slot entry sends it
+}
+
+static void tdmaCancelStaged() {
+  if (state.staged) {
+    slotTimerCancel();
+    bool sent = radioStagedSent();  // then the TX it started settles it
+    radioCancelStaged();
+    state.staged = false;
+    if (!sent) {
+      tdmaRollback();
+    }
+  }
+}
+
+// Entry into the TX slot: the staged packet has gone out from the timer
+// interrupt, or goes out now; without one the packet is built here
+static void tdmaStartSlot() {
+  if (state.staged) {
+    state.staged = false;
+    bool timer = radioStagedSent();
+    if (!timer) {
+      slotTimerCancel();
+      radioFireTx();
+    }
+    if (timer || radioStagedSent()) {
+      radioCancelStaged();
+      tdmaCountPacket(state.stagedLen);
+      tdmaTxLateness((int32_t)(radioTxStartUs() - state.edgeUs));
+      if (timer) {
+        stats.slotTimerStarts++;
+      } else {
+        stats.slotPolledStarts++;
+      }
+      if (!radioTxBusy()) {
+        tdmaScheduleBurst();  // TX_DONE was handled before the slot was entered
+      }
+      return;
+    }
+    radioCancelStaged();  // the radio refused it; try a fresh packet
+    tdmaRollback();
+  }
+  tdmaTransmit();
+  if (state.slotTxCount > 0) {
+    tdmaTxLateness((int32_t)(radioTxStartUs() - tdmaTxEdgeUs()));
+    stats.slotPolledStarts++;
+  }
+}
+
+bool tdmaRequestProfile(uint8_t profile) {
+  if (state.role != TDMA_MASTER || profile >= RADIO_PROFILE_COUNT) {
+    return false;
+  }
+  if (profile == state.profile) {
+    state.switchPending = false;
+    return true;
+  }
+  state.nextProfile = profile;
+  state.switchSeq = state.frameSeq + TDMA_PROFILE_SWITCH_FRAMES;
+  state.switchPending = true;
+  Serial.printf("[TDMA] Switching to %s at frame %u\n", kRadioProfiles[profile].name, state.switchSeq);
+  return true;
+}
+
+bool tdmaHandleCommand(uint32_t id, const uint8_t *data, uint8_t dlc) {
+  if (state.role != TDMA_MASTER || id != TDMA_CMD_CAN_ID) {
+    return false;
+  }
+  if (dlc >= 2 && data[0] == TDMA_CMD_SET_PROFILE) {
+    state.adr = false;
+    tdmaRequestProfile(data[1]);
+  } else if (dlc >= 2 && data[0] == TDMA_CMD_SET_ADR) {
+    state.adr = data[1] != 0;
+    adrReset();
+  } else if (dlc >= 4 && data[0] == TDMA_CMD_BACKFILL) {
+    flogForwardRequest(data, dlc);
+  }
+  return true;
 }
 
 bool tdmaIsSynced() {
   return state.synced;
 }
+
+int32_t tdmaClockOffsetUs() {
+  return state.clockOffsetUs;
+}
+
+// From inside its UPLINK, where the slot's first packet is already on the
+// air, to the next DOWNLINK, less the slot margin; the UPLINKs of the other
+// followers need nothing from this one. A stall holds interrupts, so a TX
+// whose SPI commands are still running waits out the whole stall
+uint32_t tdmaQuietUs() {
+  if (state.role != TDMA_FOLLOWER) {
+    return 0;
+  }
+  if (!state.synced) {
+    return UINT32_MAX;  // no slot to keep
+  }
+  if (state.currentWindow != tdmaTxIndex() || state.staged || !radioSpiSettled()) {
+    return 0;
+  }
+  int64_t left = (int64_t)FRAME_LEN_US + GUARD_TIME_US - tdmaFrameElapsedUs() - TDMA_SLOT_MARGIN_US;
+  return left > 0 ? (uint32_t)left : 0;
+}
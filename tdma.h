@@ -1,45 +1,256 @@
 /*
 TDMA Protocol Layer
 
-Allows duplex communication between rocket and gcs
+Allows duplex communication between rocket and gcs; one master shares the
+channel with TDMA_FOLLOWERS followers (vehicles, payload or recovery nodes)
 
 Frame structure [100 ms]:
-  [GUARD][DOWNLINK][GUARD][UPLINK]
-  - GUARD - 10 ms
-  - DOWNLINK - 60 ms (master TX, follower RX)
-  - UPLINK - 20 ms (follower TX, master RX)
+  [GUARD][DOWNLINK][GUARD][UPLINK 1]...[GUARD][UPLINK N]
+  - GUARD - 1 ms, covers the sync error (clocksync.h)
+  - DOWNLINK - master TX, every follower RX
+  - UPLINK n - follower n TX, master RX; the other followers stay in RX
+  DOWNLINK + all UPLINKs = TDMA_SLOTS_US, split per frame (see below)
+
+Nodes:
+- The master is node 0, followers are TDMA_NODE_ID 1..TDMA_FOLLOWERS, set
+  per build like ROLE; every node is built with the same TDMA_FOLLOWERS
+- Byte 1 of every packet names its sender: tdmaHeader.slot_id is DOWNLINK
+  (0) from the master, tdmaUplinkHeader.node the follower's ID; a follower
+  drops what another follower sent
+- The master keeps one state per follower (uplink seq, backlog, link
+  report, delta mirror, FEC groups, flight log tracker) and demultiplexes
+  each uplink by its node; records of every follower go to the GCS bus, and
+  to the GCS stream with their node (gcsstream.h)
+- DOWNLINK records go to every follower; an ARQ record is done once every
+  follower heard in the last TDMA_PROFILE_FALLBACK_FRAMES frames has
+  acknowledged it (arq.h)
+
+Slot allocation:
+- Each follower sends an uplink every frame while synced (header only if
+  txBuf is empty) and reports its txBuf depth in it
+- Each frame the master sizes every follower's UPLINK to its backlog and
+  DOWNLINK to its own txBuf, within the bounds of the radio profile's
+  tdmaTiming; the time nobody needs is split evenly between DOWNLINK and
+  the UPLINK of each follower heard lately (half of it to the UPLINK with
+  one follower). The slot map (DOWNLINK, then each UPLINK and byte budget
+  in node order) is announced in tdmaHeader
+- All nodes follow the runtime slot table and each follower transmits in
+  its own UPLINK only; a follower keeps the last map it heard, which is
+  safe since the sum is constant
+- An UPLINK is capped at one full packet or UPLINK_SHARE_US, and at an
+  equal split of what DOWNLINK leaves, so the uplink share of the frame
+  grows with the number of followers
+
+Radio profiles:
+- tdmaTiming is derived from the profile's time-on-air when it is applied:
+  DOWNLINK floor (one MASTER_PAYLOAD_LEN packet; while records wait, plus
+  a burst packet with the longest record if the first cannot carry it, as
+  with CAN FD), UPLINK floor (one UPLINK_MIN_PAYLOAD_LEN packet, also the
+  default), UPLINK ceiling (one full packet or UPLINK_SHARE_US, whichever
+  is longer) and the largest follower packet
+- The master announces a switch in tdmaHeader TDMA_PROFILE_SWITCH_FRAMES
+  ahead; both ends apply it at that frame's rollover
+- Requested with a TDMA_CMD_SET_PROFILE frame on TDMA_CMD_CAN_ID on the GCS
+  bus, which the master consumes instead of bridging
+- Fallback: a follower returns to TDMA_FALLBACK_PROFILE when it loses
+  sync, the master after TDMA_PROFILE_FALLBACK_FRAMES frames without an
+  uplink from any follower; both also start there
+
+Adaptive data rate (TDMA_ENABLE_ADR):
+- Each end keeps the worst RSSI/SNR of the packets it received in the frame
+  and a one-bit-per-frame history of frames it heard the peer in
+- The follower reports its side in every tdmaUplinkHeader; the master feeds
+  both to adr.h at each rollover and announces the profile it picks
+- With several followers the worst loss and report of those heard lately
+  count, so the weakest link sets the profile
+- Starts and falls back to the most robust profile (RADIO_PROFILE_LORA_SF8)
+- A TDMA_CMD_SET_PROFILE command pauses it, TDMA_CMD_SET_ADR resumes it
+
+Bursts:
+- A slot may carry several packets: on TX_DONE the owner of the slot
+  schedules another one TDMA_BURST_GAP_US later (time for the receiver to
+  read the last packet and re-arm RX), sent as soon as txBuf has records
+  while a packet fits the airtime left before the slot end (less
+  TDMA_SLOT_MARGIN_US), so records arriving during the slot still go out
+- Each packet is sized to that remaining airtime; the master's first
+  DOWNLINK packet stays at MASTER_PAYLOAD_LEN so the follower hears the slot
+  map early
+
+Clock sync:
+- Every DOWNLINK packet carries the master's frame start (epoch_us) and its
+  own TX start (tx_us); the follower filters the offsets they give in
+  clocksync.h and tracks the crystal drift, so slot edges stay predicted
+  through missed frames
 
 - Master (GCS) transmits during DOWNLINK, receives during UPLINK
 - Follower (Rocket) receives during DOWNLINK, transmits during UPLINK
 - Follower syncs clock using header information from master
 
 Packet format:
-  [tdmaHeader 8 bytes][canRec 13 bytes][canRec]...
+  DOWNLINK: [tdmaHeader 19 + 2 * TDMA_FOLLOWERS bytes][record][record]...
+  UPLINK:   [tdmaUplinkHeader 13 bytes][record][record]...
+            (with log tags: [header][base][tag][record][tag][record]...)
+  Records use the compact variable-length encoding in codec.h (29-bit IDs
+  and CAN FD frames in its long form)
+
+Downlink ARQ (TDMA_ENABLE_ARQ):
+- DOWNLINK records are [seq][record] (TDMA_FORMAT_ARQ) and resent every
+  frame until the follower acknowledges them; see arq.h
+- tdmaHeader.arq_base and tdmaUplinkHeader.ack_base / ack_mask carry the
+  window state; a sync packet whose frame_seq is not the follower's own
+  means the master restarted, which resets the receive window
+
+Delta uplink (TDMA_ENABLE_DELTA):
+- Records carry only the bytes that changed since the last uplink of the ID
+- TDMA_FORMAT_DELTA_KEY packets restart both mirrors and carry full records;
+  sent every TDMA_DELTA_KEYFRAME_INTERVAL uplinks and when the master sets
+  the follower's TDMA_FLAG_KEYFRAME bit after a sequence gap or an
+  unresolvable record
+
+Slot timer (TDMA_ENABLE_SLOT_TIMER):
+- On entering the GUARD before its TX slot a node builds the slot's first
+  packet and stages it: written into the SX1280 buffer during the GUARD
+  (radio.h); slottimer.h fires at the slot edge and the interrupt only
+  issues SetTx, so neither packing nor the SPI write delays the preamble
+  and TX start no longer depends on when loop() polls tdmaUpdate()
+- The master's tx_us is stamped for the edge; a late start stamps it again
+- tdmaUpdate() still enters the slot by polling: it accounts the staged
+  packet, sends it itself if the timer has not (edge too close to arm, or
+  missed), and runs the burst as before
+- Slot edge to the first preamble symbol (radioTxStartUs()) goes to stats
+  (frame 6)
+
+TX packets (pktpool.h):
+- Packets are built straight into a pool packet and handed to the radio,
+  staged or not; no copy between packing and the SPI write
+- Records are taken from txBuf, not shifted: tdmaTxDone(true) commits them
+  on TX_DONE; a TX that fails, times out, or a staged packet that is
+  cancelled rolls them back to the front of txBuf (stats frame 7). A
+  rolled-back uplink restarts the delta mirror and the FEC group
+
+Flight log (FLOG_ENABLE, flightlog.h):
+- Uplink records carry their log number: TDMA_FORMAT_LOG_TAGS on the
+  format, [u16 base] after the header and [int8 number - base] before each
+  record (-128: none); a record too far from the base waits for the next
+  packet
+- A follower with txBuf empty sends requested log ranges instead
+  (TDMA_FORMAT_BACKFILL), in the first packet of UPLINK or a burst; they
+  count in the uplink seq and FEC groups like any data packet
+- tdmaQuietUs() tells the log when a flash stall cannot delay a slot edge
+  or a received packet
+
+Uplink FEC (TDMA_ENABLE_FEC):
+- The follower adds one TDMA_FORMAT_PARITY packet per FEC_K uplink packets
+  in its UPLINK slot; the master rebuilds a lost packet from it; see fec.h
+- Data packets are kept one parity header (uplink header plus
+  FEC_PARITY_OVERHEAD) short of the profile's packet size, so the parity
+  over them still fits one
 */
 
 #pragma once
 
 #include <stdint.h>
 #include <stddef.h>
+#include "adr.h"
 
 // Frame timing
 #define FRAME_LEN_US (100 * 1000) // 100 ms
-#define DOWNLINK_TIME_US (60 * 1000) // 60 ms
-#define UPLINK_TIME_US (20 * 1000) // 20 ms
-#define GUARD_TIME_US (10 * 1000) // 10 ms
+#ifndef GUARD_TIME_US
+#define GUARD_TIME_US 1000 // 1 ms
+#endif
+
+// Nodes on the channel
+#ifndef TDMA_FOLLOWERS
+#define TDMA_FOLLOWERS 1  // UPLINK sub-slots; the same on every node
+#endif
+#ifndef TDMA_NODE_ID
+#define TDMA_NODE_ID 1  // follower: 1..TDMA_FOLLOWERS, the master is node 0
+#endif
+#define TDMA_MAX_FOLLOWERS 4  // keyframe flag bits, room left in the sync packet
+
+static_assert(TDMA_FOLLOWERS >= 1 && TDMA_FOLLOWERS <= TDMA_MAX_FOLLOWERS, "TDMA_FOLLOWERS");
+static_assert(TDMA_NODE_ID >= 1 && TDMA_NODE_ID <= TDMA_FOLLOWERS, "TDMA_NODE_ID");
+
+// Slot allocation; bounds per radio profile are in tdmaTiming
+#define TDMA_SLOT_UNIT_US 500  // slot map resolution in tdmaHeader
+#define TDMA_SLOT_MARGIN_US 1000  // slack between packet end and slot end
+#ifndef TDMA_BURST_GAP_US
+#define TDMA_BURST_GAP_US 1000  // TX_DONE to the next packet of a burst
+#endif
+#define TDMA_SLOTS_US (FRAME_LEN_US - (1 + TDMA_FOLLOWERS) * GUARD_TIME_US)  // DOWNLINK + UPLINKs
+#define TDMA_WINDOWS (2 + 2 * TDMA_FOLLOWERS)  // slot table entries, guards included
+#define UPLINK_MIN_PAYLOAD_LEN 128  // bytes the smallest UPLINK carries in one packet
+// An UPLINK may grow to this even if one packet is shorter; whole units, as announced
+#define UPLINK_SHARE_US (TDMA_SLOTS_US / (TDMA_FOLLOWERS + 1) / TDMA_SLOT_UNIT_US * TDMA_SLOT_UNIT_US)
+
+static_assert(TDMA_SLOTS_US / TDMA_SLOT_UNIT_US <= 255, "slot map units");
+static_assert(TDMA_SLOTS_US % TDMA_SLOT_UNIT_US == 0, "slot map units");
+
+// Radio profile switching
+#define TDMA_PROFILE_SWITCH_FRAMES 4     // announced this many frames ahead
+#define TDMA_PROFILE_FALLBACK_FRAMES 10  // master: frames without uplink before TDMA_FALLBACK_PROFILE;
+                                         // also how long a silent follower counts as present
+
+#ifndef TDMA_ENABLE_ADR
+#define TDMA_ENABLE_ADR 1  // master picks the profile from link quality (adr.h)
+#endif
+
+#if TDMA_ENABLE_ADR
+#define TDMA_FALLBACK_PROFILE RADIO_PROFILE_LORA_SF8  // most robust
+#else
+#define TDMA_FALLBACK_PROFILE RADIO_PROFILE_DEFAULT
+#endif
+
+// Link commands on the GCS bus, consumed by the master: [command][argument]
+#define TDMA_CMD_CAN_ID 0x7E0
+#define TDMA_CMD_SET_PROFILE 0x01  // argument: RadioProfileId, pauses ADR
+#define TDMA_CMD_SET_ADR 0x02      // argument: 0 off, 1 on
+#define TDMA_CMD_BACKFILL 0x03     // arguments: first log number (16 bits), count, node (all if left out); forwarded
+
+// Payload format
+#define TDMA_FORMAT_COMPACT 2    // records encoded with codec.h
+#define TDMA_FORMAT_DELTA 3      // uplink only: delta records
+#define TDMA_FORMAT_DELTA_KEY 4  // uplink only: delta records, mirrors restarted
+#define TDMA_FORMAT_ARQ 5        // downlink only: [seq][record]
+#define TDMA_FORMAT_PARITY 6     // uplink only: fec.h parity, no records
+#define TDMA_FORMAT_BACKFILL 7   // uplink only: flightlog.h entries, no live records
+#define TDMA_FORMAT_LOG_TAGS 0x80  // uplink flag: records carry their flight log number
+
+#ifndef TDMA_ENABLE_ARQ
+#define TDMA_ENABLE_ARQ 1  // master resends DOWNLINK records until acknowledged
+#endif
+
+#ifndef TDMA_ENABLE_DELTA
+#define TDMA_ENABLE_DELTA 0  // follower sends delta records; the master always accepts them
+#endif
+#define TDMA_DELTA_KEYFRAME_INTERVAL 10  // uplink packets
+
+#ifndef TDMA_ENABLE_SLOT_TIMER
+#define TDMA_ENABLE_SLOT_TIMER 1  // first packet of a TX slot started by slottimer.h
+#endif
+
+#ifndef TDMA_ENABLE_FEC
+#define TDMA_ENABLE_FEC 0  // follower sends parity packets; the master always uses them
+#endif
+
+// Downlink header flags
+#define TDMA_FLAG_KEYFRAME 0x01  // << (node - 1): that follower restarts delta mirrors on its next uplink
 
 // Payload limits
-#define CAN_REC_SIZE 13  // sizeof(canRec): 4 + 1 + 8
-#define TDMA_HEADER_SIZE 8  // sizeof(tdmaHeader): 1 + 2 + 4 + 1
+#define TDMA_HEADER_SIZE (19 + 2 * TDMA_FOLLOWERS)  // sizeof(tdmaHeader): 1 + 1 + 2 + 4 + 4 + 1 + 1 + 1 + 2N + 3 + 1
+#define TDMA_UPLINK_HEADER_SIZE 13  // sizeof(tdmaUplinkHeader): 5 + 3 + 1 + 4
 
-#define MASTER_MAX_CAN_RECORDS 2
-#define FOLLOWER_MAX_CAN_RECORDS 16
+#define MASTER_MAX_CAN_RECORDS 4
+#define FOLLOWER_MAX_CAN_RECORDS 64
 
-// Master (GCS): header + 2 CAN records for commands
-#define MASTER_PAYLOAD_LEN (TDMA_HEADER_SIZE + (MASTER_MAX_CAN_RECORDS * CAN_REC_SIZE))  // 34 bytes
+// Master (GCS): header + commands, same airtime as 2 fixed 13-byte records;
+// later packets of a DOWNLINK burst use the follower limits
+#define MASTER_PAYLOAD_LEN 38  // bytes
 
-// Follower (Rocket): 16 CAN records for telemetry (no header)
-#define FOLLOWER_PAYLOAD_LEN (FOLLOWER_MAX_CAN_RECORDS * CAN_REC_SIZE)  // 208 bytes
+// Follower (Rocket): uplink header + telemetry records, upper bound of the
+// per-profile limit (tdmaTiming) and of the per-frame budget announced by
+// the master
+#define FOLLOWER_PAYLOAD_LEN 250  // bytes, MAX_PAYLOAD_LENGTH
 
 enum TdmaRole: uint8_t {
   TDMA_MASTER,
@@ -52,9 +263,19 @@ enum SlotId: uint8_t {
   GUARD
 };
 
+// Slot bounds of a radio profile, derived from its time-on-air
+struct tdmaTiming {
+  uint32_t downlinkMinUs;
+  uint32_t downlinkLongUs;  // DOWNLINK floor while records wait (>= downlinkMinUs)
+  uint32_t uplinkMinUs;  // also the UPLINK of the default slot map
+  uint32_t uplinkMaxUs;
+  uint8_t payloadLen;    // largest follower packet, fits uplinkMaxUs
+};
+
 struct tdmaState {
   TdmaRole role;
   SlotId currentSlot;
+  uint8_t currentWindow; // index into the slot table
 
   uint16_t frameSeq;     // current frame sequence
   uint32_t frameStartUs; // start time of frame in microseconds
@@ -62,17 +283,73 @@ struct tdmaState {
   
   uint32_t lastSyncUs;
   bool synced;           // follower only transmits when true
+
+  uint8_t uplinkSeq;     // follower: last sent (the master keeps one per follower)
+  bool keyframeNeeded;   // follower: restart delta mirrors
+
+  uint32_t downlinkUs;   // slot map of the current frame
+  uint32_t uplinkUs[TDMA_FOLLOWERS];  // by node ID - 1
+  uint8_t uplinkLen[TDMA_FOLLOWERS];  // follower payload budgets in bytes
+  uint8_t slotTxCount;   // packets sent in the current slot
+  bool burstPending;     // next packet of the burst due at burstDueUs
+  uint32_t burstDueUs;
+  bool staged;           // first packet of the next TX slot is in the radio
+  uint8_t stagedLen;
+  uint32_t edgeUs;       // local micros() of that slot's start
+
+  uint8_t profile;       // RadioProfileId in use
+  tdmaTiming timing;     // of profile
+  bool switchPending;    // apply nextProfile at the rollover into switchSeq
+  uint8_t nextProfile;
+  uint16_t switchSeq;
+  uint8_t framesSinceUplink;  // master: from any follower
+
+  adrLink link;          // packets from the peers this frame
+  uint16_t linkHistory;  // follower: frames the master was heard in, bit 0 = this frame
+  bool adr;              // master: adaptive data rate running
 };
 
 struct tdmaHeader {
+  uint8_t format;     // TDMA_FORMAT_*
   SlotId slot_id;
   uint16_t frame_seq; 
-  uint32_t epoch_us;  // micros() captured at tx start
+  uint32_t epoch_us;  // start of this frame, master micros()
+  uint32_t tx_us;     // master micros() at TX start of this packet
   uint8_t num_records; // # of CAN records in payload
+  uint8_t flags;      // TDMA_FLAG_*
+  uint8_t downlink_units; // slot map of this frame, TDMA_SLOT_UNIT_US
+  uint8_t uplink_units[TDMA_FOLLOWERS];  // by node ID - 1, in slot order
+  uint8_t uplink_len[TDMA_FOLLOWERS];    // follower payload budgets in bytes
+  uint8_t profile;        // RadioProfileId of this frame
+  uint8_t next_profile;   // valid if switch_in > 0
+  uint8_t switch_in;      // frames until next_profile applies, 0 = none pending
+  uint8_t arq_base;       // oldest DOWNLINK record not yet acknowledged or expired
+} __attribute__((packed));
+
+struct tdmaUplinkHeader {
+  uint8_t format;     // TDMA_FORMAT_*
+  uint8_t node;       // TDMA_NODE_ID of the sender
+  uint8_t seq;        // per uplink packet and node, gaps invalidate delta history
+  uint8_t queue_depth; // txBuf records pending before packing, saturated
+  uint8_t num_records;
+  int8_t rssi;         // worst DOWNLINK packet this frame [dBm], ADR_NO_SAMPLE if none
+  int8_t snr;          // [0.25 dB]
+  uint8_t loss;        // frames without DOWNLINK of the last ADR_WINDOW_FRAMES
+  uint8_t ack_base;    // oldest DOWNLINK record not yet received
+  uint32_t ack_mask;   // bit i: record ack_base + i received
 } __attribute__((packed));
 
+static_assert(sizeof(tdmaHeader) == TDMA_HEADER_SIZE, "tdmaHeader size");
+static_assert(sizeof(tdmaUplinkHeader) == TDMA_UPLINK_HEADER_SIZE, "tdmaUplinkHeader size");
+static_assert(offsetof(tdmaHeader, slot_id) == offsetof(tdmaUplinkHeader, node), "sender in byte 1");
+
 void tdmaInit(TdmaRole role);
 void tdmaUpdate(); // run every loop iteration: check micros(), advance slots, control radio actions
-void tdmaProcessRx(const uint8_t *buf, size_t len, uint32_t rx_time_us); // process received message: decode header, update clockOffset (follower), push CAN payloads
+void tdmaProcessRx(const uint8_t *buf, size_t len, uint32_t rx_time_us, bool stamped, float rssi, float snr); // process received message: decode header, update clockOffset (follower, stamped only), push CAN payloads
+void tdmaTxDone(bool sent); // radio TX over: commit its records and schedule the next packet of a burst, or requeue them
+bool tdmaRequestProfile(uint8_t profile); // master: announce a switch, false if invalid
+bool tdmaHandleCommand(uint32_t id, const uint8_t *data, uint8_t dlc); // true if the frame was a link command for this node
 
 bool tdmaIsSynced(); 
+int32_t tdmaClockOffsetUs(); // follower: estimate of master micros() - local micros()
+uint32_t tdmaQuietUs(); // follower: time before anything needs the CPU on time, 0 outside its UPLINK